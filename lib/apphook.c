@@ -28,6 +28,7 @@
 #include "dnscache.h"
 #include "alarms.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-dynamic-cache.h"
 #include "tags.h"
 #include "logmsg.h"
 #include "timeutils.h"
@@ -126,8 +127,10 @@ app_startup(void)
   child_manager_init();
   alarm_init();
   stats_init();
+  stats_dynamic_cache_thread_init();
   tzset();
   log_msg_global_init();
+  scratch_buffers_global_init();
   log_tags_global_init();
   log_source_global_init();
   log_template_global_init();
@@ -160,7 +163,9 @@ app_shutdown(void)
   log_template_global_deinit();
   log_tags_global_deinit();
   log_msg_global_deinit();
+  scratch_buffers_global_deinit();
 
+  stats_dynamic_cache_thread_deinit();
   stats_destroy();
   child_manager_deinit();
   g_list_foreach(application_hooks, (GFunc) g_free, NULL);
@@ -189,12 +194,14 @@ app_thread_start(void)
 {
   scratch_buffers_init();
   dns_cache_thread_init();
+  stats_dynamic_cache_thread_init();
   main_loop_call_thread_init();
 }
 
 void
 app_thread_stop(void)
 {
+  stats_dynamic_cache_thread_deinit();
   dns_cache_thread_deinit();
   scratch_buffers_free();
   main_loop_call_thread_deinit();
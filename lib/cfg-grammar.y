@@ -39,6 +39,7 @@
 #include "rewrite/rewrite-expr-parser.h"
 #include "logmatcher.h"
 #include "logthrdestdrv.h"
+#include "logparallelizer.h"
 
 /* uses struct declarations instead of the typedefs to avoid having to
  * include logreader/logwriter/driver.h, which defines the typedefs.  This
@@ -60,6 +61,7 @@ extern struct _ValuePairsTransformSet *last_vp_transset;
 extern struct _LogMatcherOptions *last_matcher_options;
 extern struct _HostResolveOptions *last_host_resolve_options;
 extern struct _StatsOptions *last_stats_options;
+extern struct _LogPipe *last_parallelizer;
 
 }
 
@@ -158,6 +160,7 @@ extern struct _StatsOptions *last_stats_options;
 %token LL_CONTEXT_INNER_SRC           16
 %token LL_CONTEXT_CLIENT_PROTO        17
 %token LL_CONTEXT_SERVER_PROTO        18
+%token LL_CONTEXT_PARALLELIZE         19
 
 /* statements */
 %token KW_SOURCE                      10000
@@ -208,6 +211,8 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_FILE_TEMPLATE               10079
 %token KW_PROTO_TEMPLATE              10080
 %token KW_MARK_MODE                   10081
+%token KW_STATS_LATENCY               10082
+%token KW_STATS_SHM_FILE              10083
 
 %token KW_CHAIN_HOSTNAMES             10090
 %token KW_NORMALIZE_HOSTNAMES         10091
@@ -237,6 +242,7 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_FRAC_DIGITS                 10152
 
 %token KW_LOG_FIFO_SIZE               10160
+%token KW_LOG_FIFO_TYPE               10161
 %token KW_LOG_FETCH_LIMIT             10162
 %token KW_LOG_IW_SIZE                 10163
 %token KW_LOG_PREFIX                  10164
@@ -250,6 +256,10 @@ extern struct _StatsOptions *last_stats_options;
 /* log statement options */
 %token KW_FLAGS                       10190
 
+%token KW_PARALLELIZE                 10195
+%token KW_WORKERS                     10196
+%token KW_PARTITION_KEY               10197
+
 /* reader options */
 %token KW_PAD_SIZE                    10200
 %token KW_TIME_ZONE                   10201
@@ -397,6 +407,7 @@ ValuePairsTransformSet *last_vp_transset;
 LogMatcherOptions *last_matcher_options;
 HostResolveOptions *last_host_resolve_options;
 StatsOptions *last_stats_options;
+LogPipe *last_parallelizer;
 
 }
 
@@ -722,9 +733,31 @@ log_item
         | KW_REWRITE '{' rewrite_content '}'    { $$ = log_expr_node_new_rewrite(NULL, $3, &@$); }
         | KW_DESTINATION '(' string ')'		{ $$ = log_expr_node_new_destination_reference($3, &@$); free($3); }
         | KW_DESTINATION '{' dest_content '}'   { $$ = log_expr_node_new_destination(NULL, $3, &@$); }
+        | KW_PARALLELIZE
+          {
+            cfg_lexer_push_context(lexer, LL_CONTEXT_PARALLELIZE, parallelize_keywords, "parallelize");
+            last_parallelizer = log_parallelizer_new(configuration);
+          }
+          '(' parallelize_options ')'
+          { cfg_lexer_pop_context(lexer); }
+          { $$ = log_expr_node_new_pipe(last_parallelizer, &@$); }
         | log_junction                          { $$ = $1; }
 	;
 
+parallelize_options
+        : parallelize_option parallelize_options
+        |
+        ;
+
+parallelize_option
+        : KW_WORKERS '(' LL_NUMBER ')'
+          {
+            CHECK_ERROR($3 > 0 && $3 <= MAIN_LOOP_MAX_WORKER_THREADS, @3, "workers() must be between 1 and %d", MAIN_LOOP_MAX_WORKER_THREADS);
+            log_parallelizer_set_workers(last_parallelizer, $3);
+          }
+        | KW_PARTITION_KEY '(' template_content ')' { log_parallelizer_set_partition_key(last_parallelizer, $3); }
+        ;
+
 log_junction
         : KW_JUNCTION '{' log_forks '}'         { $$ = log_expr_node_new_junction($3, &@$); }
         ;
@@ -961,6 +994,13 @@ stat_option
 	: KW_STATS_FREQ '(' LL_NUMBER ')'          { last_stats_options->log_freq = $3; }
 	| KW_STATS_LEVEL '(' LL_NUMBER ')'         { last_stats_options->level = $3; }
 	| KW_STATS_LIFETIME '(' LL_NUMBER ')'      { last_stats_options->lifetime = $3; }
+	| KW_STATS_LATENCY '(' yesno ')'           { last_stats_options->latency = $3; }
+	| KW_STATS_SHM_FILE '(' string ')'
+          {
+            g_free(last_stats_options->shm_file);
+            last_stats_options->shm_file = g_strdup($3);
+            free($3);
+          }
 	;
 
 /* START_RULES */
@@ -1113,6 +1153,11 @@ dest_driver_option
         /* NOTE: plugins need to set "last_driver" in order to incorporate this rule in their grammar */
 
 	: KW_LOG_FIFO_SIZE '(' LL_NUMBER ')'	{ ((LogDestDriver *) last_driver)->log_fifo_size = $3; }
+	| KW_LOG_FIFO_TYPE '(' string ')'
+          {
+            CHECK_ERROR(log_dest_driver_set_log_fifo_type((LogDestDriver *) last_driver, $3), @3, "Unknown log-fifo-type() %s, valid values are fifo and mpsc", $3);
+            free($3);
+          }
 	| KW_THROTTLE '(' LL_NUMBER ')'         { ((LogDestDriver *) last_driver)->throttle = $3; }
         | LL_IDENTIFIER
           {
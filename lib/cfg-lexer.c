@@ -1065,6 +1065,7 @@ static const gchar *lexer_contexts[] =
   [LL_CONTEXT_INNER_SRC] = "inner-src",
   [LL_CONTEXT_CLIENT_PROTO] = "client-proto",
   [LL_CONTEXT_SERVER_PROTO] = "server-proto",
+  [LL_CONTEXT_PARALLELIZE] = "parallelize",
 };
 
 gint
@@ -43,6 +43,7 @@ static CfgLexerKeyword main_keywords[] = {
   { "log",                KW_LOG },
   { "junction",           KW_JUNCTION, 0x0304 },
   { "channel",            KW_CHANNEL, 0x0304 },
+  { "parallelize",        KW_PARALLELIZE },
   { "options",            KW_OPTIONS },
   { "include",            KW_INCLUDE, 0x0300, },
   { "block",              KW_BLOCK, 0x0302 },
@@ -79,6 +80,8 @@ static CfgLexerKeyword main_keywords[] = {
   { "stats_freq",         KW_STATS_FREQ },
   { "stats_lifetime",     KW_STATS_LIFETIME, 0x0306 },
   { "stats_level",        KW_STATS_LEVEL },
+  { "stats_latency",      KW_STATS_LATENCY },
+  { "stats_shm_file",     KW_STATS_SHM_FILE },
   { "stats",              KW_STATS_FREQ, 0, KWS_OBSOLETE, "stats_freq" },
   { "flush_lines",        KW_FLUSH_LINES },
   { "flush_timeout",      KW_FLUSH_TIMEOUT },
@@ -120,6 +123,7 @@ static CfgLexerKeyword main_keywords[] = {
   { "values",             KW_VALUES },
 
   { "log_fifo_size",      KW_LOG_FIFO_SIZE },
+  { "log_fifo_type",      KW_LOG_FIFO_TYPE },
   { "log_fetch_limit",    KW_LOG_FETCH_LIMIT },
   { "log_iw_size",        KW_LOG_IW_SIZE },
   { "log_msg_size",       KW_LOG_MSG_SIZE },
@@ -163,6 +167,13 @@ static CfgLexerKeyword main_keywords[] = {
   { NULL, 0 }
 };
 
+/* options of parallelize(), only recognized within its parentheses */
+CfgLexerKeyword parallelize_keywords[] = {
+  { "workers",            KW_WORKERS },
+  { "partition_key",      KW_PARTITION_KEY },
+  { NULL, 0 }
+};
+
 
 CfgParser main_parser =
 {
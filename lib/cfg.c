@@ -526,6 +526,7 @@ cfg_free(GlobalConfig *self)
   log_template_unref(self->proto_template);
   log_template_options_destroy(&self->template_options);
   host_resolve_options_destroy(&self->host_resolve_options);
+  stats_options_destroy(&self->stats_options);
 
   if (self->bad_hostname_compiled)
     regfree(&self->bad_hostname);
@@ -28,6 +28,7 @@
 #include "messages.h"
 #include "stats/stats-csv.h"
 #include "stats/stats-counter.h"
+#include "stats/stats-histogram.h"
 #include "misc.h"
 #include "mainloop.h"
 
@@ -58,11 +59,42 @@ control_connection_send_stats(GString *command)
   return result;
 }
 
+/* QUERY_STATS <pattern>: only the counters matching the glob pattern */
+static GString *
+control_connection_query_stats(GString *command)
+{
+  gchar **cmds = g_strsplit(command->str, " ", 2);
+  gchar *stats;
+  GString *result;
+
+  if (!cmds[1])
+    {
+      g_strfreev(cmds);
+      return g_string_new("Invalid arguments received, expected a filter pattern");
+    }
+
+  stats = stats_generate_csv_filtered(cmds[1]);
+  result = g_string_new(stats);
+  g_free(stats);
+  g_strfreev(cmds);
+  return result;
+}
+
 static GString *
 control_connection_reset_stats(GString *command)
 {
   GString *result = g_string_new("The statistics of syslog-ng have been reset to 0.");
   stats_reset_non_stored_counters();
+  stats_histogram_reset_all();
+  return result;
+}
+
+static GString *
+control_connection_send_latency(GString *command)
+{
+  GString *result = g_string_sized_new(1024);
+
+  stats_histogram_format_buckets(result);
   return result;
 }
 
@@ -131,6 +163,8 @@ control_connection_reload(GString *command)
 ControlCommand default_commands[] = {
   { "STATS", NULL, control_connection_send_stats },
   { "RESET_STATS", NULL, control_connection_reset_stats },
+  { "QUERY_STATS", NULL, control_connection_query_stats },
+  { "LATENCY", NULL, control_connection_send_latency },
   { "LOG", NULL, control_connection_message_log },
   { "STOP", NULL, control_connection_stop_process },
   { "RELOAD", NULL, control_connection_reload },
@@ -86,6 +86,33 @@ test_stats()
   return;
 }
 
+void
+test_query_stats()
+{
+  GString *reply = NULL;
+  GString *command = g_string_sized_new(128);
+  StatsCounterItem *counter = NULL;
+
+  stats_lock();
+  stats_register_counter(0, SCS_CENTER, "id", "queued", SC_TYPE_PROCESSED, &counter);
+  stats_unlock();
+
+  g_string_assign(command, "QUERY_STATS center;id;queued;*");
+  reply = control_connection_query_stats(command);
+  assert_string(reply->str, "SourceName;SourceId;SourceInstance;State;Type;Number\ncenter;id;queued;a;processed;0\n", "Bad reply");
+  g_string_free(reply, TRUE);
+
+  g_string_assign(command, "QUERY_STATS");
+  reply = control_connection_query_stats(command);
+  assert_string(reply->str, "Invalid arguments received, expected a filter pattern", "Bad reply");
+  g_string_free(reply, TRUE);
+
+  stats_lock();
+  stats_unregister_counter(SCS_CENTER, "id", "queued", SC_TYPE_PROCESSED, &counter);
+  stats_unlock();
+  g_string_free(command, TRUE);
+}
+
 void
 test_reset_stats()
 {
@@ -120,6 +147,7 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   app_startup();
   test_log();
   test_stats();
+  test_query_stats();
   test_reset_stats();
   app_shutdown();
   return 0;
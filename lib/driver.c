@@ -24,6 +24,7 @@
   
 #include "driver.h"
 #include "logqueue-fifo.h"
+#include "logqueue-mpsc.h"
 #include "afinter.h"
 #include "cfg-tree.h"
 
@@ -202,12 +203,29 @@ log_dest_driver_acquire_queue_method(LogDestDriver *self, gchar *persist_name, g
 
   if (!queue)
     {
-      queue = log_queue_fifo_new(self->log_fifo_size < 0 ? cfg->log_fifo_size : self->log_fifo_size, persist_name);
+      gint log_fifo_size = self->log_fifo_size < 0 ? cfg->log_fifo_size : self->log_fifo_size;
+
+      if (self->log_fifo_type == LDD_QUEUE_MPSC)
+        queue = log_queue_mpsc_new(log_fifo_size, persist_name);
+      else
+        queue = log_queue_fifo_new(log_fifo_size, persist_name);
       log_queue_set_throttle(queue, self->throttle);
     }
   return queue;
 }
 
+gboolean
+log_dest_driver_set_log_fifo_type(LogDestDriver *self, const gchar *fifo_type)
+{
+  if (strcmp(fifo_type, "fifo") == 0)
+    self->log_fifo_type = LDD_QUEUE_FIFO;
+  else if (strcmp(fifo_type, "mpsc") == 0)
+    self->log_fifo_type = LDD_QUEUE_MPSC;
+  else
+    return FALSE;
+  return TRUE;
+}
+
 /* consumes the reference in @q */
 static void
 log_dest_driver_release_queue_method(LogDestDriver *self, LogQueue *q, gpointer user_data)
@@ -297,6 +315,7 @@ log_dest_driver_init_instance(LogDestDriver *self, GlobalConfig *cfg)
   self->acquire_queue = log_dest_driver_acquire_queue_method;
   self->release_queue = log_dest_driver_release_queue_method;
   self->log_fifo_size = -1;
+  self->log_fifo_type = LDD_QUEUE_FIFO;
   self->throttle = 0;
 }
 
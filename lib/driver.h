@@ -144,6 +144,13 @@ void log_src_driver_free(LogPipe *s);
 
 /* destination driver class: LogDestDriver */
 
+/* queue implementations, selected by log-fifo-type() */
+enum
+{
+  LDD_QUEUE_FIFO,
+  LDD_QUEUE_MPSC,
+};
+
 typedef struct _LogDestDriver LogDestDriver;
 
 struct _LogDestDriver
@@ -160,6 +167,7 @@ struct _LogDestDriver
   GList *queues;
 
   gint log_fifo_size;
+  gint log_fifo_type;
   gint throttle;
   StatsCounterItem *queued_global_messages;
 };
@@ -197,6 +205,8 @@ gboolean log_dest_driver_init_method(LogPipe *s);
 gboolean log_dest_driver_deinit_method(LogPipe *s);
 void log_dest_driver_queue_method(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data);
 
+gboolean log_dest_driver_set_log_fifo_type(LogDestDriver *self, const gchar *fifo_type);
+
 void log_dest_driver_init_instance(LogDestDriver *self, GlobalConfig *cfg);
 void log_dest_driver_free(LogPipe *s);
 
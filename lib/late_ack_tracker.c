@@ -26,11 +26,24 @@
 #include "bookmark.h"
 #include "ringbuffer.h"
 #include "syslog-ng.h"
+#include "mainloop-worker.h"
+
+/*
+ * Acks are coalesced: acking a message only sets the "acked" flag of its
+ * record (without locking) and bumps unacked_records.  The thread that
+ * bumps it from zero becomes responsible for advancing the bookmark over
+ * the continuous range of acked records, which it does once, at the end
+ * of its current I/O job (e.g. once per destination flush), or right away
+ * if the thread doesn't support batch callbacks.  Acks arriving in the
+ * meantime from other threads are picked up by that same pass, so only
+ * one thread at a time takes the storage lock on the ack path.
+ */
 
 typedef struct _LateAckRecord
 {
   AckRecord super;
-  gboolean acked;
+  /* accessed atomically, 0 (AT_UNDEFINED) if not yet acked, the AckType otherwise */
+  gint acked;
   Bookmark bookmark;
 } LateAckRecord;
 
@@ -40,6 +53,9 @@ typedef struct LateAckTracker
   LateAckRecord *pending_ack_record;
   RingBuffer ack_record_storage;
   GStaticMutex storage_mutex;
+  /* number of acks not yet processed by _process_acks(), accessed atomically */
+  gint unprocessed_acks;
+  WorkerBatchCallback batch_cb;
 } LateAckTracker;
 
 static inline void
@@ -66,7 +82,7 @@ _ack_range_is_continuous(void *data)
 {
   LateAckRecord *ack_rec = (LateAckRecord *)data;
 
-  return ack_rec->acked;
+  return g_atomic_int_get(&ack_rec->acked) != 0;
 }
 
 static inline guint32
@@ -84,7 +100,7 @@ _drop_range(LateAckTracker *self, guint32 n)
   for (i = 0; i < n; i++)
     {
       ack_rec = ring_buffer_element_at(&self->ack_record_storage, i);
-      ack_rec->acked = FALSE;
+      g_atomic_int_set(&ack_rec->acked, 0);
 
       late_ack_record_destroy(ack_rec);
 
@@ -117,32 +133,80 @@ late_ack_tracker_track_msg(AckTracker *s, LogMessage *msg)
   self->pending_ack_record = NULL;
 }
 
+/* must be called with the storage lock held */
+static void
+_advance_bookmark(LateAckTracker *self)
+{
+  LateAckRecord *last_in_range = NULL;
+  guint32 ack_range_length = 0;
+
+  ack_range_length = _get_continuous_range_length(self);
+  if (ack_range_length > 0)
+    {
+      last_in_range = ring_buffer_element_at(&self->ack_record_storage, ack_range_length - 1);
+      if (g_atomic_int_get(&last_in_range->acked) == AT_PROCESSED)
+        {
+          Bookmark *bookmark = &(last_in_range->bookmark);
+          bookmark->save(bookmark);
+        }
+      _drop_range(self, ack_range_length);
+      log_source_flow_control_adjust(self->super.source, ack_range_length);
+    }
+}
+
+static void
+_process_acks(LateAckTracker *self)
+{
+  gint seen;
+
+  /* repeat until no acks arrived while we were advancing the bookmark,
+   * acks counted in "seen" have set their flag before incrementing the
+   * counter, so they are all visible to _advance_bookmark() */
+  do
+    {
+      seen = g_atomic_int_get(&self->unprocessed_acks);
+
+      _late_tracker_lock(self);
+      _advance_bookmark(self);
+      _late_tracker_unlock(self);
+    }
+  while (!g_atomic_int_compare_and_exchange(&self->unprocessed_acks, seen, 0));
+}
+
+static gpointer
+_process_acks_batch_callback(gpointer s)
+{
+  LateAckTracker *self = (LateAckTracker *)s;
+  LogSource *source = self->super.source;
+
+  _process_acks(self);
+  /* drop the reference taken when the callback was registered */
+  log_pipe_unref((LogPipe *)source);
+  return NULL;
+}
+
 static void
 late_ack_tracker_manage_msg_ack(AckTracker *s, LogMessage *msg, AckType ack_type)
 {
   LateAckTracker *self = (LateAckTracker *)s;
   LateAckRecord *ack_rec = (LateAckRecord *)msg->ack_record;
-  LateAckRecord *last_in_range = NULL;
-  guint32 ack_range_length = 0;
 
-  ack_rec->acked = TRUE;
+  g_atomic_int_set(&ack_rec->acked, ack_type);
 
-  _late_tracker_lock(self);
+  if (g_atomic_int_exchange_and_add(&self->unprocessed_acks, 1) == 0)
     {
-      ack_range_length = _get_continuous_range_length(self);
-      if (ack_range_length > 0)
+      /* we are the first one since the last pass, it's our job to
+       * advance the bookmark */
+      if (main_loop_worker_is_batching())
+        {
+          log_pipe_ref((LogPipe *)self->super.source);
+          main_loop_worker_register_batch_callback(&self->batch_cb);
+        }
+      else
         {
-          last_in_range = ring_buffer_element_at(&self->ack_record_storage, ack_range_length - 1);
-          if (ack_type == AT_PROCESSED)
-            {
-              Bookmark *bookmark = &(last_in_range->bookmark);
-              bookmark->save(bookmark);
-            }
-          _drop_range(self, ack_range_length);
-          log_source_flow_control_adjust(self->super.source, ack_range_length);
+          _process_acks(self);
         }
     }
-  _late_tracker_unlock(self);
 
   log_msg_unref(msg);
   log_pipe_unref((LogPipe *)self->super.source);
@@ -182,6 +246,9 @@ late_ack_tracker_init_instance(LateAckTracker *self, LogSource *source)
   self->super.manage_msg_ack = late_ack_tracker_manage_msg_ack;
   ring_buffer_alloc(&self->ack_record_storage, sizeof(LateAckRecord), log_source_get_init_window_size(source));
   g_static_mutex_init(&self->storage_mutex);
+  worker_batch_callback_init(&self->batch_cb);
+  self->batch_cb.func = _process_acks_batch_callback;
+  self->batch_cb.user_data = self;
 }
 
 AckTracker*
@@ -202,15 +202,11 @@ gint logmsg_queue_node_max = 1;
 /* statistics */
 static StatsCounterItem *count_msg_clones;
 static StatsCounterItem *count_payload_reallocs;
+static StatsCounterItem *count_payload_clones;
+static StatsCounterItem *count_payload_clones_avoided;
 static StatsCounterItem *count_sdata_updates;
 static GStaticPrivate priv_macro_value = G_STATIC_PRIVATE_INIT;
 
-static inline gboolean
-log_msg_is_write_protected(const LogMessage *self)
-{
-  return self->protect_cnt > 0;
-}
-
 void
 log_msg_write_protect(LogMessage *self)
 {
@@ -237,33 +233,34 @@ log_msg_make_writable(LogMessage **pself, const LogPathOptions *path_options)
   return *pself;
 }
 
-
+/*
+ * Take ownership of a payload that is shared with our "original" message
+ * as the result of log_msg_clone_cow().  Instead of copying the shared
+ * payload as a whole, we put a small overlay on top of it that stores
+ * our changes only.  The parent of the overlay is kept alive (and
+ * unchanged) by the reference to our original, which is write protected.
+ */
 static void
-log_msg_update_sdata_slow(LogMessage *self, NVHandle handle, const gchar *name, gssize name_len)
+log_msg_unshare_payload(LogMessage *self, gsize additional_space)
 {
-  guint16 alloc_sdata;
-  guint16 prefix_and_block_len;
-  gint i;
-  const gchar *dot;
-
-  /* this was a structured data element, insert a ref to the sdata array */
-
-  stats_counter_inc(count_sdata_updates);
-  if (self->num_sdata == 255)
+  if (G_LIKELY(self->original && !self->payload->parent))
     {
-      msg_error("syslog-ng only supports 255 SD elements right now, just drop an email to the mailing list that it was not enough with your use-case so we can increase it", NULL);
-      return;
+      self->payload = nv_table_new_overlay(self->payload, 4, 64 + additional_space);
+      stats_counter_inc(count_payload_clones_avoided);
     }
-
-  if (self->alloc_sdata <= self->num_sdata)
+  else
     {
-      alloc_sdata = MAX(self->num_sdata + 1, (self->num_sdata + 8) & ~7);
-      if (alloc_sdata > 255)
-        alloc_sdata = 255;
+      /* the shared payload is an overlay itself, copy the overlay which
+       * is usually small and keep its parent */
+      self->payload = nv_table_clone(self->payload, additional_space);
+      stats_counter_inc(count_payload_clones);
     }
-  else
-    alloc_sdata = self->alloc_sdata;
+  log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
+}
 
+static void
+log_msg_alloc_sdata(LogMessage *self, guint16 alloc_sdata)
+{
   if (log_msg_chk_flag(self, LF_STATE_OWN_SDATA) && self->sdata)
     {
       if (self->alloc_sdata < alloc_sdata)
@@ -284,6 +281,52 @@ log_msg_update_sdata_slow(LogMessage *self, NVHandle handle, const gchar *name,
       log_msg_set_flag(self, LF_STATE_OWN_SDATA);
     }
   self->alloc_sdata = alloc_sdata;
+}
+
+/**
+ * log_msg_reserve_sdata:
+ * @self: LogMessage instance
+ * @count: number of SDATA values about to be added
+ *
+ * Grows the SDATA array in one step, so that parsers that know the number
+ * of SD params in advance avoid reallocating it every 8 values.
+ **/
+void
+log_msg_reserve_sdata(LogMessage *self, gint count)
+{
+  guint16 alloc_sdata = MIN(self->num_sdata + count, 255);
+
+  if (alloc_sdata > self->alloc_sdata)
+    log_msg_alloc_sdata(self, alloc_sdata);
+}
+
+static void
+log_msg_update_sdata_slow(LogMessage *self, NVHandle handle, const gchar *name, gssize name_len)
+{
+  guint16 alloc_sdata;
+  guint16 prefix_and_block_len;
+  gint i;
+  const gchar *dot;
+
+  /* this was a structured data element, insert a ref to the sdata array */
+
+  stats_counter_inc(count_sdata_updates);
+  if (self->num_sdata == 255)
+    {
+      msg_error("syslog-ng only supports 255 SD elements right now, just drop an email to the mailing list that it was not enough with your use-case so we can increase it", NULL);
+      return;
+    }
+
+  if (self->alloc_sdata <= self->num_sdata)
+    {
+      alloc_sdata = MAX(self->num_sdata + 1, (self->num_sdata + 8) & ~7);
+      if (alloc_sdata > 255)
+        alloc_sdata = 255;
+    }
+  else
+    alloc_sdata = self->alloc_sdata;
+
+  log_msg_alloc_sdata(self, alloc_sdata);
 
   /* ok, we have our own SDATA array now which has at least one free slot */
 
@@ -347,6 +390,18 @@ log_msg_get_value_handle(const gchar *value_name)
   return handle;
 }
 
+/* hidden values can be referenced by indirect values, without being
+ * visible as name-value pairs of the message */
+NVHandle
+log_msg_get_hidden_value_handle(const gchar *value_name)
+{
+  NVHandle handle;
+
+  handle = nv_registry_alloc_handle(logmsg_registry, value_name);
+  nv_registry_set_handle_flags(logmsg_registry, handle, LM_VF_HIDDEN);
+  return handle;
+}
+
 const gchar *
 log_msg_get_value_name(NVHandle handle, gssize *name_len)
 {
@@ -433,6 +488,8 @@ log_msg_init_queue_node(LogMessage *msg, LogMessageQueueNode *node, const LogPat
 {
   INIT_IV_LIST_HEAD(&node->list);
   node->ack_needed = path_options->ack_needed;
+  node->flow_control_requested = path_options->flow_control_requested;
+  node->enqueue_stamp = 0;
   node->msg = log_msg_ref(msg);
   log_msg_write_protect(msg);
 }
@@ -511,10 +568,7 @@ log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize
     value_len = strlen(value);
 
   if (!log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
-    {
-      self->payload = nv_table_clone(self->payload, name_len + value_len + 2);
-      log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
-    }
+    log_msg_unshare_payload(self, name_len + value_len + 2);
 
   /* we need a loop here as a single realloc may not be enough. Might help
    * if we pass how much bytes we need though. */
@@ -557,10 +611,7 @@ log_msg_set_value_indirect(LogMessage *self, NVHandle handle, NVHandle ref_handl
   name = log_msg_get_value_name(handle, &name_len);
 
   if (!log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
-    {
-      self->payload = nv_table_clone(self->payload, name_len + 1);
-      log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
-    }
+    log_msg_unshare_payload(self, name_len + 1);
 
   while (!nv_table_add_value_indirect(self->payload, handle, name, name_len, ref_handle, type, ofs, len, &new_entry))
     {
@@ -581,10 +632,23 @@ log_msg_set_value_indirect(LogMessage *self, NVHandle handle, NVHandle ref_handl
     log_msg_update_sdata(self, handle, name, name_len);
 }
 
+static gboolean
+_values_foreach_skip_hidden(NVHandle handle, const gchar *name, const gchar *value, gssize value_len, gpointer user_data)
+{
+  gpointer *args = (gpointer *) user_data;
+  NVTableForeachFunc func = (NVTableForeachFunc) args[0];
+
+  if (nv_registry_get_handle_flags(logmsg_registry, handle) & LM_VF_HIDDEN)
+    return FALSE;
+  return func(handle, name, value, value_len, args[1]);
+}
+
 gboolean
 log_msg_values_foreach(const LogMessage *self, NVTableForeachFunc func, gpointer user_data)
 {
-  return nv_table_foreach(self->payload, logmsg_registry, func, user_data);
+  gpointer args[] = { (gpointer) func, user_data };
+
+  return nv_table_foreach(self->payload, logmsg_registry, _values_foreach_skip_hidden, args);
 }
 
 void
@@ -1657,6 +1721,8 @@ log_msg_global_init(void)
   stats_lock();
   stats_register_counter(0, SCS_GLOBAL, "msg_clones", NULL, SC_TYPE_PROCESSED, &count_msg_clones);
   stats_register_counter(0, SCS_GLOBAL, "payload_reallocs", NULL, SC_TYPE_PROCESSED, &count_payload_reallocs);
+  stats_register_counter(0, SCS_GLOBAL, "payload_clones", NULL, SC_TYPE_PROCESSED, &count_payload_clones);
+  stats_register_counter(0, SCS_GLOBAL, "payload_clones_avoided", NULL, SC_TYPE_PROCESSED, &count_payload_clones_avoided);
   stats_register_counter(0, SCS_GLOBAL, "sdata_updates", NULL, SC_TYPE_PROCESSED, &count_sdata_updates);
   stats_unlock();
 }
@@ -87,6 +87,8 @@ enum
   LM_VF_SDATA = 0x0001,
   LM_VF_MATCH = 0x0002,
   LM_VF_MACRO = 0x0004,
+  /* internal values, not listed by log_msg_values_foreach() */
+  LM_VF_HIDDEN = 0x0008,
 };
 
 enum
@@ -125,7 +127,9 @@ typedef struct _LogMessageQueueNode
 {
   struct iv_list_head list;
   LogMessage *msg;
-  gboolean ack_needed:1, embedded:1;
+  gboolean ack_needed:1, flow_control_requested:1, embedded:1;
+  /* monotonic time of the push in usec (truncated), 0 if not measured */
+  guint32 enqueue_stamp;
 } LogMessageQueueNode;
 
 
@@ -201,6 +205,13 @@ LogMessage *log_msg_ref(LogMessage *m);
 void log_msg_unref(LogMessage *m);
 void log_msg_write_protect(LogMessage *m);
 void log_msg_write_unprotect(LogMessage *m);
+
+static inline gboolean
+log_msg_is_write_protected(const LogMessage *self)
+{
+  return self->protect_cnt > 0;
+}
+
 LogMessage *log_msg_clone_cow(LogMessage *msg, const LogPathOptions *path_options);
 LogMessage *log_msg_make_writable(LogMessage **pmsg, const LogPathOptions *path_options);
 
@@ -209,6 +220,7 @@ gboolean log_msg_read(LogMessage *self, SerializeArchive *sa);
 
 /* generic values that encapsulate log message fields, dynamic values and structured data */
 NVHandle log_msg_get_value_handle(const gchar *value_name);
+NVHandle log_msg_get_hidden_value_handle(const gchar *value_name);
 const gchar *log_msg_get_value_name(NVHandle handle, gssize *name_len);
 gboolean log_msg_is_value_name_valid(const gchar *value);
 
@@ -247,6 +259,7 @@ typedef gboolean (*LogMessageTagsForeachFunc)(const LogMessage *self, LogTagId t
 
 void log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *new_value, gssize length);
 void log_msg_set_value_indirect(LogMessage *self, NVHandle handle, NVHandle ref_handle, guint8 type, guint16 ofs, guint16 len);
+void log_msg_reserve_sdata(LogMessage *self, gint count);
 gboolean log_msg_values_foreach(const LogMessage *self, NVTableForeachFunc func, gpointer user_data);
 void log_msg_set_match(LogMessage *self, gint index, const gchar *value, gssize value_len);
 void log_msg_set_match_indirect(LogMessage *self, gint index, NVHandle ref_handle, guint8 type, guint16 ofs, guint16 len);
@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "logparallelizer.h"
+#include "logqueue-mpsc.h"
+#include "mainloop-worker.h"
+#include "scratch-buffers.h"
+#include "stats/stats-registry.h"
+#include "cfg.h"
+#include "messages.h"
+
+#include <iv.h>
+#include <iv_event.h>
+
+/*
+ * LogParallelizer
+ *
+ * Without parallelize(), a message is processed by the thread that
+ * received it, all the way through parsers, rewrite rules and filters, so
+ * a single busy connection keeps a single core busy.
+ *
+ * LogParallelizer owns a set of worker threads, each with its own
+ * LogQueueMpsc.  queue() evaluates the partition key in the receiving
+ * thread, picks a worker based on the hash of the key and puts the
+ * message to the queue of that worker.  The worker threads pop messages
+ * from their queues and forward them to the rest of the log path.  As a
+ * given key always maps to the same worker, and the queues are FIFOs,
+ * messages of the same partition are processed in the order they were
+ * received in.  Without a partition key, messages are distributed
+ * round-robin and no ordering is guaranteed.
+ *
+ * Flow control: if the log path requested flow control, the ACK chain is
+ * kept intact, so the source window is released only once the worker
+ * processed the message and all of its destinations acknowledged it.
+ * Otherwise, the message is acknowledged as soon as it is queued, just
+ * like destinations do.
+ *
+ * The queues are limited to log-fifo-size() messages, further messages
+ * are dropped and counted, just like in a destination queue.
+ *
+ * As the rest of the log path runs asynchronously, the outcome of the
+ * filters after parallelize() is not known by the time queue() returns:
+ * messages passed to parallelize() always count as matched, as far as
+ * flags(final) and flags(fallback) of the enclosing log paths are
+ * concerned.
+ *
+ * Worker threads are started in init() and are stopped by the main loop
+ * before reload or shutdown, just like threaded destinations.  Messages
+ * still in the queues at that point are processed before the thread
+ * exits, stragglers that are queued afterwards are aborted when the queues
+ * are freed in deinit().
+ */
+
+/* number of messages processed before giving ivykis a chance to run */
+#define LOG_PARALLELIZER_BATCH_SIZE 100
+
+typedef struct _LogParallelizerWorker
+{
+  LogParallelizer *owner;
+  LogQueue *queue;
+  struct iv_task do_work;
+  struct iv_event wake_up_event;
+  struct iv_event shutdown_event;
+} LogParallelizerWorker;
+
+struct _LogParallelizer
+{
+  LogPipe super;
+  gint num_workers;
+  LogTemplate *partition_key;
+  gint next_worker;
+
+  WorkerOptions worker_options;
+  LogParallelizerWorker *workers;
+  gchar *stats_instance;
+  StatsCounterItem *stored_messages;
+  StatsCounterItem *dropped_messages;
+};
+
+void
+log_parallelizer_set_workers(LogPipe *s, gint num_workers)
+{
+  LogParallelizer *self = (LogParallelizer *) s;
+
+  self->num_workers = num_workers;
+}
+
+/* NOTE: consumes partition_key */
+void
+log_parallelizer_set_partition_key(LogPipe *s, LogTemplate *partition_key)
+{
+  LogParallelizer *self = (LogParallelizer *) s;
+
+  log_template_unref(self->partition_key);
+  self->partition_key = partition_key;
+}
+
+/* Worker thread */
+
+/* runs in the thread that processes the worker's queue */
+static gint
+log_parallelizer_worker_process_messages(LogParallelizerWorker *self, gint limit)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gint count = 0;
+
+  while ((limit < 0 || count < limit) &&
+         (msg = log_queue_pop_head(self->queue, &path_options)) != NULL)
+    {
+      msg_set_context(msg);
+      log_pipe_forward_msg(&self->owner->super, msg, &path_options);
+      msg_set_context(NULL);
+      count++;
+    }
+
+  /* push out whatever the rest of the log path queued in this thread */
+  main_loop_worker_invoke_batch_callbacks();
+  return count;
+}
+
+/* NOTE: runs in the thread that queued the message */
+static void
+log_parallelizer_worker_message_became_available(gpointer s)
+{
+  LogParallelizerWorker *self = (LogParallelizerWorker *) s;
+
+  iv_event_post(&self->wake_up_event);
+}
+
+static void
+log_parallelizer_worker_wake_up(gpointer s)
+{
+  LogParallelizerWorker *self = (LogParallelizerWorker *) s;
+
+  if (!iv_task_registered(&self->do_work))
+    iv_task_register(&self->do_work);
+}
+
+static void
+log_parallelizer_worker_do_work(gpointer s)
+{
+  LogParallelizerWorker *self = (LogParallelizerWorker *) s;
+  gint timeout_msec = 0;
+
+  if (log_queue_check_items(self->queue, &timeout_msec,
+                            log_parallelizer_worker_message_became_available,
+                            self, NULL))
+    {
+      log_parallelizer_worker_process_messages(self, LOG_PARALLELIZER_BATCH_SIZE);
+
+      /* come back for the rest once other events had a chance to run */
+      iv_task_register(&self->do_work);
+    }
+}
+
+static void
+log_parallelizer_worker_shutdown(gpointer s)
+{
+  LogParallelizerWorker *self = (LogParallelizerWorker *) s;
+
+  log_queue_reset_parallel_push(self->queue);
+  if (iv_task_registered(&self->do_work))
+    iv_task_unregister(&self->do_work);
+
+  /* the sources are being stopped, finish what they have already sent us */
+  log_parallelizer_worker_process_messages(self, -1);
+
+  iv_event_unregister(&self->wake_up_event);
+  iv_event_unregister(&self->shutdown_event);
+  iv_quit();
+}
+
+static void
+log_parallelizer_worker_thread_main(gpointer s)
+{
+  LogParallelizerWorker *self = (LogParallelizerWorker *) s;
+
+  iv_init();
+
+  IV_EVENT_INIT(&self->wake_up_event);
+  self->wake_up_event.cookie = self;
+  self->wake_up_event.handler = log_parallelizer_worker_wake_up;
+  iv_event_register(&self->wake_up_event);
+
+  IV_EVENT_INIT(&self->shutdown_event);
+  self->shutdown_event.cookie = self;
+  self->shutdown_event.handler = log_parallelizer_worker_shutdown;
+  iv_event_register(&self->shutdown_event);
+
+  IV_TASK_INIT(&self->do_work);
+  self->do_work.cookie = self;
+  self->do_work.handler = log_parallelizer_worker_do_work;
+  iv_task_register(&self->do_work);
+
+  iv_main();
+
+  iv_deinit();
+}
+
+static void
+log_parallelizer_worker_stop_thread(gpointer s)
+{
+  LogParallelizerWorker *self = (LogParallelizerWorker *) s;
+
+  iv_event_post(&self->shutdown_event);
+}
+
+/* LogPipe */
+
+static LogParallelizerWorker *
+log_parallelizer_select_worker(LogParallelizer *self, LogMessage *msg)
+{
+  SBGString *key;
+  guint index;
+
+  if (!self->partition_key)
+    {
+      index = (guint) g_atomic_int_exchange_and_add(&self->next_worker, 1);
+    }
+  else
+    {
+      key = sb_gstring_acquire();
+      log_template_format(self->partition_key, msg, NULL, LTZ_LOCAL, 0, NULL, sb_gstring_string(key));
+      index = g_str_hash(sb_gstring_string(key)->str);
+      sb_gstring_release(key);
+    }
+  return &self->workers[index % self->num_workers];
+}
+
+static void
+log_parallelizer_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  LogParallelizer *self = (LogParallelizer *) s;
+  LogPathOptions local_options;
+
+  if (!path_options->flow_control_requested)
+    path_options = log_msg_break_ack(msg, path_options, &local_options);
+
+  /* a write protected message is still being delivered to other log paths
+   * by this thread, but the protection is gone by the time the worker gets
+   * to it, so the worker needs a copy it can modify independently */
+  log_msg_make_writable(&msg, path_options);
+
+  log_queue_push_tail(log_parallelizer_select_worker(self, msg)->queue, msg, path_options);
+}
+
+static gboolean
+log_parallelizer_init(LogPipe *s)
+{
+  LogParallelizer *self = (LogParallelizer *) s;
+  GlobalConfig *cfg = log_pipe_get_config(s);
+  gchar buf[256];
+  gint i;
+
+  self->stats_instance = g_strdup(log_expr_node_format_location(s->expr_node, buf, sizeof(buf)));
+  stats_lock();
+  stats_register_counter(0, SCS_GLOBAL, "parallelize", self->stats_instance, SC_TYPE_STORED, &self->stored_messages);
+  stats_register_counter(0, SCS_GLOBAL, "parallelize", self->stats_instance, SC_TYPE_DROPPED, &self->dropped_messages);
+  stats_unlock();
+
+  self->workers = g_new0(LogParallelizerWorker, self->num_workers);
+  for (i = 0; i < self->num_workers; i++)
+    {
+      LogParallelizerWorker *worker = &self->workers[i];
+
+      worker->owner = self;
+      worker->queue = log_queue_mpsc_new(cfg->log_fifo_size, NULL);
+      log_queue_set_counters(worker->queue, self->stored_messages, self->dropped_messages);
+    }
+
+  for (i = 0; i < self->num_workers; i++)
+    main_loop_create_worker_thread(log_parallelizer_worker_thread_main,
+                                   log_parallelizer_worker_stop_thread,
+                                   &self->workers[i], &self->worker_options);
+  return TRUE;
+}
+
+static gboolean
+log_parallelizer_deinit(LogPipe *s)
+{
+  LogParallelizer *self = (LogParallelizer *) s;
+  gint i;
+
+  /* NOTE: the worker threads have exited by now */
+  for (i = 0; i < self->num_workers; i++)
+    {
+      log_queue_reset_parallel_push(self->workers[i].queue);
+      log_queue_set_counters(self->workers[i].queue, NULL, NULL);
+      log_queue_unref(self->workers[i].queue);
+    }
+  g_free(self->workers);
+  self->workers = NULL;
+
+  stats_lock();
+  stats_unregister_counter(SCS_GLOBAL, "parallelize", self->stats_instance, SC_TYPE_STORED, &self->stored_messages);
+  stats_unregister_counter(SCS_GLOBAL, "parallelize", self->stats_instance, SC_TYPE_DROPPED, &self->dropped_messages);
+  stats_unlock();
+  g_free(self->stats_instance);
+  self->stats_instance = NULL;
+  return TRUE;
+}
+
+static LogPipe *
+log_parallelizer_clone(LogPipe *s)
+{
+  LogParallelizer *self = (LogParallelizer *) s;
+  LogPipe *cloned = log_parallelizer_new(s->cfg);
+
+  log_parallelizer_set_workers(cloned, self->num_workers);
+  log_parallelizer_set_partition_key(cloned, log_template_ref(self->partition_key));
+  return cloned;
+}
+
+static void
+log_parallelizer_free(LogPipe *s)
+{
+  LogParallelizer *self = (LogParallelizer *) s;
+
+  log_template_unref(self->partition_key);
+  log_pipe_free_method(s);
+}
+
+LogPipe *
+log_parallelizer_new(GlobalConfig *cfg)
+{
+  LogParallelizer *self = g_new0(LogParallelizer, 1);
+
+  log_pipe_init_instance(&self->super, cfg);
+  self->super.init = log_parallelizer_init;
+  self->super.deinit = log_parallelizer_deinit;
+  self->super.queue = log_parallelizer_queue;
+  self->super.clone = log_parallelizer_clone;
+  self->super.free_fn = log_parallelizer_free;
+  self->num_workers = LOG_PARALLELIZER_DEFAULT_WORKERS;
+  return &self->super;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef LOGPARALLELIZER_H_INCLUDED
+#define LOGPARALLELIZER_H_INCLUDED
+
+#include "logpipe.h"
+#include "template/templates.h"
+
+#define LOG_PARALLELIZER_DEFAULT_WORKERS 4
+
+/**
+ * The parallelize() element of a log path.  Messages are handed over to a
+ * pool of processing threads and the rest of the log path runs in those
+ * threads instead of the one that received the message.  Messages with
+ * the same partition key are processed by the same thread, so their order
+ * is retained.
+ **/
+typedef struct _LogParallelizer LogParallelizer;
+
+LogPipe *log_parallelizer_new(GlobalConfig *cfg);
+void log_parallelizer_set_workers(LogPipe *s, gint num_workers);
+void log_parallelizer_set_partition_key(LogPipe *s, LogTemplate *partition_key);
+
+#endif
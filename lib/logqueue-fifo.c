@@ -265,6 +265,7 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
         }
 
       node = log_msg_alloc_queue_node(msg, path_options);
+      log_queue_stamp_node(&self->super, node);
       iv_list_add_tail(&node->list, &self->qoverflow_input[thread_id].items);
       self->qoverflow_input[thread_id].len++;
       log_msg_unref(msg);
@@ -281,6 +282,7 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
   if (log_queue_fifo_get_length(s) < self->qoverflow_size)
     {
       node = log_msg_alloc_queue_node(msg, path_options);
+      log_queue_stamp_node(&self->super, node);
 
       iv_list_add_tail(&node->list, &self->qoverflow_wait);
       self->qoverflow_wait_len++;
@@ -359,6 +361,8 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
 
       msg = node->msg;
       path_options->ack_needed = node->ack_needed;
+      path_options->flow_control_requested = node->flow_control_requested;
+      log_queue_record_node_latency(&self->super, node);
       self->qoverflow_output_len--;
       if (!self->super.use_backlog)
         {
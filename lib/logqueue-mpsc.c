@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "logqueue-mpsc.h"
+#include "logpipe.h"
+#include "messages.h"
+#include "atomic.h"
+
+#include <string.h>
+
+/*
+ * LogQueueMpsc is a bounded, lock-free multi-producer, single-consumer
+ * queue, meant for destinations that only ever have a single thread
+ * consuming their queue (which is true for LogWriter and the threaded
+ * destination drivers).
+ *
+ * Producers claim a slot in a ring of LogMessageQueueNode pointers by
+ * incrementing enqueue_pos, store the node and publish it by bumping the
+ * slot's sequence number.  The consumer takes elements from the ring in
+ * order, waiting for each slot to be published.  Unlike LogQueueFifo,
+ * there are no per-thread input queues and no batch callbacks, so
+ * elements are visible to the consumer as soon as push_tail() returns.
+ *
+ * The number of elements is tracked in an atomic counter, so
+ * log_queue_get_length() is exact and does not need any locks.
+ *
+ * Elements put back by push_head() and rewind_backlog() are stored in an
+ * unlocked list that is consulted before the ring, these are only touched
+ * by the consumer.
+ *
+ * The LogQueue lock is only taken by a producer when the queue becomes
+ * non-empty, in order to deliver the parallel_push notification set up by
+ * log_queue_check_items(), or while a consumer waits for a given queue
+ * length using log_queue_notify_on_length().
+ *
+ * Threading assumptions:
+ *   - push_tail() can be called from any thread
+ *   - everything else is called from the output thread
+ */
+
+typedef struct _LogQueueMpscSlot
+{
+  /* the slot is free for producer "pos" when sequence == pos, contains an
+   * element for the consumer at "pos" when sequence == pos + 1 */
+  gint sequence;
+  LogMessageQueueNode *node;
+} LogQueueMpscSlot;
+
+typedef struct _LogQueueMpsc
+{
+  LogQueue super;
+
+  gint qoverflow_size; /* in number of elements */
+
+  /* number of elements in the ring, may temporarily go negative as
+   * producers increment it after publishing their element */
+  GAtomicCounter ring_len;
+  gint enqueue_pos;
+  gint dequeue_pos;
+
+  /* elements put back to the front of the queue, output thread only */
+  struct iv_list_head qoutput;
+  gint qoutput_len;
+
+  struct iv_list_head qbacklog;    /* entries that were sent but not acked yet */
+  gint qbacklog_len;
+
+  guint32 ring_mask;
+  LogQueueMpscSlot ring[0];
+} LogQueueMpsc;
+
+static gint64
+log_queue_mpsc_get_length(LogQueue *s)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+
+  return MAX(g_atomic_counter_get(&self->ring_len), 0) + self->qoutput_len;
+}
+
+/* NOTE: this is inherently racy, can only be called if log processing is suspended (e.g. reload time) */
+static gboolean
+log_queue_mpsc_keep_on_reload(LogQueue *s)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+
+  return log_queue_mpsc_get_length(s) > 0 || self->qbacklog_len > 0;
+}
+
+/* claims a free slot in the ring, returns FALSE if the ring is full */
+static gboolean
+log_queue_mpsc_claim_slot(LogQueueMpsc *self, guint32 *claimed_pos)
+{
+  guint32 pos = (guint32) g_atomic_int_get(&self->enqueue_pos);
+
+  while (1)
+    {
+      LogQueueMpscSlot *slot = &self->ring[pos & self->ring_mask];
+      gint diff = (gint) ((guint32) g_atomic_int_get(&slot->sequence) - pos);
+
+      if (diff == 0)
+        {
+          if (g_atomic_int_compare_and_exchange(&self->enqueue_pos, (gint) pos, (gint) (pos + 1)))
+            {
+              *claimed_pos = pos;
+              return TRUE;
+            }
+        }
+      else if (diff < 0)
+        {
+          /* the consumer hasn't released this slot yet */
+          return FALSE;
+        }
+      pos = (guint32) g_atomic_int_get(&self->enqueue_pos);
+    }
+}
+
+/*
+ * Can be called from any thread.
+ *
+ * NOTE: It consumes the reference passed by the caller.
+ */
+static void
+log_queue_mpsc_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+  LogQueueMpscSlot *slot;
+  LogMessageQueueNode *node;
+  guint32 pos;
+  gint ring_len;
+
+  if (log_queue_mpsc_get_length(s) >= self->qoverflow_size ||
+      !log_queue_mpsc_claim_slot(self, &pos))
+    {
+      stats_counter_inc(self->super.dropped_messages);
+      log_msg_drop(msg, path_options);
+
+      msg_debug("Destination queue full, dropping message",
+                evt_tag_int("queue_len", log_queue_mpsc_get_length(&self->super)),
+                evt_tag_int("log_fifo_size", self->qoverflow_size),
+                evt_tag_str("persist_name", self->super.persist_name),
+                NULL);
+      return;
+    }
+
+  slot = &self->ring[pos & self->ring_mask];
+  node = log_msg_alloc_queue_node(msg, path_options);
+  log_queue_stamp_node(&self->super, node);
+  g_atomic_pointer_set(&slot->node, node);
+  g_atomic_int_set(&slot->sequence, (gint) (pos + 1));
+  log_msg_unref(msg);
+
+  stats_counter_inc(self->super.stored_messages);
+  ring_len = g_atomic_counter_exchange_and_add(&self->ring_len, 1) + 1;
+  if (ring_len == 1 ||
+      (g_atomic_pointer_get(&self->super.parallel_push_notify) &&
+       ring_len >= g_atomic_int_get(&self->super.parallel_push_notify_limit)))
+    {
+      /* the queue just became non-empty or reached the length the
+       * consumer is waiting for, it may be waiting for us */
+      g_static_mutex_lock(&self->super.lock);
+      log_queue_push_notify(&self->super);
+      g_static_mutex_unlock(&self->super.lock);
+    }
+}
+
+/*
+ * Put an item back to the front of the queue.
+ *
+ * This is assumed to be called only from the output thread.
+ *
+ * NOTE: It consumes the reference passed by the caller.
+ */
+static void
+log_queue_mpsc_push_head(LogQueue *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+  LogMessageQueueNode *node;
+
+  /* no limit checks here, see log_queue_fifo_push_head() */
+
+  node = log_msg_alloc_dynamic_queue_node(msg, path_options);
+  iv_list_add(&node->list, &self->qoutput);
+  self->qoutput_len++;
+  log_msg_unref(msg);
+
+  stats_counter_inc(self->super.stored_messages);
+}
+
+/* takes the next published element off the ring, output thread only */
+static LogMessageQueueNode *
+log_queue_mpsc_take_from_ring(LogQueueMpsc *self)
+{
+  guint32 pos = (guint32) self->dequeue_pos;
+  LogQueueMpscSlot *slot = &self->ring[pos & self->ring_mask];
+  LogMessageQueueNode *node;
+
+  if ((gint) ((guint32) g_atomic_int_get(&slot->sequence) - (pos + 1)) < 0)
+    return NULL;
+
+  node = g_atomic_pointer_get(&slot->node);
+  INIT_IV_LIST_HEAD(&node->list);
+
+  /* release the slot for the producer that wraps around to it */
+  g_atomic_int_set(&slot->sequence, (gint) (pos + self->ring_mask + 1));
+  self->dequeue_pos = (gint) (pos + 1);
+  g_atomic_counter_exchange_and_add(&self->ring_len, -1);
+  return node;
+}
+
+/*
+ * Can only run from the output thread.
+ *
+ * NOTE: this returns a reference which the caller must take care to free.
+ */
+static LogMessage *
+log_queue_mpsc_pop_head(LogQueue *s, LogPathOptions *path_options)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+  LogMessageQueueNode *node;
+  LogMessage *msg;
+
+  if (self->qoutput_len > 0)
+    {
+      node = iv_list_entry(self->qoutput.next, LogMessageQueueNode, list);
+      iv_list_del_init(&node->list);
+      self->qoutput_len--;
+    }
+  else
+    {
+      node = log_queue_mpsc_take_from_ring(self);
+      if (!node)
+        return NULL;
+    }
+
+  msg = node->msg;
+  path_options->ack_needed = node->ack_needed;
+  path_options->flow_control_requested = node->flow_control_requested;
+  log_queue_record_node_latency(&self->super, node);
+  stats_counter_dec(self->super.stored_messages);
+
+  if (self->super.use_backlog)
+    {
+      log_msg_ref(msg);
+      iv_list_add_tail(&node->list, &self->qbacklog);
+      self->qbacklog_len++;
+    }
+  else
+    {
+      log_msg_free_queue_node(node);
+    }
+
+  return msg;
+}
+
+/*
+ * Can only run from the output thread.
+ */
+static void
+log_queue_mpsc_ack_backlog(LogQueue *s, gint rewind_count)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint pos;
+
+  for (pos = 0; pos < rewind_count && self->qbacklog_len > 0; pos++)
+    {
+      LogMessageQueueNode *node;
+      LogMessage *msg;
+
+      node = iv_list_entry(self->qbacklog.next, LogMessageQueueNode, list);
+      msg = node->msg;
+
+      iv_list_del(&node->list);
+      self->qbacklog_len--;
+      path_options.ack_needed = node->ack_needed;
+      log_msg_ack(msg, &path_options, AT_PROCESSED);
+      log_msg_free_queue_node(node);
+      log_msg_unref(msg);
+    }
+}
+
+/*
+ * Move all items on our backlog back to the front of the queue, in their
+ * original order.
+ *
+ * NOTE: this is assumed to be called from the output thread.
+ */
+static void
+log_queue_mpsc_rewind_backlog_all(LogQueue *s)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+
+  iv_list_splice_init(&self->qbacklog, &self->qoutput);
+  self->qoutput_len += self->qbacklog_len;
+  stats_counter_add(self->super.stored_messages, self->qbacklog_len);
+  self->qbacklog_len = 0;
+}
+
+static void
+log_queue_mpsc_rewind_backlog(LogQueue *s, guint rewind_count)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+  guint pos;
+
+  if (rewind_count > self->qbacklog_len)
+    rewind_count = self->qbacklog_len;
+
+  for (pos = 0; pos < rewind_count; pos++)
+    {
+      LogMessageQueueNode *node = iv_list_entry(self->qbacklog.prev, LogMessageQueueNode, list);
+
+      iv_list_del_init(&node->list);
+      iv_list_add(&node->list, &self->qoutput);
+
+      self->qbacklog_len--;
+      self->qoutput_len++;
+      stats_counter_inc(self->super.stored_messages);
+    }
+}
+
+static void
+log_queue_mpsc_free_node(LogMessageQueueNode *node)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = node->msg;
+
+  path_options.ack_needed = node->ack_needed;
+  log_msg_free_queue_node(node);
+  log_msg_ack(msg, &path_options, AT_ABORTED);
+  log_msg_unref(msg);
+}
+
+static void
+log_queue_mpsc_free_queue(struct iv_list_head *q)
+{
+  while (!iv_list_empty(q))
+    {
+      LogMessageQueueNode *node = iv_list_entry(q->next, LogMessageQueueNode, list);
+
+      iv_list_del(&node->list);
+      log_queue_mpsc_free_node(node);
+    }
+}
+
+static void
+log_queue_mpsc_free(LogQueue *s)
+{
+  LogQueueMpsc *self = (LogQueueMpsc *) s;
+  LogMessageQueueNode *node;
+
+  log_queue_mpsc_free_queue(&self->qoutput);
+  while ((node = log_queue_mpsc_take_from_ring(self)) != NULL)
+    log_queue_mpsc_free_node(node);
+  log_queue_mpsc_free_queue(&self->qbacklog);
+  log_queue_free_method(s);
+}
+
+LogQueue *
+log_queue_mpsc_new(gint qoverflow_size, const gchar *persist_name)
+{
+  LogQueueMpsc *self;
+  guint32 ring_size = 2;
+  guint32 i;
+
+  while ((gint) ring_size < qoverflow_size && ring_size < (1U << 30))
+    ring_size <<= 1;
+
+  self = g_malloc0(sizeof(LogQueueMpsc) + ring_size * sizeof(self->ring[0]));
+
+  log_queue_init_instance(&self->super, persist_name);
+  self->super.use_backlog = FALSE;
+  self->super.get_length = log_queue_mpsc_get_length;
+  self->super.keep_on_reload = log_queue_mpsc_keep_on_reload;
+  self->super.push_tail = log_queue_mpsc_push_tail;
+  self->super.push_head = log_queue_mpsc_push_head;
+  self->super.pop_head = log_queue_mpsc_pop_head;
+  self->super.ack_backlog = log_queue_mpsc_ack_backlog;
+  self->super.rewind_backlog = log_queue_mpsc_rewind_backlog;
+  self->super.rewind_backlog_all = log_queue_mpsc_rewind_backlog_all;
+
+  self->super.free_fn = log_queue_mpsc_free;
+
+  for (i = 0; i < ring_size; i++)
+    self->ring[i].sequence = i;
+  self->ring_mask = ring_size - 1;
+  g_atomic_counter_set(&self->ring_len, 0);
+  INIT_IV_LIST_HEAD(&self->qoutput);
+  INIT_IV_LIST_HEAD(&self->qbacklog);
+
+  self->qoverflow_size = qoverflow_size;
+  return &self->super;
+}
@@ -42,7 +42,8 @@ gint log_queue_max_threads = 0;
 void
 log_queue_push_notify(LogQueue *self)
 {
-  if (self->parallel_push_notify)
+  if (self->parallel_push_notify &&
+      log_queue_get_length(self) >= self->parallel_push_notify_limit)
     {
       /* make sure the callback can call log_queue_check_items() again */
       GDestroyNotify destroy = self->parallel_push_data_destroy;
@@ -69,6 +70,7 @@ log_queue_reset_parallel_push(LogQueue *self)
   g_static_mutex_lock(&self->lock);
   self->parallel_push_notify = NULL;
   self->parallel_push_data = NULL;
+  self->parallel_push_notify_limit = 0;
   g_static_mutex_unlock(&self->lock);
 }
 
@@ -79,6 +81,7 @@ log_queue_set_parallel_push(LogQueue *self, LogQueuePushNotifyFunc parallel_push
   self->parallel_push_notify = parallel_push_notify;
   self->parallel_push_data = user_data;
   self->parallel_push_data_destroy = user_data_destroy;
+  self->parallel_push_notify_limit = 0;
   g_static_mutex_unlock(&self->lock);
 }
 
@@ -105,6 +108,7 @@ log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc para
       self->parallel_push_notify = parallel_push_notify;
       self->parallel_push_data = user_data;
       self->parallel_push_data_destroy = user_data_destroy;
+      self->parallel_push_notify_limit = 0;
       g_static_mutex_unlock(&self->lock);
       return FALSE;
     }
@@ -167,6 +171,44 @@ log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc para
   return TRUE;
 }
 
+/*
+ * Sets up @parallel_push_notify to be called once the queue holds at least
+ * @min_items elements, unless that is already the case, which is indicated
+ * by returning TRUE.  Used by consumers that prefer to wait for a batch,
+ * but don't want to depend on a timer alone to notice that the batch is
+ * complete.
+ */
+gboolean
+log_queue_notify_on_length(LogQueue *self, gint min_items, LogQueuePushNotifyFunc parallel_push_notify, gpointer user_data, GDestroyNotify user_data_destroy)
+{
+  g_static_mutex_lock(&self->lock);
+
+  if (self->parallel_push_data && self->parallel_push_data_destroy)
+    self->parallel_push_data_destroy(self->parallel_push_data);
+
+  self->parallel_push_notify = parallel_push_notify;
+  self->parallel_push_data = user_data;
+  self->parallel_push_data_destroy = user_data_destroy;
+  self->parallel_push_notify_limit = min_items;
+
+  /* checked after publishing the callback, so a producer either sees it or
+   * its element is already counted here */
+  if (log_queue_get_length(self) < min_items)
+    {
+      g_static_mutex_unlock(&self->lock);
+      return FALSE;
+    }
+
+  if (user_data && user_data_destroy)
+    user_data_destroy(user_data);
+  self->parallel_push_notify = NULL;
+  self->parallel_push_data = NULL;
+  self->parallel_push_data_destroy = NULL;
+  self->parallel_push_notify_limit = 0;
+  g_static_mutex_unlock(&self->lock);
+  return TRUE;
+}
+
 void
 log_queue_set_counters(LogQueue *self, StatsCounterItem *stored_messages, StatsCounterItem *dropped_messages)
 {
@@ -175,6 +217,12 @@ log_queue_set_counters(LogQueue *self, StatsCounterItem *stored_messages, StatsC
   stats_counter_set(self->stored_messages, log_queue_get_length(self));
 }
 
+void
+log_queue_set_latency_histogram(LogQueue *self, StatsHistogram *queue_latency)
+{
+  self->queue_latency = queue_latency;
+}
+
 void
 log_queue_init_instance(LogQueue *self, const gchar *persist_name)
 {
@@ -27,6 +27,7 @@
 
 #include "logmsg.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 
 extern gint log_queue_max_threads;
 
@@ -48,11 +49,14 @@ struct _LogQueue
   gchar *persist_name;
   StatsCounterItem *stored_messages;
   StatsCounterItem *dropped_messages;
+  StatsHistogram *queue_latency;
 
   GStaticMutex lock;
   LogQueuePushNotifyFunc parallel_push_notify;
   gpointer parallel_push_data;
   GDestroyNotify parallel_push_data_destroy;
+  /* parallel_push_notify is only called once the queue has this many elements */
+  gint parallel_push_notify_limit;
 
   /* queue management */
   gboolean (*keep_on_reload)(LogQueue *self);
@@ -68,6 +72,31 @@ struct _LogQueue
   void (*free_fn)(LogQueue *self);
 };
 
+/*
+ * Queue latency accounting, used by the queue implementations: the push
+ * time is stored in the node and the time spent in the queue is recorded
+ * when the node is popped.  Only done when a histogram is set, so it costs
+ * nothing unless stats-latency() is enabled.
+ */
+static inline void
+log_queue_stamp_node(LogQueue *self, LogMessageQueueNode *node)
+{
+  if (self->queue_latency)
+    node->enqueue_stamp = (guint32) stats_histogram_get_monotonic_usec() | 1;
+}
+
+static inline void
+log_queue_record_node_latency(LogQueue *self, LogMessageQueueNode *node)
+{
+  if (self->queue_latency && node->enqueue_stamp)
+    {
+      /* unsigned arithmetic takes care of wrap-arounds of the 32 bit stamp */
+      stats_histogram_record(self->queue_latency,
+                             (guint32) ((guint32) stats_histogram_get_monotonic_usec() - node->enqueue_stamp));
+      node->enqueue_stamp = 0;
+    }
+}
+
 static inline gboolean
 log_queue_keep_on_reload(LogQueue *self)
 {
@@ -192,7 +221,9 @@ void log_queue_push_notify(LogQueue *self);
 void log_queue_reset_parallel_push(LogQueue *self);
 void log_queue_set_parallel_push(LogQueue *self, LogQueuePushNotifyFunc parallel_push_notify, gpointer user_data, GDestroyNotify user_data_destroy);
 gboolean log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc parallel_push_notify, gpointer user_data, GDestroyNotify user_data_destroy);
+gboolean log_queue_notify_on_length(LogQueue *self, gint min_items, LogQueuePushNotifyFunc parallel_push_notify, gpointer user_data, GDestroyNotify user_data_destroy);
 void log_queue_set_counters(LogQueue *self, StatsCounterItem *stored_messages, StatsCounterItem *dropped_messages);
+void log_queue_set_latency_histogram(LogQueue *self, StatsHistogram *queue_latency);
 void log_queue_init_instance(LogQueue *self, const gchar *persist_name);
 void log_queue_free_method(LogQueue *self);
 
@@ -129,15 +129,83 @@ __disconnect(LogThrDestDriver *self)
 
 
 
+/* puts back messages queued by worker.insert() but not yet flushed, they
+ * are the last ones on the backlog except for messages already rewound */
+static void
+_rewind_batch(LogThrDestDriver *self)
+{
+  log_queue_rewind_backlog(self->queue, self->batch_size);
+  self->batch_size = 0;
+}
+
 static void
 _disconnect_and_suspend(LogThrDestDriver *self)
 {
   self->suspended = TRUE;
   __disconnect(self);
+  _rewind_batch(self);
   log_queue_reset_parallel_push(self->queue);
   log_threaded_dest_driver_suspend(self);
 }
 
+static void
+_accept_batch(LogThrDestDriver *self)
+{
+  self->retries.counter = 0;
+  log_queue_ack_backlog(self->queue, self->batch_size);
+  self->batch_size = 0;
+}
+
+static void
+_drop_batch(LogThrDestDriver *self)
+{
+  stats_counter_add(self->dropped_messages, self->batch_size);
+  _accept_batch(self);
+}
+
+static void
+log_threaded_dest_driver_flush(LogThrDestDriver *self)
+{
+  worker_insert_result_t result;
+
+  if (self->batch_size == 0)
+    return;
+
+  result = self->worker.flush(self);
+  switch (result)
+    {
+    case WORKER_INSERT_RESULT_DROP:
+      _drop_batch(self);
+      _disconnect_and_suspend(self);
+      break;
+
+    case WORKER_INSERT_RESULT_ERROR:
+      self->retries.counter++;
+
+      if (self->retries.counter >= self->retries.max)
+        _drop_batch(self);
+      else
+        _disconnect_and_suspend(self);
+      break;
+
+    case WORKER_INSERT_RESULT_NOT_CONNECTED:
+      _disconnect_and_suspend(self);
+      break;
+
+    case WORKER_INSERT_RESULT_REWIND:
+      _rewind_batch(self);
+      break;
+
+    case WORKER_INSERT_RESULT_SUCCESS:
+      _accept_batch(self);
+      break;
+
+    default:
+      g_assert_not_reached();
+      break;
+    }
+}
+
 static void
 log_threaded_dest_driver_do_insert(LogThrDestDriver *self)
 {
@@ -189,13 +257,25 @@ log_threaded_dest_driver_do_insert(LogThrDestDriver *self)
           log_threaded_dest_driver_message_accept(self, msg);
           break;
 
+        case WORKER_INSERT_RESULT_QUEUED:
+          /* the message stays on the backlog until the batch is flushed */
+          self->batch_size++;
+          step_sequence_number(&self->seq_num);
+          log_msg_unref(msg);
+          break;
+
         default:
           break;
         }
 
       msg_set_context(NULL);
       log_msg_refcache_stop();
+
+      if (self->batch_lines > 0 && self->batch_size >= self->batch_lines)
+        log_threaded_dest_driver_flush(self);
     }
+  if (!self->suspended)
+    log_threaded_dest_driver_flush(self);
   if (!self->suspended)
     {
       if (self->worker.worker_message_queue_empty)
@@ -473,3 +553,11 @@ log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries)
 
   self->retries.max = max_retries;
 }
+
+void
+log_threaded_dest_driver_set_batch_lines(LogDriver *s, gint batch_lines)
+{
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->batch_lines = batch_lines;
+}
@@ -39,7 +39,9 @@ typedef enum
   WORKER_INSERT_RESULT_ERROR,
   WORKER_INSERT_RESULT_REWIND,
   WORKER_INSERT_RESULT_SUCCESS,
-  WORKER_INSERT_RESULT_NOT_CONNECTED
+  WORKER_INSERT_RESULT_NOT_CONNECTED,
+  /* the message was added to a batch, its fate is decided by worker.flush() */
+  WORKER_INSERT_RESULT_QUEUED
 } worker_insert_result_t;
 
 typedef struct _LogThrDestDriver LogThrDestDriver;
@@ -63,6 +65,8 @@ struct _LogThrDestDriver
     void (*thread_init) (LogThrDestDriver *s);
     void (*thread_deinit) (LogThrDestDriver *s);
     worker_insert_result_t (*insert) (LogThrDestDriver *s, LogMessage *msg);
+    /* sends out messages batched by insert(), mandatory if insert() can return QUEUED */
+    worker_insert_result_t (*flush) (LogThrDestDriver *s);
     gboolean (*connect) (LogThrDestDriver *s);
     void (*worker_message_queue_empty)(LogThrDestDriver *s);
     void (*disconnect) (LogThrDestDriver *s);
@@ -87,6 +91,11 @@ struct _LogThrDestDriver
     gint max;
   } retries;
 
+  /* number of messages inserted with the QUEUED result and not yet flushed */
+  gint batch_size;
+  /* flush once this many messages are queued, 0 means flush when the queue becomes empty */
+  gint batch_lines;
+
   void (*queue_method) (LogThrDestDriver *s);
   WorkerOptions worker_options;
   struct iv_event wake_up_event;
@@ -112,5 +121,6 @@ void log_threaded_dest_driver_message_rewind(LogThrDestDriver *self,
                                              LogMessage *msg);
 
 void log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries);
+void log_threaded_dest_driver_set_batch_lines(LogDriver *s, gint batch_lines);
 
 #endif
@@ -25,6 +25,7 @@
 #include "logwriter.h"
 #include "messages.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 #include "hostname.h"
 #include "host-resolve.h"
 #include "misc.h"
@@ -33,6 +34,7 @@
 #include "mainloop-call.h"
 #include "ml-batched-timer.h"
 #include "str-format.h"
+#include "timeutils.h"
 
 #include <unistd.h>
 #include <assert.h>
@@ -64,6 +66,10 @@ struct _LogWriter
   StatsCounterItem *suppressed_messages;
   StatsCounterItem *processed_messages;
   StatsCounterItem *stored_messages;
+  StatsCounterItem *batch_size;
+  StatsHistogram *queue_latency;
+  StatsHistogram *write_latency;
+  StatsHistogram *end_to_end_latency;
   LogPipe *control;
   LogWriterOptions *options;
   LogMessage *last_msg;
@@ -86,6 +92,8 @@ struct _LogWriter
   struct iv_timer reopen_timer;
   gboolean work_result;
   gint pollable_state;
+  gint flush_batch;
+  guint flush_count;
   LogProtoClient *proto, *pending_proto;
   gboolean watches_running:1, suspended:1, working:1, waiting_for_throttle:1;
   gboolean pending_proto_present;
@@ -114,6 +122,19 @@ struct _LogWriter
  * usual GQueue and messages get acknowledged when they are moved to the
  * disk buffer.
  *
+ * Adaptive flushing
+ * -----------------
+ * With the adaptive-flush flag, LogWriter waits until flush_batch messages
+ * accumulate in the queue (or flush_timeout elapses) before starting a
+ * flush.  flush_batch is tuned using AIMD: it is increased by one whenever
+ * a flush finds at least flush_batch messages to write, and halved when
+ * the queue drained before reaching it or when the flush itself took
+ * longer than flush_timeout (measured on every 16th flush only).  While
+ * waiting, the queue notifies LogWriter as soon as flush_batch messages
+ * are queued, flush_timeout only bounds the wait when traffic is low.  It is kept between 1 and flush_lines, so an
+ * idle destination sends each message right away, while a busy one
+ * converges to large batches.
+ *
  **/
 
 static gboolean log_writer_flush(LogWriter *self, LogWriterFlushMode flush_mode);
@@ -420,6 +441,28 @@ log_writer_suspend(LogWriter *self)
   self->suspended = TRUE;
 }
 
+/*
+ * In adaptive-flush mode, returns TRUE if fewer than flush_batch messages
+ * are queued, in which case @timeout_msec is set to the time we are
+ * willing to wait for the batch to fill up.  The queue wakes us up
+ * earlier, as soon as the batch is complete.
+ */
+static gboolean
+log_writer_wait_for_batch(LogWriter *self, gint *timeout_msec)
+{
+  if ((self->options->options & LWO_ADAPTIVE_FLUSH) == 0 ||
+      self->options->flush_timeout <= 0 ||
+      self->flush_batch <= 1)
+    return FALSE;
+
+  if (log_queue_notify_on_length(self->queue, self->flush_batch,
+                                 (LogQueuePushNotifyFunc) log_writer_schedule_update_watches, self, NULL))
+    return FALSE;
+
+  *timeout_msec = self->options->flush_timeout;
+  return TRUE;
+}
+
 static void
 log_writer_update_watches(LogWriter *self)
 {
@@ -433,15 +476,24 @@ log_writer_update_watches(LogWriter *self)
 
   if (log_proto_client_prepare(self->proto, &fd, &cond) ||
       self->waiting_for_throttle ||
-      log_queue_check_items(self->queue, &timeout_msec,
-                            (LogQueuePushNotifyFunc) log_writer_schedule_update_watches, self, NULL))
+      (log_queue_check_items(self->queue, &timeout_msec,
+                             (LogQueuePushNotifyFunc) log_writer_schedule_update_watches, self, NULL) &&
+       !log_writer_wait_for_batch(self, &timeout_msec)))
     {
       /* flush_lines number of element is already available and throttle would permit us to send. */
+      if (iv_timer_registered(&self->suspend_timer) &&
+          self->suspend_timer.handler == (void (*)(void *)) log_writer_update_watches)
+        {
+          /* woken up by the queue before the batch timer expired */
+          iv_timer_unregister(&self->suspend_timer);
+        }
       log_writer_update_fd_callbacks(self, cond);
     }
   else if (timeout_msec)
     {
-      /* few elements are available, but less than flush_lines, we need to start a timer to initiate a flush */
+      /* few elements are available, but less than flush_lines (or
+       * flush_batch in adaptive-flush mode), we need to start a timer to
+       * initiate a flush */
 
       log_writer_update_fd_callbacks(self, 0);
       self->waiting_for_throttle = TRUE;
@@ -1019,6 +1071,19 @@ log_writer_flush_finalize(LogWriter *self)
   return TRUE;
 }
 
+/* time between receiving the message and handing it over to the transport */
+static void
+log_writer_record_end_to_end_latency(LogWriter *self, LogMessage *msg)
+{
+  GTimeVal now;
+  gint64 diff;
+
+  g_get_current_time(&now);
+  diff = ((gint64) now.tv_sec - msg->timestamps[LM_TS_RECVD].tv_sec) * G_USEC_PER_SEC +
+         (now.tv_usec - (gint64) msg->timestamps[LM_TS_RECVD].tv_usec);
+  stats_histogram_record(self->end_to_end_latency, MAX(diff, 0));
+}
+
 gboolean
 log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_options, gboolean *write_error)
 {
@@ -1075,6 +1140,9 @@ log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_
       if (msg->flags & LF_LOCAL)
         step_sequence_number(&self->seq_num);
 
+      if (self->end_to_end_latency)
+        log_writer_record_end_to_end_latency(self, msg);
+
       log_msg_unref(msg);
       msg_set_context(NULL);
       log_msg_refcache_stop();
@@ -1115,14 +1183,50 @@ log_writer_queue_pop_message(LogWriter *self, LogPathOptions *path_options, gboo
  * LW_FLUSH_FORCE     - flush the buffer immediately please
  *
  */
+static void
+log_writer_adjust_flush_batch(LogWriter *self, gint msg_count, gboolean drained, glong elapsed_msec)
+{
+  gint max_batch = MAX(self->options->flush_lines, 1);
+
+  if (elapsed_msec > self->options->flush_timeout ||
+      (drained && msg_count < self->flush_batch))
+    {
+      /* the destination is slow or the load went away: back off */
+      self->flush_batch = MAX(self->flush_batch / 2, 1);
+    }
+  else if (msg_count >= self->flush_batch && self->flush_batch < max_batch)
+    {
+      self->flush_batch++;
+    }
+  else if (self->flush_batch > max_batch)
+    {
+      self->flush_batch = max_batch;
+    }
+  stats_counter_set(self->batch_size, self->flush_batch);
+}
+
+/* adaptive flushing only looks at the duration of every Nth flush */
+#define LOG_WRITER_FLUSH_TIMING_SAMPLE 16
+
 gboolean
 log_writer_flush(LogWriter *self, LogWriterFlushMode flush_mode)
 {
   gboolean write_error = FALSE;
+  gboolean drained = FALSE;
+  gboolean adaptive = (self->options->options & LWO_ADAPTIVE_FLUSH) && flush_mode == LW_FLUSH_NORMAL;
+  gboolean timed;
+  gint msg_count = 0;
+  glong elapsed_nsec = 0;
+  struct timespec start, stop;
 
   if (!self->proto)
     return FALSE;
 
+  timed = self->write_latency ||
+          (adaptive && (self->flush_count++ % LOG_WRITER_FLUSH_TIMING_SAMPLE) == 0);
+  if (timed)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
   /* NOTE: in case we're reloading or exiting we flush all queued items as
    * long as the destination can consume it.  This is not going to be an
    * infinite loop, since the reader will cease to produce new messages when
@@ -1134,16 +1238,32 @@ log_writer_flush(LogWriter *self, LogWriterFlushMode flush_mode)
       LogMessage *msg = log_writer_queue_pop_message(self, &path_options, flush_mode == LW_FLUSH_FORCE);
 
       if (!msg)
-        break;
+        {
+          drained = TRUE;
+          break;
+        }
 
       if (!log_writer_write_message(self, msg, &path_options, &write_error))
         break;
+      msg_count++;
     }
 
   if (write_error)
     return FALSE;
 
-  return log_writer_flush_finalize(self);
+  if (!log_writer_flush_finalize(self))
+    return FALSE;
+
+  if (timed)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      elapsed_nsec = timespec_diff_nsec(&stop, &start);
+      if (self->write_latency && msg_count > 0)
+        stats_histogram_record(self->write_latency, elapsed_nsec / 1000);
+    }
+  if (adaptive)
+    log_writer_adjust_flush_batch(self, msg_count, drained, elapsed_nsec / 1000000);
+  return TRUE;
 }
 
 static void
@@ -1213,9 +1333,22 @@ log_writer_init(LogPipe *s)
       stats_register_counter(self->stats_level, self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_PROCESSED, &self->processed_messages);
       
       stats_register_counter(self->stats_level, self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_STORED, &self->stored_messages);
+      if (self->options->options & LWO_ADAPTIVE_FLUSH)
+        stats_register_counter(self->stats_level, self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_BATCH_SIZE, &self->batch_size);
       stats_unlock();
     }
+  if ((self->options->options & LWO_NO_STATS) == 0 && stats_check_latency() && !self->queue_latency)
+    {
+      self->queue_latency = stats_histogram_register(self->stats_id, self->stats_instance, "queue_wait");
+      self->write_latency = stats_histogram_register(self->stats_id, self->stats_instance, "flush");
+      self->end_to_end_latency = stats_histogram_register(self->stats_id, self->stats_instance, "end_to_end");
+    }
   log_queue_set_counters(self->queue, self->stored_messages, self->dropped_messages);
+  log_queue_set_latency_histogram(self->queue, self->queue_latency);
+
+  self->flush_batch = 1;
+  stats_counter_set(self->batch_size, self->flush_batch);
+
   if (self->proto)
     {
       LogProtoClient *proto;
@@ -1256,12 +1389,18 @@ log_writer_deinit(LogPipe *s)
   ml_batched_timer_unregister(&self->mark_timer);
 
   log_queue_set_counters(self->queue, NULL, NULL);
+  log_queue_set_latency_histogram(self->queue, NULL);
+
+  stats_histogram_unregister(&self->queue_latency);
+  stats_histogram_unregister(&self->write_latency);
+  stats_histogram_unregister(&self->end_to_end_latency);
 
   stats_lock();
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_DROPPED, &self->dropped_messages);
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_SUPPRESSED, &self->suppressed_messages);
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_PROCESSED, &self->processed_messages);
   stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_STORED, &self->stored_messages);
+  stats_unregister_counter(self->stats_source | SCS_DESTINATION, self->stats_id, self->stats_instance, SC_TYPE_BATCH_SIZE, &self->batch_size);
   stats_unlock();
   
   return TRUE;
@@ -1586,6 +1725,8 @@ log_writer_options_lookup_flag(const gchar *flag)
     return LWO_THREADED;
   if (strcmp(flag, "ignore-errors") == 0 || strcmp(flag, "ignore_errors") == 0)
     return LWO_IGNORE_ERRORS;
+  if (strcmp(flag, "adaptive-flush") == 0 || strcmp(flag, "adaptive_flush") == 0)
+    return LWO_ADAPTIVE_FLUSH;
   msg_error("Unknown dest writer flag", evt_tag_str("flag", flag), NULL);
   return 0;
 }
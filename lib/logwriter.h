@@ -47,6 +47,8 @@
 #define LWO_SHARE_STATS     0x0008
 #define LWO_THREADED        0x0010
 #define LWO_IGNORE_ERRORS   0x0020
+/* tune the flush batch size between 1 and flush_lines based on load */
+#define LWO_ADAPTIVE_FLUSH  0x0040
 
 typedef struct _LogWriterOptions
 {
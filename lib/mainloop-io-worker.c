@@ -25,32 +25,206 @@
 #include "mainloop-worker.h"
 #include "mainloop-call.h"
 #include "logqueue.h"
+#include "stats/stats-registry.h"
+#include "timeutils.h"
+
+#include <iv_event.h>
+#include <time.h>
 
 /************************************************************************************
  * I/O worker threads
+ *
+ * I/O jobs are executed by a fixed set of worker threads.  Each worker has
+ * its own job queue protected by its own lock, so unrelated connections
+ * don't contend on a single pool-wide queue.
+ *
+ * A job is always submitted to the worker that executed it the last time
+ * (round-robin for jobs that have never run), so the state of a
+ * LogReader/LogWriter stays in the caches of the same CPU.  A worker that
+ * runs out of work of its own steals a job from the tail of another
+ * worker's queue, in which case the job also sticks to its new worker.
+ * Stealing only happens when a worker would otherwise go to sleep.
+ *
+ * Completions are delivered to the main thread via an iv_event, in the
+ * order jobs were finished.
  ************************************************************************************/
 
-static struct iv_work_pool main_loop_io_workers;
+typedef struct _MainLoopIOWorker
+{
+  gint index;
+  GThread *thread;
+
+  /* protects the fields below, up to the stats counters */
+  GStaticMutex lock;
+  GCond *cond;
+  struct iv_list_head jobs;
+  gint num_jobs;
+  gboolean idle:1, wakeup_pending:1;
+
+  StatsCounterItem *processed_jobs;
+  StatsCounterItem *stolen_jobs;
+  StatsCounterItem *busy_msec;
+  /* remainder not yet added to busy_msec, only used by the worker thread */
+  glong busy_nsec;
+} MainLoopIOWorker;
+
+static struct
+{
+  gint max_threads;
+  gint num_workers;
+  MainLoopIOWorker *workers;
+
+  /* round-robin for jobs without affinity, only used by the main thread */
+  gint next_worker;
+  volatile gboolean quit;
+
+  GStaticMutex completion_lock;
+  struct iv_list_head completed_jobs;
+  struct iv_event completion_event;
+} main_loop_io_workers;
+
+static void
+_wake_up_worker(MainLoopIOWorker *worker)
+{
+  worker->wakeup_pending = TRUE;
+  g_cond_signal(worker->cond);
+}
+
+/* NOTE: runs in the main thread, the target worker is busy, try to find
+ * an idle one that would steal the job */
+static void
+_wake_up_idle_worker(MainLoopIOWorker *busy_worker)
+{
+  gint i;
+
+  for (i = 1; i < main_loop_io_workers.num_workers; i++)
+    {
+      MainLoopIOWorker *worker = &main_loop_io_workers.workers[(busy_worker->index + i) % main_loop_io_workers.num_workers];
+      gboolean found;
+
+      g_static_mutex_lock(&worker->lock);
+      found = worker->idle;
+      if (found)
+        _wake_up_worker(worker);
+      g_static_mutex_unlock(&worker->lock);
+
+      if (found)
+        break;
+    }
+}
+
+static MainLoopIOWorker *
+_select_worker(MainLoopIOWorkerJob *self)
+{
+  if (self->worker < 0 || self->worker >= main_loop_io_workers.num_workers)
+    {
+      self->worker = main_loop_io_workers.next_worker;
+      main_loop_io_workers.next_worker = (main_loop_io_workers.next_worker + 1) % main_loop_io_workers.num_workers;
+    }
+  return &main_loop_io_workers.workers[self->worker];
+}
 
 /* NOTE: runs in the main thread */
 void
 main_loop_io_worker_job_submit(MainLoopIOWorkerJob *self)
 {
+  MainLoopIOWorker *worker;
+  gboolean worker_idle;
+
   g_assert(self->working == FALSE);
   if (main_loop_workers_quit)
     return;
   main_loop_worker_job_start();
   self->working = TRUE;
-  iv_work_pool_submit_work(&main_loop_io_workers, &self->work_item);
+
+  worker = _select_worker(self);
+
+  g_static_mutex_lock(&worker->lock);
+  iv_list_add_tail(&self->list, &worker->jobs);
+  worker->num_jobs++;
+  worker_idle = worker->idle;
+  _wake_up_worker(worker);
+  g_static_mutex_unlock(&worker->lock);
+
+  if (!worker_idle)
+    _wake_up_idle_worker(worker);
+}
+
+/* NOTE: must be called with worker->lock held */
+static MainLoopIOWorkerJob *
+_pop_job(MainLoopIOWorker *worker, gboolean from_tail)
+{
+  MainLoopIOWorkerJob *job;
+
+  if (worker->num_jobs == 0)
+    return NULL;
+
+  if (from_tail)
+    job = iv_list_entry(worker->jobs.prev, MainLoopIOWorkerJob, list);
+  else
+    job = iv_list_entry(worker->jobs.next, MainLoopIOWorkerJob, list);
+  iv_list_del_init(&job->list);
+  worker->num_jobs--;
+  return job;
+}
+
+/* NOTE: runs in the worker thread, without holding self->lock */
+static MainLoopIOWorkerJob *
+_steal_job(MainLoopIOWorker *self)
+{
+  gint i;
+
+  for (i = 1; i < main_loop_io_workers.num_workers; i++)
+    {
+      MainLoopIOWorker *victim = &main_loop_io_workers.workers[(self->index + i) % main_loop_io_workers.num_workers];
+      MainLoopIOWorkerJob *job;
+
+      g_static_mutex_lock(&victim->lock);
+      job = _pop_job(victim, TRUE);
+      g_static_mutex_unlock(&victim->lock);
+
+      if (job)
+        {
+          stats_counter_inc(self->stolen_jobs);
+          return job;
+        }
+    }
+  return NULL;
+}
+
+/* NOTE: runs in the worker thread */
+static void
+_complete_job_later(MainLoopIOWorkerJob *job)
+{
+  g_static_mutex_lock(&main_loop_io_workers.completion_lock);
+  iv_list_add_tail(&job->list, &main_loop_io_workers.completed_jobs);
+  g_static_mutex_unlock(&main_loop_io_workers.completion_lock);
+
+  iv_event_post(&main_loop_io_workers.completion_event);
 }
 
-/* NOTE: runs in the actual worker thread spawned by the
- * main_loop_io_workers thread pool */
+/* NOTE: runs in the worker thread */
 static void
-_work(MainLoopIOWorkerJob *self)
+_work(MainLoopIOWorker *worker, MainLoopIOWorkerJob *self)
 {
+  struct timespec start, stop;
+
+  self->worker = worker->index;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
   self->work(self->user_data);
   main_loop_worker_invoke_batch_callbacks();
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  stats_counter_inc(worker->processed_jobs);
+  worker->busy_nsec += timespec_diff_nsec(&stop, &start);
+  if (worker->busy_nsec >= 1000000)
+    {
+      stats_counter_add(worker->busy_msec, worker->busy_nsec / 1000000);
+      worker->busy_nsec %= 1000000;
+    }
+
+  _complete_job_later(self);
 }
 
 /* NOTE: runs in the main thread */
@@ -62,13 +236,80 @@ _complete(MainLoopIOWorkerJob *self)
   main_loop_worker_job_complete();
 }
 
+/* NOTE: runs in the main thread */
+static void
+_deliver_completions(gpointer s)
+{
+  struct iv_list_head completed, *lh, *lh2;
+
+  INIT_IV_LIST_HEAD(&completed);
+  g_static_mutex_lock(&main_loop_io_workers.completion_lock);
+  iv_list_splice_tail_init(&main_loop_io_workers.completed_jobs, &completed);
+  g_static_mutex_unlock(&main_loop_io_workers.completion_lock);
+
+  iv_list_for_each_safe(lh, lh2, &completed)
+    {
+      MainLoopIOWorkerJob *job = iv_list_entry(lh, MainLoopIOWorkerJob, list);
+
+      /* the completion callback may submit the job again */
+      iv_list_del_init(&job->list);
+      _complete(job);
+    }
+}
+
+static gpointer
+_worker_thread(gpointer s)
+{
+  MainLoopIOWorker *self = (MainLoopIOWorker *) s;
+  MainLoopIOWorkerJob *job;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  g_static_mutex_lock(&self->lock);
+  while (1)
+    {
+      job = _pop_job(self, FALSE);
+      if (!job)
+        {
+          if (main_loop_io_workers.quit)
+            break;
+
+          /* out of work: advertise that we are idle, so that the main
+           * thread wakes us up when another worker has a backlog, then try
+           * to steal something before going to sleep */
+
+          self->idle = TRUE;
+          self->wakeup_pending = FALSE;
+          g_static_mutex_unlock(&self->lock);
+
+          job = _steal_job(self);
+
+          g_static_mutex_lock(&self->lock);
+          if (!job && self->num_jobs == 0 && !self->wakeup_pending && !main_loop_io_workers.quit)
+            g_cond_wait(self->cond, g_static_mutex_get_mutex(&self->lock));
+          self->idle = FALSE;
+          if (!job)
+            continue;
+        }
+      g_static_mutex_unlock(&self->lock);
+
+      _work(self, job);
+
+      g_static_mutex_lock(&self->lock);
+    }
+  g_static_mutex_unlock(&self->lock);
+
+  main_loop_worker_thread_stop();
+  iv_deinit();
+  return NULL;
+}
+
 void
 main_loop_io_worker_job_init(MainLoopIOWorkerJob *self)
 {
-  IV_WORK_ITEM_INIT(&self->work_item);
-  self->work_item.cookie = self;
-  self->work_item.work = (void (*)(void *)) _work;
-  self->work_item.completion = (void (*)(void *)) _complete;
+  INIT_IV_LIST_HEAD(&self->list);
+  self->worker = -1;
 }
 
 static gint
@@ -81,25 +322,109 @@ get_processor_count(void)
 #endif
 }
 
+static void
+_register_worker_counters(MainLoopIOWorker *worker)
+{
+  gchar instance[16];
+
+  g_snprintf(instance, sizeof(instance), "%d", worker->index);
+  stats_register_counter(0, SCS_GLOBAL, "io_worker_jobs", instance, SC_TYPE_PROCESSED, &worker->processed_jobs);
+  stats_register_counter(0, SCS_GLOBAL, "io_worker_stolen_jobs", instance, SC_TYPE_PROCESSED, &worker->stolen_jobs);
+  stats_register_counter(0, SCS_GLOBAL, "io_worker_busy_msec", instance, SC_TYPE_PROCESSED, &worker->busy_msec);
+}
+
+static void
+_unregister_worker_counters(MainLoopIOWorker *worker)
+{
+  gchar instance[16];
+
+  g_snprintf(instance, sizeof(instance), "%d", worker->index);
+  stats_unregister_counter(SCS_GLOBAL, "io_worker_jobs", instance, SC_TYPE_PROCESSED, &worker->processed_jobs);
+  stats_unregister_counter(SCS_GLOBAL, "io_worker_stolen_jobs", instance, SC_TYPE_PROCESSED, &worker->stolen_jobs);
+  stats_unregister_counter(SCS_GLOBAL, "io_worker_busy_msec", instance, SC_TYPE_PROCESSED, &worker->busy_msec);
+}
+
 void
 main_loop_io_worker_init(void)
 {
+  gint i;
+
   if (main_loop_io_workers.max_threads == 0)
     {
       main_loop_io_workers.max_threads = MIN(MAX(MAIN_LOOP_MIN_WORKER_THREADS, get_processor_count()), MAIN_LOOP_MAX_WORKER_THREADS);
     }
+  main_loop_io_workers.num_workers = MIN(main_loop_io_workers.max_threads, MAIN_LOOP_MAX_WORKER_THREADS);
+  main_loop_io_workers.next_worker = 0;
+  main_loop_io_workers.quit = FALSE;
+
+  g_static_mutex_init(&main_loop_io_workers.completion_lock);
+  INIT_IV_LIST_HEAD(&main_loop_io_workers.completed_jobs);
+  IV_EVENT_INIT(&main_loop_io_workers.completion_event);
+  main_loop_io_workers.completion_event.handler = _deliver_completions;
+  iv_event_register(&main_loop_io_workers.completion_event);
+
+  main_loop_io_workers.workers = g_new0(MainLoopIOWorker, main_loop_io_workers.num_workers);
+
+  stats_lock();
+  for (i = 0; i < main_loop_io_workers.num_workers; i++)
+    {
+      MainLoopIOWorker *worker = &main_loop_io_workers.workers[i];
+
+      worker->index = i;
+      g_static_mutex_init(&worker->lock);
+      worker->cond = g_cond_new();
+      INIT_IV_LIST_HEAD(&worker->jobs);
+      _register_worker_counters(worker);
+    }
+  stats_unlock();
 
-  main_loop_io_workers.thread_start = (void (*)(void *)) main_loop_worker_thread_start;
-  main_loop_io_workers.thread_stop = (void (*)(void *)) main_loop_worker_thread_stop;
-  iv_work_pool_create(&main_loop_io_workers);
-  
-  log_queue_set_max_threads(MIN(main_loop_io_workers.max_threads, MAIN_LOOP_MAX_WORKER_THREADS));
+  for (i = 0; i < main_loop_io_workers.num_workers; i++)
+    {
+      MainLoopIOWorker *worker = &main_loop_io_workers.workers[i];
+
+      worker->thread = g_thread_create_full(_worker_thread, worker, 1024 * 1024, TRUE, TRUE, G_THREAD_PRIORITY_NORMAL, NULL);
+      g_assert(worker->thread != NULL);
+    }
+
+  log_queue_set_max_threads(main_loop_io_workers.num_workers);
 }
 
 void
 main_loop_io_worker_deinit(void)
 {
-  iv_work_pool_put(&main_loop_io_workers);
+  gint i;
+
+  main_loop_io_workers.quit = TRUE;
+  for (i = 0; i < main_loop_io_workers.num_workers; i++)
+    {
+      MainLoopIOWorker *worker = &main_loop_io_workers.workers[i];
+
+      g_static_mutex_lock(&worker->lock);
+      _wake_up_worker(worker);
+      g_static_mutex_unlock(&worker->lock);
+    }
+
+  /* NOTE: exiting threads take stats_lock() themselves (to release their
+   * dynamic counter cache), so it must not be held while joining them */
+  for (i = 0; i < main_loop_io_workers.num_workers; i++)
+    {
+      MainLoopIOWorker *worker = &main_loop_io_workers.workers[i];
+
+      g_thread_join(worker->thread);
+      g_cond_free(worker->cond);
+      g_static_mutex_free(&worker->lock);
+    }
+
+  stats_lock();
+  for (i = 0; i < main_loop_io_workers.num_workers; i++)
+    _unregister_worker_counters(&main_loop_io_workers.workers[i]);
+  stats_unlock();
+
+  iv_event_unregister(&main_loop_io_workers.completion_event);
+  g_static_mutex_free(&main_loop_io_workers.completion_lock);
+  g_free(main_loop_io_workers.workers);
+  main_loop_io_workers.workers = NULL;
+  main_loop_io_workers.num_workers = 0;
 }
 
 static GOptionEntry main_loop_io_worker_options[] =
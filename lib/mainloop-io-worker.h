@@ -26,7 +26,7 @@
 
 #include "mainloop-worker.h"
 
-#include <iv_work.h>
+#include <iv_list.h>
 
 typedef struct _MainLoopIOWorkerJob
 {
@@ -34,7 +34,11 @@ typedef struct _MainLoopIOWorkerJob
   void (*completion)(gpointer user_data);
   gpointer user_data;
   gboolean working:1;
-  struct iv_work_item work_item;
+
+  /* private, used by the worker pool */
+  struct iv_list_head list;
+  /* the worker that executed this job the last time, -1 if none */
+  gint worker;
 } MainLoopIOWorkerJob;
 
 void main_loop_io_worker_job_init(MainLoopIOWorkerJob *self);
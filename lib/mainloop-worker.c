@@ -25,6 +25,7 @@
 #include "mainloop-call.h"
 #include "tls-support.h"
 #include "apphook.h"
+#include "scratch-buffers.h"
 
 #include <iv.h>
 
@@ -246,6 +247,18 @@ main_loop_worker_job_complete(void)
     }
 }
 
+/*
+ * Returns TRUE if the current thread invokes batch callbacks at the end of
+ * its jobs, e.g. it is safe to call
+ * main_loop_worker_register_batch_callback().  Output threads of threaded
+ * destinations don't.
+ */
+gboolean
+main_loop_worker_is_batching(void)
+{
+  return main_loop_worker_id != 0 && main_loop_worker_type != OUTPUT_THREAD;
+}
+
 /*
  * Register a function to be called back when the current I/O job is
  * finished (in the worker thread).
@@ -267,9 +280,14 @@ main_loop_worker_invoke_batch_callbacks(void)
     {
       WorkerBatchCallback *cb = iv_list_entry(lh, WorkerBatchCallback, list);
 
-      cb->func(cb->user_data);
+      /* unlink first, the callback may make it possible to register the
+       * same WorkerBatchCallback again, possibly in a different thread */
       iv_list_del_init(&cb->list);
+      cb->func(cb->user_data);
     }
+
+  /* the batch is complete, drop the temporaries of its messages */
+  scratch_arena_reset();
 }
 
 typedef struct _WorkerThreadParams
@@ -61,6 +61,7 @@ worker_batch_callback_init(WorkerBatchCallback *self)
   INIT_IV_LIST_HEAD(&self->list);
 }
 
+gboolean main_loop_worker_is_batching(void);
 void main_loop_worker_register_batch_callback(WorkerBatchCallback *cb);
 void main_loop_worker_invoke_batch_callbacks(void);
 
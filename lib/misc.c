@@ -258,6 +258,45 @@ find_cr_or_lf(gchar *s, gsize n)
   return NULL;
 }
 
+/**
+ * Find the first occurrence of any of three characters in @s, the
+ * equivalent of strpbrk() for buffers that are not NUL terminated.
+ *
+ * Processes a word at a time, using the "has zero byte" bit trick on the
+ * input XOR-ed with each of the characters.  Header fields are usually
+ * separated by one of a few delimiters, this is used to find their end.
+ **/
+const gchar *
+find_first_of3(const gchar *s, gsize n, gchar c1, gchar c2, gchar c3)
+{
+  const gchar *end = s + n;
+  gulong ones, highs, mask1, mask2, mask3, longword, x1, x2, x3;
+
+  memset(&ones, 0x01, sizeof(ones));
+  memset(&highs, 0x80, sizeof(highs));
+  memset(&mask1, c1, sizeof(mask1));
+  memset(&mask2, c2, sizeof(mask2));
+  memset(&mask3, c3, sizeof(mask3));
+
+  while (end - s >= sizeof(longword))
+    {
+      memcpy(&longword, s, sizeof(longword));
+      x1 = longword ^ mask1;
+      x2 = longword ^ mask2;
+      x3 = longword ^ mask3;
+      if ((((x1 - ones) & ~x1) | ((x2 - ones) & ~x2) | ((x3 - ones) & ~x3)) & highs)
+        break;
+      s += sizeof(longword);
+    }
+
+  for (; s < end; s++)
+    {
+      if (*s == c1 || *s == c2 || *s == c3)
+        return s;
+    }
+  return NULL;
+}
+
 /*
  * NOTE: pointer values below 0x1000 (4096) are taken as special values used
  * by the application code and are not duplicated, but assumed to be literal
@@ -44,6 +44,7 @@ gboolean resolve_group(const char *group, gint *gid);
 gboolean resolve_user_group(char *arg, gint *uid, gint *gid);
 
 gchar *find_cr_or_lf(gchar *s, gsize n);
+const gchar *find_first_of3(const gchar *s, gsize n, gchar c1, gchar c2, gchar c3);
 
 gchar *find_file_in_path(const gchar *path, const gchar *filename, GFileTest test);
 
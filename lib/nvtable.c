@@ -31,24 +31,136 @@ GStaticMutex nv_registry_lock = G_STATIC_MUTEX_INIT;
 
 const gchar *null_string = "";
 
+/*
+ * Lock-free name lookups
+ *
+ * name_map is the authoritative name -> handle mapping, it is only used
+ * with nv_registry_lock held.  Lookups go through an open addressing hash
+ * index first, which is read without locking:
+ *
+ *   - slots are only ever filled in (or in case of aliases, their handle
+ *     replaced), never removed, a slot becomes visible to readers when its
+ *     name pointer is stored, after its other fields
+ *
+ *   - when the index gets half full, a larger copy is built and swapped
+ *     in.  Readers may still be using the old one, so it is only freed
+ *     together with the registry; the retired copies add up to less than
+ *     the size of the current one.
+ *
+ * Names are never freed while the registry exists, so the index can point
+ * to them directly.  Handle descriptors live in chunks that are allocated
+ * as the handles are, and a handle only becomes visible through the index
+ * after its descriptor is filled in.
+ */
+
+typedef struct _NVRegistryIndexSlot
+{
+  const gchar *name;
+  guint32 hash;
+  NVHandle handle;
+} NVRegistryIndexSlot;
+
+struct _NVRegistryIndex
+{
+  guint32 mask;
+  guint32 count;
+  NVRegistryIndexSlot slots[0];
+};
+
+#define NV_REGISTRY_INDEX_INITIAL_SIZE 256
+
+static NVRegistryIndex *
+nv_registry_index_new(guint32 size)
+{
+  NVRegistryIndex *index = g_malloc0(sizeof(NVRegistryIndex) + size * sizeof(NVRegistryIndexSlot));
+
+  index->mask = size - 1;
+  return index;
+}
+
+static NVRegistryIndexSlot *
+nv_registry_index_find_slot(NVRegistryIndex *index, const gchar *name, guint32 hash)
+{
+  guint32 i;
+
+  for (i = hash & index->mask; ; i = (i + 1) & index->mask)
+    {
+      NVRegistryIndexSlot *slot = &index->slots[i];
+      const gchar *slot_name = g_atomic_pointer_get(&slot->name);
+
+      if (!slot_name || (slot->hash == hash && strcmp(slot_name, name) == 0))
+        return slot;
+    }
+}
+
+static NVHandle
+nv_registry_index_lookup(NVRegistry *self, const gchar *name, guint32 hash)
+{
+  NVRegistryIndex *index = g_atomic_pointer_get(&self->index);
+  NVRegistryIndexSlot *slot = nv_registry_index_find_slot(index, name, hash);
+
+  if (!g_atomic_pointer_get(&slot->name))
+    return 0;
+  return g_atomic_int_get(&slot->handle);
+}
+
+/* must be called with nv_registry_lock held */
+static void
+nv_registry_index_insert(NVRegistry *self, const gchar *name, guint32 hash, NVHandle handle)
+{
+  NVRegistryIndex *index = self->index;
+  NVRegistryIndexSlot *slot;
+
+  slot = nv_registry_index_find_slot(index, name, hash);
+  if (slot->name)
+    {
+      g_atomic_int_set(&slot->handle, handle);
+      return;
+    }
+
+  if ((index->count + 1) * 2 > index->mask + 1)
+    {
+      NVRegistryIndex *new_index = nv_registry_index_new((index->mask + 1) * 2);
+      guint32 i;
+
+      for (i = 0; i <= index->mask; i++)
+        {
+          if (index->slots[i].name)
+            {
+              *nv_registry_index_find_slot(new_index, index->slots[i].name, index->slots[i].hash) = index->slots[i];
+              new_index->count++;
+            }
+        }
+      g_ptr_array_add(self->retired_indexes, index);
+      g_atomic_pointer_set(&self->index, new_index);
+      index = new_index;
+      slot = nv_registry_index_find_slot(index, name, hash);
+    }
+
+  slot->hash = hash;
+  slot->handle = handle;
+  g_atomic_pointer_set(&slot->name, name);
+  index->count++;
+}
+
 NVHandle
 nv_registry_get_handle(NVRegistry *self, const gchar *name)
 {
-  gpointer p;
-
-  p = g_hash_table_lookup(self->name_map, name);
-  if (p)
-    return GPOINTER_TO_UINT(p);
-  return 0;
+  return nv_registry_index_lookup(self, name, g_str_hash(name));
 }
 
 NVHandle
 nv_registry_alloc_handle(NVRegistry *self, const gchar *name)
 {
   gpointer p;
-  NVHandleDesc stored;
+  NVHandleDesc *stored;
   gsize len;
   NVHandle res = 0;
+  guint32 hash = g_str_hash(name);
+
+  res = nv_registry_index_lookup(self, name, hash);
+  if (G_LIKELY(res))
+    return res;
 
   g_static_mutex_lock(&nv_registry_lock);
   p = g_hash_table_lookup(self->name_map, name);
@@ -70,21 +182,24 @@ nv_registry_alloc_handle(NVRegistry *self, const gchar *name)
                 NULL);
       goto exit;
     }
-  else if (self->names->len >= 65535)
+  else if (self->num_names >= NV_REGISTRY_MAX_HANDLES)
     {
       msg_error("Hard wired limit of 65535 name-value pairs have been reached, all further name-value pair will expand to nothing",
                 evt_tag_str("value", name),
                 NULL);
       goto exit;
     }
-  /* flags (2 bytes) || length (1 byte) || name (len bytes) || NUL */
-  /* memory layout: flags || length || name (NUL terminated) */
-  stored.flags = 0;
-  stored.name_len = len;
-  stored.name = g_strdup(name);
-  g_array_append_val(self->names, stored);
-  g_hash_table_insert(self->name_map, stored.name, GUINT_TO_POINTER(self->names->len));
-  res = self->names->len;
+
+  if ((self->num_names & (NV_REGISTRY_CHUNK_SIZE - 1)) == 0)
+    self->name_chunks[self->num_names >> NV_REGISTRY_CHUNK_BITS] = g_new0(NVHandleDesc, NV_REGISTRY_CHUNK_SIZE);
+  res = ++self->num_names;
+
+  stored = nv_registry_get_handle_desc(self, res);
+  stored->flags = 0;
+  stored->name_len = len;
+  stored->name = g_strdup(name);
+  g_hash_table_insert(self->name_map, stored->name, GUINT_TO_POINTER(res));
+  nv_registry_index_insert(self, stored->name, hash, res);
  exit:
   g_static_mutex_unlock(&nv_registry_lock);
   return res;
@@ -98,8 +213,21 @@ nv_registry_alloc_handle(NVRegistry *self, const gchar *name)
 void
 nv_registry_add_alias(NVRegistry *self, NVHandle handle, const gchar *alias)
 {
+  gchar *stored_alias;
+
   g_static_mutex_lock(&nv_registry_lock);
-  g_hash_table_insert(self->name_map, g_strdup(alias), GUINT_TO_POINTER((glong) handle));
+  /* when replacing an existing alias, the hash table keeps its original
+   * key and frees the new one, the index refers to the original */
+  if (g_hash_table_lookup_extended(self->name_map, alias, (gpointer *) &stored_alias, NULL))
+    {
+      g_hash_table_insert(self->name_map, g_strdup(alias), GUINT_TO_POINTER((glong) handle));
+    }
+  else
+    {
+      stored_alias = g_strdup(alias);
+      g_hash_table_insert(self->name_map, stored_alias, GUINT_TO_POINTER((glong) handle));
+    }
+  nv_registry_index_insert(self, stored_alias, g_str_hash(alias), handle);
   g_static_mutex_unlock(&nv_registry_lock);
 }
 
@@ -111,7 +239,7 @@ nv_registry_set_handle_flags(NVRegistry *self, NVHandle handle, guint16 flags)
   if (G_UNLIKELY(!handle))
     return;
 
-  stored = &g_array_index(self->names, NVHandleDesc, handle - 1);
+  stored = nv_registry_get_handle_desc(self, handle);
   stored->flags = flags;
 }
 
@@ -128,7 +256,8 @@ nv_registry_new(const gchar **static_names)
   gint i;
 
   self->name_map = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  self->names = g_array_new(FALSE, FALSE, sizeof(NVHandleDesc));
+  self->index = nv_registry_index_new(NV_REGISTRY_INDEX_INITIAL_SIZE);
+  self->retired_indexes = g_ptr_array_new_with_free_func(g_free);
   for (i = 0; static_names[i]; i++)
     {
       nv_registry_alloc_handle(self, static_names[i]);
@@ -139,8 +268,13 @@ nv_registry_new(const gchar **static_names)
 void
 nv_registry_free(NVRegistry *self)
 {
-  g_array_free(self->names, TRUE);
+  gint i;
+
+  for (i = 0; i < NV_REGISTRY_MAX_CHUNKS; i++)
+    g_free(self->name_chunks[i]);
   g_hash_table_destroy(self->name_map);
+  g_ptr_array_free(self->retired_indexes, TRUE);
+  g_free(self->index);
   g_free(self);
 }
 
@@ -263,6 +397,12 @@ nv_table_get_entry_slow(NVTable *self, NVHandle handle, NVDynValue **dyn_slot)
   return entry;
 }
 
+static inline gboolean
+nv_table_is_value_set_in_parent(NVTable *self, NVHandle handle)
+{
+  return self->parent && nv_table_is_value_set(self->parent, handle);
+}
+
 static gboolean
 nv_table_reserve_table_entry(NVTable *self, NVHandle handle, NVDynValue **dyn_slot)
 {
@@ -375,7 +515,7 @@ nv_table_add_value(NVTable *self, NVHandle handle, const gchar *name, gsize name
   if (new_entry)
     *new_entry = FALSE;
   entry = nv_table_get_entry(self, handle, &dyn_slot);
-  if (G_UNLIKELY(!entry && !new_entry && value_len == 0))
+  if (G_UNLIKELY(!entry && !new_entry && value_len == 0 && !nv_table_is_value_set_in_parent(self, handle)))
     {
       /* we don't store zero length matches unless the caller is
        * interested in whether a new entry was created. It is used by
@@ -420,7 +560,7 @@ nv_table_add_value(NVTable *self, NVHandle handle, const gchar *name, gsize name
       return TRUE;
     }
   else if (!entry && new_entry)
-    *new_entry = TRUE;
+    *new_entry = !nv_table_is_value_set_in_parent(self, handle);
 
   /* check if there's enough free space: size of the struct plus the
    * size needed for a dynamic table slot */
@@ -459,15 +599,20 @@ nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar *name, g
   if (new_entry)
     *new_entry = FALSE;
   ref_entry = nv_table_get_entry(self, ref_handle, &dyn_slot);
-  if ((ref_entry && ref_entry->indirect) || handle == ref_handle)
+  if ((ref_entry && ref_entry->indirect) || handle == ref_handle ||
+      (!ref_entry && nv_table_is_value_set_in_parent(self, ref_handle)))
     {
       const gchar *ref_value;
       gssize ref_length;
 
       /* NOTE: uh-oh, the to-be-referenced value is already an indirect
-       * reference, this is not supported, copy the stuff */
+       * reference or it lives in the parent of an overlay, which we
+       * can't mark as referenced. This is not supported, copy the stuff */
 
-      ref_value = nv_table_resolve_entry(self, ref_entry, &ref_length);
+      if (ref_entry)
+        ref_value = nv_table_resolve_entry(self, ref_entry, &ref_length);
+      else
+        ref_value = nv_table_get_value(self, ref_handle, &ref_length);
 
       if (rofs > ref_length)
         {
@@ -482,7 +627,7 @@ nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar *name, g
     }
 
   entry = nv_table_get_entry(self, handle, &dyn_slot);
-  if (!entry && !new_entry && (rlen == 0 || !ref_entry))
+  if (!entry && !new_entry && (rlen == 0 || !ref_entry) && !nv_table_is_value_set_in_parent(self, handle))
     {
       /* we don't store zero length matches unless the caller is
        * interested in whether a new entry was created. It is used by
@@ -523,7 +668,7 @@ nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar *name, g
       return TRUE;
     }
   else if (!entry && new_entry)
-    *new_entry = TRUE;
+    *new_entry = !nv_table_is_value_set_in_parent(self, handle);
 
   if (!nv_table_reserve_table_entry(self, handle, &dyn_slot))
     return FALSE;
@@ -560,8 +705,14 @@ nv_table_call_foreach(NVHandle handle, NVEntry *entry, gpointer user_data)
   NVRegistry *registry = (NVRegistry *) ((gpointer *) user_data)[1];
   NVTableForeachFunc func = ((gpointer *) user_data)[2];
   gpointer func_data = ((gpointer *) user_data)[3];
+  NVTable *overlay = (NVTable *) ((gpointer *) user_data)[4];
   const gchar *value;
   gssize value_len;
+  NVDynValue *dyn_slot;
+
+  /* iterating the parent of an overlay, skip values overridden by the overlay */
+  if (overlay && nv_table_get_entry(overlay, handle, &dyn_slot))
+    return FALSE;
 
   value = nv_table_resolve_entry(self, entry, &value_len);
   return func(handle, nv_registry_get_handle_name(registry, handle, NULL), value, value_len, func_data);
@@ -570,11 +721,22 @@ nv_table_call_foreach(NVHandle handle, NVEntry *entry, gpointer user_data)
 gboolean
 nv_table_foreach(NVTable *self, NVRegistry *registry, NVTableForeachFunc func, gpointer user_data)
 {
-  gpointer data[4] = { self, registry, func, user_data };
+  gpointer data[5] = { self, registry, func, user_data, NULL };
+
+  if (nv_table_foreach_entry(self, nv_table_call_foreach, data))
+    return TRUE;
 
-  return nv_table_foreach_entry(self, nv_table_call_foreach, data);
+  if (!self->parent)
+    return FALSE;
+
+  data[0] = self->parent;
+  data[4] = self;
+  return nv_table_foreach_entry(self->parent, nv_table_call_foreach, data);
 }
 
+/* NOTE: only iterates over the entries stored in @self, entries inherited
+ * from the parent of an overlay are not included */
+
 gboolean
 nv_table_foreach_entry(NVTable *self, NVTableForeachEntryFunc func, gpointer user_data)
 {
@@ -613,6 +775,7 @@ nv_table_clear(NVTable *self)
   g_assert(self->ref_cnt == 1);
   self->used = 0;
   self->num_dyn_entries = 0;
+  self->parent = NULL;
   memset(&self->static_entries[0], 0, self->num_static_entries * sizeof(self->static_entries[0]));
 }
 
@@ -626,6 +789,7 @@ nv_table_init(NVTable *self, gsize alloc_length, gint num_static_entries)
   self->num_static_entries = num_static_entries;
   self->ref_cnt = 1;
   self->borrowed = FALSE;
+  self->parent = NULL;
   memset(&self->static_entries[0], 0, self->num_static_entries * sizeof(self->static_entries[0]));
 }
 
@@ -642,6 +806,24 @@ nv_table_new(gint num_static_entries, gint num_dyn_values, gint init_length)
   return self;
 }
 
+/**
+ * nv_table_new_overlay:
+ * @parent: the shared payload to be overlaid, must not be an overlay itself
+ *
+ * Creates an empty NVTable that shadows @parent, see the "Overlays"
+ * section in nvtable.h for details.
+ **/
+NVTable *
+nv_table_new_overlay(NVTable *parent, gint num_dyn_values, gint init_length)
+{
+  NVTable *self;
+
+  g_assert(parent->parent == NULL);
+  self = nv_table_new(parent->num_static_entries, num_dyn_values, init_length);
+  self->parent = parent;
+  return self;
+}
+
 NVTable *
 nv_table_init_borrowed(gpointer space, gsize space_len, gint num_static_entries)
 {
@@ -33,6 +33,7 @@ typedef struct _NVDynValue NVDynValue;
 typedef struct _NVEntry NVEntry;
 typedef guint32 NVHandle;
 typedef struct _NVHandleDesc NVHandleDesc;
+typedef struct _NVRegistryIndex NVRegistryIndex;
 typedef gboolean (*NVTableForeachFunc)(NVHandle handle, const gchar *name, const gchar *value, gssize value_len, gpointer user_data);
 typedef gboolean (*NVTableForeachEntryFunc)(NVHandle handle, NVEntry *entry, gpointer user_data);
 
@@ -49,12 +50,22 @@ struct _NVHandleDesc
   guint8 name_len;
 };
 
+/* handle descriptors are allocated in fixed size chunks, which never move
+ * once allocated, so that they can be read without locking */
+#define NV_REGISTRY_MAX_HANDLES    65535
+#define NV_REGISTRY_CHUNK_BITS     8
+#define NV_REGISTRY_CHUNK_SIZE     (1 << NV_REGISTRY_CHUNK_BITS)
+#define NV_REGISTRY_MAX_CHUNKS     ((NV_REGISTRY_MAX_HANDLES + NV_REGISTRY_CHUNK_SIZE - 1) / NV_REGISTRY_CHUNK_SIZE)
+
 struct _NVRegistry
 {
   /* number of static names that are statically allocated in each payload */
   gint num_static_names;
-  GArray *names;
+  guint32 num_names;
+  NVHandleDesc *name_chunks[NV_REGISTRY_MAX_CHUNKS];
   GHashTable *name_map;
+  NVRegistryIndex *index;
+  GPtrArray *retired_indexes;
 };
 
 extern const gchar *null_string;
@@ -67,6 +78,12 @@ void nv_registry_foreach(NVRegistry *self, GHFunc callback, gpointer user_data);
 NVRegistry *nv_registry_new(const gchar **static_names);
 void nv_registry_free(NVRegistry *self);
 
+static inline NVHandleDesc *
+nv_registry_get_handle_desc(NVRegistry *self, NVHandle handle)
+{
+  return &self->name_chunks[(handle - 1) >> NV_REGISTRY_CHUNK_BITS][(handle - 1) & (NV_REGISTRY_CHUNK_SIZE - 1)];
+}
+
 static inline guint16
 nv_registry_get_handle_flags(NVRegistry *self, NVHandle handle)
 {
@@ -75,7 +92,7 @@ nv_registry_get_handle_flags(NVRegistry *self, NVHandle handle)
   if (G_UNLIKELY(!handle))
     return 0;
 
-  stored = &g_array_index(self->names, NVHandleDesc, handle - 1);
+  stored = nv_registry_get_handle_desc(self, handle);
   return stored->flags;
 }
 
@@ -91,7 +108,7 @@ nv_registry_get_handle_name(NVRegistry *self, NVHandle handle, gssize *length)
       return "None";
     }
 
-  stored = &g_array_index(self->names, NVHandleDesc, handle - 1);
+  stored = nv_registry_get_handle_desc(self, handle);
   if (G_LIKELY(length))
     *length = stored->name_len;
   return stored->name;
@@ -186,6 +203,22 @@ nv_entry_get_name(NVEntry *self)
  *
  *   - It is possible to clone an NVTable, which basically copies the
  *     underlying memory contents.
+ *
+ * Overlays
+ * ========
+ *   - an NVTable may be created as an overlay on top of a @parent
+ *     NVTable. Lookups are satisfied from the overlay first, and fall back
+ *     to the parent if the value is not set in the overlay, while all
+ *     changes are stored in the overlay.  This makes it possible to modify
+ *     a write protected payload without copying it first.
+ *
+ *   - the parent is never modified through the overlay and it is not
+ *     reference counted by it either, the owner of the overlay has to
+ *     make sure that the parent stays alive (LogMessage does that through
+ *     its "original" pointer)
+ *
+ *   - the parent of an overlay is never an overlay itself, cloning an
+ *     overlay copies the overlay only and retains the same parent.
  */
 struct _NVTable
 {
@@ -196,6 +229,8 @@ struct _NVTable
   guint8 num_static_entries;
   guint8 ref_cnt:7,
     borrowed:1; /* specifies if the memory used by NVTable was borrowed from the container struct */
+  /* the shared NVTable this one is an overlay of, NULL if it is not an overlay */
+  NVTable *parent;
 
   /* variable data, see memory layout in the comment above */
   union
@@ -223,6 +258,7 @@ gboolean nv_table_foreach_entry(NVTable *self, NVTableForeachEntryFunc func, gpo
 
 void nv_table_clear(NVTable *self);
 NVTable *nv_table_new(gint num_static_values, gint num_dyn_values, gint init_length);
+NVTable *nv_table_new_overlay(NVTable *parent, gint num_dyn_values, gint init_length);
 NVTable *nv_table_init_borrowed(gpointer space, gsize space_len, gint num_static_entries);
 gboolean nv_table_realloc(NVTable *self, NVTable **new);
 NVTable *nv_table_clone(NVTable *self, gint additional_space);
@@ -290,7 +326,9 @@ nv_table_is_value_set(NVTable *self, NVHandle handle)
 {
   NVDynValue *dyn_slot;
 
-  return nv_table_get_entry(self, handle, &dyn_slot) != NULL;
+  if (nv_table_get_entry(self, handle, &dyn_slot) != NULL)
+    return TRUE;
+  return self->parent && nv_table_get_entry(self->parent, handle, &dyn_slot) != NULL;
 }
 
 static inline const gchar *
@@ -300,6 +338,13 @@ __nv_table_get_value(NVTable *self, NVHandle handle, guint16 num_static_entries,
   NVDynValue *dyn_slot;
 
   entry = nv_table_get_entry(self, handle, &dyn_slot);
+  if (G_UNLIKELY(!entry && self->parent))
+    {
+      /* not overridden by the overlay, indirect values found in the
+       * parent are resolved against the parent */
+      self = self->parent;
+      entry = nv_table_get_entry(self, handle, &dyn_slot);
+    }
   if (G_UNLIKELY(!entry))
     {
       if (length)
@@ -25,15 +25,34 @@
 #include "tls-support.h"
 #include "scratch-buffers.h"
 #include "misc.h"
+#include "stats/stats-registry.h"
+
+#include <string.h>
+
+typedef struct _ScratchArenaChunk ScratchArenaChunk;
+
+/* the header is two words, so data is aligned just like malloc() results */
+struct _ScratchArenaChunk
+{
+  ScratchArenaChunk *prev;
+  gsize size;
+  gchar data[0];
+};
 
 TLS_BLOCK_START
 {
   GTrashStack *sb_gstrings;
   GTrashStack *sb_th_gstrings;
   GList *sb_registry;
+  ScratchArenaChunk *sa_chunk;
+  ScratchArenaChunk *sa_spare_chunks;
+  gsize sa_pos;
+  gsize sa_used_in_prev_chunks;
 }
 TLS_BLOCK_END;
 
+static StatsCounterItem *sa_high_water_mark;
+
 /* GStrings */
 
 #define local_sb_gstrings        __tls_deref(sb_gstrings)
@@ -127,6 +146,195 @@ ScratchBufferStack SBTHGStringStack = {
   .free_stack = sb_th_gstring_free_stack
 };
 
+/* Arena
+ *
+ * A per-thread bump allocator for temporaries that are only needed while
+ * a message is processed.  Allocations are a pointer increment in the
+ * current chunk, and are never freed one by one.  Instead, the whole arena
+ * is reset at the end of each worker batch (see
+ * main_loop_worker_invoke_batch_callbacks()), or a caller may give back
+ * everything it allocated since a mark using scratch_arena_reclaim().
+ * Threads that do not process batches must do the latter.
+ *
+ * If a batch did not fit into a single chunk, the chunks are merged into a
+ * single, larger one on reset, so the arena quickly settles at the size
+ * the workload needs.
+ */
+
+#define local_sa_chunk              __tls_deref(sa_chunk)
+#define local_sa_spare_chunks       __tls_deref(sa_spare_chunks)
+#define local_sa_pos                __tls_deref(sa_pos)
+#define local_sa_used_in_prev_chunks __tls_deref(sa_used_in_prev_chunks)
+
+#define SCRATCH_ARENA_CHUNK_SIZE  16384
+
+static ScratchArenaChunk *
+scratch_arena_chunk_new(gsize size)
+{
+  ScratchArenaChunk *chunk;
+
+  size = MAX(size, SCRATCH_ARENA_CHUNK_SIZE);
+  chunk = g_malloc(sizeof(ScratchArenaChunk) + size);
+  chunk->prev = NULL;
+  chunk->size = size;
+  return chunk;
+}
+
+static void
+scratch_arena_free_chunks(ScratchArenaChunk *chunk)
+{
+  ScratchArenaChunk *prev;
+
+  while (chunk)
+    {
+      prev = chunk->prev;
+      g_free(chunk);
+      chunk = prev;
+    }
+}
+
+static gpointer
+scratch_arena_alloc_in_new_chunk(gsize size)
+{
+  ScratchArenaChunk *chunk = local_sa_spare_chunks;
+
+  if (chunk && chunk->size >= size)
+    {
+      local_sa_spare_chunks = chunk->prev;
+    }
+  else
+    {
+      chunk = scratch_arena_chunk_new(size);
+    }
+
+  if (local_sa_chunk)
+    local_sa_used_in_prev_chunks += local_sa_pos;
+  chunk->prev = local_sa_chunk;
+  local_sa_chunk = chunk;
+  local_sa_pos = size;
+  return chunk->data;
+}
+
+gpointer
+scratch_arena_alloc(gsize size)
+{
+  gpointer result;
+
+  size = (size + SCRATCH_ARENA_ALIGN - 1) & ~(SCRATCH_ARENA_ALIGN - 1);
+  if (G_UNLIKELY(!local_sa_chunk || local_sa_pos + size > local_sa_chunk->size))
+    return scratch_arena_alloc_in_new_chunk(size);
+
+  result = local_sa_chunk->data + local_sa_pos;
+  local_sa_pos += size;
+  return result;
+}
+
+gpointer
+scratch_arena_alloc0(gsize size)
+{
+  return memset(scratch_arena_alloc(size), 0, size);
+}
+
+gchar *
+scratch_arena_strndup(const gchar *str, gsize len)
+{
+  gchar *result = scratch_arena_alloc(len + 1);
+
+  memcpy(result, str, len);
+  result[len] = 0;
+  return result;
+}
+
+gchar *
+scratch_arena_strdup(const gchar *str)
+{
+  return scratch_arena_strndup(str, strlen(str));
+}
+
+ScratchArenaMark
+scratch_arena_mark(void)
+{
+  ScratchArenaMark mark;
+
+  mark.chunk = local_sa_chunk;
+  mark.pos = local_sa_pos;
+  mark.used_in_prev_chunks = local_sa_used_in_prev_chunks;
+  return mark;
+}
+
+/* the high water mark is shared by all threads, only raise it */
+static void
+scratch_arena_update_high_water_mark(void)
+{
+  gint used = MIN(local_sa_used_in_prev_chunks + local_sa_pos, G_MAXINT);
+  gint high_water_mark;
+
+  if (!sa_high_water_mark)
+    return;
+
+  do
+    {
+      high_water_mark = g_atomic_int_get(&sa_high_water_mark->value);
+      if (used <= high_water_mark)
+        return;
+    }
+  while (!g_atomic_int_compare_and_exchange(&sa_high_water_mark->value, high_water_mark, used));
+}
+
+/* frees everything that was allocated since @mark was taken */
+void
+scratch_arena_reclaim(ScratchArenaMark mark)
+{
+  ScratchArenaChunk *chunk;
+
+  scratch_arena_update_high_water_mark();
+  while (local_sa_chunk != mark.chunk)
+    {
+      chunk = local_sa_chunk;
+      local_sa_chunk = chunk->prev;
+      chunk->prev = local_sa_spare_chunks;
+      local_sa_spare_chunks = chunk;
+    }
+  local_sa_pos = mark.pos;
+  local_sa_used_in_prev_chunks = mark.used_in_prev_chunks;
+}
+
+/* frees everything allocated from the arena of the current thread */
+void
+scratch_arena_reset(void)
+{
+  gsize size = 0;
+  ScratchArenaChunk *chunk;
+
+  if (!local_sa_chunk)
+    return;
+
+  scratch_arena_update_high_water_mark();
+  if (local_sa_chunk->prev)
+    {
+      for (chunk = local_sa_chunk; chunk; chunk = chunk->prev)
+        size += chunk->size;
+
+      scratch_arena_free_chunks(local_sa_chunk);
+      local_sa_chunk = scratch_arena_chunk_new(size);
+    }
+  scratch_arena_free_chunks(local_sa_spare_chunks);
+  local_sa_spare_chunks = NULL;
+  local_sa_pos = 0;
+  local_sa_used_in_prev_chunks = 0;
+}
+
+static void
+scratch_arena_free(void)
+{
+  scratch_arena_free_chunks(local_sa_chunk);
+  scratch_arena_free_chunks(local_sa_spare_chunks);
+  local_sa_chunk = NULL;
+  local_sa_spare_chunks = NULL;
+  local_sa_pos = 0;
+  local_sa_used_in_prev_chunks = 0;
+}
+
 /* Global API */
 
 #define local_sb_registry  __tls_deref(sb_registry)
@@ -158,4 +366,21 @@ scratch_buffers_free(void)
 {
   g_list_foreach(local_sb_registry, scratch_buffers_free_stack, NULL);
   g_list_free(local_sb_registry);
+  scratch_arena_free();
+}
+
+void
+scratch_buffers_global_init(void)
+{
+  stats_lock();
+  stats_register_counter(0, SCS_GLOBAL, "scratch_arena", "allocated_bytes", SC_TYPE_HIGH_WATER_MARK, &sa_high_water_mark);
+  stats_unlock();
+}
+
+void
+scratch_buffers_global_deinit(void)
+{
+  stats_lock();
+  stats_unregister_counter(SCS_GLOBAL, "scratch_arena", "allocated_bytes", SC_TYPE_HIGH_WATER_MARK, &sa_high_water_mark);
+  stats_unlock();
 }
@@ -52,6 +52,30 @@ scratch_buffer_release(ScratchBufferStack *stack, GTrashStack *buffer)
 void scratch_buffers_register(ScratchBufferStack *stack);
 void scratch_buffers_init(void);
 void scratch_buffers_free(void);
+void scratch_buffers_global_init(void);
+void scratch_buffers_global_deinit(void);
+
+/* Arena for per-message temporaries */
+
+#define SCRATCH_ARENA_ALIGN (2 * sizeof(gpointer))
+
+typedef struct
+{
+  gpointer chunk;
+  gsize pos;
+  gsize used_in_prev_chunks;
+} ScratchArenaMark;
+
+gpointer scratch_arena_alloc(gsize size);
+gpointer scratch_arena_alloc0(gsize size);
+gchar *scratch_arena_strdup(const gchar *str);
+gchar *scratch_arena_strndup(const gchar *str, gsize len);
+ScratchArenaMark scratch_arena_mark(void);
+void scratch_arena_reclaim(ScratchArenaMark mark);
+void scratch_arena_reset(void);
+
+#define scratch_arena_new(type) ((type *) scratch_arena_alloc(sizeof(type)))
+#define scratch_arena_new0(type) ((type *) scratch_arena_alloc0(sizeof(type)))
 
 /* GStrings */
 
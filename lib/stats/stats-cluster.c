@@ -49,6 +49,13 @@ stats_cluster_get_type_name(gint type)
     /* [SC_TYPE_STORED]   = */  "stored",
     /* [SC_TYPE_SUPPRESSED] = */ "suppressed",
     /* [SC_TYPE_STAMP] = */ "stamp",
+    /* [SC_TYPE_BATCH_SIZE] = */ "batch_size",
+    /* [SC_TYPE_HITS] = */ "hits",
+    /* [SC_TYPE_MISSES] = */ "misses",
+    /* [SC_TYPE_EVICTED] = */ "evicted",
+    /* [SC_TYPE_FULL_HANDSHAKES] = */ "full_handshakes",
+    /* [SC_TYPE_RESUMED_HANDSHAKES] = */ "resumed_handshakes",
+    /* [SC_TYPE_HIGH_WATER_MARK] = */ "high_water_mark",
   };
 
   return tag_names[type];
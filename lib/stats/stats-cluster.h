@@ -34,6 +34,13 @@ typedef enum
   SC_TYPE_STORED,    /* number of messages on disk */
   SC_TYPE_SUPPRESSED,/* number of messages suppressed */
   SC_TYPE_STAMP,     /* timestamp */
+  SC_TYPE_BATCH_SIZE,/* current flush batch size */
+  SC_TYPE_HITS,      /* number of lookups that found their object */
+  SC_TYPE_MISSES,    /* number of lookups that had to create their object */
+  SC_TYPE_EVICTED,   /* number of objects closed to stay within a limit */
+  SC_TYPE_FULL_HANDSHAKES,    /* number of TLS handshakes negotiating a new session */
+  SC_TYPE_RESUMED_HANDSHAKES, /* number of TLS handshakes resuming a session */
+  SC_TYPE_HIGH_WATER_MARK,    /* the largest value seen so far, e.g. memory use */
   SC_TYPE_MAX
 } StatsCounterType;
 
@@ -33,7 +33,7 @@ _reset_counter(StatsCluster *sc, gint type, StatsCounterItem *counter, gpointer
 static inline void
 _reset_non_stored_counter(StatsCluster *sc, gint type, StatsCounterItem *counter, gpointer user_data)
 {
-  if (type != SC_TYPE_STORED)
+  if (type != SC_TYPE_STORED && type != SC_TYPE_BATCH_SIZE && type != SC_TYPE_HIGH_WATER_MARK)
     {
       _reset_counter(sc, type, counter, user_data);
     }
@@ -23,6 +23,7 @@
  */
 #include "stats/stats-csv.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 #include "utf8utils.h"
 
 #include <string.h>
@@ -57,42 +58,94 @@ stats_format_csv_escapevar(const gchar *var)
   return escaped_result;
 }
 
+/* appends "component;id;instance;type", the key used by filters and by
+ * the shared memory export to identify a counter */
+void
+stats_format_csv_counter_name(StatsCluster *sc, gint type, GString *result)
+{
+  gchar *s_id, *s_instance, *tag_name;
+  gchar buf[32];
+
+  s_id = stats_format_csv_escapevar(sc->id);
+  s_instance = stats_format_csv_escapevar(sc->instance);
+  tag_name = stats_format_csv_escapevar(stats_cluster_get_type_name(type));
+  g_string_append_printf(result, "%s;%s;%s;%s",
+                         stats_cluster_get_component_name(sc, buf, sizeof(buf)),
+                         s_id, s_instance, tag_name);
+  g_free(tag_name);
+  g_free(s_id);
+  g_free(s_instance);
+}
+
+typedef struct _StatsCsvFormatState
+{
+  GString *csv;
+  const gchar *filter;
+  GString *name;
+} StatsCsvFormatState;
+
 static void
 stats_format_csv(StatsCluster *sc, gint type, StatsCounterItem *counter, gpointer user_data)
 {
-  GString *csv = (GString *) user_data;
+  StatsCsvFormatState *state = (StatsCsvFormatState *) user_data;
   gchar *s_id, *s_instance, *tag_name;
   gchar buf[32];
-  gchar state;
+  gchar sc_state;
+
+  if (state->filter)
+    {
+      g_string_truncate(state->name, 0);
+      stats_format_csv_counter_name(sc, type, state->name);
+      if (!g_pattern_match_simple(state->filter, state->name->str))
+        return;
+    }
 
   s_id = stats_format_csv_escapevar(sc->id);
   s_instance = stats_format_csv_escapevar(sc->instance);
   
   if (sc->dynamic)
-    state = 'd';
+    sc_state = 'd';
   else if (sc->use_count == 0)
-    state = 'o';
+    sc_state = 'o';
   else
-    state = 'a';
+    sc_state = 'a';
 
   tag_name = stats_format_csv_escapevar(stats_cluster_get_type_name(type));
-  g_string_append_printf(csv, "%s;%s;%s;%c;%s;%u\n",
+  g_string_append_printf(state->csv, "%s;%s;%s;%c;%s;%u\n",
                          stats_cluster_get_component_name(sc, buf, sizeof(buf)),
-                         s_id, s_instance, state, tag_name, stats_counter_get(&sc->counters[type]));
+                         s_id, s_instance, sc_state, tag_name, stats_counter_get(&sc->counters[type]));
   g_free(tag_name);
   g_free(s_id);
   g_free(s_instance);
 }
 
-
+/*
+ * @filter: a glob pattern matched against "component;id;instance;type",
+ *          only matching counters are returned, NULL returns everything
+ */
 gchar *
-stats_generate_csv(void)
+stats_generate_csv_filtered(const gchar *filter)
 {
-  GString *csv = g_string_sized_new(1024);
+  StatsCsvFormatState state;
 
-  g_string_append_printf(csv, "%s;%s;%s;%s;%s;%s\n", "SourceName", "SourceId", "SourceInstance", "State", "Type", "Number");
+  state.csv = g_string_sized_new(1024);
+  state.filter = filter;
+  state.name = filter ? g_string_sized_new(128) : NULL;
+
+  g_string_append_printf(state.csv, "%s;%s;%s;%s;%s;%s\n", "SourceName", "SourceId", "SourceInstance", "State", "Type", "Number");
   stats_lock();
-  stats_foreach_counter(stats_format_csv, csv);
+  stats_foreach_counter(stats_format_csv, &state);
   stats_unlock();
-  return g_string_free(csv, FALSE);
+  if (!filter)
+    stats_histogram_format_csv(state.csv);
+
+  if (state.name)
+    g_string_free(state.name, TRUE);
+  return g_string_free(state.csv, FALSE);
+}
+
+gchar *
+stats_generate_csv(void)
+{
+  return stats_generate_csv_filtered(NULL);
 }
@@ -25,7 +25,10 @@
 #define STATS_CSV_H_INCLUDED 1
 
 #include "syslog-ng.h"
+#include "stats/stats-cluster.h"
 
+void stats_format_csv_counter_name(StatsCluster *sc, gint type, GString *result);
 gchar *stats_generate_csv(void);
+gchar *stats_generate_csv_filtered(const gchar *filter);
 
 #endif
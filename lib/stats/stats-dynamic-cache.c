@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2002-2013 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "stats/stats-dynamic-cache.h"
+#include "stats/stats-registry.h"
+#include "mainloop-worker.h"
+#include "tls-support.h"
+
+#include <string.h>
+
+/*
+ * Per-thread cache of dynamic counters
+ *
+ * Dynamic counters (per-host, per-sender and per-program) are looked up
+ * for every incoming message, which would otherwise need stats_lock() and
+ * a lookup in the global counter hash each time, serializing all reader
+ * threads on the same mutex.
+ *
+ * Instead, every thread keeps a small, direct mapped cache of the
+ * StatsClusters it recently used.  A cached entry holds a reference to
+ * its cluster (by keeping its PROCESSED and STAMP counters registered),
+ * so the cluster cannot be pruned while it is cached, and the counters can
+ * be updated atomically without any locks.  stats_lock() is only taken
+ * when an entry is missing from the cache, or when an entry is evicted.
+ *
+ * To let unused clusters expire, threads drop their cached references
+ * after a pruning pass, as signalled by stats_dynamic_cache_invalidate():
+ * the next time they increment a counter, or at the end of their current
+ * batch, whichever comes first.  Worker threads also drop them at the end
+ * of a batch once more than STATS_DYNAMIC_CACHE_MAX_KEPT_ENTRIES clusters
+ * are cached, bounding the number of clusters a thread keeps alive.
+ * Counters that are still in use get cached again, the others are pruned
+ * by the next pass as usual.
+ */
+
+#define STATS_DYNAMIC_CACHE_SIZE 256
+#define STATS_DYNAMIC_CACHE_MAX_KEPT_ENTRIES (STATS_DYNAMIC_CACHE_SIZE / 2)
+
+typedef struct _StatsDynamicCacheEntry
+{
+  guint hash;
+  gint component;
+  gchar *instance;
+  StatsCluster *sc;
+  StatsCounterItem *processed;
+  StatsCounterItem *stamp;
+} StatsDynamicCacheEntry;
+
+typedef struct _StatsDynamicCache
+{
+  StatsDynamicCacheEntry entries[STATS_DYNAMIC_CACHE_SIZE];
+  gint num_entries;
+  gint generation;
+  WorkerBatchCallback batch_cb;
+} StatsDynamicCache;
+
+TLS_BLOCK_START
+{
+  StatsDynamicCache *dynamic_cache;
+}
+TLS_BLOCK_END;
+
+#define dynamic_cache  __tls_deref(dynamic_cache)
+
+static gint stats_dynamic_cache_generation;
+
+/* must be called with stats_lock() held */
+static void
+_release_entry(StatsDynamicCache *self, StatsDynamicCacheEntry *entry)
+{
+  if (!entry->sc)
+    return;
+
+  stats_unregister_dynamic_counter(entry->sc, SC_TYPE_PROCESSED, &entry->processed);
+  stats_unregister_dynamic_counter(entry->sc, SC_TYPE_STAMP, &entry->stamp);
+  g_free(entry->instance);
+  memset(entry, 0, sizeof(*entry));
+  self->num_entries--;
+}
+
+static void
+_release_all_entries(StatsDynamicCache *self)
+{
+  gint i;
+
+  if (self->num_entries == 0)
+    return;
+
+  stats_lock();
+  for (i = 0; i < STATS_DYNAMIC_CACHE_SIZE && self->num_entries > 0; i++)
+    _release_entry(self, &self->entries[i]);
+  stats_unlock();
+}
+
+static void
+_release_all_entries_if_invalidated(StatsDynamicCache *self)
+{
+  gint generation = g_atomic_int_get(&stats_dynamic_cache_generation);
+
+  if (G_UNLIKELY(self->generation != generation))
+    {
+      _release_all_entries(self);
+      self->generation = generation;
+    }
+}
+
+/* runs in the thread owning the cache, once its current batch is complete */
+static gpointer
+_release_stale_entries_at_batch_end(gpointer s)
+{
+  StatsDynamicCache *self = (StatsDynamicCache *) s;
+
+  if (self->num_entries > STATS_DYNAMIC_CACHE_MAX_KEPT_ENTRIES)
+    _release_all_entries(self);
+  _release_all_entries_if_invalidated(self);
+  return NULL;
+}
+
+/* must be called with stats_lock() held */
+static void
+_fill_entry(StatsDynamicCache *self, StatsDynamicCacheEntry *entry, guint hash, gint stats_level, gint component,
+            const gchar *instance)
+{
+  StatsCluster *sc;
+
+  sc = stats_register_dynamic_counter(stats_level, component, NULL, instance, SC_TYPE_PROCESSED, &entry->processed);
+  if (!sc)
+    return;
+
+  stats_register_associated_counter(sc, SC_TYPE_STAMP, &entry->stamp);
+  entry->hash = hash;
+  entry->component = component;
+  entry->instance = g_strdup(instance);
+  entry->sc = sc;
+  self->num_entries++;
+}
+
+static inline gboolean
+_entry_matches(StatsDynamicCacheEntry *entry, guint hash, gint component, const gchar *instance)
+{
+  return entry->sc &&
+         entry->hash == hash &&
+         entry->component == component &&
+         strcmp(entry->instance, instance) == 0;
+}
+
+/*
+ * stats_dynamic_cache_inc:
+ * @timestamp: if non-negative, the associated timestamp is updated as well
+ *
+ * Same as stats_register_and_increment_dynamic_counter() with a NULL id,
+ * except that it must be called _without_ holding stats_lock().
+ */
+void
+stats_dynamic_cache_inc(gint stats_level, gint component, const gchar *instance, time_t timestamp)
+{
+  StatsDynamicCache *self = dynamic_cache;
+  StatsDynamicCacheEntry *entry;
+  guint hash;
+
+  if (!stats_check_level(stats_level))
+    return;
+
+  if (!instance)
+    instance = "";
+
+  if (G_UNLIKELY(!self))
+    {
+      /* thread without a cache, fall back to the global registry */
+      stats_lock();
+      stats_register_and_increment_dynamic_counter(stats_level, component, NULL, instance, timestamp);
+      stats_unlock();
+      return;
+    }
+
+  _release_all_entries_if_invalidated(self);
+
+  hash = g_str_hash(instance) ^ component;
+  entry = &self->entries[hash & (STATS_DYNAMIC_CACHE_SIZE - 1)];
+  if (G_UNLIKELY(!_entry_matches(entry, hash, component, instance)))
+    {
+      stats_lock();
+      _release_entry(self, entry);
+      _fill_entry(self, entry, hash, stats_level, component, instance);
+      stats_unlock();
+      if (!entry->sc)
+        return;
+    }
+
+  if (iv_list_empty(&self->batch_cb.list) && main_loop_worker_is_batching())
+    main_loop_worker_register_batch_callback(&self->batch_cb);
+
+  stats_counter_inc(entry->processed);
+  if (timestamp >= 0)
+    stats_counter_set(entry->stamp, timestamp);
+}
+
+/* makes threads drop their cached references, so that unused dynamic
+ * counters can expire */
+void
+stats_dynamic_cache_invalidate(void)
+{
+  g_atomic_int_inc(&stats_dynamic_cache_generation);
+}
+
+void
+stats_dynamic_cache_thread_init(void)
+{
+  StatsDynamicCache *self;
+
+  g_assert(dynamic_cache == NULL);
+  self = g_new0(StatsDynamicCache, 1);
+  self->generation = g_atomic_int_get(&stats_dynamic_cache_generation);
+  worker_batch_callback_init(&self->batch_cb);
+  self->batch_cb.func = _release_stale_entries_at_batch_end;
+  self->batch_cb.user_data = self;
+  dynamic_cache = self;
+}
+
+void
+stats_dynamic_cache_thread_deinit(void)
+{
+  StatsDynamicCache *self = dynamic_cache;
+
+  if (!self)
+    return;
+
+  iv_list_del_init(&self->batch_cb.list);
+  _release_all_entries(self);
+  g_free(self);
+  dynamic_cache = NULL;
+}
@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2002-2013 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "stats/stats-histogram.h"
+#include "mainloop-worker.h"
+
+#include <string.h>
+#include <time.h>
+
+/*
+ * Latency histograms
+ *
+ * A StatsHistogram is a log-linear (HDR style) histogram of microsecond
+ * values: the range [2^n, 2^(n+1)) is divided into STATS_HISTOGRAM_SUB_BUCKETS
+ * equal buckets, so the recorded values are accurate to a few percent over
+ * the whole range, using a fixed number of buckets.
+ *
+ * Recording must be cheap as it happens once per message, so every
+ * worker thread gets its own shard of buckets (indexed by
+ * main_loop_worker_get_thread_id()) that it updates without locks or
+ * atomic operations.  Threads without a worker id (e.g.  the main thread)
+ * share a single shard that is protected by a mutex.  Buckets are 64 bit
+ * wide, so that they don't wrap around on a busy, long running instance.  Shards are allocated
+ * lazily, the first time a thread records a value.  Readers merge the
+ * shards into a StatsHistogramSnapshot, the result is racy in the same
+ * way as reading StatsCounterItems is.
+ *
+ * Histograms are kept in a registry keyed by (id, instance, name) and are
+ * reference counted, so that drivers registering the same key share a
+ * histogram.  Unlike counters, a histogram is freed when its last user
+ * unregisters it: as the drivers of the old configuration are deinitialized
+ * before the new ones are initialized, the recorded values are lost on
+ * reload.
+ */
+
+/* general and output workers have separate thread id ranges */
+#define STATS_HISTOGRAM_MAX_SHARDS (MAIN_LOOP_MAX_WORKER_THREADS * 2)
+
+typedef struct _StatsHistogramShard
+{
+  guint64 buckets[STATS_HISTOGRAM_BUCKETS];
+  guint64 count;
+  guint64 max;
+} StatsHistogramShard;
+
+struct _StatsHistogram
+{
+  gint ref_cnt;
+  gchar *id;
+  gchar *instance;
+  gchar *name;
+  gchar *key;
+  GStaticMutex shared_lock;
+  StatsHistogramShard shared;
+  StatsHistogramShard *shards[STATS_HISTOGRAM_MAX_SHARDS];
+};
+
+static GHashTable *stats_histograms;
+static GStaticMutex stats_histograms_lock = G_STATIC_MUTEX_INIT;
+
+gint
+stats_histogram_get_bucket(guint64 value)
+{
+  gint msb;
+
+  if (value < STATS_HISTOGRAM_SUB_BUCKETS)
+    return (gint) value;
+
+  if (value > STATS_HISTOGRAM_MAX_VALUE)
+    value = STATS_HISTOGRAM_MAX_VALUE;
+
+  msb = g_bit_storage(value) - 1;
+  return (msb - STATS_HISTOGRAM_SUB_BITS + 1) * STATS_HISTOGRAM_SUB_BUCKETS +
+         ((value >> (msb - STATS_HISTOGRAM_SUB_BITS)) & (STATS_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+guint64
+stats_histogram_get_bucket_lower_bound(gint bucket)
+{
+  gint shift;
+
+  if (bucket < STATS_HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  shift = bucket / STATS_HISTOGRAM_SUB_BUCKETS - 1;
+  return ((guint64) (STATS_HISTOGRAM_SUB_BUCKETS + bucket % STATS_HISTOGRAM_SUB_BUCKETS)) << shift;
+}
+
+guint64
+stats_histogram_get_bucket_upper_bound(gint bucket)
+{
+  if (bucket + 1 >= STATS_HISTOGRAM_BUCKETS)
+    return STATS_HISTOGRAM_MAX_VALUE;
+  return stats_histogram_get_bucket_lower_bound(bucket + 1) - 1;
+}
+
+static StatsHistogramShard *
+_get_local_shard(StatsHistogram *self)
+{
+  gint thread_id = main_loop_worker_get_thread_id();
+  StatsHistogramShard *shard;
+
+  if (thread_id < 0 || thread_id >= STATS_HISTOGRAM_MAX_SHARDS)
+    return NULL;
+
+  shard = g_atomic_pointer_get(&self->shards[thread_id]);
+  if (G_UNLIKELY(!shard))
+    {
+      /* only this thread ever installs this slot, but readers may look at
+       * it concurrently, so publish it atomically */
+      shard = g_new0(StatsHistogramShard, 1);
+      g_atomic_pointer_set(&self->shards[thread_id], shard);
+    }
+  return shard;
+}
+
+void
+stats_histogram_record(StatsHistogram *self, guint64 value)
+{
+  StatsHistogramShard *shard;
+  gint bucket;
+
+  if (!self)
+    return;
+
+  bucket = stats_histogram_get_bucket(value);
+  shard = _get_local_shard(self);
+  if (shard)
+    {
+      shard->buckets[bucket]++;
+      shard->count++;
+      if (value > shard->max)
+        shard->max = value;
+    }
+  else
+    {
+      g_static_mutex_lock(&self->shared_lock);
+      self->shared.buckets[bucket]++;
+      self->shared.count++;
+      if (value > self->shared.max)
+        self->shared.max = value;
+      g_static_mutex_unlock(&self->shared_lock);
+    }
+}
+
+static void
+_merge_shard(StatsHistogramSnapshot *snapshot, StatsHistogramShard *shard)
+{
+  gint i;
+
+  for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    snapshot->buckets[i] += shard->buckets[i];
+  snapshot->count += shard->count;
+  snapshot->max = MAX(snapshot->max, shard->max);
+}
+
+void
+stats_histogram_snapshot(StatsHistogram *self, StatsHistogramSnapshot *snapshot)
+{
+  gint i;
+
+  memset(snapshot, 0, sizeof(*snapshot));
+  g_static_mutex_lock(&self->shared_lock);
+  _merge_shard(snapshot, &self->shared);
+  g_static_mutex_unlock(&self->shared_lock);
+  for (i = 0; i < STATS_HISTOGRAM_MAX_SHARDS; i++)
+    {
+      StatsHistogramShard *shard = g_atomic_pointer_get(&self->shards[i]);
+
+      if (shard)
+        _merge_shard(snapshot, shard);
+    }
+}
+
+/* returns the upper bound of the bucket containing the given percentile */
+guint64
+stats_histogram_snapshot_get_percentile(StatsHistogramSnapshot *snapshot, gdouble percentile)
+{
+  guint64 rank, seen = 0;
+  gint i;
+
+  if (snapshot->count == 0)
+    return 0;
+
+  rank = (guint64) (snapshot->count * percentile / 100.0 + 0.5);
+  if (rank == 0)
+    rank = 1;
+
+  for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += snapshot->buckets[i];
+      if (seen >= rank)
+        return MIN(stats_histogram_get_bucket_upper_bound(i), snapshot->max);
+    }
+  return snapshot->max;
+}
+
+/* NOTE: not synchronized with writers, values recorded in parallel may
+ * survive the reset */
+void
+stats_histogram_reset(StatsHistogram *self)
+{
+  gint i;
+
+  g_static_mutex_lock(&self->shared_lock);
+  memset(&self->shared, 0, sizeof(self->shared));
+  g_static_mutex_unlock(&self->shared_lock);
+  for (i = 0; i < STATS_HISTOGRAM_MAX_SHARDS; i++)
+    {
+      StatsHistogramShard *shard = g_atomic_pointer_get(&self->shards[i]);
+
+      if (shard)
+        memset(shard, 0, sizeof(*shard));
+    }
+}
+
+const gchar *
+stats_histogram_get_id(StatsHistogram *self)
+{
+  return self->id;
+}
+
+const gchar *
+stats_histogram_get_instance(StatsHistogram *self)
+{
+  return self->instance;
+}
+
+const gchar *
+stats_histogram_get_name(StatsHistogram *self)
+{
+  return self->name;
+}
+
+gint64
+stats_histogram_get_monotonic_usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static void
+stats_histogram_free(StatsHistogram *self)
+{
+  gint i;
+
+  for (i = 0; i < STATS_HISTOGRAM_MAX_SHARDS; i++)
+    g_free(self->shards[i]);
+  g_static_mutex_free(&self->shared_lock);
+  g_free(self->id);
+  g_free(self->instance);
+  g_free(self->name);
+  g_free(self->key);
+  g_free(self);
+}
+
+StatsHistogram *
+stats_histogram_register(const gchar *id, const gchar *instance, const gchar *name)
+{
+  StatsHistogram *self;
+  gchar *key;
+
+  key = g_strdup_printf("%s;%s;%s", id ? : "", instance ? : "", name);
+
+  g_static_mutex_lock(&stats_histograms_lock);
+  self = g_hash_table_lookup(stats_histograms, key);
+  if (self)
+    {
+      g_free(key);
+    }
+  else
+    {
+      self = g_new0(StatsHistogram, 1);
+      g_static_mutex_init(&self->shared_lock);
+      self->id = g_strdup(id ? : "");
+      self->instance = g_strdup(instance ? : "");
+      self->name = g_strdup(name);
+      self->key = key;
+      g_hash_table_insert(stats_histograms, self->key, self);
+    }
+  self->ref_cnt++;
+  g_static_mutex_unlock(&stats_histograms_lock);
+  return self;
+}
+
+void
+stats_histogram_unregister(StatsHistogram **histogram)
+{
+  StatsHistogram *self = *histogram;
+
+  if (!self)
+    return;
+
+  g_static_mutex_lock(&stats_histograms_lock);
+  if (--self->ref_cnt == 0)
+    {
+      g_hash_table_remove(stats_histograms, self->key);
+      stats_histogram_free(self);
+    }
+  g_static_mutex_unlock(&stats_histograms_lock);
+  *histogram = NULL;
+}
+
+typedef struct _StatsHistogramForeachArgs
+{
+  StatsHistogramForeachFunc func;
+  gpointer user_data;
+} StatsHistogramForeachArgs;
+
+static void
+_foreach_histogram(gpointer key, gpointer value, gpointer user_data)
+{
+  StatsHistogramForeachArgs *args = (StatsHistogramForeachArgs *) user_data;
+
+  args->func((StatsHistogram *) value, args->user_data);
+}
+
+void
+stats_histogram_foreach(StatsHistogramForeachFunc func, gpointer user_data)
+{
+  StatsHistogramForeachArgs args = { func, user_data };
+
+  g_static_mutex_lock(&stats_histograms_lock);
+  if (stats_histograms)
+    g_hash_table_foreach(stats_histograms, _foreach_histogram, &args);
+  g_static_mutex_unlock(&stats_histograms_lock);
+}
+
+static void
+_reset_histogram(StatsHistogram *self, gpointer user_data)
+{
+  stats_histogram_reset(self);
+}
+
+void
+stats_histogram_reset_all(void)
+{
+  stats_histogram_foreach(_reset_histogram, NULL);
+}
+
+static void
+_format_csv(StatsHistogram *self, gpointer user_data)
+{
+  GString *csv = (GString *) user_data;
+  StatsHistogramSnapshot *snapshot = g_new(StatsHistogramSnapshot, 1);
+
+  stats_histogram_snapshot(self, snapshot);
+  g_string_append_printf(csv,
+                         "latency;%s;%s;a;%s_count;%" G_GUINT64_FORMAT "\n"
+                         "latency;%s;%s;a;%s_p50_usec;%" G_GUINT64_FORMAT "\n"
+                         "latency;%s;%s;a;%s_p90_usec;%" G_GUINT64_FORMAT "\n"
+                         "latency;%s;%s;a;%s_p99_usec;%" G_GUINT64_FORMAT "\n"
+                         "latency;%s;%s;a;%s_max_usec;%" G_GUINT64_FORMAT "\n",
+                         self->id, self->instance, self->name, snapshot->count,
+                         self->id, self->instance, self->name, stats_histogram_snapshot_get_percentile(snapshot, 50),
+                         self->id, self->instance, self->name, stats_histogram_snapshot_get_percentile(snapshot, 90),
+                         self->id, self->instance, self->name, stats_histogram_snapshot_get_percentile(snapshot, 99),
+                         self->id, self->instance, self->name, snapshot->max);
+  g_free(snapshot);
+}
+
+/* appends percentile rows to the output of the STATS command */
+void
+stats_histogram_format_csv(GString *csv)
+{
+  stats_histogram_foreach(_format_csv, csv);
+}
+
+static void
+_format_buckets(StatsHistogram *self, gpointer user_data)
+{
+  GString *result = (GString *) user_data;
+  StatsHistogramSnapshot *snapshot = g_new(StatsHistogramSnapshot, 1);
+  gint i;
+
+  stats_histogram_snapshot(self, snapshot);
+  g_string_append_printf(result, "%s;%s;%s;count;%" G_GUINT64_FORMAT "\n",
+                         self->id, self->instance, self->name, snapshot->count);
+  for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    {
+      if (snapshot->buckets[i] == 0)
+        continue;
+      g_string_append_printf(result, "%s;%s;%s;%" G_GUINT64_FORMAT ";%" G_GUINT64_FORMAT "\n",
+                             self->id, self->instance, self->name,
+                             stats_histogram_get_bucket_upper_bound(i), snapshot->buckets[i]);
+    }
+  g_free(snapshot);
+}
+
+/* dumps the non-empty buckets of every histogram, one line per bucket,
+ * identified by the upper bound of the bucket in microseconds */
+void
+stats_histogram_format_buckets(GString *result)
+{
+  g_string_append(result, "SourceId;SourceInstance;Name;BucketUsec;Number\n");
+  stats_histogram_foreach(_format_buckets, result);
+}
+
+void
+stats_histogram_registry_init(void)
+{
+  stats_histograms = g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+void
+stats_histogram_registry_deinit(void)
+{
+  g_hash_table_destroy(stats_histograms);
+  stats_histograms = NULL;
+}
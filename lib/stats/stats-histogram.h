@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2002-2013 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef STATS_HISTOGRAM_H_INCLUDED
+#define STATS_HISTOGRAM_H_INCLUDED 1
+
+#include "syslog-ng.h"
+
+/* values below 2^STATS_HISTOGRAM_SUB_BITS are counted exactly, larger
+ * ones are split into 2^STATS_HISTOGRAM_SUB_BITS linear sub-buckets per
+ * power of two, which keeps the relative error below ~6% */
+#define STATS_HISTOGRAM_SUB_BITS    4
+#define STATS_HISTOGRAM_SUB_BUCKETS (1 << STATS_HISTOGRAM_SUB_BITS)
+#define STATS_HISTOGRAM_MAX_BITS    40
+#define STATS_HISTOGRAM_BUCKETS     ((STATS_HISTOGRAM_MAX_BITS - STATS_HISTOGRAM_SUB_BITS + 1) * STATS_HISTOGRAM_SUB_BUCKETS)
+#define STATS_HISTOGRAM_MAX_VALUE   ((G_GUINT64_CONSTANT(1) << STATS_HISTOGRAM_MAX_BITS) - 1)
+
+typedef struct _StatsHistogram StatsHistogram;
+
+typedef struct _StatsHistogramSnapshot
+{
+  guint64 buckets[STATS_HISTOGRAM_BUCKETS];
+  guint64 count;
+  guint64 max;
+} StatsHistogramSnapshot;
+
+typedef void (*StatsHistogramForeachFunc)(StatsHistogram *histogram, gpointer user_data);
+
+gint stats_histogram_get_bucket(guint64 value);
+guint64 stats_histogram_get_bucket_lower_bound(gint bucket);
+guint64 stats_histogram_get_bucket_upper_bound(gint bucket);
+
+void stats_histogram_record(StatsHistogram *self, guint64 value);
+void stats_histogram_snapshot(StatsHistogram *self, StatsHistogramSnapshot *snapshot);
+guint64 stats_histogram_snapshot_get_percentile(StatsHistogramSnapshot *snapshot, gdouble percentile);
+void stats_histogram_reset(StatsHistogram *self);
+void stats_histogram_reset_all(void);
+
+const gchar *stats_histogram_get_id(StatsHistogram *self);
+const gchar *stats_histogram_get_instance(StatsHistogram *self);
+const gchar *stats_histogram_get_name(StatsHistogram *self);
+
+StatsHistogram *stats_histogram_register(const gchar *id, const gchar *instance, const gchar *name);
+void stats_histogram_unregister(StatsHistogram **histogram);
+void stats_histogram_foreach(StatsHistogramForeachFunc func, gpointer user_data);
+
+gint64 stats_histogram_get_monotonic_usec(void);
+
+void stats_histogram_format_csv(GString *csv);
+void stats_histogram_format_buckets(GString *result);
+
+void stats_histogram_registry_init(void);
+void stats_histogram_registry_deinit(void);
+
+#endif
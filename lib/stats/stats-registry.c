@@ -27,6 +27,7 @@
 
 static GHashTable *counter_hash;
 static GStaticMutex stats_mutex = G_STATIC_MUTEX_INIT;
+static gint stats_generation;
 gboolean stats_locked;
 
 void
@@ -43,6 +44,18 @@ stats_unlock(void)
   g_static_mutex_unlock(&stats_mutex);
 }
 
+static StatsCounterItem *
+_track_counter(StatsCluster *sc, StatsCounterType type)
+{
+  guint16 live_mask = sc->live_mask;
+  StatsCounterItem *counter;
+
+  counter = stats_cluster_track_counter(sc, type);
+  if (sc->live_mask != live_mask)
+    g_atomic_int_inc(&stats_generation);
+  return counter;
+}
+
 static StatsCluster *
 _grab_cluster(gint stats_level, gint component, const gchar *id, const gchar *instance, gboolean dynamic)
 {
@@ -68,6 +81,7 @@ _grab_cluster(gint stats_level, gint component, const gchar *id, const gchar *in
       sc = stats_cluster_new(component, id, instance);
       sc->dynamic = dynamic;
       g_hash_table_insert(counter_hash, sc, sc);
+      g_atomic_int_inc(&stats_generation);
     }
   else
     {
@@ -91,7 +105,7 @@ _register_counter(gint stats_level, gint component, const gchar *id, const gchar
 
   sc = _grab_cluster(stats_level, component, id, instance, dynamic);
   if (sc)
-    *counter = stats_cluster_track_counter(sc, type);
+    *counter = _track_counter(sc, type);
   else
     *counter = NULL;
   return sc;
@@ -168,7 +182,7 @@ stats_register_associated_counter(StatsCluster *sc, StatsCounterType type, Stats
     return;
   g_assert(sc->dynamic);
 
-  *counter = stats_cluster_track_counter(sc, type);
+  *counter = _track_counter(sc, type);
 }
 
 void
@@ -232,8 +246,12 @@ _foreach_cluster_remove_helper(gpointer key, gpointer value, gpointer user_data)
   StatsForeachClusterRemoveFunc func = args[0];
   gpointer func_data = args[1];
   StatsCluster *sc = (StatsCluster *) value;
-  
-  return func(sc, func_data);
+
+  if (!func(sc, func_data))
+    return FALSE;
+
+  g_atomic_int_inc(&stats_generation);
+  return TRUE;
 }
 
 void
@@ -262,6 +280,17 @@ stats_foreach_counter(StatsForeachCounterFunc func, gpointer user_data)
   stats_foreach_cluster(_foreach_counter_helper, args);
 }
 
+/*
+ * Changes whenever a StatsCluster is added to or removed from the
+ * registry, can be used to detect that the set of counters has changed
+ * without taking stats_lock().
+ */
+guint32
+stats_registry_get_generation(void)
+{
+  return (guint32) g_atomic_int_get(&stats_generation);
+}
+
 void
 stats_registry_init(void)
 {
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2002-2013 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "stats/stats-shm.h"
+#include "stats/stats-csv.h"
+#include "stats/stats-registry.h"
+#include "messages.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/*
+ * Shared memory statistics export
+ *
+ * When stats-shm-file() is set, the counters are periodically published
+ * into a memory mapped file, which external exporters can read without
+ * talking to syslog-ng, and without ever taking stats_lock().  The
+ * segment consists of a StatsShmHeader, a table of StatsShmEntry
+ * structures pointing into a name table, and an array of 32 bit counter
+ * values, in the same order as the entries.
+ *
+ * The name table is only rebuilt (under stats_lock()) when the set of
+ * registered counters changes, otherwise publishing is a plain copy of the
+ * counter values.  This is safe without the lock, as StatsClusters are
+ * only freed from the main thread (while pruning), which is also where
+ * publishing happens, and pruning changes the registry generation.
+ *
+ * Updates are protected by a seqlock: the writer makes the sequence number
+ * odd while it updates the segment, and even again once it is finished.
+ * Readers retry whenever they see an odd sequence number or the sequence
+ * number changes while they read.  The segment never shrinks, in case it
+ * grows, readers need to remap it based on segment_size.
+ */
+
+typedef struct _StatsShm
+{
+  gchar *filename;
+  gint fd;
+  StatsShmHeader *header;
+  gsize segment_size;
+  guint32 layout_generation;
+  gboolean layout_valid;
+  GPtrArray *counters;
+} StatsShm;
+
+static StatsShm *stats_shm;
+
+static gboolean
+stats_shm_resize(StatsShm *self, gsize required_size)
+{
+  gsize new_size;
+  gpointer map;
+
+  if (required_size <= self->segment_size)
+    return TRUE;
+
+  new_size = MAX(self->segment_size, 4096);
+  while (new_size < required_size)
+    new_size *= 2;
+
+  if (ftruncate(self->fd, new_size) < 0)
+    {
+      msg_error("Error resizing the shared memory statistics file",
+                evt_tag_str("filename", self->filename),
+                evt_tag_errno("error", errno),
+                NULL);
+      return FALSE;
+    }
+
+  map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+  if (map == MAP_FAILED)
+    {
+      msg_error("Error mapping the shared memory statistics file",
+                evt_tag_str("filename", self->filename),
+                evt_tag_errno("error", errno),
+                NULL);
+      return FALSE;
+    }
+
+  if (self->header)
+    munmap(self->header, self->segment_size);
+  self->header = (StatsShmHeader *) map;
+  self->segment_size = new_size;
+  return TRUE;
+}
+
+static inline guint32 *
+stats_shm_get_values(StatsShm *self)
+{
+  return (guint32 *) (((gchar *) self->header) + self->header->values_offset);
+}
+
+typedef struct _StatsShmLayoutState
+{
+  GPtrArray *counters;
+  GArray *entries;
+  GString *names;
+} StatsShmLayoutState;
+
+static void
+stats_shm_collect_counter(StatsCluster *sc, gint type, StatsCounterItem *counter, gpointer user_data)
+{
+  StatsShmLayoutState *state = (StatsShmLayoutState *) user_data;
+  StatsShmEntry entry;
+
+  entry.name_offset = state->names->len;
+  stats_format_csv_counter_name(sc, type, state->names);
+  entry.name_len = state->names->len - entry.name_offset;
+  g_string_append_c(state->names, 0);
+
+  g_array_append_val(state->entries, entry);
+  g_ptr_array_add(state->counters, counter);
+}
+
+/* called while the seqlock is held for writing */
+static void
+stats_shm_rebuild_layout(StatsShm *self)
+{
+  StatsShmLayoutState state;
+  StatsShmHeader *header;
+  guint32 entries_offset, values_offset, names_offset;
+  gsize required_size;
+
+  state.counters = g_ptr_array_new();
+  state.entries = g_array_new(FALSE, FALSE, sizeof(StatsShmEntry));
+  state.names = g_string_sized_new(4096);
+
+  stats_lock();
+  self->layout_generation = stats_registry_get_generation();
+  stats_foreach_counter(stats_shm_collect_counter, &state);
+  stats_unlock();
+
+  entries_offset = sizeof(StatsShmHeader);
+  values_offset = entries_offset + state.entries->len * sizeof(StatsShmEntry);
+  names_offset = values_offset + state.counters->len * sizeof(guint32);
+  required_size = names_offset + state.names->len;
+
+  self->layout_valid = stats_shm_resize(self, required_size);
+  if (self->layout_valid)
+    {
+      header = self->header;
+      header->layout_generation = self->layout_generation;
+      header->segment_size = self->segment_size;
+      header->num_counters = state.counters->len;
+      header->entries_offset = entries_offset;
+      header->values_offset = values_offset;
+      header->names_offset = names_offset;
+      header->names_size = state.names->len;
+      memcpy(((gchar *) header) + entries_offset, state.entries->data, state.entries->len * sizeof(StatsShmEntry));
+      memcpy(((gchar *) header) + names_offset, state.names->str, state.names->len);
+    }
+
+  if (self->counters)
+    g_ptr_array_free(self->counters, TRUE);
+  self->counters = state.counters;
+  g_array_free(state.entries, TRUE);
+  g_string_free(state.names, TRUE);
+}
+
+void
+stats_shm_publish(void)
+{
+  StatsShm *self = stats_shm;
+  guint32 *values;
+  guint i;
+
+  if (!self || !self->header)
+    return;
+
+  /* odd: update in progress */
+  g_atomic_int_inc((gint *) &self->header->seq);
+
+  if (!self->layout_valid || self->layout_generation != stats_registry_get_generation())
+    stats_shm_rebuild_layout(self);
+
+  if (self->layout_valid)
+    {
+      values = stats_shm_get_values(self);
+      for (i = 0; i < self->counters->len; i++)
+        values[i] = stats_counter_get((StatsCounterItem *) g_ptr_array_index(self->counters, i));
+      self->header->update_time = (guint64) time(NULL);
+    }
+
+  /* even: consistent again */
+  g_atomic_int_inc((gint *) &self->header->seq);
+}
+
+static StatsShm *
+stats_shm_new(const gchar *filename)
+{
+  StatsShm *self;
+  gint fd;
+
+  /* the file is recreated, so that readers of a previous instance
+   * don't see a segment that changes under their feet */
+  unlink(filename);
+  fd = open(filename, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    {
+      msg_error("Error creating the shared memory statistics file",
+                evt_tag_str("filename", filename),
+                evt_tag_errno("error", errno),
+                NULL);
+      return NULL;
+    }
+
+  self = g_new0(StatsShm, 1);
+  self->filename = g_strdup(filename);
+  self->fd = fd;
+
+  if (!stats_shm_resize(self, sizeof(StatsShmHeader)))
+    {
+      close(fd);
+      g_free(self->filename);
+      g_free(self);
+      return NULL;
+    }
+
+  memcpy(self->header->magic, STATS_SHM_MAGIC, sizeof(self->header->magic));
+  self->header->version = STATS_SHM_VERSION;
+  self->header->header_size = sizeof(StatsShmHeader);
+  self->header->segment_size = self->segment_size;
+  return self;
+}
+
+static void
+stats_shm_free(StatsShm *self)
+{
+  if (self->header)
+    munmap(self->header, self->segment_size);
+  close(self->fd);
+  unlink(self->filename);
+  if (self->counters)
+    g_ptr_array_free(self->counters, TRUE);
+  g_free(self->filename);
+  g_free(self);
+}
+
+/* @filename: the file to publish counters into, NULL disables the export */
+void
+stats_shm_reinit(const gchar *filename)
+{
+  if (stats_shm && filename && strcmp(stats_shm->filename, filename) == 0)
+    {
+      /* counters may have been unregistered during reload */
+      stats_shm->layout_valid = FALSE;
+      return;
+    }
+
+  stats_shm_deinit();
+  if (filename)
+    stats_shm = stats_shm_new(filename);
+}
+
+void
+stats_shm_deinit(void)
+{
+  if (!stats_shm)
+    return;
+  stats_shm_free(stats_shm);
+  stats_shm = NULL;
+}
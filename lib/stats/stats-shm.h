@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2002-2013 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef STATS_SHM_H_INCLUDED
+#define STATS_SHM_H_INCLUDED 1
+
+#include "syslog-ng.h"
+
+/*
+ * Layout of the shared memory statistics segment, see stats-shm.c for
+ * a description.  Every offset is relative to the start of the segment,
+ * integers are in host byte order.
+ */
+
+#define STATS_SHM_MAGIC   "SNGSTATS"
+#define STATS_SHM_VERSION 1
+
+typedef struct _StatsShmHeader
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 header_size;
+  /* seqlock, odd while the segment is being updated */
+  volatile guint32 seq;
+  /* changes whenever the set of counters (and thus the name table) changes */
+  guint32 layout_generation;
+  /* the segment never shrinks, readers must remap if this grew */
+  guint32 segment_size;
+  guint32 num_counters;
+  /* StatsShmEntry[num_counters] */
+  guint32 entries_offset;
+  /* guint32[num_counters] */
+  guint32 values_offset;
+  guint32 names_offset;
+  guint32 names_size;
+  /* UNIX time of the last update */
+  guint64 update_time;
+} StatsShmHeader;
+
+/* name_offset is relative to names_offset, names are NUL terminated and
+ * formatted as "component;id;instance;type", escaped the same way as in
+ * the CSV output */
+typedef struct _StatsShmEntry
+{
+  guint32 name_offset;
+  guint32 name_len;
+} StatsShmEntry;
+
+void stats_shm_reinit(const gchar *filename);
+void stats_shm_publish(void);
+void stats_shm_deinit(void);
+
+#endif
@@ -26,6 +26,9 @@
 #include "stats/stats-syslog.h"
 #include "stats/stats-registry.h"
 #include "stats/stats-log.h"
+#include "stats/stats-histogram.h"
+#include "stats/stats-dynamic-cache.h"
+#include "stats/stats-shm.h"
 #include "timeutils.h"
 
 #include <string.h>
@@ -90,6 +93,13 @@ stats_check_level(gint level)
     return level == 0;
 }
 
+/* latency histograms are only collected when stats-latency(yes) is set */
+gboolean
+stats_check_latency(void)
+{
+  return stats_options && stats_options->latency;
+}
+
 static gboolean
 stats_cluster_is_expired(StatsCluster *sc, time_t now)
 {
@@ -165,6 +175,10 @@ stats_publish_and_prune_counters(void)
   stats_foreach_cluster_remove(stats_format_and_prune_cluster, &st);
   stats_unlock();
 
+  /* let the per-thread caches drop their references, so that unused
+   * dynamic counters can be pruned the next time */
+  stats_dynamic_cache_invalidate();
+
   if (publish)
     msg_event_send(st.stats_event);
 
@@ -233,23 +247,50 @@ stats_timer_reinit(void)
   stats_timer_rearm(&stats_timer);
 }
 
+static struct iv_timer stats_shm_timer;
+
+static void
+stats_shm_timer_elapsed(gpointer st)
+{
+  stats_shm_publish();
+  stats_timer_rearm(&stats_shm_timer);
+}
+
+static void
+stats_shm_timer_reinit(void)
+{
+  stats_timer_kill(&stats_shm_timer);
+  stats_shm_reinit(stats_options->shm_file);
+  if (stats_options->shm_file)
+    {
+      stats_shm_publish();
+      stats_timer_init(&stats_shm_timer, stats_shm_timer_elapsed, 1);
+      stats_timer_rearm(&stats_shm_timer);
+    }
+}
+
 void
 stats_reinit(StatsOptions *options)
 {
   stats_options = options;
   stats_syslog_reinit();
   stats_timer_reinit();
+  stats_shm_timer_reinit();
 }
 
 void
 stats_init(void)
 {
   stats_registry_init();
+  stats_histogram_registry_init();
 }
 
 void
 stats_destroy(void)
 {
+  stats_timer_kill(&stats_shm_timer);
+  stats_shm_deinit();
+  stats_histogram_registry_deinit();
   stats_registry_deinit();
 }
 
@@ -259,4 +300,13 @@ stats_options_defaults(StatsOptions *options)
   options->level = 0;
   options->log_freq = 600;
   options->lifetime = 600;
+  options->latency = FALSE;
+  options->shm_file = NULL;
+}
+
+void
+stats_options_destroy(StatsOptions *options)
+{
+  g_free(options->shm_file);
+  options->shm_file = NULL;
 }
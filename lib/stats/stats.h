@@ -33,6 +33,8 @@ typedef struct _StatsOptions
   gint log_freq;
   gint level;
   gint lifetime;
+  gboolean latency;
+  gchar *shm_file;
 } StatsOptions;
 
 enum
@@ -48,6 +50,7 @@ void stats_init(void);
 void stats_destroy(void);
 
 void stats_options_defaults(StatsOptions *options);
+void stats_options_destroy(StatsOptions *options);
 
 
 #endif
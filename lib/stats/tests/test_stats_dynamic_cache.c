@@ -0,0 +1,174 @@
+#include "testutils.h"
+#include "stats/stats.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-dynamic-cache.h"
+#include "mainloop-worker.h"
+#include "apphook.h"
+
+#include <string.h>
+
+#define STATS_DYNAMIC_CACHE_TESTCASE(x) x()
+
+typedef struct _ClusterLookup
+{
+  const gchar *instance;
+  StatsCluster *sc;
+} ClusterLookup;
+
+static void
+_find_cluster(StatsCluster *sc, gpointer user_data)
+{
+  ClusterLookup *lookup = (ClusterLookup *) user_data;
+
+  if (strcmp(sc->instance, lookup->instance) == 0)
+    lookup->sc = sc;
+}
+
+static StatsCluster *
+find_cluster(const gchar *instance)
+{
+  ClusterLookup lookup = { instance, NULL };
+
+  stats_lock();
+  stats_foreach_cluster(_find_cluster, &lookup);
+  stats_unlock();
+  return lookup.sc;
+}
+
+static void
+test_increments_are_visible_in_the_registry(void)
+{
+  StatsCluster *sc;
+  gint i;
+
+  for (i = 0; i < 10; i++)
+    stats_dynamic_cache_inc(2, SCS_HOST | SCS_SOURCE, "host1", 1000 + i);
+
+  sc = find_cluster("host1");
+  assert_not_null(sc, "dynamic cluster was not registered");
+  assert_true(sc->dynamic, "cluster should be dynamic");
+  assert_guint32(stats_counter_get(&sc->counters[SC_TYPE_PROCESSED]), 10, "processed counter mismatch");
+  assert_guint32(stats_counter_get(&sc->counters[SC_TYPE_STAMP]), 1009, "stamp counter mismatch");
+  assert_true(sc->use_count > 0, "cached cluster should be referenced");
+}
+
+static void
+test_same_instance_with_different_component_is_a_different_counter(void)
+{
+  stats_dynamic_cache_inc(2, SCS_HOST | SCS_SOURCE, "name2", -1);
+  stats_dynamic_cache_inc(3, SCS_PROGRAM | SCS_SOURCE, "name2", -1);
+  stats_dynamic_cache_inc(3, SCS_PROGRAM | SCS_SOURCE, "name2", -1);
+
+  stats_lock();
+  {
+    StatsCounterItem *host, *program;
+
+    stats_register_dynamic_counter(2, SCS_HOST | SCS_SOURCE, NULL, "name2", SC_TYPE_PROCESSED, &host);
+    stats_register_dynamic_counter(3, SCS_PROGRAM | SCS_SOURCE, NULL, "name2", SC_TYPE_PROCESSED, &program);
+    assert_guint32(stats_counter_get(host), 1, "host counter mismatch");
+    assert_guint32(stats_counter_get(program), 2, "program counter mismatch");
+    stats_unregister_counter(SCS_HOST | SCS_SOURCE, NULL, "name2", SC_TYPE_PROCESSED, &host);
+    stats_unregister_counter(SCS_PROGRAM | SCS_SOURCE, NULL, "name2", SC_TYPE_PROCESSED, &program);
+  }
+  stats_unlock();
+}
+
+static void
+test_invalidate_drops_cached_references(void)
+{
+  StatsCluster *sc;
+
+  stats_dynamic_cache_inc(2, SCS_HOST | SCS_SOURCE, "host3", -1);
+  sc = find_cluster("host3");
+  assert_true(sc->use_count > 0, "cached cluster should be referenced");
+
+  stats_dynamic_cache_invalidate();
+  /* references are dropped by the next increment, which caches the
+   * counter it increments again */
+  stats_dynamic_cache_inc(2, SCS_HOST | SCS_SOURCE, "host1", -1);
+  assert_gint(sc->use_count, 0, "invalidated cluster should not be referenced anymore");
+  assert_guint32(stats_counter_get(&sc->counters[SC_TYPE_PROCESSED]), 1, "counter value should be kept");
+}
+
+static gpointer
+_increment_in_worker_thread(gpointer user_data)
+{
+  StatsCluster *sc;
+
+  main_loop_worker_thread_start(NULL);
+  stats_dynamic_cache_inc(2, SCS_HOST | SCS_SOURCE, "host4", -1);
+  sc = find_cluster("host4");
+  assert_true(sc->use_count > 0, "cached cluster should be referenced during the batch");
+
+  main_loop_worker_invoke_batch_callbacks();
+  assert_true(sc->use_count > 0, "cached references should be kept across batches");
+
+  /* invalidated at the end of the next batch, without any further
+   * increments */
+  stats_dynamic_cache_inc(2, SCS_HOST | SCS_SOURCE, "host4", -1);
+  stats_dynamic_cache_invalidate();
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(sc->use_count, 0, "cached references should be dropped at the end of the batch after invalidation");
+  assert_guint32(stats_counter_get(&sc->counters[SC_TYPE_PROCESSED]), 2, "counter value should be kept");
+
+  main_loop_worker_thread_stop();
+  return NULL;
+}
+
+static void
+test_batch_end_drops_invalidated_references(void)
+{
+  g_thread_join(g_thread_create(_increment_in_worker_thread, NULL, TRUE, NULL));
+}
+
+/* more instances than the slots of the cache, most slots are filled */
+#define NUM_INSTANCES 1024
+
+static gpointer
+_increment_many_in_worker_thread(gpointer user_data)
+{
+  StatsCluster *sc;
+  gchar instance[32];
+  gint i;
+
+  main_loop_worker_thread_start(NULL);
+  for (i = 0; i < NUM_INSTANCES; i++)
+    {
+      g_snprintf(instance, sizeof(instance), "many%d", i);
+      stats_dynamic_cache_inc(2, SCS_HOST | SCS_SOURCE, instance, -1);
+    }
+  sc = find_cluster(instance);
+  assert_true(sc->use_count > 0, "cached cluster should be referenced during the batch");
+
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(sc->use_count, 0, "cached references should be dropped at the end of the batch above the size bound");
+
+  main_loop_worker_thread_stop();
+  return NULL;
+}
+
+static void
+test_batch_end_drops_references_above_size_bound(void)
+{
+  g_thread_join(g_thread_create(_increment_many_in_worker_thread, NULL, TRUE, NULL));
+}
+
+int
+main(int argc, char *argv[])
+{
+  StatsOptions options;
+
+  app_startup();
+  stats_options_defaults(&options);
+  options.level = 3;
+  stats_reinit(&options);
+
+  STATS_DYNAMIC_CACHE_TESTCASE(test_increments_are_visible_in_the_registry);
+  STATS_DYNAMIC_CACHE_TESTCASE(test_same_instance_with_different_component_is_a_different_counter);
+  STATS_DYNAMIC_CACHE_TESTCASE(test_invalidate_drops_cached_references);
+  STATS_DYNAMIC_CACHE_TESTCASE(test_batch_end_drops_invalidated_references);
+  STATS_DYNAMIC_CACHE_TESTCASE(test_batch_end_drops_references_above_size_bound);
+
+  app_shutdown();
+  return 0;
+}
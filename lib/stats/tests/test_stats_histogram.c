@@ -0,0 +1,149 @@
+#include "testutils.h"
+#include "stats/stats-histogram.h"
+#include "mainloop-worker.h"
+
+#define STATS_HISTOGRAM_TESTCASE(x) x()
+
+static void
+test_small_values_have_their_own_buckets(void)
+{
+  gint i;
+
+  for (i = 0; i < STATS_HISTOGRAM_SUB_BUCKETS; i++)
+    {
+      assert_gint(stats_histogram_get_bucket(i), i, "small values should be counted exactly, value: %d", i);
+      assert_guint64(stats_histogram_get_bucket_lower_bound(i), i, "lower bound mismatch for bucket %d", i);
+      assert_guint64(stats_histogram_get_bucket_upper_bound(i), i, "upper bound mismatch for bucket %d", i);
+    }
+}
+
+static void
+test_values_fall_between_the_bounds_of_their_bucket(void)
+{
+  guint64 values[] = { 16, 17, 31, 32, 33, 1000, 1023, 1024, 123456, 999999999, STATS_HISTOGRAM_MAX_VALUE };
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS(values); i++)
+    {
+      gint bucket = stats_histogram_get_bucket(values[i]);
+
+      assert_true(bucket < STATS_HISTOGRAM_BUCKETS, "bucket out of range for value %" G_GUINT64_FORMAT, values[i]);
+      assert_true(stats_histogram_get_bucket_lower_bound(bucket) <= values[i] &&
+                  stats_histogram_get_bucket_upper_bound(bucket) >= values[i],
+                  "value %" G_GUINT64_FORMAT " is outside of its bucket", values[i]);
+    }
+  assert_gint(stats_histogram_get_bucket(G_MAXUINT64), STATS_HISTOGRAM_BUCKETS - 1,
+              "values above the maximum should go to the last bucket");
+}
+
+static void
+test_buckets_are_contiguous(void)
+{
+  gint i;
+
+  for (i = 1; i < STATS_HISTOGRAM_BUCKETS; i++)
+    assert_guint64(stats_histogram_get_bucket_lower_bound(i), stats_histogram_get_bucket_upper_bound(i - 1) + 1,
+                   "gap between buckets %d and %d", i - 1, i);
+}
+
+static void
+test_percentiles_are_merged_from_all_threads(void)
+{
+  StatsHistogram *histogram = stats_histogram_register("id", "instance", "test");
+  StatsHistogramSnapshot *snapshot = g_new(StatsHistogramSnapshot, 1);
+  gint i;
+
+  /* 1..100 usec, half from the main thread, half from a worker */
+  for (i = 1; i <= 100; i++)
+    {
+      main_loop_worker_set_thread_id(i % 2 ? -1 : 0);
+      stats_histogram_record(histogram, i);
+    }
+  main_loop_worker_set_thread_id(-1);
+
+  stats_histogram_snapshot(histogram, snapshot);
+  assert_guint64(snapshot->count, 100, "count mismatch");
+  assert_guint64(snapshot->max, 100, "max mismatch");
+  assert_true(stats_histogram_snapshot_get_percentile(snapshot, 50) >= 50 &&
+              stats_histogram_snapshot_get_percentile(snapshot, 50) <= 53,
+              "p50 is out of the expected range");
+  assert_guint64(stats_histogram_snapshot_get_percentile(snapshot, 100), 100, "p100 should be the maximum");
+
+  stats_histogram_reset(histogram);
+  stats_histogram_snapshot(histogram, snapshot);
+  assert_guint64(snapshot->count, 0, "count should be zero after reset");
+
+  g_free(snapshot);
+  stats_histogram_unregister(&histogram);
+  assert_true(histogram == NULL, "unregister should clear the reference");
+}
+
+#define NUM_THREADS 4
+#define RECORDS_PER_THREAD 10000
+
+static gpointer
+_record_without_worker_id(gpointer user_data)
+{
+  StatsHistogram *histogram = (StatsHistogram *) user_data;
+  gint i;
+
+  for (i = 0; i < RECORDS_PER_THREAD; i++)
+    stats_histogram_record(histogram, 1000);
+  return NULL;
+}
+
+static void
+test_threads_without_worker_id_do_not_lose_values(void)
+{
+  StatsHistogram *histogram = stats_histogram_register("id", "instance", "shared");
+  StatsHistogramSnapshot *snapshot = g_new(StatsHistogramSnapshot, 1);
+  GThread *threads[NUM_THREADS];
+  gint i;
+
+  for (i = 0; i < NUM_THREADS; i++)
+    threads[i] = g_thread_create(_record_without_worker_id, histogram, TRUE, NULL);
+  for (i = 0; i < NUM_THREADS; i++)
+    g_thread_join(threads[i]);
+
+  stats_histogram_snapshot(histogram, snapshot);
+  assert_guint64(snapshot->count, NUM_THREADS * RECORDS_PER_THREAD, "values recorded in parallel were lost");
+  assert_guint64(snapshot->buckets[stats_histogram_get_bucket(1000)], NUM_THREADS * RECORDS_PER_THREAD,
+                 "values recorded in parallel were lost from their bucket");
+  assert_guint64(snapshot->max, 1000, "max mismatch");
+
+  g_free(snapshot);
+  stats_histogram_unregister(&histogram);
+}
+
+static void
+test_registry_returns_the_same_histogram_for_the_same_key(void)
+{
+  StatsHistogram *h1 = stats_histogram_register("id", "instance", "test");
+  StatsHistogram *h2 = stats_histogram_register("id", "instance", "test");
+  StatsHistogram *h3 = stats_histogram_register("id", "instance", "other");
+
+  assert_true(h1 == h2, "the same key should yield the same histogram");
+  assert_true(h1 != h3, "different keys should yield different histograms");
+  assert_string(stats_histogram_get_name(h3), "other", "name mismatch");
+
+  stats_histogram_unregister(&h1);
+  stats_histogram_unregister(&h2);
+  stats_histogram_unregister(&h3);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_thread_init(NULL);
+  stats_histogram_registry_init();
+
+  STATS_HISTOGRAM_TESTCASE(test_small_values_have_their_own_buckets);
+  STATS_HISTOGRAM_TESTCASE(test_values_fall_between_the_bounds_of_their_bucket);
+  STATS_HISTOGRAM_TESTCASE(test_buckets_are_contiguous);
+  STATS_HISTOGRAM_TESTCASE(test_percentiles_are_merged_from_all_threads);
+  STATS_HISTOGRAM_TESTCASE(test_threads_without_worker_id_do_not_lose_values);
+  STATS_HISTOGRAM_TESTCASE(test_registry_returns_the_same_histogram_for_the_same_key);
+
+  stats_histogram_registry_deinit();
+  return 0;
+}
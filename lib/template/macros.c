@@ -36,6 +36,7 @@
 #include "hostname.h"
 #include "template/templates.h"
 #include "cfg.h"
+#include "scratch-buffers.h"
 
 #include <string.h>
 
@@ -293,11 +294,11 @@ log_macro_expand(GString *result, gint id, gboolean escape, const LogTemplateOpt
     case M_SDATA:
       if (escape)
         {
-          GString *sdstr = g_string_sized_new(0);
+          SBGString *sdstr = sb_gstring_acquire();
 
-          log_msg_append_format_sdata(msg, sdstr, seq_num);
-          result_append(result, sdstr->str, sdstr->len, TRUE);
-          g_string_free(sdstr, TRUE);
+          log_msg_append_format_sdata(msg, sb_gstring_string(sdstr), seq_num);
+          result_append(result, sb_gstring_string(sdstr)->str, sb_gstring_string(sdstr)->len, TRUE);
+          sb_gstring_release(sdstr);
         }
       else
         {
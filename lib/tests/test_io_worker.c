@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "mainloop.h"
+#include "mainloop-io-worker.h"
+#include "apphook.h"
+
+#include <iv.h>
+
+#define NUM_JOBS 64
+#define ROUNDS_PER_JOB 10
+
+typedef struct _TestJob
+{
+  MainLoopIOWorkerJob io_job;
+  gint rounds;
+  gint work_calls;
+  gint completions;
+} TestJob;
+
+static TestJob jobs[NUM_JOBS];
+static gint jobs_finished;
+
+static void
+_test_job_work(gpointer s)
+{
+  TestJob *self = (TestJob *) s;
+
+  /* the pool guarantees that a job is executed by one worker at a time */
+  self->work_calls++;
+}
+
+static void
+_test_job_complete(gpointer s)
+{
+  TestJob *self = (TestJob *) s;
+
+  self->completions++;
+  if (self->completions < self->rounds)
+    {
+      main_loop_io_worker_job_submit(&self->io_job);
+      return;
+    }
+
+  jobs_finished++;
+  if (jobs_finished == NUM_JOBS)
+    iv_quit();
+}
+
+static void
+_submit_jobs(gint rounds)
+{
+  gint i;
+
+  jobs_finished = 0;
+  for (i = 0; i < NUM_JOBS; i++)
+    {
+      TestJob *job = &jobs[i];
+
+      main_loop_io_worker_job_init(&job->io_job);
+      job->io_job.work = _test_job_work;
+      job->io_job.completion = _test_job_complete;
+      job->io_job.user_data = job;
+      job->rounds = rounds;
+      job->work_calls = 0;
+      job->completions = 0;
+      main_loop_io_worker_job_submit(&job->io_job);
+    }
+}
+
+static void
+_assert_all_jobs_ran(gint rounds)
+{
+  gint i;
+
+  assert_gint(jobs_finished, NUM_JOBS, "Not all I/O jobs were completed");
+  for (i = 0; i < NUM_JOBS; i++)
+    {
+      assert_gint(jobs[i].work_calls, rounds, "I/O job %d was executed a wrong number of times", i);
+      assert_gint(jobs[i].completions, rounds, "I/O job %d was completed a wrong number of times", i);
+      assert_false(jobs[i].io_job.working, "I/O job %d is still marked as working", i);
+    }
+}
+
+static void
+test_start_and_stop_without_jobs(void)
+{
+  main_loop_io_worker_init();
+  main_loop_io_worker_deinit();
+}
+
+static void
+test_jobs_are_executed_and_completed(void)
+{
+  main_loop_io_worker_init();
+
+  _submit_jobs(ROUNDS_PER_JOB);
+  iv_main();
+  _assert_all_jobs_ran(ROUNDS_PER_JOB);
+
+  main_loop_io_worker_deinit();
+}
+
+static void
+test_pool_can_be_restarted(void)
+{
+  gint i;
+
+  for (i = 0; i < 3; i++)
+    {
+      main_loop_io_worker_init();
+
+      _submit_jobs(1);
+      iv_main();
+      _assert_all_jobs_ran(1);
+
+      main_loop_io_worker_deinit();
+    }
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+  main_loop_worker_init();
+
+  test_start_and_stop_without_jobs();
+  test_jobs_are_executed_and_completed();
+  test_pool_can_be_restarted();
+
+  main_loop_worker_deinit();
+  app_shutdown();
+  return 0;
+}
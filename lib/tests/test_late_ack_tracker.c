@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "ack_tracker.h"
+#include "bookmark.h"
+#include "logsource.h"
+#include "mainloop-worker.h"
+#include "apphook.h"
+#include "cfg.h"
+
+#define WINDOW_SIZE 10
+
+typedef struct _PostedMessage
+{
+  LogMessage *msg;
+  LogPathOptions path_options;
+} PostedMessage;
+
+static LogSourceOptions source_options;
+static PostedMessage posted[WINDOW_SIZE];
+static gint num_posted;
+static gint last_saved_bookmark;
+static gint saved_bookmarks;
+
+static void
+_save_bookmark(Bookmark *bookmark)
+{
+  last_saved_bookmark = *(gint *) &bookmark->container;
+  saved_bookmarks++;
+}
+
+static void
+_capture_message(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  posted[num_posted].msg = msg;
+  posted[num_posted].path_options = *path_options;
+  num_posted++;
+}
+
+static LogSource *
+_create_source(void)
+{
+  LogSource *source = g_new0(LogSource, 1);
+
+  log_source_init_instance(source, configuration);
+  source->super.queue = _capture_message;
+  log_source_set_options(source, &source_options, 0, SCS_FILE, "test", "late_ack_tracker", FALSE, TRUE, NULL);
+  assert_true(log_pipe_init(&source->super), "Error initializing test source");
+
+  num_posted = 0;
+  last_saved_bookmark = -1;
+  saved_bookmarks = 0;
+  return source;
+}
+
+static void
+_destroy_source(LogSource *source)
+{
+  log_pipe_deinit(&source->super);
+  log_pipe_unref(&source->super);
+}
+
+static void
+_post_messages(LogSource *source, gint n)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    {
+      Bookmark *bookmark = ack_tracker_request_bookmark(source->ack_tracker);
+
+      assert_not_null(bookmark, "Late ack tracker ran out of bookmarks");
+      *(gint *) &bookmark->container = num_posted;
+      bookmark->save = _save_bookmark;
+      log_source_post(source, log_msg_new_empty());
+    }
+}
+
+static void
+_ack_message(gint index)
+{
+  log_msg_ack(posted[index].msg, &posted[index].path_options, AT_PROCESSED);
+  log_msg_unref(posted[index].msg);
+}
+
+static gint
+_window_size(LogSource *source)
+{
+  return g_atomic_counter_get(&source->window_size);
+}
+
+static void
+test_acks_outside_of_batches_are_processed_right_away(void)
+{
+  LogSource *source = _create_source();
+
+  _post_messages(source, 3);
+  assert_gint(_window_size(source), WINDOW_SIZE - 3, "Window was not decreased by posting");
+
+  _ack_message(1);
+  assert_gint(_window_size(source), WINDOW_SIZE - 3, "Window released for a non-continuous ack");
+  assert_gint(saved_bookmarks, 0, "Bookmark saved for a non-continuous ack");
+
+  _ack_message(0);
+  assert_gint(_window_size(source), WINDOW_SIZE - 1, "Window not released after a continuous range was acked");
+  assert_gint(last_saved_bookmark, 1, "Bookmark of the last continuous ack was not saved");
+  assert_gint(saved_bookmarks, 1, "Bookmarks should be saved once per continuous range");
+
+  _ack_message(2);
+  assert_gint(_window_size(source), WINDOW_SIZE, "Window not released completely");
+  assert_gint(last_saved_bookmark, 2, "Bookmark of the last message was not saved");
+
+  _destroy_source(source);
+}
+
+static gpointer
+_batched_acks_thread(gpointer user_data)
+{
+  LogSource *source = (LogSource *) user_data;
+
+  main_loop_worker_thread_start(NULL);
+
+  _post_messages(source, 5);
+
+  /* acks within a batch are only recorded */
+  _ack_message(2);
+  _ack_message(0);
+  _ack_message(1);
+  assert_gint(_window_size(source), WINDOW_SIZE - 5, "Window released before the end of the batch");
+  assert_gint(saved_bookmarks, 0, "Bookmark saved before the end of the batch");
+
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(_window_size(source), WINDOW_SIZE - 2, "Window not released at the end of the batch");
+  assert_gint(saved_bookmarks, 1, "A batch of acks should save a single bookmark");
+  assert_gint(last_saved_bookmark, 2, "Bookmark of the last continuous ack was not saved");
+
+  /* a gap in the acked range keeps the window */
+  _ack_message(4);
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(_window_size(source), WINDOW_SIZE - 2, "Window released for a non-continuous ack");
+  assert_gint(saved_bookmarks, 1, "Bookmark saved for a non-continuous ack");
+
+  _ack_message(3);
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(_window_size(source), WINDOW_SIZE, "Window not released after the gap was filled");
+  assert_gint(saved_bookmarks, 2, "A batch of acks should save a single bookmark");
+  assert_gint(last_saved_bookmark, 4, "Bookmark of the last message was not saved");
+
+  main_loop_worker_thread_stop();
+  return NULL;
+}
+
+static void
+test_acks_are_processed_at_the_end_of_the_batch(void)
+{
+  LogSource *source = _create_source();
+  GThread *thread;
+
+  /* emulate an I/O worker thread that runs batch callbacks */
+  thread = g_thread_create(_batched_acks_thread, source, TRUE, NULL);
+  g_thread_join(thread);
+
+  _destroy_source(source);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+  configuration = cfg_new(VERSION_VALUE);
+
+  log_source_options_defaults(&source_options);
+  source_options.init_window_size = WINDOW_SIZE;
+  log_source_options_init(&source_options, configuration, "test");
+
+  test_acks_outside_of_batches_are_processed_right_away();
+  test_acks_are_processed_at_the_end_of_the_batch();
+
+  log_source_options_destroy(&source_options);
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "logparallelizer.h"
+#include "logmpx.h"
+#include "logmsg.h"
+#include "mainloop.h"
+#include "mainloop-call.h"
+#include "mainloop-worker.h"
+#include "stats/stats-registry.h"
+#include "apphook.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <iv.h>
+
+#define PARALLELIZER_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+#define NUM_HOSTS 8
+#define MESSAGES_PER_HOST 200
+
+/* stats instance of a parallelize() element without a location */
+#define STATS_INSTANCE "#unknown"
+
+/*
+ * The pipe after parallelize(): checks that the messages of each host
+ * arrive in order, processed by the same thread, and either acknowledges
+ * them right away or holds them until the test does.
+ */
+typedef struct _Recorder
+{
+  LogPipe super;
+  GMutex *lock;
+  GCond *cond;
+  gboolean hold_messages;
+  gboolean gate_closed;
+  gint entered;
+
+  gint processed;
+  gint order_errors;
+  gint last_seq[NUM_HOSTS];
+  GThread *threads[NUM_HOSTS];
+  gint thread_errors;
+  GPtrArray *held_messages;
+  GArray *held_path_options;
+} Recorder;
+
+static Recorder recorder;
+static gint acked_messages;
+static struct iv_task quit_task;
+
+static void
+_recorder_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  Recorder *self = (Recorder *) s;
+  gint host = atoi(log_msg_get_value(msg, LM_V_HOST, NULL) + strlen("host"));
+  gint seq = atoi(log_msg_get_value(msg, LM_V_MESSAGE, NULL));
+
+  g_mutex_lock(self->lock);
+  self->entered++;
+  g_cond_broadcast(self->cond);
+  while (self->gate_closed)
+    g_cond_wait(self->cond, self->lock);
+
+  if (seq != self->last_seq[host] + 1)
+    self->order_errors++;
+  self->last_seq[host] = seq;
+
+  if (!self->threads[host])
+    self->threads[host] = g_thread_self();
+  else if (self->threads[host] != g_thread_self())
+    self->thread_errors++;
+  self->processed++;
+
+  if (self->hold_messages)
+    {
+      g_ptr_array_add(self->held_messages, msg);
+      g_array_append_val(self->held_path_options, *path_options);
+      msg = NULL;
+    }
+  g_mutex_unlock(self->lock);
+
+  if (msg)
+    log_msg_drop(msg, path_options);
+}
+
+static void
+_recorder_reset(gboolean hold_messages)
+{
+  gint i;
+
+  recorder.hold_messages = hold_messages;
+  recorder.gate_closed = FALSE;
+  recorder.entered = 0;
+  recorder.processed = 0;
+  recorder.order_errors = 0;
+  recorder.thread_errors = 0;
+  for (i = 0; i < NUM_HOSTS; i++)
+    {
+      recorder.last_seq[i] = -1;
+      recorder.threads[i] = NULL;
+    }
+  acked_messages = 0;
+}
+
+static void
+_recorder_release_held_messages(void)
+{
+  gint i;
+
+  for (i = 0; i < recorder.held_messages->len; i++)
+    log_msg_drop(g_ptr_array_index(recorder.held_messages, i),
+                 &g_array_index(recorder.held_path_options, LogPathOptions, i));
+  g_ptr_array_set_size(recorder.held_messages, 0);
+  g_array_set_size(recorder.held_path_options, 0);
+}
+
+static void
+_recorder_open_gate(void)
+{
+  g_mutex_lock(recorder.lock);
+  recorder.gate_closed = FALSE;
+  g_cond_broadcast(recorder.cond);
+  g_mutex_unlock(recorder.lock);
+}
+
+static void
+_recorder_wait_for_entered(gint count)
+{
+  g_mutex_lock(recorder.lock);
+  while (recorder.entered < count)
+    g_cond_wait(recorder.cond, recorder.lock);
+  g_mutex_unlock(recorder.lock);
+}
+
+static void
+_ack_message(LogMessage *msg, AckType ack_type)
+{
+  g_atomic_int_inc(&acked_messages);
+}
+
+static void
+_queue_message(LogPipe *pipe, gint host, gint seq, gboolean flow_control)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = log_msg_new_empty();
+  gchar buf[32];
+
+  g_snprintf(buf, sizeof(buf), "host%d", host);
+  log_msg_set_value(msg, LM_V_HOST, buf, -1);
+  g_snprintf(buf, sizeof(buf), "%d", seq);
+  log_msg_set_value(msg, LM_V_MESSAGE, buf, -1);
+
+  path_options.ack_needed = TRUE;
+  path_options.flow_control_requested = flow_control;
+  msg->ack_func = _ack_message;
+  log_msg_add_ack(msg, &path_options);
+  log_pipe_queue(pipe, msg, &path_options);
+}
+
+static void
+_queue_messages(LogPipe *parallelizer, gboolean flow_control)
+{
+  gint host, seq;
+
+  for (seq = 0; seq < MESSAGES_PER_HOST; seq++)
+    {
+      for (host = 0; host < NUM_HOSTS; host++)
+        _queue_message(parallelizer, host, seq, flow_control);
+    }
+}
+
+static LogPipe *
+_create_parallelizer_before(gint num_workers, LogPipe *next)
+{
+  LogPipe *parallelizer = log_parallelizer_new(configuration);
+  LogTemplate *partition_key = log_template_new(configuration, NULL);
+
+  assert_true(log_template_compile(partition_key, "$HOST", NULL), "Error compiling the partition key");
+  log_parallelizer_set_workers(parallelizer, num_workers);
+  log_parallelizer_set_partition_key(parallelizer, partition_key);
+  log_pipe_append(parallelizer, next);
+  assert_true(log_pipe_init(parallelizer), "Error initializing parallelize()");
+  return parallelizer;
+}
+
+static LogPipe *
+_create_parallelizer(gint num_workers)
+{
+  return _create_parallelizer_before(num_workers, &recorder.super);
+}
+
+static void
+_quit_main_loop(gpointer user_data)
+{
+  iv_quit();
+}
+
+/* NOTE: registered after the task that reenables the worker jobs, see
+ * main_loop_worker_job_complete() */
+static void
+_workers_stopped(void)
+{
+  iv_task_register(&quit_task);
+}
+
+/* the worker threads process what is still in their queues and exit */
+static void
+_stop_workers_and_destroy(LogPipe *parallelizer)
+{
+  main_loop_worker_sync_call(_workers_stopped);
+  iv_main();
+
+  assert_true(log_pipe_deinit(parallelizer), "Error deinitializing parallelize()");
+  log_pipe_unref(parallelizer);
+}
+
+static void
+test_messages_of_a_partition_are_processed_in_order(void)
+{
+  LogPipe *parallelizer;
+
+  _recorder_reset(FALSE);
+  parallelizer = _create_parallelizer(4);
+
+  _queue_messages(parallelizer, FALSE);
+  assert_gint(g_atomic_int_get(&acked_messages), NUM_HOSTS * MESSAGES_PER_HOST,
+              "Without flow control, messages should be acknowledged when queued");
+
+  _stop_workers_and_destroy(parallelizer);
+  assert_gint(recorder.processed, NUM_HOSTS * MESSAGES_PER_HOST, "Queued messages should be processed before the workers exit");
+  assert_gint(recorder.order_errors, 0, "Messages of the same partition were reordered");
+  assert_gint(recorder.thread_errors, 0, "Messages of the same partition were processed by different threads");
+}
+
+static void
+test_flow_control_releases_the_window_once_processed(void)
+{
+  LogPipe *parallelizer;
+
+  _recorder_reset(TRUE);
+  parallelizer = _create_parallelizer(4);
+
+  _queue_messages(parallelizer, TRUE);
+  _stop_workers_and_destroy(parallelizer);
+  assert_gint(recorder.processed, NUM_HOSTS * MESSAGES_PER_HOST, "Queued messages should be processed before the workers exit");
+  assert_gint(recorder.order_errors, 0, "Messages of the same partition were reordered");
+  assert_gint(g_atomic_int_get(&acked_messages), 0,
+              "With flow control, messages should not be acknowledged until the rest of the log path does");
+
+  _recorder_release_held_messages();
+  assert_gint(g_atomic_int_get(&acked_messages), NUM_HOSTS * MESSAGES_PER_HOST,
+              "With flow control, messages should be acknowledged once the rest of the log path does");
+}
+
+static void
+test_overflowing_messages_are_dropped_and_counted(void)
+{
+  LogPipe *parallelizer;
+  StatsCounterItem *dropped = NULL;
+  gint dropped_before, seq;
+  gint saved_log_fifo_size = configuration->log_fifo_size;
+
+  _recorder_reset(FALSE);
+  configuration->log_fifo_size = 10;
+  parallelizer = _create_parallelizer(1);
+
+  stats_lock();
+  stats_register_counter(0, SCS_GLOBAL, "parallelize", STATS_INSTANCE, SC_TYPE_DROPPED, &dropped);
+  stats_unlock();
+  dropped_before = stats_counter_get(dropped);
+
+  /* the worker is stuck processing the first message, the queue fills up */
+  recorder.gate_closed = TRUE;
+  _queue_message(parallelizer, 0, 0, TRUE);
+  _recorder_wait_for_entered(1);
+  for (seq = 1; seq <= configuration->log_fifo_size + 5; seq++)
+    _queue_message(parallelizer, 0, seq, TRUE);
+
+  assert_gint(stats_counter_get(dropped) - dropped_before, 5, "Messages above log-fifo-size() should be dropped");
+  assert_gint(g_atomic_int_get(&acked_messages), 5, "Dropped messages should be acknowledged");
+
+  _recorder_open_gate();
+  _stop_workers_and_destroy(parallelizer);
+  assert_gint(recorder.processed, configuration->log_fifo_size + 1, "Messages in the queue should be processed");
+  assert_gint(g_atomic_int_get(&acked_messages), configuration->log_fifo_size + 6, "All messages should be acknowledged");
+
+  stats_lock();
+  stats_unregister_counter(SCS_GLOBAL, "parallelize", STATS_INSTANCE, SC_TYPE_DROPPED, &dropped);
+  stats_unlock();
+  configuration->log_fifo_size = saved_log_fifo_size;
+}
+
+/* a rewrite rule after parallelize(), changes $PROGRAM */
+static void
+_rewrite_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  log_msg_make_writable(&msg, path_options);
+  log_msg_set_value(msg, LM_V_PROGRAM, "rewritten", -1);
+  log_pipe_forward_msg(s, msg, path_options);
+}
+
+static LogMessage *other_path_msg;
+
+/* another log path getting the same message, keeps it to check it later */
+static void
+_other_path_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  other_path_msg = log_msg_ref(msg);
+  log_msg_drop(msg, path_options);
+}
+
+static void
+test_rewrite_after_parallelize_does_not_change_other_paths(void)
+{
+  LogPipe rewrite, other_path;
+  LogMultiplexer *mpx;
+  LogPipe *parallelizer;
+  LogMessage *rewritten;
+
+  _recorder_reset(TRUE);
+  log_pipe_init_instance(&rewrite, configuration);
+  rewrite.queue = _rewrite_queue;
+  log_pipe_init_instance(&other_path, configuration);
+  other_path.queue = _other_path_queue;
+
+  parallelizer = _create_parallelizer_before(1, &rewrite);
+  log_pipe_append(&rewrite, &recorder.super);
+
+  mpx = log_multiplexer_new(configuration);
+  log_multiplexer_add_next_hop(mpx, parallelizer);
+  log_multiplexer_add_next_hop(mpx, &other_path);
+  assert_true(log_pipe_init(&mpx->super), "Error initializing the multiplexer");
+
+  /* the worker is stuck processing the first message, so the second one
+   * is only rewritten once the multiplexer has delivered it to both paths */
+  recorder.gate_closed = TRUE;
+  _queue_message(parallelizer, 0, 0, TRUE);
+  _recorder_wait_for_entered(1);
+  _queue_message(&mpx->super, 0, 1, TRUE);
+
+  _recorder_open_gate();
+  _stop_workers_and_destroy(parallelizer);
+  assert_gint(recorder.processed, 2, "Queued messages should be processed");
+
+  rewritten = g_ptr_array_index(recorder.held_messages, 1);
+  assert_string(log_msg_get_value(rewritten, LM_V_PROGRAM, NULL), "rewritten",
+                "The message should be rewritten after parallelize()");
+  assert_string(log_msg_get_value(other_path_msg, LM_V_PROGRAM, NULL), "",
+                "The rewrite after parallelize() should not change the message of the other log path");
+
+  _recorder_release_held_messages();
+  assert_gint(g_atomic_int_get(&acked_messages), 2, "All messages should be acknowledged");
+
+  log_msg_unref(other_path_msg);
+  log_pipe_deinit(&mpx->super);
+  log_pipe_unref(&mpx->super);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+  main_loop_worker_init();
+  main_loop_call_init();
+
+  configuration = cfg_new(VERSION_VALUE);
+
+  IV_TASK_INIT(&quit_task);
+  quit_task.handler = _quit_main_loop;
+
+  log_pipe_init_instance(&recorder.super, configuration);
+  recorder.super.queue = _recorder_queue;
+  recorder.lock = g_mutex_new();
+  recorder.cond = g_cond_new();
+  recorder.held_messages = g_ptr_array_new();
+  recorder.held_path_options = g_array_new(FALSE, FALSE, sizeof(LogPathOptions));
+
+  PARALLELIZER_TESTCASE(test_messages_of_a_partition_are_processed_in_order);
+  PARALLELIZER_TESTCASE(test_flow_control_releases_the_window_once_processed);
+  PARALLELIZER_TESTCASE(test_overflowing_messages_are_dropped_and_counted);
+  PARALLELIZER_TESTCASE(test_rewrite_after_parallelize_does_not_change_other_paths);
+
+  g_ptr_array_free(recorder.held_messages, TRUE);
+  g_array_free(recorder.held_path_options, TRUE);
+  g_cond_free(recorder.cond);
+  g_mutex_free(recorder.lock);
+
+  cfg_free(configuration);
+  main_loop_call_deinit();
+  main_loop_worker_deinit();
+  app_shutdown();
+  return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "scratch-buffers.h"
+#include "stats/stats-registry.h"
+#include "apphook.h"
+
+#include <string.h>
+
+static void
+test_allocations_are_aligned_and_distinct(void)
+{
+  gchar *a, *b;
+
+  a = scratch_arena_alloc(1);
+  b = scratch_arena_alloc(3);
+  assert_true(((gsize) a % SCRATCH_ARENA_ALIGN) == 0, "Arena allocation is not aligned");
+  assert_true(((gsize) b % SCRATCH_ARENA_ALIGN) == 0, "Arena allocation is not aligned");
+  assert_true(b >= a + 1, "Arena allocations overlap");
+  scratch_arena_reset();
+}
+
+static void
+test_strdup_copies_the_string(void)
+{
+  gchar *s;
+
+  s = scratch_arena_strdup("foobar");
+  assert_string(s, "foobar", "scratch_arena_strdup() returned a wrong copy");
+  s = scratch_arena_strndup("foobar", 3);
+  assert_string(s, "foo", "scratch_arena_strndup() returned a wrong copy");
+  scratch_arena_reset();
+}
+
+static void
+test_alloc0_clears_memory(void)
+{
+  gchar *p;
+  gint i;
+
+  p = scratch_arena_alloc(64);
+  memset(p, 'x', 64);
+  scratch_arena_reset();
+
+  p = scratch_arena_alloc0(64);
+  for (i = 0; i < 64; i++)
+    assert_gint(p[i], 0, "scratch_arena_alloc0() returned uninitialized memory at %d", i);
+  scratch_arena_reset();
+}
+
+static void
+test_reclaim_returns_to_mark(void)
+{
+  ScratchArenaMark mark;
+  gchar *before, *kept, *after;
+  gint i;
+
+  kept = scratch_arena_strdup("kept");
+  mark = scratch_arena_mark();
+  before = scratch_arena_alloc(16);
+
+  /* spill into a few more chunks */
+  for (i = 0; i < 100; i++)
+    scratch_arena_alloc(1024);
+  scratch_arena_reclaim(mark);
+
+  after = scratch_arena_alloc(16);
+  assert_gpointer(after, before, "scratch_arena_reclaim() did not return to the mark");
+  assert_string(kept, "kept", "scratch_arena_reclaim() clobbered data allocated before the mark");
+  scratch_arena_reset();
+}
+
+static void
+test_large_allocations_survive_reset(void)
+{
+  gchar *large;
+  gint i;
+
+  for (i = 0; i < 4; i++)
+    {
+      large = scratch_arena_alloc(100000);
+      memset(large, 'x', 100000);
+      assert_gint(large[99999], 'x', "Large arena allocation is not writable");
+      scratch_arena_strdup("small");
+      scratch_arena_reset();
+    }
+}
+
+static void
+test_high_water_mark_is_exported(void)
+{
+  StatsCounterItem *high_water_mark = NULL;
+  guint32 before;
+
+  stats_lock();
+  stats_register_counter(0, SCS_GLOBAL, "scratch_arena", "allocated_bytes", SC_TYPE_HIGH_WATER_MARK, &high_water_mark);
+  stats_unlock();
+
+  before = stats_counter_get(high_water_mark);
+  scratch_arena_alloc(before + 1000);
+  scratch_arena_reset();
+  assert_true(stats_counter_get(high_water_mark) >= before + 1000, "The high water mark should follow the arena size");
+
+  before = stats_counter_get(high_water_mark);
+  scratch_arena_alloc(16);
+  scratch_arena_reset();
+  assert_guint32(stats_counter_get(high_water_mark), before, "The high water mark should not decrease");
+
+  stats_reset_non_stored_counters();
+  assert_guint32(stats_counter_get(high_water_mark), before, "The high water mark should not be reset with the other counters");
+
+  stats_lock();
+  stats_unregister_counter(SCS_GLOBAL, "scratch_arena", "allocated_bytes", SC_TYPE_HIGH_WATER_MARK, &high_water_mark);
+  stats_unlock();
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+  scratch_buffers_init();
+
+  test_allocations_are_aligned_and_distinct();
+  test_strdup_copies_the_string();
+  test_alloc0_clears_memory();
+  test_reclaim_returns_to_mark();
+  test_large_allocations_survive_reset();
+  test_high_water_mark_is_exported();
+
+  scratch_buffers_free();
+  app_shutdown();
+  return 0;
+}
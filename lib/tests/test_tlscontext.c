@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "tlscontext.h"
+#include "stats/stats-registry.h"
+#include "apphook.h"
+
+#include <stdlib.h>
+#include <openssl/bio.h>
+
+#define TLS_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+/* the same key and certificate as the one used by the functional tests */
+#define TEST_KEY_FILE "%s/tests/functional/ssl.key"
+#define TEST_CERT_FILE "%s/tests/functional/ssl.crt"
+
+#define MAX_HANDSHAKE_ROUNDS 64
+
+#define STATS_INSTANCE "tls,127.0.0.1:6514"
+#define TEST_PEER "127.0.0.1:6514"
+#define OTHER_TEST_PEER "127.0.0.2:6514"
+
+static const gchar *top_srcdir;
+
+static TLSContext *
+_create_server_context(const gchar *stats_id)
+{
+  TLSContext *self = tls_context_new(TM_SERVER);
+
+  self->verify_mode = TVM_NONE;
+  self->key_file = g_strdup_printf(TEST_KEY_FILE, top_srcdir);
+  self->cert_file = g_strdup_printf(TEST_CERT_FILE, top_srcdir);
+  tls_context_register_stats(self, SCS_TCP | SCS_SOURCE, stats_id, STATS_INSTANCE);
+  return self;
+}
+
+static TLSContext *
+_create_client_context(void)
+{
+  TLSContext *self = tls_context_new(TM_CLIENT);
+
+  self->verify_mode = TVM_NONE;
+  return self;
+}
+
+static void
+_free_server_context(TLSContext *self, const gchar *stats_id)
+{
+  tls_context_unregister_stats(self, SCS_TCP | SCS_SOURCE, stats_id, STATS_INSTANCE);
+  tls_context_free(self);
+}
+
+static gboolean
+_ssl_wants_more(SSL *ssl, gint ret)
+{
+  gint error = SSL_get_error(ssl, ret);
+
+  return error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE;
+}
+
+/*
+ * Connects a client and a server session through a BIO pair, completes
+ * the handshake and sends a byte from the server to the client, which
+ * makes the client process any session tickets sent after the handshake.
+ * Returns whether the client resumed its previous session.
+ */
+static gboolean
+_handshake_with_peer(TLSContext *client_ctx, const gchar *peer, TLSContext *server_ctx)
+{
+  TLSSession *client = tls_context_setup_session(client_ctx, peer);
+  TLSSession *server = tls_context_setup_session(server_ctx, NULL);
+  BIO *client_bio, *server_bio;
+  gboolean client_done = FALSE, server_done = FALSE;
+  gboolean resumed;
+  gchar buf[1];
+  gint ret, i;
+
+  assert_not_null(client, "Error setting up the client session");
+  assert_not_null(server, "Error setting up the server session");
+
+  assert_true(BIO_new_bio_pair(&client_bio, 0, &server_bio, 0) == 1, "Error creating a BIO pair");
+  SSL_set_bio(client->ssl, client_bio, client_bio);
+  SSL_set_bio(server->ssl, server_bio, server_bio);
+
+  for (i = 0; i < MAX_HANDSHAKE_ROUNDS && !(client_done && server_done); i++)
+    {
+      if (!client_done)
+        {
+          ret = SSL_do_handshake(client->ssl);
+          client_done = ret == 1;
+          assert_true(client_done || _ssl_wants_more(client->ssl, ret), "Client handshake failed");
+        }
+      if (!server_done)
+        {
+          ret = SSL_do_handshake(server->ssl);
+          server_done = ret == 1;
+          assert_true(server_done || _ssl_wants_more(server->ssl, ret), "Server handshake failed");
+        }
+    }
+  assert_true(client_done && server_done, "Handshake did not finish in %d rounds", MAX_HANDSHAKE_ROUNDS);
+
+  assert_gint(SSL_write(server->ssl, "x", 1), 1, "Error sending data to the client");
+  assert_gint(SSL_read(client->ssl, buf, sizeof(buf)), 1, "Error receiving data from the server");
+
+  resumed = SSL_session_reused(client->ssl);
+  assert_gint(SSL_session_reused(server->ssl), resumed, "Client and server disagree about resumption");
+
+  tls_session_free(client);
+  tls_session_free(server);
+  return resumed;
+}
+
+static gboolean
+_handshake(TLSContext *client_ctx, TLSContext *server_ctx)
+{
+  return _handshake_with_peer(client_ctx, TEST_PEER, server_ctx);
+}
+
+static void
+_assert_handshake_counters(TLSContext *server_ctx, gint full, gint resumed)
+{
+  assert_gint(stats_counter_get(server_ctx->full_handshakes), full, "Unexpected number of full handshakes");
+  assert_gint(stats_counter_get(server_ctx->resumed_handshakes), resumed, "Unexpected number of resumed handshakes");
+}
+
+static void
+test_second_handshake_is_resumed(gboolean session_tickets, gint session_cache_size, const gchar *stats_id)
+{
+  TLSContext *server_ctx = _create_server_context(stats_id);
+  TLSContext *client_ctx = _create_client_context();
+
+  server_ctx->session_tickets = session_tickets;
+  server_ctx->session_cache_size = session_cache_size;
+
+  assert_false(_handshake(client_ctx, server_ctx), "The first handshake should be a full one");
+  _assert_handshake_counters(server_ctx, 1, 0);
+  assert_not_null(g_hash_table_lookup(client_ctx->client_sessions, TEST_PEER), "The client should keep its session");
+
+  assert_true(_handshake(client_ctx, server_ctx), "The second handshake should be resumed");
+  _assert_handshake_counters(server_ctx, 1, 1);
+
+  tls_context_free(client_ctx);
+  _free_server_context(server_ctx, stats_id);
+}
+
+static void
+test_resumption_can_be_disabled(void)
+{
+  const gchar *stats_id = "test_resumption_disabled";
+  TLSContext *server_ctx = _create_server_context(stats_id);
+  TLSContext *client_ctx = _create_client_context();
+
+  server_ctx->session_tickets = FALSE;
+  server_ctx->session_cache_size = 0;
+
+  assert_false(_handshake(client_ctx, server_ctx), "The first handshake should be a full one");
+  assert_false(_handshake(client_ctx, server_ctx), "Sessions should not be resumed without a session cache and tickets");
+  _assert_handshake_counters(server_ctx, 2, 0);
+
+  tls_context_free(client_ctx);
+  _free_server_context(server_ctx, stats_id);
+}
+
+static void
+test_sessions_of_another_server_are_not_resumed(void)
+{
+  TLSContext *server_ctx = _create_server_context("test_another_server_1");
+  TLSContext *other_server_ctx = _create_server_context("test_another_server_2");
+  TLSContext *client_ctx = _create_client_context();
+
+  assert_false(_handshake(client_ctx, server_ctx), "The first handshake should be a full one");
+  assert_false(_handshake(client_ctx, other_server_ctx),
+               "A session should not be resumed by a server with different session cache and ticket keys");
+
+  tls_context_free(client_ctx);
+  _free_server_context(server_ctx, "test_another_server_1");
+  _free_server_context(other_server_ctx, "test_another_server_2");
+}
+
+static void
+test_sessions_are_kept_for_each_server(void)
+{
+  TLSContext *server_ctx = _create_server_context("test_each_server_1");
+  TLSContext *other_server_ctx = _create_server_context("test_each_server_2");
+  TLSContext *client_ctx = _create_client_context();
+
+  /* pooled connections of the same client, alternating between servers */
+  assert_false(_handshake_with_peer(client_ctx, TEST_PEER, server_ctx), "The first handshake should be a full one");
+  assert_false(_handshake_with_peer(client_ctx, OTHER_TEST_PEER, other_server_ctx),
+               "The first handshake with another server should be a full one");
+  assert_true(_handshake_with_peer(client_ctx, TEST_PEER, server_ctx),
+              "The session should be resumed after connecting to another server");
+  assert_true(_handshake_with_peer(client_ctx, OTHER_TEST_PEER, other_server_ctx),
+              "The session of the other server should be resumed as well");
+  _assert_handshake_counters(server_ctx, 1, 1);
+  _assert_handshake_counters(other_server_ctx, 1, 1);
+
+  /* without a peer, there is nothing to resume */
+  assert_false(_handshake_with_peer(client_ctx, NULL, server_ctx), "Sessions should not be resumed without a peer");
+
+  tls_context_free(client_ctx);
+  _free_server_context(server_ctx, "test_each_server_1");
+  _free_server_context(other_server_ctx, "test_each_server_2");
+}
+
+int
+main(int argc, char **argv)
+{
+  top_srcdir = getenv("top_srcdir");
+  assert_not_null(top_srcdir, "The $top_srcdir environment variable MUST NOT be empty!");
+
+  app_startup();
+
+  TLS_TESTCASE(test_second_handshake_is_resumed, TRUE, 20480, "test_resumed_ticket_and_cache");
+  TLS_TESTCASE(test_second_handshake_is_resumed, TRUE, 0, "test_resumed_ticket");
+  TLS_TESTCASE(test_second_handshake_is_resumed, FALSE, 20480, "test_resumed_cache");
+  TLS_TESTCASE(test_resumption_can_be_disabled);
+  TLS_TESTCASE(test_sessions_of_another_server_are_not_resumed);
+  TLS_TESTCASE(test_sessions_are_kept_for_each_server);
+
+  app_shutdown();
+  return 0;
+}
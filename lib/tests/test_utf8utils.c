@@ -49,6 +49,8 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
 
   assert_escaped_binary_with_unsafe_chars("\"text\"", "\\\"text\\\"", "\"");
   assert_escaped_binary_with_unsafe_chars("\"text\"", "\\\"te\\xt\\\"", "\"x");
+  assert_escaped_binary("a long line of text\twith a tab in the middle\n", "a long line of text\\twith a tab in the middle\\n");
+  assert_escaped_binary("truncated utf8 sequence \xc3", "truncated utf8 sequence \\xc3");
 
   assert_escaped_text("", "");
   assert_escaped_text("\n", "\\n");
@@ -63,6 +65,10 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
 
   assert_escaped_text_with_unsafe_chars("\"text\"", "\\\"text\\\"", "\"");
   assert_escaped_text_with_unsafe_chars("\"text\"", "\\\"te\\xt\\\"", "\"x");
+  assert_escaped_text("a long line of text\twith a tab in the middle\n", "a long line of text\\twith a tab in the middle\\n");
+  assert_escaped_text("truncated utf8 sequence \xc3", "truncated utf8 sequence \\\\xc3");
+  assert_escaped_text_with_unsafe_chars("some \"quoted\" words, some \\backslashes\\ and árvíztűrőtükörfúrógép",
+                                        "some \\\"quoted\\\" words, some \\\\backslashes\\\\ and árvíztűrőtükörfúrógép", "\"");
 
   return 0;
 }
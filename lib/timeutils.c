@@ -77,6 +77,18 @@ typedef struct _TimeCache
   struct tm tm;
 } TimeCache;
 
+/* UTC start of a calendar day and the local zone offset valid for the
+ * whole day, LOCAL_OFS_VARIES if it changes during the day */
+typedef struct _DayCache
+{
+  gint year, mon, mday;
+  time_t utc_start;
+  glong local_ofs;
+} DayCache;
+
+#define DAY_CACHE_SIZE 4
+#define LOCAL_OFS_VARIES G_MAXLONG
+
 static const gchar *
 get_time_zone_basedir(void)
 {
@@ -99,6 +111,7 @@ TLS_BLOCK_START
   TimeCache gm_time_cache[64];
   struct tm mktime_prev_tm;
   time_t mktime_prev_time;
+  DayCache day_cache[DAY_CACHE_SIZE];
 }
 TLS_BLOCK_END;
 
@@ -108,6 +121,7 @@ TLS_BLOCK_END;
 #define gm_time_cache        __tls_deref(gm_time_cache)
 #define mktime_prev_tm       __tls_deref(mktime_prev_tm)
 #define mktime_prev_time     __tls_deref(mktime_prev_time)
+#define day_cache            __tls_deref(day_cache)
 
 #if !defined(SYSLOG_NG_HAVE_LOCALTIME_R) || !defined(SYSLOG_NG_HAVE_GMTIME_R)
 static GStaticMutex localtime_lock = G_STATIC_MUTEX_INIT;
@@ -178,6 +192,108 @@ cached_mktime(struct tm *tm)
   return result;
 }
 
+/* number of days since the epoch, @mon is 1 based */
+static glong
+_days_from_civil(gint year, gint mon, gint mday)
+{
+  glong era, yoe, doy, doe;
+
+  year -= mon <= 2;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = year - era * 400;
+  doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + mday - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static gint
+_days_in_month(gint year, gint mon)
+{
+  static const gint days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+  if (mon == 1 && ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0))
+    return 29;
+  return days[mon];
+}
+
+static glong
+_local_ofs_at(const DayCache *day, gint hour, gint min, gint sec)
+{
+  struct tm tm;
+
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = day->year;
+  tm.tm_mon = day->mon;
+  tm.tm_mday = day->mday;
+  tm.tm_hour = hour;
+  tm.tm_min = min;
+  tm.tm_sec = sec;
+  tm.tm_isdst = -1;
+  return (day->utc_start + hour * 3600 + min * 60 + sec) - mktime(&tm);
+}
+
+static DayCache *
+_lookup_day(gint year, gint mon, gint mday)
+{
+  DayCache *day = &day_cache[mday & (DAY_CACHE_SIZE - 1)];
+  glong local_ofs;
+
+  if (G_LIKELY(day->mday == mday && day->mon == mon && day->year == year))
+    return day;
+
+  day->year = year;
+  day->mon = mon;
+  day->mday = mday;
+  day->utc_start = _days_from_civil(year + 1900, mon + 1, mday) * 86400;
+
+  /* a zone transition moves the offset between the start and the end of
+   * the day, in which case mktime() is needed to resolve the hour */
+  local_ofs = _local_ofs_at(day, 0, 0, 0);
+  day->local_ofs = local_ofs == _local_ofs_at(day, 23, 59, 59) ? local_ofs : LOCAL_OFS_VARIES;
+  return day;
+}
+
+/**
+ * cached_wall_clock_to_utc:
+ * @tm: broken down wall clock time
+ * @zone_offset: the zone offset of @tm or -1 for the local time zone, in
+ *               the latter case the local offset is stored here
+ * @result: the UTC timestamp is stored here
+ *
+ * Converts @tm to UTC using a per-thread cache of calendar days, so that
+ * the usual case does not need mktime().  Returns FALSE without changing
+ * anything if the time needs normalization (e.g. out of range fields or
+ * leap seconds), or if it is in the local zone on a day with a zone
+ * transition; cached_mktime() should be used then.
+ **/
+gboolean
+cached_wall_clock_to_utc(const struct tm *tm, glong *zone_offset, time_t *result)
+{
+  DayCache *day;
+  glong ofs = *zone_offset;
+
+  /* stay within 32 bit time_t */
+  if (tm->tm_year < 70 || tm->tm_year > 137 ||
+      tm->tm_mon < 0 || tm->tm_mon > 11 ||
+      tm->tm_mday < 1 || tm->tm_mday > _days_in_month(tm->tm_year + 1900, tm->tm_mon) ||
+      tm->tm_hour < 0 || tm->tm_hour > 23 ||
+      tm->tm_min < 0 || tm->tm_min > 59 ||
+      tm->tm_sec < 0 || tm->tm_sec > 59)
+    return FALSE;
+
+  day = _lookup_day(tm->tm_year, tm->tm_mon, tm->tm_mday);
+  if (ofs == -1)
+    {
+      if (day->local_ofs == LOCAL_OFS_VARIES)
+        return FALSE;
+      ofs = day->local_ofs;
+    }
+
+  *result = day->utc_start + tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec - ofs;
+  *zone_offset = ofs;
+  return TRUE;
+}
+
 void
 cached_localtime(time_t *when, struct tm *tm)
 {
@@ -278,6 +394,7 @@ clean_time_cache(void)
 {
   memset(&gm_time_cache, 0, sizeof(gm_time_cache));
   memset(&local_time_cache, 0, sizeof(local_time_cache));
+  memset(&day_cache, 0, sizeof(day_cache));
 }
 
 int
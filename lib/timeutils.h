@@ -29,6 +29,7 @@
 #include "compat/time.h"
 
 time_t cached_mktime(struct tm *tm);
+gboolean cached_wall_clock_to_utc(const struct tm *tm, glong *zone_offset, time_t *result);
 void cached_localtime(time_t *when, struct tm *tm);
 void cached_gmtime(time_t *when, struct tm *tm);
 
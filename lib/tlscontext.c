@@ -24,12 +24,19 @@
 #include "tlscontext.h"
 #include "misc.h"
 #include "messages.h"
+#include "stats/stats-registry.h"
 
 #include <arpa/inet.h>
+#include <string.h>
+#include <time.h>
 #include <openssl/x509_vfy.h>
 #include <openssl/x509v3.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#define TLS_SESSION_ID_CONTEXT "syslog-ng"
 
 gboolean
 tls_get_x509_digest(X509 *x, GString *hash_string)
@@ -237,12 +244,13 @@ tls_session_set_verify(TLSSession *self, TLSSessionVerifyFunc verify_func, gpoin
 }
 
 static TLSSession *
-tls_session_new(SSL *ssl, TLSContext *ctx)
+tls_session_new(SSL *ssl, TLSContext *ctx, const gchar *peer)
 {
   TLSSession *self = g_new0(TLSSession, 1);
 
   self->ssl = ssl;
   self->ctx = ctx;
+  self->peer = g_strdup(peer);
 
   /* to set verify callback */
   tls_session_set_verify(self, NULL, NULL, NULL);
@@ -255,6 +263,7 @@ tls_session_free(TLSSession *self)
   if (self->verify_data && self->verify_data_destroy)
     self->verify_data_destroy(self->verify_data);
   SSL_free(self->ssl);
+  g_free(self->peer);
   g_free(self);
 }
 
@@ -274,8 +283,161 @@ file_exists(const gchar *fname)
   return TRUE;
 }
 
+static gboolean
+tls_context_rotate_ticket_keys(TLSContext *self, time_t now)
+{
+  TLSTicketKey *current = &self->ticket_keys[0];
+
+  self->ticket_keys[1] = *current;
+  if (RAND_bytes(current->name, sizeof(current->name)) != 1 ||
+      RAND_bytes(current->hmac_key, sizeof(current->hmac_key)) != 1 ||
+      RAND_bytes(current->aes_key, sizeof(current->aes_key)) != 1)
+    {
+      *current = self->ticket_keys[1];
+      return FALSE;
+    }
+  current->created = now;
+  return TRUE;
+}
+
+/*
+ * Looks up the key for encrypting (@enc is TRUE) or decrypting a session
+ * ticket.  Returns 0 if the ticket key is unknown, 1 if the ticket can be
+ * used as is and 2 if it was encrypted with the previous key and the
+ * client should get a new ticket.
+ */
+static gint
+tls_context_lookup_ticket_key(TLSContext *self, const guchar *key_name, gboolean enc, TLSTicketKey *key)
+{
+  time_t now = time(NULL);
+  gint result = 0;
+
+  g_static_mutex_lock(&self->lock);
+  if (now - self->ticket_keys[0].created >= self->ticket_key_rotation)
+    tls_context_rotate_ticket_keys(self, now);
+
+  if (enc || memcmp(key_name, self->ticket_keys[0].name, sizeof(self->ticket_keys[0].name)) == 0)
+    {
+      *key = self->ticket_keys[0];
+      result = 1;
+    }
+  else if (self->ticket_keys[1].created &&
+           memcmp(key_name, self->ticket_keys[1].name, sizeof(self->ticket_keys[1].name)) == 0)
+    {
+      *key = self->ticket_keys[1];
+      result = 2;
+    }
+  g_static_mutex_unlock(&self->lock);
+  return result;
+}
+
+static int
+tls_context_ticket_key_callback(SSL *ssl, unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *hmac_ctx, int enc)
+{
+  TLSSession *session = (TLSSession *) SSL_get_app_data(ssl);
+  TLSTicketKey key;
+  gint result;
+
+  result = tls_context_lookup_ticket_key(session->ctx, key_name, enc, &key);
+  if (result == 0)
+    return 0;
+
+  if (enc)
+    {
+      memcpy(key_name, key.name, sizeof(key.name));
+      if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1 ||
+          !EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv))
+        result = -1;
+    }
+  else if (!EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv))
+    {
+      result = -1;
+    }
+
+  if (result > 0 && !HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL))
+    result = -1;
+
+  OPENSSL_cleanse(&key, sizeof(key));
+  return result;
+}
+
+/* keeps the last session negotiated by a client with each server for
+ * resumption on the next connect to the same server */
+static int
+tls_context_new_session_callback(SSL *ssl, SSL_SESSION *ssl_session)
+{
+  TLSSession *session = (TLSSession *) SSL_get_app_data(ssl);
+  TLSContext *self = session->ctx;
+
+  if (!session->peer)
+    return 0;
+
+  g_static_mutex_lock(&self->lock);
+  g_hash_table_replace(self->client_sessions, g_strdup(session->peer), ssl_session);
+  g_static_mutex_unlock(&self->lock);
+
+  /* we have taken over the reference */
+  return 1;
+}
+
+static void
+tls_context_info_callback(const SSL *ssl, int where, int ret)
+{
+  TLSSession *session;
+
+  if (!(where & SSL_CB_HANDSHAKE_DONE))
+    return;
+
+  session = (TLSSession *) SSL_get_app_data(ssl);
+  if (!session || session->handshake_done)
+    return;
+
+  session->handshake_done = TRUE;
+  if (SSL_session_reused((SSL *) ssl))
+    stats_counter_inc(session->ctx->resumed_handshakes);
+  else
+    stats_counter_inc(session->ctx->full_handshakes);
+}
+
+static gboolean
+tls_context_setup_session_cache(TLSContext *self)
+{
+  if (self->mode == TM_CLIENT)
+    {
+      SSL_CTX_set_session_cache_mode(self->ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb(self->ssl_ctx, tls_context_new_session_callback);
+    }
+  else
+    {
+      if (self->session_cache_size > 0)
+        {
+          SSL_CTX_set_session_cache_mode(self->ssl_ctx, SSL_SESS_CACHE_SERVER);
+          SSL_CTX_sess_set_cache_size(self->ssl_ctx, self->session_cache_size);
+        }
+      else
+        SSL_CTX_set_session_cache_mode(self->ssl_ctx, SSL_SESS_CACHE_OFF);
+
+      /* needed for resumption when client certificates are verified */
+      if (!SSL_CTX_set_session_id_context(self->ssl_ctx, (const guchar *) TLS_SESSION_ID_CONTEXT, strlen(TLS_SESSION_ID_CONTEXT)))
+        return FALSE;
+
+      if (self->session_tickets)
+        {
+          if (!tls_context_rotate_ticket_keys(self, time(NULL)))
+            return FALSE;
+          SSL_CTX_set_tlsext_ticket_key_cb(self->ssl_ctx, tls_context_ticket_key_callback);
+        }
+      else
+        SSL_CTX_set_options(self->ssl_ctx, SSL_OP_NO_TICKET);
+    }
+
+  SSL_CTX_set_timeout(self->ssl_ctx, self->session_timeout);
+  SSL_CTX_set_info_callback(self->ssl_ctx, tls_context_info_callback);
+  return TRUE;
+}
+
 TLSSession *
-tls_context_setup_session(TLSContext *self)
+tls_context_setup_session(TLSContext *self, const gchar *peer)
 {
   SSL *ssl;
   TLSSession *session;
@@ -360,16 +522,29 @@ tls_context_setup_session(TLSContext *self)
           if (!SSL_CTX_set_cipher_list(self->ssl_ctx, self->cipher_suite))
             goto error;
         }
+
+      if (!tls_context_setup_session_cache(self))
+        goto error;
     }
 
   ssl = SSL_new(self->ssl_ctx);
 
   if (self->mode == TM_CLIENT)
-    SSL_set_connect_state(ssl);
+    {
+      SSL_SESSION *client_session = NULL;
+
+      g_static_mutex_lock(&self->lock);
+      if (peer)
+        client_session = g_hash_table_lookup(self->client_sessions, peer);
+      if (client_session)
+        SSL_set_session(ssl, client_session);
+      g_static_mutex_unlock(&self->lock);
+      SSL_set_connect_state(ssl);
+    }
   else
     SSL_set_accept_state(ssl);
 
-  session = tls_session_new(ssl, self);
+  session = tls_session_new(ssl, self, peer);
   SSL_set_app_data(ssl, session);
   return session;
 
@@ -395,12 +570,39 @@ tls_context_new(TLSMode mode)
   self->mode = mode;
   self->verify_mode = TVM_REQUIRED | TVM_TRUSTED;
   self->ssl_options = TSO_NOSSLv2;
+  self->session_cache_size = 20480;
+  self->session_timeout = 300;
+  self->session_tickets = TRUE;
+  self->ticket_key_rotation = 3600;
+  g_static_mutex_init(&self->lock);
+  self->client_sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) SSL_SESSION_free);
   return self;
 }
 
+void
+tls_context_register_stats(TLSContext *self, gint stats_source, const gchar *stats_id, const gchar *stats_instance)
+{
+  stats_lock();
+  stats_register_counter(0, stats_source, stats_id, stats_instance, SC_TYPE_FULL_HANDSHAKES, &self->full_handshakes);
+  stats_register_counter(0, stats_source, stats_id, stats_instance, SC_TYPE_RESUMED_HANDSHAKES, &self->resumed_handshakes);
+  stats_unlock();
+}
+
+void
+tls_context_unregister_stats(TLSContext *self, gint stats_source, const gchar *stats_id, const gchar *stats_instance)
+{
+  stats_lock();
+  stats_unregister_counter(stats_source, stats_id, stats_instance, SC_TYPE_FULL_HANDSHAKES, &self->full_handshakes);
+  stats_unregister_counter(stats_source, stats_id, stats_instance, SC_TYPE_RESUMED_HANDSHAKES, &self->resumed_handshakes);
+  stats_unlock();
+}
+
 void
 tls_context_free(TLSContext *self)
 {
+  g_hash_table_destroy(self->client_sessions);
+  OPENSSL_cleanse(self->ticket_keys, sizeof(self->ticket_keys));
+  g_static_mutex_free(&self->lock);
   SSL_CTX_free(self->ssl_ctx);
   g_list_foreach(self->trusted_fingerpint_list, (GFunc) g_free, NULL);
   g_list_foreach(self->trusted_dn_list, (GFunc) g_free, NULL);
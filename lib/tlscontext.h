@@ -25,6 +25,7 @@
 #define TLSCONTEXT_H_INCLUDED
 
 #include "syslog-ng.h"
+#include "stats/stats-counter.h"
 
 #include <openssl/ssl.h>
 
@@ -57,6 +58,16 @@ enum
 typedef gint (*TLSSessionVerifyFunc)(gint ok, X509_STORE_CTX *ctx, gpointer user_data);
 typedef struct _TLSContext TLSContext;
 
+/* key material used to encrypt session tickets, the current key is
+ * ticket_keys[0], the previous one is still accepted for decryption */
+typedef struct _TLSTicketKey
+{
+  guchar name[16];
+  guchar hmac_key[32];
+  guchar aes_key[32];
+  time_t created;
+} TLSTicketKey;
+
 typedef struct _TLSSession
 {
   SSL *ssl;
@@ -64,6 +75,9 @@ typedef struct _TLSSession
   TLSSessionVerifyFunc verify_func;
   gpointer verify_data;
   GDestroyNotify verify_data_destroy;
+  gboolean handshake_done;
+  /* the server of a client session, the key of its cached SSL_SESSION */
+  gchar *peer;
 } TLSSession;
 
 void tls_session_set_verify(TLSSession *self, TLSSessionVerifyFunc verify_func, gpointer verify_data, GDestroyNotify verify_destroy);
@@ -82,14 +96,32 @@ struct _TLSContext
   GList *trusted_fingerpint_list;
   GList *trusted_dn_list;
   gint ssl_options;
+
+  /* session resumption */
+  gint session_cache_size;
+  gint session_timeout;
+  gboolean session_tickets;
+  gint ticket_key_rotation;
+
+  /* protects ticket_keys and client_sessions */
+  GStaticMutex lock;
+  TLSTicketKey ticket_keys[2];
+  /* the last SSL_SESSION negotiated with each server, keyed by peer */
+  GHashTable *client_sessions;
+
+  StatsCounterItem *full_handshakes;
+  StatsCounterItem *resumed_handshakes;
 };
 
 
-TLSSession *tls_context_setup_session(TLSContext *self);
+TLSSession *tls_context_setup_session(TLSContext *self, const gchar *peer);
 void tls_session_set_trusted_fingerprints(TLSContext *self, GList *fingerprints);
 void tls_session_set_trusted_dn(TLSContext *self, GList *dns);
 TLSContext *tls_context_new(TLSMode mode);
 void tls_context_free(TLSContext *s);
+void tls_context_register_stats(TLSContext *self, gint stats_source, const gchar *stats_id, const gchar *stats_instance);
+void tls_context_unregister_stats(TLSContext *self, gint stats_source, const gchar *stats_id,
+                                  const gchar *stats_instance);
 
 TLSVerifyMode tls_lookup_verify_mode(const gchar *mode_str);
 gint tls_lookup_options(GList *options);
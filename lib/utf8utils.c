@@ -23,6 +23,71 @@
 #include "utf8utils.h"
 #include <string.h>
 
+/*
+ * Returns the length of the initial run of @str that the functions below
+ * copy to their output verbatim: printable ASCII characters, except for
+ * backslash and @unsafe_chars.
+ *
+ * Most values consist of such characters only, so the input is checked a
+ * word at a time, using the usual "has zero/less than byte" bit tricks.
+ * This is only done if there is at most one unsafe character, which
+ * covers all users of these functions.
+ */
+static gsize
+_get_verbatim_prefix_len(const gchar *str, gsize len, const gchar *unsafe_chars)
+{
+  const gchar *p = str;
+  const gchar *end = str + len;
+  gulong ones, highs, spaces, backslashes, unsafes, word, x1, x2;
+  guchar c;
+
+  if (!unsafe_chars || !unsafe_chars[0] || !unsafe_chars[1])
+    {
+      memset(&ones, 0x01, sizeof(ones));
+      memset(&highs, 0x80, sizeof(highs));
+      memset(&spaces, ' ', sizeof(spaces));
+      memset(&backslashes, '\\', sizeof(backslashes));
+      memset(&unsafes, unsafe_chars && unsafe_chars[0] ? unsafe_chars[0] : '\\', sizeof(unsafes));
+
+      while (end - p >= sizeof(word))
+        {
+          memcpy(&word, p, sizeof(word));
+          x1 = word ^ backslashes;
+          x2 = word ^ unsafes;
+          if (((word - spaces) | word | ((x1 - ones) & ~x1) | ((x2 - ones) & ~x2)) & highs)
+            break;
+          p += sizeof(word);
+        }
+    }
+
+  for (; p < end; p++)
+    {
+      c = *(const guchar *) p;
+      if (c < 0x20 || c >= 0x80 || c == '\\' || (unsafe_chars && strchr(unsafe_chars, c)))
+        break;
+    }
+  return p - str;
+}
+
+/* valid characters are copied as they are, instead of re-encoding them */
+static inline void
+_append_utf8_char(GString *escaped_string, const gchar *char_ptr)
+{
+  g_string_append_len(escaped_string, char_ptr, g_utf8_next_char(char_ptr) - char_ptr);
+}
+
+static inline void
+_reserve(GString *escaped_string, gsize len)
+{
+  gsize orig_len = escaped_string->len;
+
+  if (escaped_string->allocated_len <= orig_len + len)
+    {
+      g_string_set_size(escaped_string, orig_len + len);
+      g_string_truncate(escaped_string, orig_len);
+    }
+}
+
 /**
  * This function escapes an unsanitized input (e.g. that can contain binary
  * characters, and produces an escaped format that can be deescaped in need,
@@ -47,14 +112,25 @@ void
 append_unsafe_utf8_as_escaped_binary(GString *escaped_string, const gchar *str, const gchar *unsafe_chars)
 {
   const gchar *char_ptr = str;
+  const gchar *end = str + strlen(str);
+  gsize verbatim_len;
+  gunichar uchar;
 
-  while (*char_ptr)
+  _reserve(escaped_string, end - str);
+  while (1)
     {
-      gunichar uchar = g_utf8_get_char_validated(char_ptr, -1);
+      verbatim_len = _get_verbatim_prefix_len(char_ptr, end - char_ptr, unsafe_chars);
+      g_string_append_len(escaped_string, char_ptr, verbatim_len);
+      char_ptr += verbatim_len;
+      if (char_ptr >= end)
+        break;
+
+      uchar = g_utf8_get_char_validated(char_ptr, -1);
 
       switch (uchar)
         {
           case (gunichar) -1:
+          case (gunichar) -2:
             g_string_append_printf(escaped_string, "\\x%02x", *(guint8 *) char_ptr);
             char_ptr++;
             continue;
@@ -83,7 +159,7 @@ append_unsafe_utf8_as_escaped_binary(GString *escaped_string, const gchar *str,
             else if (uchar < 256 && unsafe_chars && strchr(unsafe_chars, (gchar) uchar))
               g_string_append_printf(escaped_string, "\\%c", (gchar) uchar);
             else
-              g_string_append_unichar(escaped_string, uchar);
+              _append_utf8_char(escaped_string, char_ptr);
             break;
         }
       char_ptr = g_utf8_next_char(char_ptr);
@@ -124,14 +200,25 @@ void
 append_unsafe_utf8_as_escaped_text(GString *escaped_string, const gchar *str, const gchar *unsafe_chars)
 {
   const gchar *char_ptr = str;
+  const gchar *end = str + strlen(str);
+  gsize verbatim_len;
+  gunichar uchar;
 
-  while (*char_ptr)
+  _reserve(escaped_string, end - str);
+  while (1)
     {
-      gunichar uchar = g_utf8_get_char_validated(char_ptr, -1);
+      verbatim_len = _get_verbatim_prefix_len(char_ptr, end - char_ptr, unsafe_chars);
+      g_string_append_len(escaped_string, char_ptr, verbatim_len);
+      char_ptr += verbatim_len;
+      if (char_ptr >= end)
+        break;
+
+      uchar = g_utf8_get_char_validated(char_ptr, -1);
 
       switch (uchar)
         {
           case (gunichar) -1:
+          case (gunichar) -2:
             g_string_append_printf(escaped_string, "\\\\x%02x", *(guint8 *) char_ptr);
             char_ptr++;
             continue;
@@ -160,7 +247,7 @@ append_unsafe_utf8_as_escaped_text(GString *escaped_string, const gchar *str, co
             else if (uchar < 256 && unsafe_chars && strchr(unsafe_chars, (gchar) uchar))
               g_string_append_printf(escaped_string, "\\%c", (gchar) uchar);
             else
-              g_string_append_unichar(escaped_string, uchar);
+              _append_utf8_char(escaped_string, char_ptr);
             break;
         }
       char_ptr = g_utf8_next_char(char_ptr);
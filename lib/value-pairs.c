@@ -381,8 +381,7 @@ value_pairs_foreach_sorted (ValuePairs *vp, VPForeachFunc func,
    */
   if (vp->scopes & (VPS_NV_PAIRS + VPS_DOT_NV_PAIRS + VPS_SDATA + VPS_RFC5424) ||
       vp->patterns_size > 0)
-    nv_table_foreach(msg->payload, logmsg_registry,
-                     (NVTableForeachFunc) vp_msg_nvpairs_foreach, args);
+    log_msg_values_foreach(msg, (NVTableForeachFunc) vp_msg_nvpairs_foreach, args);
 
   if (vp->patterns_size > 0)
     vp_merge_macros(vp, msg, seq_num, time_zone_mode, scope_set, template_options);
@@ -468,6 +467,7 @@ typedef struct
 
   gpointer user_data;
   vp_stack_t *stack;
+  GPtrArray *tokens;
 } vp_walk_state_t;
 
 static vp_stack_t *
@@ -562,9 +562,6 @@ vp_walker_stack_unwind_until (vp_stack_t *stack, vp_walk_state_t *state,
         state->obj_end(t->key, t->prefix, &t->data,
                        NULL, NULL,
                        state->user_data);
-      g_free(t->key);
-      g_free(t->prefix);
-      g_free(t);
     }
 }
 
@@ -586,10 +583,6 @@ vp_walker_stack_unwind_all(vp_stack_t *stack,
         state->obj_end(t->key, t->prefix, &t->data,
                        NULL, NULL,
                        state->user_data);
-
-      g_free(t->key);
-      g_free(t->prefix);
-      g_free(t);
     }
 }
 
@@ -597,7 +590,7 @@ static vp_walk_stack_data_t *
 vp_walker_stack_push (vp_stack_t *stack,
                       gchar *key, gchar *prefix)
 {
-  vp_walk_stack_data_t *nt = g_new(vp_walk_stack_data_t, 1);
+  vp_walk_stack_data_t *nt = scratch_arena_new(vp_walk_stack_data_t);
 
   nt->key = key;
   nt->prefix = prefix;
@@ -615,17 +608,17 @@ vp_walker_name_value_split_add_name_token(GPtrArray *array, const gchar *name,
 {
   gchar *token;
 
-  token = g_strndup(name + *current_name_start_idx, *index - *current_name_start_idx);
+  token = scratch_arena_strndup(name + *current_name_start_idx, *index - *current_name_start_idx);
   *current_name_start_idx = ++(*index);
   g_ptr_array_add(array, (gpointer) token);
 }
 
-static GPtrArray *
-vp_walker_name_value_split(const gchar *name)
+static void
+vp_walker_name_value_split(GPtrArray *array, const gchar *name)
 {
   int i, current_name_start_idx = 0, name_len = strlen(name);
-  GPtrArray *array = g_ptr_array_new();
 
+  g_ptr_array_set_size(array, 0);
   for (i = 0; i < name_len; i++)
     {
       if (name[i] == '@')
@@ -639,11 +632,6 @@ vp_walker_name_value_split(const gchar *name)
     }
   if (current_name_start_idx <= i - 1)
     vp_walker_name_value_split_add_name_token(array, name, &current_name_start_idx, &i);
-
-  if (array->len == 0)
-    return NULL;
-
-  return array;
 }
 
 static gchar *
@@ -660,7 +648,7 @@ vp_walker_name_combine_prefix(GPtrArray *tokens, gint until)
     }
   g_string_append(sb_gstring_string(s), g_ptr_array_index(tokens, until));
 
-  str = g_strdup(sb_gstring_string(s)->str);
+  str = scratch_arena_strndup(sb_gstring_string(s)->str, sb_gstring_string(s)->len);
 
   sb_gstring_release(s);
 
@@ -671,17 +659,18 @@ static gchar *
 vp_walker_name_split(vp_stack_t *stack, vp_walk_state_t *state,
                      const gchar *name)
 {
-  GPtrArray *tokens;
-  gchar *key = NULL;
+  GPtrArray *tokens = state->tokens;
   guint i, start;
 
-  tokens = vp_walker_name_value_split(name);
+  vp_walker_name_value_split(tokens, name);
+  if (tokens->len == 0)
+    return scratch_arena_strdup(name);
 
   start = vp_stack_height(stack);
   for (i = start; i < tokens->len - 1; i++)
     {
       vp_walk_stack_data_t *p = vp_stack_peek(stack);
-      vp_walk_stack_data_t *nt = vp_walker_stack_push(stack, g_strdup(g_ptr_array_index(tokens, i)),
+      vp_walk_stack_data_t *nt = vp_walker_stack_push(stack, g_ptr_array_index(tokens, i),
                                  vp_walker_name_combine_prefix(tokens, i));
 
       if (p)
@@ -695,12 +684,7 @@ vp_walker_name_split(vp_stack_t *stack, vp_walk_state_t *state,
 
   /* The last token is the key (well, second to last, last being
      NULL), so treat that normally. */
-  key = g_strdup(g_ptr_array_index(tokens, tokens->len - 1));
-
-  g_ptr_array_foreach(tokens, (GFunc)g_free, NULL);
-  g_ptr_array_free(tokens, TRUE);
-
-  return key;
+  return g_ptr_array_index(tokens, tokens->len - 1);
 }
 
 static gboolean
@@ -727,8 +711,6 @@ value_pairs_walker(const gchar *name, TypeHint type, const gchar *value,
                                   NULL,
                                   state->user_data);
 
-  g_free(key);
-
   return result;
 }
 
@@ -748,6 +730,7 @@ value_pairs_walk(ValuePairs *vp,
                  gpointer user_data)
 {
   vp_walk_state_t state;
+  ScratchArenaMark mark = scratch_arena_mark();
   gboolean result;
 
   state.user_data = user_data;
@@ -755,6 +738,7 @@ value_pairs_walk(ValuePairs *vp,
   state.obj_end = obj_end_func;
   state.process_value = process_value_func;
   state.stack = vp_stack_create();
+  state.tokens = g_ptr_array_new();
 
   state.obj_start(NULL, NULL, NULL, NULL, NULL, user_data);
   result = value_pairs_foreach_sorted(vp, value_pairs_walker,
@@ -763,6 +747,10 @@ value_pairs_walk(ValuePairs *vp,
   vp_walker_stack_unwind_all(state.stack, &state);
   state.obj_end(NULL, NULL, NULL, NULL, NULL, user_data);
   vp_stack_destroy(state.stack);
+  g_ptr_array_free(state.tokens, TRUE);
+
+  /* keys and prefixes passed to the callbacks live in the scratch arena */
+  scratch_arena_reclaim(mark);
 
   return result;
 }
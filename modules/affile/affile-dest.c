@@ -36,6 +36,7 @@
 #include "transport/transport-pipe.h"
 #include "compat/lfs.h"
 #include "logwriter.h"
+#include "scratch-buffers.h"
 
 #include <iv.h>
 #include <sys/types.h>
@@ -58,9 +59,10 @@
  * performed in various threads.
  *
  *   - queue runs in the thread of the source thread that generated the message
- *   - if the message is to be written to a not-yet-opened file, a new gets
- *     opened and stored in the writer_hash hashtable (initiated from queue,
- *     but performed in the main thread, but more on that later)
+ *   - if the message is to be written to a not-yet-opened file, a new
+ *     writer is stored in the writer_map in a pending state and the file
+ *     is opened asynchronously in the main thread (initiated from queue,
+ *     but more on that later)
  *   - currently opened destination files are checked regularly and closed
  *     if they are idle for a given amount of time (time_reap) (this is done
  *     in the main thread)
@@ -76,17 +78,70 @@
  * syslog-ng is running.
  *
  * AFFileDestWriter instances are created dynamically when a new file is
- * opened. A reference is stored in the writer_hash hashtable. This is then:
+ * opened. A reference is stored in the writer_map. This is then:
  *    - looked up in _queue() (in the source thread)
  *    - cleaned up in reap callback (in the main thread)
  *
- * writer_hash is locked (currently a simple mutex) using
- * AFFileDestDriver->lock.  The "queue" method cannot hold the lock while
+ * writer_map is split into AFFILE_DD_WRITER_MAP_SHARDS hashtables, each
+ * protected by its own mutex, the shard is selected by the hash of the
+ * filename. This way source threads writing to different files rarely
+ * contend on the same lock. The "queue" method cannot hold the lock while
  * forwarding it to the next pipe, thus a reference is taken under the
  * protection of the lock, keeping a the next pipe alive, even if that would
  * go away in a parallel reaper process.
+ *
+ * Asynchronous opens
+ * ==================
+ *
+ * When the writer for a filename is missing, the source thread inserts a
+ * new, uninitialized writer into the writer_map in the
+ * AFFILE_DW_OPEN_PENDING state, puts it onto
+ * AFFileDestDriver->pending_writers and posts pending_writers_posted. The
+ * message (and any other message arriving for the same file in the
+ * meantime) is parked on the writer instead of blocking the source
+ * thread.  The main thread then initializes the writer (which opens the
+ * file, creating directories as needed) and forwards the parked messages
+ * in order.  If the open fails, the writer is removed from the map and
+ * the parked messages are dropped.
+ *
+ * Open file limit
+ * ===============
+ *
+ * With max-open-files() set, open writers of a templated destination are
+ * kept on AFFileDestDriver->lru_writers, most recently written first.
+ * Writers are moved to the front at most once a second (when their
+ * last_msg_stamp changes), so source threads only take the driver lock
+ * occasionally.  Before a new file is opened in the main thread, the
+ * least recently written writers are closed (flushing their queues) to
+ * stay within the limit.
  */
 
+#define AFFILE_DD_WRITER_MAP_SHARDS 16
+
+typedef struct _AFFileDestWriterShard
+{
+  GStaticMutex lock;
+  GHashTable *writers;
+} AFFileDestWriterShard;
+
+struct _AFFileDestWriterMap
+{
+  AFFileDestWriterShard shards[AFFILE_DD_WRITER_MAP_SHARDS];
+};
+
+enum
+{
+  AFFILE_DW_OPENED,
+  AFFILE_DW_OPEN_PENDING,
+  AFFILE_DW_OPEN_FAILED,
+};
+
+typedef struct _AFFileParkedMessage
+{
+  LogMessage *msg;
+  LogPathOptions path_options;
+} AFFileParkedMessage;
+
 struct _AFFileDestWriter
 {
   LogPipe super;
@@ -98,9 +153,76 @@ struct _AFFileDestWriter
   time_t last_open_stamp;
   time_t time_reopen;
   struct iv_timer reap_timer;
-  gboolean reopen_pending, queue_pending;
+  gboolean reopen_pending;
+  /* number of messages being forwarded to this writer by source threads,
+   * incremented under the lock the writer was looked up with */
+  gint queue_pending;
+
+  /* the members below are protected by lock */
+  gint open_state;
+  GQueue parked_msgs;
+  struct iv_list_head pending_list;
+
+  /* protected by owner->lock, lru_stamp by lock */
+  struct iv_list_head lru_list;
+  time_t lru_stamp;
 };
 
+static AFFileDestWriterMap *
+affile_dwm_new(void)
+{
+  AFFileDestWriterMap *self = g_new0(AFFileDestWriterMap, 1);
+  gint i;
+
+  for (i = 0; i < AFFILE_DD_WRITER_MAP_SHARDS; i++)
+    {
+      g_static_mutex_init(&self->shards[i].lock);
+      self->shards[i].writers = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+  return self;
+}
+
+static void
+affile_dwm_free(AFFileDestWriterMap *self)
+{
+  gint i;
+
+  for (i = 0; i < AFFILE_DD_WRITER_MAP_SHARDS; i++)
+    {
+      g_hash_table_destroy(self->shards[i].writers);
+      g_static_mutex_free(&self->shards[i].lock);
+    }
+  g_free(self);
+}
+
+static inline AFFileDestWriterShard *
+affile_dwm_get_shard(AFFileDestWriterMap *self, const gchar *filename)
+{
+  return &self->shards[g_str_hash(filename) % AFFILE_DD_WRITER_MAP_SHARDS];
+}
+
+static void
+affile_dwm_foreach(AFFileDestWriterMap *self, GHFunc func, gpointer user_data)
+{
+  gint i;
+
+  for (i = 0; i < AFFILE_DD_WRITER_MAP_SHARDS; i++)
+    g_hash_table_foreach(self->shards[i].writers, func, user_data);
+}
+
+static void
+affile_dwm_foreach_remove(AFFileDestWriterMap *self, GHRFunc func, gpointer user_data)
+{
+  gint i;
+
+  for (i = 0; i < AFFILE_DD_WRITER_MAP_SHARDS; i++)
+    {
+      g_static_mutex_lock(&self->shards[i].lock);
+      g_hash_table_foreach_remove(self->shards[i].writers, func, user_data);
+      g_static_mutex_unlock(&self->shards[i].lock);
+    }
+}
+
 static gchar *
 affile_dw_format_persist_name(AFFileDestWriter *self)
 {
@@ -112,7 +234,9 @@ affile_dw_format_persist_name(AFFileDestWriter *self)
   return persist_name;
 }
 
+static gboolean affile_dd_unpublish_idle_writer(AFFileDestDriver *self, AFFileDestWriter *dw);
 static void affile_dd_reap_writer(AFFileDestDriver *self, AFFileDestWriter *dw);
+static void affile_dd_touch_writer(AFFileDestDriver *self, AFFileDestWriter *dw);
 
 static void
 affile_dw_arm_reaper(AFFileDestWriter *self)
@@ -124,19 +248,33 @@ affile_dw_arm_reaper(AFFileDestWriter *self)
   iv_timer_register(&self->reap_timer);
 }
 
+/* TRUE if the writer still has messages to write, closing it would lose them */
+static gboolean
+affile_dw_has_pending_writes(AFFileDestWriter *self)
+{
+  gboolean pending;
+
+  g_static_mutex_lock(&self->lock);
+  pending = log_writer_has_pending_writes(self->writer);
+  g_static_mutex_unlock(&self->lock);
+  return pending;
+}
+
 static void
 affile_dw_reap(gpointer s)
 {
   AFFileDestWriter *self = (AFFileDestWriter *) s;
+  gboolean timed_out;
 
   main_loop_assert_main_thread();
 
   g_static_mutex_lock(&self->lock);
-  if (!log_writer_has_pending_writes(self->writer) &&
-      !self->queue_pending &&
-      (cached_g_current_time_sec() - self->last_msg_stamp) >= self->owner->time_reap)
+  timed_out = !log_writer_has_pending_writes(self->writer) &&
+              (cached_g_current_time_sec() - self->last_msg_stamp) >= self->owner->time_reap;
+  g_static_mutex_unlock(&self->lock);
+
+  if (timed_out && affile_dd_unpublish_idle_writer(self->owner, self))
     {
-      g_static_mutex_unlock(&self->lock);
       msg_verbose("Destination timed out, reaping",
                   evt_tag_str("template", self->owner->filename_template->template),
                   evt_tag_str("filename", self->filename),
@@ -145,7 +283,6 @@ affile_dw_reap(gpointer s)
     }
   else
     {
-      g_static_mutex_unlock(&self->lock);
       affile_dw_arm_reaper(self);
     }
 }
@@ -271,11 +408,17 @@ static void
 affile_dw_queue(LogPipe *s, LogMessage *lm, const LogPathOptions *path_options, gpointer user_data)
 {
   AFFileDestWriter *self = (AFFileDestWriter *) s;
+  gboolean touch_lru = FALSE;
 
   g_static_mutex_lock(&self->lock);
   self->last_msg_stamp = cached_g_current_time_sec();
   if (self->last_open_stamp == 0)
     self->last_open_stamp = self->last_msg_stamp;
+  if (self->owner->max_open_files > 0 && self->lru_stamp != self->last_msg_stamp)
+    {
+      self->lru_stamp = self->last_msg_stamp;
+      touch_lru = TRUE;
+    }
 
   if (!log_writer_opened(self->writer) &&
       !self->reopen_pending &&
@@ -290,9 +433,87 @@ affile_dw_queue(LogPipe *s, LogMessage *lm, const LogPathOptions *path_options,
     }
   g_static_mutex_unlock(&self->lock);
 
+  if (touch_lru)
+    affile_dd_touch_writer(self->owner, self);
+
   log_pipe_forward_msg(&self->super, lm, path_options);
 }
 
+/*
+ * Parks @msg on a writer whose file is being opened in the main thread.
+ * Returns FALSE if the writer is open and the caller has to queue the
+ * message itself.
+ */
+static gboolean
+affile_dw_park_msg(AFFileDestWriter *self, LogMessage *msg, const LogPathOptions *path_options)
+{
+  AFFileParkedMessage *parked;
+
+  g_static_mutex_lock(&self->lock);
+  switch (self->open_state)
+    {
+    case AFFILE_DW_OPENED:
+      g_static_mutex_unlock(&self->lock);
+      return FALSE;
+    case AFFILE_DW_OPEN_FAILED:
+      g_static_mutex_unlock(&self->lock);
+      log_msg_drop(msg, path_options);
+      return TRUE;
+    default:
+      break;
+    }
+
+  parked = g_new(AFFileParkedMessage, 1);
+  parked->msg = msg;
+  parked->path_options = *path_options;
+  parked->path_options.matched = NULL;
+  g_queue_push_tail(&self->parked_msgs, parked);
+  g_static_mutex_unlock(&self->lock);
+  return TRUE;
+}
+
+/*
+ * Forwards the messages parked while the file was being opened. The
+ * writer leaves the pending state only once the queue is empty, so
+ * messages arriving in the meantime are still parked behind the earlier
+ * ones and ordering is retained.
+ */
+static void
+affile_dw_release_parked_msgs(AFFileDestWriter *self)
+{
+  AFFileParkedMessage *parked;
+
+  main_loop_assert_main_thread();
+  while (1)
+    {
+      g_static_mutex_lock(&self->lock);
+      parked = g_queue_pop_head(&self->parked_msgs);
+      if (!parked)
+        self->open_state = AFFILE_DW_OPENED;
+      g_static_mutex_unlock(&self->lock);
+
+      if (!parked)
+        break;
+      log_pipe_queue(&self->super, parked->msg, &parked->path_options);
+      g_free(parked);
+    }
+}
+
+static void
+affile_dw_drop_parked_msgs(AFFileDestWriter *self)
+{
+  AFFileParkedMessage *parked;
+
+  g_static_mutex_lock(&self->lock);
+  self->open_state = AFFILE_DW_OPEN_FAILED;
+  while ((parked = g_queue_pop_head(&self->parked_msgs)))
+    {
+      log_msg_drop(parked->msg, &parked->path_options);
+      g_free(parked);
+    }
+  g_static_mutex_unlock(&self->lock);
+}
+
 static void
 affile_dw_set_owner(AFFileDestWriter *self, AFFileDestDriver *owner)
 {
@@ -323,6 +544,7 @@ affile_dw_free(LogPipe *s)
 {
   AFFileDestWriter *self = (AFFileDestWriter *) s;
   
+  affile_dw_drop_parked_msgs(self);
   log_pipe_unref((LogPipe *) self->writer);
 
   g_static_mutex_free(&self->lock);
@@ -367,6 +589,10 @@ affile_dw_new(const gchar *filename, GlobalConfig *cfg)
      This avoids a move of the filename. */
   self->filename = g_strdup(filename);
   g_static_mutex_init(&self->lock);
+  self->open_state = AFFILE_DW_OPENED;
+  g_queue_init(&self->parked_msgs);
+  INIT_IV_LIST_HEAD(&self->pending_list);
+  INIT_IV_LIST_HEAD(&self->lru_list);
   return self;
 }
 
@@ -394,6 +620,14 @@ affile_dd_set_fsync(LogDriver *s, gboolean fsync)
   self->use_fsync = fsync;
 }
 
+void
+affile_dd_set_max_open_files(LogDriver *s, gint max_open_files)
+{
+  AFFileDestDriver *self = (AFFileDestDriver *) s;
+
+  self->max_open_files = max_open_files;
+}
+
 static inline gchar *
 affile_dd_format_persist_name(AFFileDestDriver *self)
 {
@@ -404,55 +638,301 @@ affile_dd_format_persist_name(AFFileDestDriver *self)
 }
 
 static void
-affile_dd_reap_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
+affile_dd_register_writer_stats(AFFileDestDriver *self)
 {
-  LogWriter *writer = (LogWriter *)dw->writer;
+  const gchar *instance = self->filename_template->template;
+
+  stats_lock();
+  stats_register_counter(0, SCS_FILE | SCS_DESTINATION, self->super.super.id, instance, SC_TYPE_HITS, &self->writer_hits);
+  stats_register_counter(0, SCS_FILE | SCS_DESTINATION, self->super.super.id, instance, SC_TYPE_MISSES, &self->writer_misses);
+  stats_register_counter(0, SCS_FILE | SCS_DESTINATION, self->super.super.id, instance, SC_TYPE_EVICTED, &self->writer_evictions);
+  stats_unlock();
+}
 
+static void
+affile_dd_unregister_writer_stats(AFFileDestDriver *self)
+{
+  const gchar *instance = self->filename_template->template;
+
+  stats_lock();
+  stats_unregister_counter(SCS_FILE | SCS_DESTINATION, self->super.super.id, instance, SC_TYPE_HITS, &self->writer_hits);
+  stats_unregister_counter(SCS_FILE | SCS_DESTINATION, self->super.super.id, instance, SC_TYPE_MISSES, &self->writer_misses);
+  stats_unregister_counter(SCS_FILE | SCS_DESTINATION, self->super.super.id, instance, SC_TYPE_EVICTED, &self->writer_evictions);
+  stats_unlock();
+}
+
+static void
+affile_dd_add_lru_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
+{
   main_loop_assert_main_thread();
-  
+
+  g_static_mutex_lock(&self->lock);
+  iv_list_add(&dw->lru_list, &self->lru_writers);
+  self->open_writers++;
+  g_static_mutex_unlock(&self->lock);
+}
+
+static void
+affile_dd_remove_lru_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
+{
+  g_static_mutex_lock(&self->lock);
+  if (!iv_list_empty(&dw->lru_list))
+    {
+      iv_list_del_init(&dw->lru_list);
+      self->open_writers--;
+    }
+  g_static_mutex_unlock(&self->lock);
+}
+
+static void
+affile_dd_touch_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
+{
+  g_static_mutex_lock(&self->lock);
+  if (!iv_list_empty(&dw->lru_list))
+    {
+      iv_list_del(&dw->lru_list);
+      iv_list_add(&dw->lru_list, &self->lru_writers);
+    }
+  g_static_mutex_unlock(&self->lock);
+}
+
+/*
+ * Removes @dw from writer_map (or single_writer), unless a source thread is
+ * forwarding a message to it right now.  Source threads increment
+ * queue_pending under the same lock they look up the writer with, so once
+ * this function returns TRUE, no new message can reach @dw.
+ */
+static gboolean
+affile_dd_unpublish_idle_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
+{
+  gboolean idle;
+
+  main_loop_assert_main_thread();
+
   if (self->filename_is_a_template)
     {
-      g_static_mutex_lock(&self->lock);
-      /* remove from hash table */
-      g_hash_table_remove(self->writer_hash, dw->filename);
-      g_static_mutex_unlock(&self->lock);
+      AFFileDestWriterShard *shard = affile_dwm_get_shard(self->writer_map, dw->filename);
+
+      g_static_mutex_lock(&shard->lock);
+      idle = g_atomic_int_get(&dw->queue_pending) == 0;
+      if (idle)
+        g_hash_table_remove(shard->writers, dw->filename);
+      g_static_mutex_unlock(&shard->lock);
     }
   else
     {
       g_static_mutex_lock(&self->lock);
       g_assert(dw == self->single_writer);
-      self->single_writer = NULL;
+      idle = g_atomic_int_get(&dw->queue_pending) == 0;
+      if (idle)
+        self->single_writer = NULL;
+      g_static_mutex_unlock(&self->lock);
+    }
+  return idle;
+}
+
+/*
+ * Closes the least recently written writer that is not being written to
+ * right now and has no pending writes, the same conditions the reaper
+ * checks. Busy writers are moved to the front of lru_writers. Returns
+ * FALSE if there was no writer to close.
+ */
+static gboolean
+affile_dd_evict_lru_writer(AFFileDestDriver *self)
+{
+  AFFileDestWriter *dw;
+  gint candidates;
+
+  main_loop_assert_main_thread();
+
+  for (candidates = self->open_writers; candidates > 0; candidates--)
+    {
+      g_static_mutex_lock(&self->lock);
+      if (iv_list_empty(&self->lru_writers))
+        {
+          g_static_mutex_unlock(&self->lock);
+          return FALSE;
+        }
+      dw = iv_list_entry(self->lru_writers.prev, AFFileDestWriter, lru_list);
+      log_pipe_ref(&dw->super);
       g_static_mutex_unlock(&self->lock);
+
+      /* the shard lock can't be taken while holding self->lock, as source
+       * threads take them in the opposite order */
+      if (!affile_dw_has_pending_writes(dw) &&
+          affile_dd_unpublish_idle_writer(self, dw))
+        {
+          msg_verbose("Too many open destination files, closing the least recently written one",
+                      evt_tag_str("template", self->filename_template->template),
+                      evt_tag_str("filename", dw->filename),
+                      evt_tag_int("max_open_files", self->max_open_files),
+                      NULL);
+          stats_counter_inc(self->writer_evictions);
+          affile_dd_reap_writer(self, dw);
+          log_pipe_unref(&dw->super);
+          return TRUE;
+        }
+
+      affile_dd_touch_writer(self, dw);
+      log_pipe_unref(&dw->super);
     }
+  return FALSE;
+}
+
+/*
+ * Closes @dw, which must have been removed from writer_map (or
+ * single_writer) using affile_dd_unpublish_idle_writer().
+ */
+static void
+affile_dd_reap_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
+{
+  LogWriter *writer = (LogWriter *)dw->writer;
+
+  main_loop_assert_main_thread();
+
+  if (self->filename_is_a_template)
+    affile_dd_remove_lru_writer(self, dw);
 
   log_dest_driver_release_queue(&self->super, log_writer_get_queue(writer));
   log_pipe_deinit(&dw->super);
   log_pipe_unref(&dw->super);
 }
 
+/*
+ * This function is called as a g_hash_table_foreach_remove() callback to
+ * move the writers of a persisted writer map to @user_data, so that they
+ * can be initialized without holding the shard locks.
+ */
+static gboolean
+affile_dd_collect_writer(gpointer key, gpointer value, gpointer user_data)
+{
+  GPtrArray *writers = (GPtrArray *) user_data;
+
+  g_ptr_array_add(writers, value);
+  return TRUE;
+}
 
 /**
- * affile_dd_reuse_writer:
+ * affile_dd_reuse_writers:
  *
- * This function is called as a g_hash_table_foreach() callback to set the
- * owner of each writer, previously connected to an AFileDestDriver instance
- * in an earlier configuration. This way AFFileDestWriter instances are
- * remembered accross reloads.
- * 
+ * Sets the owner of each writer, previously connected to an
+ * AFileDestDriver instance in an earlier configuration, initializes it
+ * and puts it back to the writer_map. This way AFFileDestWriter instances
+ * are remembered accross reloads.
+ *
+ * Writers are initialized outside of the shard locks (initialization
+ * opens the file), and are only published in writer_map once they are
+ * initialized.
  **/
 static void
-affile_dd_reuse_writer(gpointer key, gpointer value, gpointer user_data)
+affile_dd_reuse_writers(AFFileDestDriver *self)
 {
-  AFFileDestDriver *self = (AFFileDestDriver *) user_data;
-  AFFileDestWriter *writer = (AFFileDestWriter *) value;
-  
-  affile_dw_set_owner(writer, self);
-  if (!log_pipe_init(&writer->super))
+  GPtrArray *writers = g_ptr_array_new();
+  AFFileDestWriterShard *shard;
+  gint i;
+
+  affile_dwm_foreach_remove(self->writer_map, affile_dd_collect_writer, writers);
+
+  for (i = 0; i < writers->len; i++)
     {
-      affile_dw_set_owner(writer, NULL);
-      log_pipe_unref(&writer->super);
-      g_hash_table_remove(self->writer_hash, key);
+      AFFileDestWriter *writer = (AFFileDestWriter *) g_ptr_array_index(writers, i);
+
+      affile_dw_set_owner(writer, self);
+      if (!log_pipe_init(&writer->super))
+        {
+          log_pipe_unref(&writer->super);
+          continue;
+        }
+
+      shard = affile_dwm_get_shard(self->writer_map, writer->filename);
+      g_static_mutex_lock(&shard->lock);
+      g_hash_table_insert(shard->writers, writer->filename, writer);
+      g_static_mutex_unlock(&shard->lock);
+
+      affile_dd_add_lru_writer(self, writer);
     }
+  g_ptr_array_free(writers, TRUE);
+}
+
+/*
+ * Runs in the main thread, initializes a writer that was created by
+ * affile_dd_queue() and forwards the messages parked on it.  Consumes the
+ * reference held by the pending_writers list.
+ */
+static void
+affile_dd_open_pending_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
+{
+  AFFileDestWriterShard *shard;
+
+  if (self->max_open_files > 0)
+    {
+      while (self->open_writers >= self->max_open_files &&
+             affile_dd_evict_lru_writer(self))
+        ;
+    }
+
+  if (log_pipe_init(&dw->super))
+    {
+      affile_dd_add_lru_writer(self, dw);
+      affile_dw_release_parked_msgs(dw);
+    }
+  else
+    {
+      shard = affile_dwm_get_shard(self->writer_map, dw->filename);
+      g_static_mutex_lock(&shard->lock);
+      g_hash_table_remove(shard->writers, dw->filename);
+      g_static_mutex_unlock(&shard->lock);
+
+      affile_dw_drop_parked_msgs(dw);
+      /* drop the reference of writer_map */
+      log_pipe_unref(&dw->super);
+    }
+  log_pipe_unref(&dw->super);
+}
+
+static void
+affile_dd_open_pending_writers(gpointer s)
+{
+  AFFileDestDriver *self = (AFFileDestDriver *) s;
+  struct iv_list_head pending;
+  AFFileDestWriter *dw;
+
+  main_loop_assert_main_thread();
+
+  INIT_IV_LIST_HEAD(&pending);
+  g_static_mutex_lock(&self->lock);
+  iv_list_splice_tail_init(&self->pending_writers, &pending);
+  g_static_mutex_unlock(&self->lock);
+
+  while (!iv_list_empty(&pending))
+    {
+      dw = iv_list_entry(pending.next, AFFileDestWriter, pending_list);
+      iv_list_del_init(&dw->pending_list);
+      affile_dd_open_pending_writer(self, dw);
+    }
+}
+
+/*
+ * Runs in the source thread with the shard lock held, registers a new
+ * writer for @filename which is then opened by the main thread.
+ */
+static AFFileDestWriter *
+affile_dd_new_pending_writer(AFFileDestDriver *self, AFFileDestWriterShard *shard, const gchar *filename)
+{
+  AFFileDestWriter *dw;
+
+  dw = affile_dw_new(filename, log_pipe_get_config(&self->super.super.super));
+  affile_dw_set_owner(dw, self);
+  dw->open_state = AFFILE_DW_OPEN_PENDING;
+  g_hash_table_insert(shard->writers, dw->filename, dw);
+
+  /* reference for the pending_writers list, the initial one is owned by writer_map */
+  log_pipe_ref(&dw->super);
+  g_static_mutex_lock(&self->lock);
+  iv_list_add_tail(&dw->pending_list, &self->pending_writers);
+  g_static_mutex_unlock(&self->lock);
+  iv_event_post(&self->pending_writers_posted);
+  return dw;
 }
 
 
@@ -475,9 +955,14 @@ affile_dd_init(LogPipe *s)
               
   if (self->filename_is_a_template)
     {
-      self->writer_hash = cfg_persist_config_fetch(cfg, affile_dd_format_persist_name(self));
-      if (self->writer_hash)
-        g_hash_table_foreach(self->writer_hash, affile_dd_reuse_writer, self);
+      self->writer_map = cfg_persist_config_fetch(cfg, affile_dd_format_persist_name(self));
+      if (self->writer_map)
+        affile_dd_reuse_writers(self);
+      else
+        self->writer_map = affile_dwm_new();
+
+      affile_dd_register_writer_stats(self);
+      iv_event_register(&self->pending_writers_posted);
     }
   else
     {
@@ -523,23 +1008,26 @@ affile_dd_destroy_writer_hr(gpointer key, gpointer value, gpointer user_data)
 }
 
 /**
- * affile_dd_destroy_writer_hash:
- * @value: GHashTable instance passed as a generic pointer
+ * affile_dd_destroy_writer_map:
+ * @value: AFFileDestWriterMap instance passed as a generic pointer
  *
- * Destroy notify callback for the GHashTable storing AFFileDestWriter instances.
+ * Destroy notify callback for the AFFileDestWriterMap storing AFFileDestWriter instances.
  **/
 static void
-affile_dd_destroy_writer_hash(gpointer value)
+affile_dd_destroy_writer_map(gpointer value)
 {
-  GHashTable *writer_hash = (GHashTable *) value;
+  AFFileDestWriterMap *writer_map = (AFFileDestWriterMap *) value;
   
-  g_hash_table_foreach_remove(writer_hash, affile_dd_destroy_writer_hr, NULL);
-  g_hash_table_destroy(writer_hash);
+  affile_dwm_foreach_remove(writer_map, affile_dd_destroy_writer_hr, NULL);
+  affile_dwm_free(writer_map);
 }
 
 static void
 affile_dd_deinit_writer(gpointer key, gpointer value, gpointer user_data)
 {
+  AFFileDestDriver *self = (AFFileDestDriver *) user_data;
+
+  affile_dd_remove_lru_writer(self, (AFFileDestWriter *) value);
   log_pipe_deinit((LogPipe *) value);
 }
 
@@ -552,19 +1040,25 @@ affile_dd_deinit(LogPipe *s)
    * have circular references between AFFileDestDriver and file writers */
   if (self->single_writer)
     {
-      g_assert(self->writer_hash == NULL);
+      g_assert(self->writer_map == NULL);
 
       log_pipe_deinit(&self->single_writer->super);
       cfg_persist_config_add(cfg, affile_dd_format_persist_name(self), self->single_writer, affile_dd_destroy_writer, FALSE);
       self->single_writer = NULL;
     }
-  else if (self->writer_hash)
+  else if (self->writer_map)
     {
       g_assert(self->single_writer == NULL);
-      
-      g_hash_table_foreach(self->writer_hash, affile_dd_deinit_writer, NULL);
-      cfg_persist_config_add(cfg, affile_dd_format_persist_name(self), self->writer_hash, affile_dd_destroy_writer_hash, FALSE);
-      self->writer_hash = NULL;
+
+      /* settle opens still in flight, so that their messages end up in the
+       * queues of the writers that we are about to persist */
+      iv_event_unregister(&self->pending_writers_posted);
+      affile_dd_open_pending_writers(self);
+
+      affile_dwm_foreach(self->writer_map, affile_dd_deinit_writer, self);
+      affile_dd_unregister_writer_stats(self);
+      cfg_persist_config_add(cfg, affile_dd_format_persist_name(self), self->writer_map, affile_dd_destroy_writer_map, FALSE);
+      self->writer_map = NULL;
     }
 
   if (!log_dest_driver_deinit_method(s))
@@ -574,9 +1068,10 @@ affile_dd_deinit(LogPipe *s)
 }
 
 /*
- * This function is ran in the main thread whenever a writer is not yet
- * instantiated.  Returns a reference to the newly constructed LogPipe
- * instance where the caller needs to forward its message.
+ * This function is ran in the main thread whenever the single writer of a
+ * non-templated destination is not yet instantiated.  Returns a reference
+ * to the newly constructed LogPipe instance where the caller needs to
+ * forward its message.
  */
 static LogPipe *
 affile_dd_open_writer(gpointer args[])
@@ -585,83 +1080,79 @@ affile_dd_open_writer(gpointer args[])
   AFFileDestWriter *next;
 
   main_loop_assert_main_thread();
-  if (!self->filename_is_a_template)
+  if (!self->single_writer)
     {
-      if (!self->single_writer)
-	{
-	  next = affile_dw_new(self->filename_template->template, log_pipe_get_config(&self->super.super.super));
-	  affile_dw_set_owner(next, self);
-          if (next && log_pipe_init(&next->super))
-	    {
-	      log_pipe_ref(&next->super);
-	      g_static_mutex_lock(&self->lock);
-	      self->single_writer = next;
-	      g_static_mutex_unlock(&self->lock);
-	    }
-	  else
-	    {
-	      log_pipe_unref(&next->super);
-	      next = NULL;
-	    }
-	}
-      else
+      next = affile_dw_new(self->filename_template->template, log_pipe_get_config(&self->super.super.super));
+      affile_dw_set_owner(next, self);
+      if (next && log_pipe_init(&next->super))
         {
-          next = self->single_writer;
           log_pipe_ref(&next->super);
-        }
-    }
-  else
-    {
-      GString *filename = args[1];
-
-      /* hash table construction is serialized, as we only do that in the main thread. */
-      if (!self->writer_hash)
-        self->writer_hash = g_hash_table_new(g_str_hash, g_str_equal);
-
-      /* we don't need to lock the hashtable as it is only written in
-       * the main thread, which we're running right now.  lookups in
-       * other threads must be locked. writers must be locked even in
-       * this thread to exclude lookups in other threads.  */
-
-      next = g_hash_table_lookup(self->writer_hash, filename->str);
-      if (!next)
-	{
-	  next = affile_dw_new(filename->str, log_pipe_get_config(&self->super.super.super));
-          affile_dw_set_owner(next, self);
-          if (!log_pipe_init(&next->super))
-	    {
-	      log_pipe_unref(&next->super);
-	      next = NULL;
-	    }
-	  else
-	    {
-	      log_pipe_ref(&next->super);
-	      g_static_mutex_lock(&self->lock);
-              g_hash_table_insert(self->writer_hash, next->filename, next);
-              g_static_mutex_unlock(&self->lock);
-            }
+          g_static_mutex_lock(&self->lock);
+          self->single_writer = next;
+          g_static_mutex_unlock(&self->lock);
         }
       else
         {
-          log_pipe_ref(&next->super);
+          log_pipe_unref(&next->super);
+          next = NULL;
         }
     }
+  else
+    {
+      next = self->single_writer;
+      log_pipe_ref(&next->super);
+    }
 
   if (next)
     {
-      next->queue_pending = TRUE;
+      g_atomic_int_inc(&next->queue_pending);
       /* we're returning a reference */
       return &next->super;
     }
   return NULL;
 }
 
+/*
+ * Looks up the writer for the templated filename of @msg, registering a
+ * pending one if the file is not open yet.  Returns a reference.
+ */
+static AFFileDestWriter *
+affile_dd_lookup_writer(AFFileDestDriver *self, LogMessage *msg)
+{
+  AFFileDestWriterShard *shard;
+  AFFileDestWriter *next;
+  SBGString *filename;
+
+  filename = sb_gstring_acquire();
+  log_template_format(self->filename_template, msg, &self->writer_options.template_options, LTZ_LOCAL, 0, NULL,
+                      sb_gstring_string(filename));
+
+  shard = affile_dwm_get_shard(self->writer_map, sb_gstring_string(filename)->str);
+  g_static_mutex_lock(&shard->lock);
+  next = g_hash_table_lookup(shard->writers, sb_gstring_string(filename)->str);
+  if (next)
+    {
+      stats_counter_inc(self->writer_hits);
+    }
+  else
+    {
+      stats_counter_inc(self->writer_misses);
+      next = affile_dd_new_pending_writer(self, shard, sb_gstring_string(filename)->str);
+    }
+  log_pipe_ref(&next->super);
+  g_atomic_int_inc(&next->queue_pending);
+  g_static_mutex_unlock(&shard->lock);
+
+  sb_gstring_release(filename);
+  return next;
+}
+
 static void
 affile_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
 {
   AFFileDestDriver *self = (AFFileDestDriver *) s;
   AFFileDestWriter *next;
-  gpointer args[2] = { self, NULL };
+  gpointer args[1] = { self };
 
   if (!self->filename_is_a_template)
     {
@@ -680,43 +1171,22 @@ affile_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options,
           /* we need to lock single_writer in order to get a reference and
            * make sure it is not a stale pointer by the time we ref it */
           next = self->single_writer;
-          next->queue_pending = TRUE;
+          g_atomic_int_inc(&next->queue_pending);
           log_pipe_ref(&next->super);
           g_static_mutex_unlock(&self->lock);
         }
     }
   else
     {
-      GString *filename;
-
-      filename = g_string_sized_new(32);
-      log_template_format(self->filename_template, msg, &self->writer_options.template_options, LTZ_LOCAL, 0, NULL, filename);
-
-      g_static_mutex_lock(&self->lock);
-      if (self->writer_hash)
-        next = g_hash_table_lookup(self->writer_hash, filename->str);
-      else
-        next = NULL;
-
-      if (next)
-        {
-          log_pipe_ref(&next->super);
-          next->queue_pending = TRUE;
-          g_static_mutex_unlock(&self->lock);
-        }
-      else
-	{
-	  g_static_mutex_unlock(&self->lock);
-	  args[1] = filename;
-	  next = main_loop_call((void *(*)(void *)) affile_dd_open_writer, args, TRUE);
-	}
-      g_string_free(filename, TRUE);
+      next = affile_dd_lookup_writer(self, msg);
     }
   if (next)
     {
       log_msg_add_ack(msg, path_options);
-      log_pipe_queue(&next->super, log_msg_ref(msg), path_options);
-      next->queue_pending = FALSE;
+      log_msg_ref(msg);
+      if (!affile_dw_park_msg(next, msg, path_options))
+        log_pipe_queue(&next->super, msg, path_options);
+      g_atomic_int_add(&next->queue_pending, -1);
       log_pipe_unref(&next->super);
     }
 
@@ -731,7 +1201,7 @@ affile_dd_free(LogPipe *s)
   g_static_mutex_free(&self->lock);
   
   /* NOTE: this must be NULL as deinit has freed it, otherwise we'd have circular references */
-  g_assert(self->single_writer == NULL && self->writer_hash == NULL);
+  g_assert(self->single_writer == NULL && self->writer_map == NULL);
 
   log_template_unref(self->filename_template);
   log_writer_options_destroy(&self->writer_options);
@@ -762,6 +1232,11 @@ affile_dd_new_instance(gchar *filename, GlobalConfig *cfg)
   self->file_open_options.needs_privileges = FALSE;
   self->file_open_options.open_flags = DEFAULT_DW_REOPEN_FLAGS;
   g_static_mutex_init(&self->lock);
+  INIT_IV_LIST_HEAD(&self->pending_writers);
+  INIT_IV_LIST_HEAD(&self->lru_writers);
+  IV_EVENT_INIT(&self->pending_writers_posted);
+  self->pending_writers_posted.cookie = self;
+  self->pending_writers_posted.handler = affile_dd_open_pending_writers;
   return self;
 }
 
@@ -27,8 +27,13 @@
 #include "driver.h"
 #include "logwriter.h"
 #include "affile-common.h"
+#include "stats/stats-counter.h"
+
+#include <iv_event.h>
+#include <iv_list.h>
 
 typedef struct _AFFileDestWriter AFFileDestWriter;
+typedef struct _AFFileDestWriterMap AFFileDestWriterMap;
 
 typedef struct _AFFileDestDriver
 {
@@ -43,8 +48,18 @@ typedef struct _AFFileDestDriver
   FileOpenOptions file_open_options;
   TimeZoneInfo *local_time_zone_info;
   LogWriterOptions writer_options;
-  GHashTable *writer_hash;
-    
+  AFFileDestWriterMap *writer_map;
+  /* writers waiting to be opened in the main thread, protected by lock */
+  struct iv_list_head pending_writers;
+  struct iv_event pending_writers_posted;
+  /* open writers, most recently written first, protected by lock */
+  struct iv_list_head lru_writers;
+  gint open_writers;
+  gint max_open_files;
+  StatsCounterItem *writer_hits;
+  StatsCounterItem *writer_misses;
+  StatsCounterItem *writer_evictions;
+
   gint overwrite_if_older;
   gboolean use_time_recvd;
   gint time_reap;
@@ -56,6 +71,7 @@ LogDriver *afpipe_dd_new(gchar *filename, GlobalConfig *cfg);
 void affile_dd_set_create_dirs(LogDriver *s, gboolean create_dirs);
 void affile_dd_set_fsync(LogDriver *s, gboolean enable);
 void affile_dd_set_overwrite_if_older(LogDriver *s, gint overwrite_if_older);
+void affile_dd_set_max_open_files(LogDriver *s, gint max_open_files);
 void affile_dd_set_local_time_zone(LogDriver *s, const gchar *local_time_zone);
 
 #endif
@@ -134,12 +134,12 @@ affile_sd_open_file(AFFileSourceDriver *self, gchar *name, gint *fd)
   return affile_open_file(name, &self->file_open_options, &self->file_perm_options, fd);
 }
 
-static inline gchar *
-affile_sd_format_persist_name(AFFileSourceDriver *self)
+gchar *
+affile_sd_format_persist_name(const gchar *filename)
 {
   static gchar persist_name[1024];
   
-  g_snprintf(persist_name, sizeof(persist_name), "affile_sd_curpos(%s)", self->filename->str);
+  g_snprintf(persist_name, sizeof(persist_name), "affile_sd_curpos(%s)", filename);
   return persist_name;
 }
  
@@ -151,7 +151,7 @@ affile_sd_recover_state(LogPipe *s, GlobalConfig *cfg, LogProtoServer *proto)
   if (self->file_open_options.is_pipe || self->follow_freq <= 0)
     return;
 
-  if (!log_proto_server_restart_with_state(proto, cfg->state, affile_sd_format_persist_name(self)))
+  if (!log_proto_server_restart_with_state(proto, cfg->state, affile_sd_format_persist_name(self->filename->str)))
     {
       msg_error("Error converting persistent state from on-disk format, losing file position information",
                 evt_tag_str("filename", self->filename->str),
@@ -216,7 +216,7 @@ affile_sd_construct_transport(AFFileSourceDriver *self, gint fd)
     return log_transport_pipe_new(fd);
 }
 
-static LogProtoServer *
+LogProtoServer *
 affile_sd_construct_proto(AFFileSourceDriver *self, gint fd)
 {
   LogProtoServerOptions *proto_options = &self->reader_options.proto_options.super;
@@ -428,7 +428,7 @@ affile_sd_deinit(LogPipe *s)
   return TRUE;
 }
 
-static void
+void
 affile_sd_free(LogPipe *s)
 {
   AFFileSourceDriver *self = (AFFileSourceDriver *) s;
@@ -444,11 +444,9 @@ affile_sd_free(LogPipe *s)
   log_src_driver_free(s);
 }
 
-static AFFileSourceDriver *
-affile_sd_new_instance(gchar *filename, GlobalConfig *cfg)
+void
+affile_sd_init_instance(AFFileSourceDriver *self, gchar *filename, GlobalConfig *cfg)
 {
-  AFFileSourceDriver *self = g_new0(AFFileSourceDriver, 1);
-  
   log_src_driver_init_instance(&self->super, cfg);
   self->filename = g_string_new(filename);
   self->super.super.super.init = affile_sd_init;
@@ -462,6 +460,14 @@ affile_sd_new_instance(gchar *filename, GlobalConfig *cfg)
 
   if (affile_is_linux_proc_kmsg(filename))
     self->file_open_options.needs_privileges = TRUE;
+}
+
+static AFFileSourceDriver *
+affile_sd_new_instance(gchar *filename, GlobalConfig *cfg)
+{
+  AFFileSourceDriver *self = g_new0(AFFileSourceDriver, 1);
+
+  affile_sd_init_instance(self, filename, cfg);
   return self;
 }
 
@@ -61,6 +61,12 @@ gboolean affile_sd_set_multi_line_garbage(LogDriver *s, const gchar *garbage_reg
 gboolean affile_sd_set_multi_line_mode(LogDriver *s, const gchar *mode);
 void affile_sd_set_follow_freq(LogDriver *s, gint follow_freq);
 
+void affile_sd_init_instance(AFFileSourceDriver *self, gchar *filename, GlobalConfig *cfg);
+void affile_sd_free(LogPipe *s);
+gboolean affile_sd_open_file(AFFileSourceDriver *self, gchar *name, gint *fd);
+LogProtoServer *affile_sd_construct_proto(AFFileSourceDriver *self, gint fd);
+gchar *affile_sd_format_persist_name(const gchar *filename);
+
 void affile_sd_set_recursion(LogDriver *s, const gint recursion);
 void affile_sd_set_pri_level(LogDriver *s, const gint16 severity);
 void affile_sd_set_pri_facility(LogDriver *s, const gint16 facility);
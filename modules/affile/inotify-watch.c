@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "inotify-watch.h"
+#include "messages.h"
+#include "misc.h"
+
+#include <iv.h>
+
+/*
+ * A single inotify instance is shared by all followed files and
+ * directories, its fd is registered with ivykis in the main thread while at
+ * least one watch exists.  The kernel returns the same watch descriptor for
+ * the same inode, so the watches are kept in lists keyed by their wd.
+ */
+
+#if SYSLOG_NG_HAVE_SYS_INOTIFY_H
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define INOTIFY_WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#define INOTIFY_WATCH_DIR_MASK (IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_MOVE_SELF | IN_DELETE_SELF | IN_ONLYDIR)
+
+static struct iv_fd inotify_fd;
+static GHashTable *inotify_watches;
+
+static void
+_close_inotify_if_unused(void)
+{
+  if (!inotify_watches || g_hash_table_size(inotify_watches) > 0)
+    return;
+
+  iv_fd_unregister(&inotify_fd);
+  close(inotify_fd.fd);
+  g_hash_table_destroy(inotify_watches);
+  inotify_watches = NULL;
+}
+
+static gboolean
+_is_watch_registered(gint wd, InotifyWatch *watch)
+{
+  return inotify_watches &&
+         g_list_find(g_hash_table_lookup(inotify_watches, GINT_TO_POINTER(wd)), watch) != NULL;
+}
+
+/* the kernel dropped events, none of the watches can trust their state */
+static void
+_dispatch_overflow(void)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  GArray *wds;
+  GPtrArray *watches;
+  GList *l;
+  guint i;
+
+  msg_verbose("inotify event queue overflowed, rechecking all followed files",
+              NULL);
+
+  /* callbacks may add or remove watches, and removing a watch may free
+   * it, so collect them first, and only call the ones still registered */
+  wds = g_array_new(FALSE, FALSE, sizeof(gint));
+  watches = g_ptr_array_new();
+  g_hash_table_iter_init(&iter, inotify_watches);
+  while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+      for (l = (GList *) value; l; l = l->next)
+        {
+          gint wd = GPOINTER_TO_INT(key);
+
+          g_array_append_val(wds, wd);
+          g_ptr_array_add(watches, l->data);
+        }
+    }
+
+  for (i = 0; i < watches->len; i++)
+    {
+      InotifyWatch *watch = (InotifyWatch *) g_ptr_array_index(watches, i);
+
+      if (_is_watch_registered(g_array_index(wds, gint, i), watch))
+        watch->callback(watch->user_data, IWE_CHANGED | IWE_OVERFLOW, NULL);
+    }
+  g_ptr_array_free(watches, TRUE);
+  g_array_free(wds, TRUE);
+}
+
+static void
+_dispatch_event(struct inotify_event *event)
+{
+  GList *watchers, *l;
+  guint events = 0;
+
+  /* a callback may have closed the inotify instance */
+  if (!inotify_watches)
+    return;
+
+  if (event->wd == -1)
+    {
+      if (event->mask & IN_Q_OVERFLOW)
+        _dispatch_overflow();
+      return;
+    }
+
+  watchers = g_hash_table_lookup(inotify_watches, GINT_TO_POINTER(event->wd));
+  if (!watchers)
+    return;
+
+  if (event->mask & (IN_MODIFY | IN_ATTRIB))
+    events |= IWE_CHANGED;
+  if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED))
+    events |= IWE_LOST;
+  if (event->mask & (IN_CREATE | IN_MOVED_TO))
+    events |= IWE_CREATED;
+  if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+    events |= IWE_DELETED;
+
+  /* callbacks may remove watches, work on a copy */
+  watchers = g_list_copy(watchers);
+  if (event->mask & IN_IGNORED)
+    {
+      for (l = watchers; l; l = l->next)
+        ((InotifyWatch *) l->data)->wd = -1;
+      g_hash_table_remove(inotify_watches, GINT_TO_POINTER(event->wd));
+    }
+
+  for (l = watchers; l; l = l->next)
+    {
+      InotifyWatch *watch = (InotifyWatch *) l->data;
+
+      watch->callback(watch->user_data, events, event->len > 0 ? event->name : NULL);
+    }
+  g_list_free(watchers);
+}
+
+/* NOTE: also used by the unit tests to feed synthetic events */
+void
+inotify_watch_dispatch_events(const gchar *buf, gsize len)
+{
+  const gchar *p;
+
+  for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len)
+    _dispatch_event((struct inotify_event *) p);
+}
+
+static void
+_read_events(gpointer s)
+{
+  gchar buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  gssize len;
+
+  while ((len = read(inotify_fd.fd, buf, sizeof(buf))) > 0)
+    {
+      inotify_watch_dispatch_events(buf, len);
+
+      if (!inotify_watches)
+        return;
+    }
+
+  if (len < 0 && errno != EAGAIN && errno != EINTR)
+    msg_error("Error reading inotify events",
+              evt_tag_errno("error", errno),
+              NULL);
+
+  /* all watches may have been dropped by the kernel (IN_IGNORED) */
+  _close_inotify_if_unused();
+}
+
+static gboolean
+_open_inotify(void)
+{
+  gint fd;
+
+  if (inotify_watches)
+    return TRUE;
+
+  fd = inotify_init();
+  if (fd < 0)
+    {
+      msg_verbose("inotify is not available, falling back to polling followed files",
+                  evt_tag_errno("error", errno),
+                  NULL);
+      return FALSE;
+    }
+  g_fd_set_nonblock(fd, TRUE);
+  g_fd_set_cloexec(fd, TRUE);
+
+  IV_FD_INIT(&inotify_fd);
+  inotify_fd.fd = fd;
+  inotify_fd.handler_in = _read_events;
+  iv_fd_register(&inotify_fd);
+
+  inotify_watches = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_list_free);
+  return TRUE;
+}
+
+static gboolean
+_add_watch(InotifyWatch *self, const gchar *filename, guint32 mask, InotifyWatchCallback callback, gpointer user_data)
+{
+  GList *watchers;
+  gint wd;
+
+  g_assert(self->wd < 0);
+
+  if (!_open_inotify())
+    return FALSE;
+
+  wd = inotify_add_watch(inotify_fd.fd, filename, mask);
+  if (wd < 0)
+    {
+      msg_verbose("Unable to watch file with inotify, falling back to polling",
+                  evt_tag_str("filename", filename),
+                  evt_tag_errno("error", errno),
+                  NULL);
+      _close_inotify_if_unused();
+      return FALSE;
+    }
+
+  self->wd = wd;
+  self->callback = callback;
+  self->user_data = user_data;
+
+  watchers = g_hash_table_lookup(inotify_watches, GINT_TO_POINTER(wd));
+  g_hash_table_steal(inotify_watches, GINT_TO_POINTER(wd));
+  g_hash_table_insert(inotify_watches, GINT_TO_POINTER(wd), g_list_prepend(watchers, self));
+  return TRUE;
+}
+
+gboolean
+inotify_watch_add(InotifyWatch *self, const gchar *filename, InotifyWatchCallback callback, gpointer user_data)
+{
+  return _add_watch(self, filename, INOTIFY_WATCH_MASK, callback, user_data);
+}
+
+gboolean
+inotify_watch_add_dir(InotifyWatch *self, const gchar *dirname, InotifyWatchCallback callback, gpointer user_data)
+{
+  return _add_watch(self, dirname, INOTIFY_WATCH_DIR_MASK, callback, user_data);
+}
+
+void
+inotify_watch_remove(InotifyWatch *self)
+{
+  GList *watchers;
+
+  if (self->wd < 0)
+    return;
+
+  watchers = g_hash_table_lookup(inotify_watches, GINT_TO_POINTER(self->wd));
+  g_hash_table_steal(inotify_watches, GINT_TO_POINTER(self->wd));
+  watchers = g_list_remove(watchers, self);
+  if (watchers)
+    g_hash_table_insert(inotify_watches, GINT_TO_POINTER(self->wd), watchers);
+  else
+    inotify_rm_watch(inotify_fd.fd, self->wd);
+
+  self->wd = -1;
+  _close_inotify_if_unused();
+}
+
+#else
+
+gboolean
+inotify_watch_add(InotifyWatch *self, const gchar *filename, InotifyWatchCallback callback, gpointer user_data)
+{
+  return FALSE;
+}
+
+gboolean
+inotify_watch_add_dir(InotifyWatch *self, const gchar *dirname, InotifyWatchCallback callback, gpointer user_data)
+{
+  return FALSE;
+}
+
+void
+inotify_watch_remove(InotifyWatch *self)
+{
+}
+
+void
+inotify_watch_dispatch_events(const gchar *buf, gsize len)
+{
+}
+
+#endif
+
+void
+inotify_watch_init(InotifyWatch *self)
+{
+  self->wd = -1;
+}
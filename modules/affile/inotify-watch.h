@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef INOTIFY_WATCH_H_INCLUDED
+#define INOTIFY_WATCH_H_INCLUDED
+
+#include "syslog-ng.h"
+
+enum
+{
+  /* the watched file (or a file in the watched directory) was modified */
+  IWE_CHANGED = 0x01,
+  /* the watched file or directory was moved or deleted, the watch is unusable from now on */
+  IWE_LOST = 0x02,
+  /* a file was created in or moved into the watched directory */
+  IWE_CREATED = 0x04,
+  /* a file was deleted from or moved out of the watched directory */
+  IWE_DELETED = 0x08,
+  /* events were lost, the watched file or directory has to be rechecked */
+  IWE_OVERFLOW = 0x10,
+};
+
+/* @name is the name of the file within a watched directory, NULL otherwise */
+typedef void (*InotifyWatchCallback)(gpointer user_data, guint events, const gchar *name);
+
+typedef struct _InotifyWatch
+{
+  gint wd;
+  InotifyWatchCallback callback;
+  gpointer user_data;
+} InotifyWatch;
+
+gboolean inotify_watch_add(InotifyWatch *self, const gchar *filename, InotifyWatchCallback callback, gpointer user_data);
+gboolean inotify_watch_add_dir(InotifyWatch *self, const gchar *dirname, InotifyWatchCallback callback, gpointer user_data);
+void inotify_watch_remove(InotifyWatch *self);
+void inotify_watch_init(InotifyWatch *self);
+void inotify_watch_dispatch_events(const gchar *buf, gsize len);
+
+static inline gboolean
+inotify_watch_is_active(InotifyWatch *self)
+{
+  return self->wd >= 0;
+}
+
+#endif
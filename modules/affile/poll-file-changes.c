@@ -21,6 +21,7 @@
  *
  */
 #include "poll-file-changes.h"
+#include "inotify-watch.h"
 #include "logpipe.h"
 
 #include <sys/types.h>
@@ -45,10 +46,59 @@ typedef struct _PollFileChanges
   gint follow_freq;
   struct iv_timer follow_timer;
   LogPipe *control;
+  InotifyWatch watch;
+  /* input events were requested using update_watches() */
+  gboolean watching;
 } PollFileChanges;
 
+/*
+ * If the followed file can be watched using inotify, the file is only
+ * checked when the reader asks for input and when inotify reports a change,
+ * otherwise (or once the watched file was moved or deleted) it is checked
+ * every follow_freq milliseconds.
+ */
+
+static void
+poll_file_changes_rearm_timer(PollFileChanges *self, gint timeout_msec)
+{
+  iv_validate_now();
+  self->follow_timer.expires = iv_now;
+  timespec_add_msec(&self->follow_timer.expires, timeout_msec);
+  iv_timer_register(&self->follow_timer);
+}
+
+static void
+poll_file_changes_stop_timer(PollFileChanges *self)
+{
+  if (iv_timer_registered(&self->follow_timer))
+    iv_timer_unregister(&self->follow_timer);
+}
+
+/* there's no new data in the file, check it again once it changes */
+static void
+poll_file_changes_wait_for_changes(PollFileChanges *self)
+{
+  poll_file_changes_stop_timer(self);
+  self->watching = TRUE;
+
+  if (!inotify_watch_is_active(&self->watch))
+    poll_file_changes_rearm_timer(self, self->follow_freq);
+}
+
+static void
+poll_file_changes_on_inotify_event(gpointer s, guint events, const gchar *name)
+{
+  PollFileChanges *self = (PollFileChanges *) s;
+
+  if (events & IWE_LOST)
+    inotify_watch_remove(&self->watch);
+
+  if (self->watching && !iv_timer_registered(&self->follow_timer))
+    poll_file_changes_rearm_timer(self, 0);
+}
+
 /* follow timer callback. Check if the file has new content, or deleted or
- * moved.  Ran every follow_freq seconds.  */
+ * moved.  Ran when inotify reports a change or every follow_freq seconds.  */
 static void
 poll_file_changes_check_file(gpointer s)
 {
@@ -95,6 +145,13 @@ poll_file_changes_check_file(gpointer s)
                 evt_tag_int("size", st.st_size),
                 NULL);
 
+      if (st.st_nlink == 0)
+        {
+          /* the followed file was deleted, a new one will not generate
+           * inotify events on this inode */
+          inotify_watch_remove(&self->watch);
+        }
+
       if (pos < st.st_size || !S_ISREG(st.st_mode))
         {
           /* we have data to read */
@@ -141,7 +198,7 @@ poll_file_changes_check_file(gpointer s)
         }
     }
  reschedule:
-  poll_events_update_watches(s, G_IO_IN);
+  poll_file_changes_wait_for_changes(self);
 }
 
 static void
@@ -149,17 +206,8 @@ poll_file_changes_stop_watches(PollEvents *s)
 {
   PollFileChanges *self = (PollFileChanges *) s;
 
-  if (iv_timer_registered(&self->follow_timer))
-    iv_timer_unregister(&self->follow_timer);
-}
-
-static void
-poll_file_changes_rearm_timer(PollFileChanges *self)
-{
-  iv_validate_now();
-  self->follow_timer.expires = iv_now;
-  timespec_add_msec(&self->follow_timer.expires, self->follow_freq);
-  iv_timer_register(&self->follow_timer);
+  self->watching = FALSE;
+  poll_file_changes_stop_timer(self);
 }
 
 static void
@@ -173,7 +221,12 @@ poll_file_changes_update_watches(PollEvents *s, GIOCondition cond)
   poll_file_changes_stop_watches(s);
 
   if (cond & G_IO_IN)
-    poll_file_changes_rearm_timer(self);
+    {
+      self->watching = TRUE;
+      /* the reader may have stopped before EOF, check right away if
+       * changes are reported by inotify */
+      poll_file_changes_rearm_timer(self, inotify_watch_is_active(&self->watch) ? 0 : self->follow_freq);
+    }
 }
 
 static void
@@ -181,6 +234,7 @@ poll_file_changes_free(PollEvents *s)
 {
   PollFileChanges *self = (PollFileChanges *) s;
 
+  inotify_watch_remove(&self->watch);
   log_pipe_unref(self->control);
   g_free(self->follow_filename);
 }
@@ -203,5 +257,9 @@ poll_file_changes_new(gint fd, const gchar *follow_filename, gint follow_freq, L
   self->follow_timer.cookie = self;
   self->follow_timer.handler = poll_file_changes_check_file;
 
+  inotify_watch_init(&self->watch);
+  if (fd >= 0 && follow_filename)
+    inotify_watch_add(&self->watch, follow_filename, poll_file_changes_on_inotify_event, self);
+
   return &self->super;
 }
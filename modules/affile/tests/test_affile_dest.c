@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "affile/affile-dest.h"
+#include "apphook.h"
+#include "mainloop.h"
+#include "mainloop-worker.h"
+#include "plugin.h"
+#include "logmsg.h"
+#include "timeutils.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define AFFILE_DEST_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+#define TEST_DIR "affile_dest_test_dir"
+#define TEST_TEMPLATE TEST_DIR "/${HOST}.log"
+
+/* enough for the pending writers to be opened and flushed */
+#define LOOP_TIMEOUT_MSEC 200
+
+#define NUM_THREADS 4
+#define NUM_HOSTS 40
+#define MESSAGES_PER_HOST 5
+
+static void
+_quit_main_loop(gpointer user_data)
+{
+  iv_quit();
+}
+
+/* runs the main loop of the test for a while, so that writers are opened
+ * and flushed */
+static void
+_run_main_loop(void)
+{
+  struct iv_timer quit_timer;
+
+  IV_TIMER_INIT(&quit_timer);
+  quit_timer.handler = _quit_main_loop;
+  iv_validate_now();
+  quit_timer.expires = iv_now;
+  timespec_add_msec(&quit_timer.expires, LOOP_TIMEOUT_MSEC);
+  iv_timer_register(&quit_timer);
+
+  iv_main();
+
+  if (iv_timer_registered(&quit_timer))
+    iv_timer_unregister(&quit_timer);
+}
+
+static void
+_queue_message(LogPipe *driver, gint host)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = log_msg_new_empty();
+  gchar hostname[16];
+
+  g_snprintf(hostname, sizeof(hostname), "host%d", host);
+  log_msg_set_value(msg, LM_V_HOST, hostname, -1);
+  log_msg_set_value(msg, LM_V_MESSAGE, "test message", -1);
+  log_pipe_queue(driver, msg, &path_options);
+}
+
+static gint
+_count_lines(gint host)
+{
+  gchar *filename = g_strdup_printf("%s/host%d.log", TEST_DIR, host);
+  gchar *contents;
+  gint lines = 0;
+  gchar *p;
+
+  if (g_file_get_contents(filename, &contents, NULL, NULL))
+    {
+      for (p = contents; *p; p++)
+        {
+          if (*p == '\n')
+            lines++;
+        }
+      g_free(contents);
+    }
+  g_free(filename);
+  return lines;
+}
+
+static AFFileDestDriver *
+_create_driver(gint max_open_files)
+{
+  LogDriver *driver = affile_dd_new(TEST_TEMPLATE, configuration);
+
+  driver->group = g_strdup("d_test");
+  driver->id = g_strdup("d_test#0");
+  affile_dd_set_max_open_files(driver, max_open_files);
+  assert_true(log_pipe_init(&driver->super), "Error initializing file destination");
+  return (AFFileDestDriver *) driver;
+}
+
+static void
+_destroy_driver(AFFileDestDriver *self)
+{
+  LogPipe *s = &self->super.super.super;
+
+  assert_true(log_pipe_deinit(s), "Error deinitializing file destination");
+  log_pipe_unref(s);
+}
+
+static void
+_clean_test_dir(void)
+{
+  const gchar *name;
+  GDir *dir = g_dir_open(TEST_DIR, 0, NULL);
+
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name(dir)))
+    {
+      gchar *filename = g_build_filename(TEST_DIR, name, NULL);
+
+      unlink(filename);
+      g_free(filename);
+    }
+  g_dir_close(dir);
+  rmdir(TEST_DIR);
+}
+
+/* frees the writers persisted by the previous testcase */
+static void
+_reset_persist_config(void)
+{
+  if (configuration->persist)
+    persist_config_free(configuration->persist);
+  configuration->persist = persist_config_new();
+}
+
+static void
+_setup(void)
+{
+  _reset_persist_config();
+  _clean_test_dir();
+  mkdir(TEST_DIR, 0700);
+}
+
+static gpointer
+_queue_messages_thread(gpointer user_data)
+{
+  LogPipe *driver = (LogPipe *) user_data;
+  gint i, host;
+
+  main_loop_worker_thread_start(NULL);
+  for (i = 0; i < MESSAGES_PER_HOST; i++)
+    {
+      for (host = 0; host < NUM_HOSTS; host++)
+        _queue_message(driver, host);
+    }
+  main_loop_worker_invoke_batch_callbacks();
+  main_loop_worker_thread_stop();
+  return NULL;
+}
+
+/* every thread writes every file, while the writers are being opened */
+static void
+_queue_messages_in_parallel(AFFileDestDriver *self)
+{
+  GThread *threads[NUM_THREADS];
+  gint i;
+
+  for (i = 0; i < NUM_THREADS; i++)
+    threads[i] = g_thread_create(_queue_messages_thread, &self->super.super.super, TRUE, NULL);
+  for (i = 0; i < NUM_THREADS; i++)
+    g_thread_join(threads[i]);
+}
+
+static void
+test_writer_map_is_shared_between_threads(void)
+{
+  AFFileDestDriver *self;
+  gint host;
+
+  _setup();
+  self = _create_driver(0);
+
+  _queue_messages_in_parallel(self);
+  assert_gint(stats_counter_get(self->writer_misses), NUM_HOSTS,
+              "Exactly one writer should be created for each file");
+  assert_gint(stats_counter_get(self->writer_hits), NUM_THREADS * NUM_HOSTS * MESSAGES_PER_HOST - NUM_HOSTS,
+              "Further messages should find the writer of their file");
+
+  /* messages parked on the pending writers are written once they are opened */
+  _run_main_loop();
+  assert_gint(self->open_writers, NUM_HOSTS, "All writers should be opened");
+  _destroy_driver(self);
+
+  for (host = 0; host < NUM_HOSTS; host++)
+    assert_gint(_count_lines(host), NUM_THREADS * MESSAGES_PER_HOST, "Messages were lost, host: %d", host);
+
+  _clean_test_dir();
+}
+
+static void
+test_writer_map_survives_reloads(void)
+{
+  AFFileDestDriver *self;
+  gint host, misses, hits;
+
+  _setup();
+  self = _create_driver(0);
+  _queue_messages_in_parallel(self);
+  _run_main_loop();
+  _destroy_driver(self);
+
+  /* the writers of the previous configuration are initialized and put back
+   * to the writer map by the new driver instance */
+  self = _create_driver(0);
+  assert_gint(self->open_writers, NUM_HOSTS, "The writers of the previous configuration should be reused");
+
+  misses = stats_counter_get(self->writer_misses);
+  hits = stats_counter_get(self->writer_hits);
+  _queue_messages_in_parallel(self);
+  assert_gint(stats_counter_get(self->writer_misses), misses,
+              "No new writer should be created for files opened before the reload");
+  assert_gint(stats_counter_get(self->writer_hits) - hits, NUM_THREADS * NUM_HOSTS * MESSAGES_PER_HOST,
+              "All messages should find the writer of their file");
+
+  _run_main_loop();
+  _destroy_driver(self);
+
+  for (host = 0; host < NUM_HOSTS; host++)
+    assert_gint(_count_lines(host), 2 * NUM_THREADS * MESSAGES_PER_HOST, "Messages were lost, host: %d", host);
+
+  _clean_test_dir();
+}
+
+static void
+_queue_messages_to_host(AFFileDestDriver *self, gint host)
+{
+  _queue_message(&self->super.super.super, host);
+  _run_main_loop();
+}
+
+static void
+test_least_recently_written_file_is_evicted(void)
+{
+  AFFileDestDriver *self;
+  gint misses;
+
+  _setup();
+  self = _create_driver(2);
+
+  _queue_messages_to_host(self, 0);
+  _queue_messages_to_host(self, 1);
+  assert_gint(self->open_writers, 2, "Files should be opened up to max-open-files()");
+  assert_gint(stats_counter_get(self->writer_evictions), 0, "No file should be closed below max-open-files()");
+
+  /* host0 is the least recently written one */
+  _queue_messages_to_host(self, 2);
+  assert_gint(self->open_writers, 2, "No more than max-open-files() files should be open");
+  assert_gint(stats_counter_get(self->writer_evictions), 1, "A file should be closed to open a new one");
+  assert_gint(_count_lines(0), 1, "The queue of the evicted file should be flushed");
+
+  /* host0 is opened again, host1 is the least recently written one now */
+  misses = stats_counter_get(self->writer_misses);
+  _queue_messages_to_host(self, 0);
+  assert_gint(stats_counter_get(self->writer_misses), misses + 1, "An evicted file should be opened again");
+  assert_gint(stats_counter_get(self->writer_evictions), 2, "A file should be closed to open an evicted one");
+  assert_gint(self->open_writers, 2, "No more than max-open-files() files should be open");
+
+  /* host2 is still open, writing it doesn't evict anything */
+  misses = stats_counter_get(self->writer_misses);
+  _queue_messages_to_host(self, 2);
+  assert_gint(stats_counter_get(self->writer_misses), misses, "An open file should not be opened again");
+  assert_gint(stats_counter_get(self->writer_evictions), 2, "Writing an open file should not close any file");
+
+  _destroy_driver(self);
+
+  assert_gint(_count_lines(0), 2, "Messages were lost, host: 0");
+  assert_gint(_count_lines(1), 1, "Messages were lost, host: 1");
+  assert_gint(_count_lines(2), 2, "Messages were lost, host: 2");
+  _clean_test_dir();
+}
+
+static void
+test_file_with_pending_writes_is_not_evicted(void)
+{
+  AFFileDestDriver *self;
+  gint misses;
+
+  _setup();
+  self = _create_driver(2);
+
+  _queue_messages_to_host(self, 0);
+  _queue_messages_to_host(self, 1);
+
+  /* host0 is the least recently written one, but its message is still in
+   * the queue when host2 is opened, as the pending writer is opened first */
+  _queue_message(&self->super.super.super, 2);
+  _queue_message(&self->super.super.super, 0);
+  _run_main_loop();
+  assert_gint(stats_counter_get(self->writer_evictions), 1, "A file should be closed to open a new one");
+  assert_gint(self->open_writers, 2, "No more than max-open-files() files should be open");
+
+  /* host1 was closed instead of host0 */
+  misses = stats_counter_get(self->writer_misses);
+  _queue_messages_to_host(self, 0);
+  assert_gint(stats_counter_get(self->writer_misses), misses, "A file with pending writes should not be closed");
+
+  _destroy_driver(self);
+
+  assert_gint(_count_lines(0), 3, "Messages were lost, host: 0");
+  assert_gint(_count_lines(1), 1, "Messages were lost, host: 1");
+  assert_gint(_count_lines(2), 1, "Messages were lost, host: 2");
+  _clean_test_dir();
+}
+
+int
+main(int argc, char **argv)
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+
+  configuration = cfg_new(VERSION_VALUE);
+  configuration->threaded = FALSE;
+  plugin_load_module("syslogformat", configuration, NULL);
+
+  AFFILE_DEST_TESTCASE(test_writer_map_is_shared_between_threads);
+  AFFILE_DEST_TESTCASE(test_writer_map_survives_reloads);
+  AFFILE_DEST_TESTCASE(test_least_recently_written_file_is_evicted);
+  AFFILE_DEST_TESTCASE(test_file_with_pending_writes_is_not_evicted);
+
+  persist_config_free(configuration->persist);
+  configuration->persist = NULL;
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
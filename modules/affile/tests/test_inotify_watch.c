@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "affile/inotify-watch.h"
+#include "apphook.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#if SYSLOG_NG_HAVE_SYS_INOTIFY_H
+
+#include <sys/inotify.h>
+
+#define INOTIFY_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+#define TEST_FILE_A "test_inotify_a.log"
+#define TEST_FILE_B "test_inotify_b.log"
+
+typedef struct _TestWatch
+{
+  InotifyWatch watch;
+  gint calls;
+  guint events;
+  const gchar *name;
+  /* removed by the callback of this watch */
+  struct _TestWatch *victim;
+} TestWatch;
+
+static TestWatch watch_a, watch_b;
+
+static void
+_on_event(gpointer s, guint events, const gchar *name)
+{
+  TestWatch *self = (TestWatch *) s;
+
+  self->calls++;
+  self->events = events;
+  self->name = name;
+  if (self->victim)
+    inotify_watch_remove(&self->victim->watch);
+}
+
+static void
+_create_file(const gchar *filename)
+{
+  FILE *f = fopen(filename, "w");
+
+  assert_not_null(f, "Error creating test file %s", filename);
+  fclose(f);
+}
+
+static void
+_add_watch(TestWatch *self, const gchar *filename)
+{
+  memset(self, 0, sizeof(*self));
+  inotify_watch_init(&self->watch);
+  _create_file(filename);
+  assert_true(inotify_watch_add(&self->watch, filename, _on_event, self), "Error watching %s", filename);
+}
+
+static void
+_setup(void)
+{
+  _add_watch(&watch_a, TEST_FILE_A);
+  _add_watch(&watch_b, TEST_FILE_B);
+}
+
+static void
+_teardown(void)
+{
+  inotify_watch_remove(&watch_a.watch);
+  inotify_watch_remove(&watch_b.watch);
+  unlink(TEST_FILE_A);
+  unlink(TEST_FILE_B);
+}
+
+static void
+_feed_event(gint wd, guint32 mask)
+{
+  struct inotify_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.wd = wd;
+  event.mask = mask;
+  inotify_watch_dispatch_events((const gchar *) &event, sizeof(event));
+}
+
+static void
+test_event_is_dispatched_to_its_watch_only(void)
+{
+  _setup();
+
+  _feed_event(watch_a.watch.wd, IN_MODIFY);
+  assert_gint(watch_a.calls, 1, "The watch was not notified about its own event");
+  assert_gint(watch_a.events, IWE_CHANGED, "Wrong events reported");
+  assert_gint(watch_b.calls, 0, "A watch was notified about an event of another watch");
+
+  _teardown();
+}
+
+static void
+test_overflow_wakes_up_every_watch(void)
+{
+  _setup();
+
+  _feed_event(-1, IN_Q_OVERFLOW);
+  assert_gint(watch_a.calls, 1, "Watch was not notified about the overflow");
+  assert_gint(watch_b.calls, 1, "Watch was not notified about the overflow");
+  assert_gint(watch_a.events, IWE_CHANGED | IWE_OVERFLOW, "Wrong events reported for an overflow");
+  assert_gint(watch_b.events, IWE_CHANGED | IWE_OVERFLOW, "Wrong events reported for an overflow");
+  assert_null(watch_a.name, "No file name should be reported for an overflow");
+  assert_true(inotify_watch_is_active(&watch_a.watch), "Overflow should not deactivate the watch");
+
+  _teardown();
+}
+
+static void
+test_watches_removed_during_overflow_are_not_notified(void)
+{
+  _setup();
+
+  /* whichever is notified first removes the other one */
+  watch_a.victim = &watch_b;
+  watch_b.victim = &watch_a;
+
+  _feed_event(-1, IN_Q_OVERFLOW);
+  assert_gint(watch_a.calls + watch_b.calls, 1, "A watch removed by another callback was notified");
+
+  _teardown();
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+
+  INOTIFY_TESTCASE(test_event_is_dispatched_to_its_watch_only);
+  INOTIFY_TESTCASE(test_overflow_wakes_up_every_watch);
+  INOTIFY_TESTCASE(test_watches_removed_during_overflow_are_not_notified);
+
+  app_shutdown();
+  return 0;
+}
+
+#else
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "affile/wildcard-source.h"
+#include "apphook.h"
+#include "mainloop.h"
+#include "plugin.h"
+#include "persist-state.h"
+#include "logmsg.h"
+#include "timeutils.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define WILDCARD_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+#define TEST_DIR "wildcard_test_dir"
+#define TEST_PERSIST_FILE_NAME "test_wildcard_source.persist"
+
+/* enough for the readers to process the files and the inotify events */
+#define LOOP_TIMEOUT_MSEC 200
+
+static LogPipe message_counter;
+static gint num_messages;
+
+static void
+_count_message(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  num_messages++;
+  log_msg_drop(msg, path_options);
+}
+
+static void
+_quit_main_loop(gpointer user_data)
+{
+  iv_quit();
+}
+
+/* runs the main loop of the test for a while, so that the readers,
+ * inotify watches and housekeeping tasks of the source can do their job */
+static void
+_run_main_loop(void)
+{
+  struct iv_timer quit_timer;
+
+  IV_TIMER_INIT(&quit_timer);
+  quit_timer.handler = _quit_main_loop;
+  iv_validate_now();
+  quit_timer.expires = iv_now;
+  timespec_add_msec(&quit_timer.expires, LOOP_TIMEOUT_MSEC);
+  iv_timer_register(&quit_timer);
+
+  iv_main();
+
+  if (iv_timer_registered(&quit_timer))
+    iv_timer_unregister(&quit_timer);
+}
+
+static void
+_write_file(const gchar *name, const gchar *mode, gint num_lines)
+{
+  gchar *filename = g_build_filename(TEST_DIR, name, NULL);
+  FILE *f = fopen(filename, mode);
+  gint i;
+
+  assert_not_null(f, "Error opening test file %s", filename);
+  for (i = 0; i < num_lines; i++)
+    fprintf(f, "<13>Oct 11 22:14:15 host prog: %s line %d\n", name, i);
+  fclose(f);
+  g_free(filename);
+}
+
+static void
+_remove_file(const gchar *name)
+{
+  gchar *filename = g_build_filename(TEST_DIR, name, NULL);
+
+  unlink(filename);
+  g_free(filename);
+}
+
+static gboolean
+_is_followed(WildcardSourceDriver *self, const gchar *name)
+{
+  gchar *filename = g_build_filename(TEST_DIR, name, NULL);
+  gboolean found = g_hash_table_lookup(self->file_readers, filename) != NULL;
+
+  g_free(filename);
+  return found;
+}
+
+static gint
+_num_pending_readers(WildcardSourceDriver *self)
+{
+  struct iv_list_head *lh;
+  gint count = 0;
+
+  iv_list_for_each(lh, &self->pending_readers)
+    count++;
+  return count;
+}
+
+static WildcardSourceDriver *
+_create_source(gint max_files)
+{
+  LogDriver *driver = wildcard_sd_new(configuration);
+  WildcardSourceDriver *self = (WildcardSourceDriver *) driver;
+
+  wildcard_sd_set_base_dir(driver, TEST_DIR);
+  wildcard_sd_set_filename_pattern(driver, "*.log");
+  wildcard_sd_set_max_files(driver, max_files);
+  /* in case inotify is not available, don't wait long for the rescans */
+  self->super.follow_freq = 10;
+
+  log_pipe_append(&driver->super, &message_counter);
+  assert_true(log_pipe_init(&driver->super), "Error initializing wildcard-file() source");
+  return self;
+}
+
+static void
+_destroy_source(WildcardSourceDriver *self)
+{
+  LogPipe *s = &self->super.super.super.super;
+
+  assert_true(log_pipe_deinit(s), "Error deinitializing wildcard-file() source");
+  log_pipe_unref(s);
+}
+
+static void
+_clean_test_dir(void)
+{
+  const gchar *name;
+  GDir *dir = g_dir_open(TEST_DIR, 0, NULL);
+
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name(dir)))
+    {
+      gchar *filename = g_build_filename(TEST_DIR, name, NULL);
+
+      if (g_file_test(filename, G_FILE_TEST_IS_DIR))
+        rmdir(filename);
+      else
+        unlink(filename);
+      g_free(filename);
+    }
+  g_dir_close(dir);
+  rmdir(TEST_DIR);
+}
+
+static void
+_setup(void)
+{
+  _clean_test_dir();
+  mkdir(TEST_DIR, 0700);
+  num_messages = 0;
+}
+
+static void
+test_only_matching_files_are_followed(void)
+{
+  WildcardSourceDriver *self;
+
+  _setup();
+  _write_file("a.log", "w", 1);
+  _write_file("b.log", "w", 2);
+  _write_file("c.txt", "w", 4);
+  mkdir(TEST_DIR "/d.log", 0700);
+
+  self = _create_source(10);
+  assert_gint(g_hash_table_size(self->file_readers), 2, "Only the matching regular files should be followed");
+  assert_true(_is_followed(self, "a.log"), "a.log matches the pattern, but it is not followed");
+  assert_true(_is_followed(self, "b.log"), "b.log matches the pattern, but it is not followed");
+  assert_false(_is_followed(self, "c.txt"), "c.txt doesn't match the pattern, but it is followed");
+  assert_false(_is_followed(self, "d.log"), "d.log is a directory, but it is followed");
+
+  /* files are opened by the housekeeping task, not during the scan */
+  assert_gint(self->num_open_files, 0, "Files should not be opened synchronously");
+  assert_gint(_num_pending_readers(self), 2, "Matching files should be waiting to be opened");
+
+  _run_main_loop();
+  assert_gint(self->num_open_files, 2, "Matching files should be opened");
+  assert_gint(_num_pending_readers(self), 0, "No file should be waiting to be opened");
+  assert_gint(num_messages, 3, "All lines of the matching files should be read");
+
+  _destroy_source(self);
+  _clean_test_dir();
+}
+
+static void
+test_files_are_opened_and_closed_as_they_come_and_go(void)
+{
+  WildcardSourceDriver *self;
+
+  _setup();
+  self = _create_source(10);
+  assert_gint(g_hash_table_size(self->file_readers), 0, "No file should be followed in an empty directory");
+
+  _write_file("new.log", "w", 3);
+  _write_file("new.txt", "w", 3);
+  _run_main_loop();
+  assert_true(_is_followed(self, "new.log"), "A new matching file should be followed");
+  assert_false(_is_followed(self, "new.txt"), "A new file that doesn't match the pattern should not be followed");
+  assert_gint(self->num_open_files, 1, "The new file should be opened");
+  assert_gint(num_messages, 3, "The lines of the new file should be read");
+
+  _write_file("new.log", "a", 2);
+  _run_main_loop();
+  assert_gint(num_messages, 5, "Lines appended to a followed file should be read");
+
+  _remove_file("new.log");
+  _run_main_loop();
+  assert_false(_is_followed(self, "new.log"), "A deleted file should not be followed once it is read to the end");
+  assert_gint(self->num_open_files, 0, "A deleted file should be closed once it is read to the end");
+
+  /* a file created with the same name is a new file, read from the start */
+  _write_file("new.log", "w", 1);
+  _run_main_loop();
+  assert_true(_is_followed(self, "new.log"), "A recreated file should be followed");
+  assert_gint(self->num_open_files, 1, "A recreated file should be opened");
+  assert_gint(num_messages, 6, "The lines of a recreated file should be read");
+
+  _destroy_source(self);
+  _clean_test_dir();
+}
+
+static void
+test_max_files_limits_the_number_of_open_files(void)
+{
+  WildcardSourceDriver *self;
+
+  _setup();
+  _write_file("a.log", "w", 1);
+  _write_file("b.log", "w", 1);
+  _write_file("c.log", "w", 1);
+
+  self = _create_source(2);
+  assert_gint(g_hash_table_size(self->file_readers), 3, "All matching files should be followed");
+
+  /* idle readers are closed to make room for the pending ones */
+  _run_main_loop();
+  assert_gint(self->num_open_files, 2, "No more than max-files() files should be open");
+  assert_gint(_num_pending_readers(self), 0, "Files should be opened once an idle one is closed");
+  assert_gint(num_messages, 3, "All files should be read, even if they don't fit into max-files()");
+
+  /* closed files are reopened once they change */
+  _write_file("a.log", "a", 1);
+  _write_file("b.log", "a", 1);
+  _write_file("c.log", "a", 1);
+  _run_main_loop();
+  assert_gint(self->num_open_files, 2, "No more than max-files() files should be open");
+  assert_gint(_num_pending_readers(self), 0, "Changed files should be reopened once an idle one is closed");
+  assert_gint(num_messages, 6, "Lines appended to closed files should be read");
+
+  _destroy_source(self);
+  _clean_test_dir();
+}
+
+int
+main(int argc, char **argv)
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+
+  configuration = cfg_new(VERSION_VALUE);
+  configuration->threaded = FALSE;
+  configuration->state = persist_state_new(TEST_PERSIST_FILE_NAME);
+  persist_state_start(configuration->state);
+  plugin_load_module("syslogformat", configuration, NULL);
+
+  log_pipe_init_instance(&message_counter, configuration);
+  message_counter.queue = _count_message;
+
+  WILDCARD_TESTCASE(test_only_matching_files_are_followed);
+  WILDCARD_TESTCASE(test_files_are_opened_and_closed_as_they_come_and_go);
+  WILDCARD_TESTCASE(test_max_files_limits_the_number_of_open_files);
+
+  persist_state_cancel(configuration->state);
+  unlink(TEST_PERSIST_FILE_NAME);
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
@@ -0,0 +1,731 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "wildcard-source.h"
+#include "poll-file-changes.h"
+#include "messages.h"
+#include "persist-state.h"
+#include "cfg.h"
+#include "compat/lfs.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define DEFAULT_WILDCARD_SD_OPEN_FLAGS (O_RDONLY | O_NOCTTY | O_NONBLOCK | O_LARGEFILE)
+
+/*
+ * wildcard-file() follows every file in base-dir() whose name matches
+ * filename-pattern(), using a single driver instance:
+ *
+ *   - new, modified and deleted files are discovered using an inotify
+ *     watch on the directory, or by rescanning it every follow-freq() if
+ *     inotify is not available
+ *
+ *   - each file has a WildcardFileReader, which owns the LogReader of the
+ *     file while it is open.  At most max-files() files are open at the
+ *     same time: if a file needs to be opened and there's no free slot,
+ *     the reader that has been idle (at EOF) for the longest time is
+ *     closed.  If all readers are busy, the file waits in pending_readers
+ *     until one of them reaches EOF.  Closed readers are reopened once
+ *     their file changes.
+ *
+ *   - file positions are stored in the persist file using the same entry
+ *     names as file() sources, entries of deleted files are removed once
+ *     the file is read to the end, and at startup for files that were
+ *     deleted while syslog-ng was not running.
+ *
+ * The LogReaders of all files share the I/O worker pool of the main loop.
+ * Everything except WildcardFileReader's queue method runs in the main
+ * thread.
+ */
+
+typedef enum
+{
+  WFR_CLOSED,
+  WFR_PENDING,
+  WFR_OPEN,
+} WildcardFileReaderState;
+
+typedef struct _WildcardFileReader
+{
+  LogPipe super;
+  WildcardSourceDriver *owner;
+  GString *filename;
+  LogReader *reader;
+  WildcardFileReaderState state;
+  /* set when the reader reaches EOF, cleared by messages read afterwards */
+  gint eof;
+  /* size of the file when the reader reached EOF */
+  gint64 eof_size;
+  gboolean deleted;
+  /* size of the file when the reader was closed, -1 if unknown */
+  gint64 closed_size;
+  gint scan_generation;
+  /* element of idle_readers */
+  struct iv_list_head idle_list;
+  /* element of pending_readers or deleted_readers */
+  struct iv_list_head list;
+} WildcardFileReader;
+
+static void _schedule_housekeeping(WildcardSourceDriver *self);
+
+/* WildcardFileReader */
+
+static void
+_fr_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  WildcardFileReader *self = (WildcardFileReader *) s;
+  static NVHandle filename_handle = 0;
+
+  if (!filename_handle)
+    filename_handle = log_msg_get_value_handle("FILE_NAME");
+
+  if (G_UNLIKELY(g_atomic_int_get(&self->eof)))
+    g_atomic_int_set(&self->eof, FALSE);
+
+  log_msg_set_value(msg, filename_handle, self->filename->str, self->filename->len);
+  log_pipe_forward_msg(s, msg, path_options);
+}
+
+static gint64
+_fr_get_file_size(WildcardFileReader *self)
+{
+  struct stat st;
+
+  if (stat(self->filename->str, &st) < 0)
+    return -1;
+  return st.st_size;
+}
+
+static void
+_fr_close(WildcardFileReader *self)
+{
+  if (self->state != WFR_OPEN)
+    return;
+
+  log_pipe_deinit((LogPipe *) self->reader);
+  log_pipe_unref((LogPipe *) self->reader);
+  self->reader = NULL;
+
+  iv_list_del_init(&self->idle_list);
+  self->owner->num_open_files--;
+  self->state = WFR_CLOSED;
+  self->closed_size = _fr_get_file_size(self);
+}
+
+static gboolean
+_fr_open(WildcardFileReader *self)
+{
+  AFFileSourceDriver *owner = &self->owner->super;
+  GlobalConfig *cfg = log_pipe_get_config(&self->super);
+  LogProtoServer *proto;
+  PollEvents *poll_events;
+  gint fd;
+
+  g_assert(self->state == WFR_CLOSED);
+
+  if (!affile_sd_open_file(owner, self->filename->str, &fd))
+    {
+      msg_error("Error opening file for reading",
+                evt_tag_str("filename", self->filename->str),
+                evt_tag_errno(EVT_TAG_OSERROR, errno),
+                NULL);
+      return FALSE;
+    }
+
+  poll_events = poll_file_changes_new(fd, self->filename->str, owner->follow_freq, &self->super);
+  proto = affile_sd_construct_proto(owner, fd);
+
+  self->reader = log_reader_new(cfg);
+  log_reader_reopen(self->reader, proto, poll_events);
+  log_reader_set_options(self->reader,
+                         &self->super,
+                         &owner->reader_options,
+                         STATS_LEVEL1,
+                         SCS_FILE,
+                         owner->super.super.id,
+                         self->filename->str);
+
+  log_pipe_append((LogPipe *) self->reader, &self->super);
+  if (!log_pipe_init((LogPipe *) self->reader))
+    {
+      msg_error("Error initializing log_reader, closing fd",
+                evt_tag_int("fd", fd),
+                NULL);
+      log_pipe_unref((LogPipe *) self->reader);
+      self->reader = NULL;
+      close(fd);
+      return FALSE;
+    }
+
+  if (!log_proto_server_restart_with_state(proto, cfg->state, affile_sd_format_persist_name(self->filename->str)))
+    {
+      msg_error("Error converting persistent state from on-disk format, losing file position information",
+                evt_tag_str("filename", self->filename->str),
+                NULL);
+    }
+
+  g_atomic_int_set(&self->eof, FALSE);
+  self->owner->num_open_files++;
+  self->state = WFR_OPEN;
+  return TRUE;
+}
+
+static void
+_fr_request_open(WildcardFileReader *self)
+{
+  if (self->state != WFR_CLOSED)
+    return;
+
+  self->state = WFR_PENDING;
+  iv_list_add_tail(&self->list, &self->owner->pending_readers);
+  _schedule_housekeeping(self->owner);
+}
+
+/* forgets about the file, including its position in the persist file */
+static void
+_fr_drop(WildcardFileReader *self)
+{
+  WildcardSourceDriver *owner = self->owner;
+  GlobalConfig *cfg = log_pipe_get_config(&self->super);
+
+  msg_verbose("Followed file was deleted, forgetting its state",
+              evt_tag_str("filename", self->filename->str),
+              NULL);
+
+  _fr_close(self);
+  iv_list_del_init(&self->list);
+  if (cfg->state)
+    persist_state_remove_entry(cfg->state, affile_sd_format_persist_name(self->filename->str));
+
+  /* frees self */
+  g_hash_table_remove(owner->file_readers, self->filename->str);
+}
+
+static void
+_fr_notify(LogPipe *s, gint notify_code, gpointer user_data)
+{
+  WildcardFileReader *self = (WildcardFileReader *) s;
+  WildcardSourceDriver *owner = self->owner;
+
+  switch (notify_code)
+    {
+    case NC_FILE_EOF:
+      self->eof_size = _fr_get_file_size(self);
+      g_atomic_int_set(&self->eof, TRUE);
+      if (self->state == WFR_OPEN && iv_list_empty(&self->idle_list))
+        iv_list_add_tail(&self->idle_list, &owner->idle_readers);
+      if (self->deleted || !iv_list_empty(&owner->pending_readers))
+        _schedule_housekeeping(owner);
+      break;
+
+    case NC_FILE_MOVED:
+      msg_verbose("Follow-mode file source moved, tracking of the new file is started",
+                  evt_tag_str("filename", self->filename->str),
+                  NULL);
+      _fr_close(self);
+      _fr_request_open(self);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static void
+_fr_free(LogPipe *s)
+{
+  WildcardFileReader *self = (WildcardFileReader *) s;
+
+  g_assert(!self->reader);
+  g_string_free(self->filename, TRUE);
+  log_pipe_free_method(s);
+}
+
+static WildcardFileReader *
+_fr_new(WildcardSourceDriver *owner, const gchar *filename)
+{
+  WildcardFileReader *self = g_new0(WildcardFileReader, 1);
+
+  log_pipe_init_instance(&self->super, log_pipe_get_config(&owner->super.super.super.super));
+  self->super.queue = _fr_queue;
+  self->super.notify = _fr_notify;
+  self->super.free_fn = _fr_free;
+  self->super.expr_node = owner->super.super.super.super.expr_node;
+  log_pipe_append(&self->super, &owner->super.super.super.super);
+  log_pipe_init(&self->super);
+
+  self->owner = owner;
+  self->filename = g_string_new(filename);
+  self->state = WFR_CLOSED;
+  self->closed_size = -1;
+  INIT_IV_LIST_HEAD(&self->idle_list);
+  INIT_IV_LIST_HEAD(&self->list);
+  return self;
+}
+
+/* WildcardSourceDriver */
+
+/* closes the reader that has been at EOF for the longest time */
+static gboolean
+_evict_idle_reader(WildcardSourceDriver *self)
+{
+  while (!iv_list_empty(&self->idle_readers))
+    {
+      WildcardFileReader *fr = iv_list_entry(self->idle_readers.next, WildcardFileReader, idle_list);
+
+      iv_list_del_init(&fr->idle_list);
+
+      /* it has read messages since it reached EOF, or the file has grown
+       * since then, it will be put back to the list when it reaches EOF
+       * again */
+      if (!g_atomic_int_get(&fr->eof) || _fr_get_file_size(fr) != fr->eof_size)
+        continue;
+
+      msg_debug("Closing idle file to stay within max-files()",
+                evt_tag_str("filename", fr->filename->str),
+                evt_tag_int("max_files", self->max_files),
+                NULL);
+      _fr_close(fr);
+      return TRUE;
+    }
+  return FALSE;
+}
+
+static void
+_housekeeping(gpointer s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+  struct iv_list_head *lh, *lh2;
+
+  iv_list_for_each_safe(lh, lh2, &self->deleted_readers)
+    {
+      WildcardFileReader *fr = iv_list_entry(lh, WildcardFileReader, list);
+
+      if (fr->state != WFR_OPEN || g_atomic_int_get(&fr->eof))
+        _fr_drop(fr);
+    }
+
+  while (!iv_list_empty(&self->pending_readers))
+    {
+      WildcardFileReader *fr = iv_list_entry(self->pending_readers.next, WildcardFileReader, list);
+
+      if (self->num_open_files >= self->max_files && !_evict_idle_reader(self))
+        break;
+
+      iv_list_del_init(&fr->list);
+      fr->state = WFR_CLOSED;
+      if (!_fr_open(fr) && _fr_get_file_size(fr) < 0)
+        _fr_drop(fr);
+    }
+}
+
+static void
+_schedule_housekeeping(WildcardSourceDriver *self)
+{
+  if (!iv_task_registered(&self->housekeeping_task))
+    iv_task_register(&self->housekeeping_task);
+}
+
+static WildcardFileReader *
+_lookup_file(WildcardSourceDriver *self, const gchar *name)
+{
+  gchar *filename = g_build_filename(self->base_dir, name, NULL);
+  WildcardFileReader *fr;
+
+  fr = g_hash_table_lookup(self->file_readers, filename);
+  g_free(filename);
+  return fr;
+}
+
+static WildcardFileReader *
+_add_file(WildcardSourceDriver *self, const gchar *name)
+{
+  WildcardFileReader *fr;
+  gchar *filename;
+  struct stat st;
+
+  if (!g_pattern_match_simple(self->filename_pattern, name))
+    return NULL;
+
+  fr = _lookup_file(self, name);
+  if (fr)
+    {
+      if (fr->deleted)
+        {
+          /* a new file was created in place of a deleted one that is
+           * still being read, give up on the old one */
+          fr->deleted = FALSE;
+          iv_list_del_init(&fr->list);
+          _fr_close(fr);
+          _fr_request_open(fr);
+        }
+      return fr;
+    }
+
+  filename = g_build_filename(self->base_dir, name, NULL);
+  if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+      g_free(filename);
+      return NULL;
+    }
+
+  msg_verbose("Following new file",
+              evt_tag_str("filename", filename),
+              NULL);
+
+  fr = _fr_new(self, filename);
+  g_free(filename);
+  g_hash_table_insert(self->file_readers, fr->filename->str, fr);
+  _fr_request_open(fr);
+  return fr;
+}
+
+static void
+_on_file_deleted(WildcardSourceDriver *self, WildcardFileReader *fr)
+{
+  if (fr->deleted)
+    return;
+
+  fr->deleted = TRUE;
+  iv_list_del_init(&fr->list);
+  if (fr->state == WFR_PENDING)
+    fr->state = WFR_CLOSED;
+  iv_list_add_tail(&fr->list, &self->deleted_readers);
+  _schedule_housekeeping(self);
+}
+
+static void
+_on_file_changed(WildcardSourceDriver *self, const gchar *name)
+{
+  WildcardFileReader *fr = _lookup_file(self, name);
+
+  if (!fr)
+    _add_file(self, name);
+  else if (fr->state == WFR_CLOSED && !fr->deleted)
+    _fr_request_open(fr);
+}
+
+static void
+_on_dir_event(gpointer s, guint events, const gchar *name)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+  WildcardFileReader *fr;
+
+  if (events & IWE_LOST)
+    {
+      msg_warning("The base directory of a wildcard-file() source was moved or deleted, polling it from now on",
+                  evt_tag_str("base_dir", self->base_dir),
+                  NULL);
+      inotify_watch_remove(&self->dir_watch);
+      iv_validate_now();
+      self->rescan_timer.expires = iv_now;
+      iv_timer_register(&self->rescan_timer);
+      return;
+    }
+
+  if ((events & IWE_OVERFLOW) && !iv_timer_registered(&self->rescan_timer))
+    {
+      /* creations and deletions may have been lost, rescan the directory */
+      iv_validate_now();
+      self->rescan_timer.expires = iv_now;
+      iv_timer_register(&self->rescan_timer);
+    }
+
+  if (!name)
+    return;
+
+  if ((events & IWE_DELETED) && (fr = _lookup_file(self, name)))
+    _on_file_deleted(self, fr);
+  if (events & IWE_CREATED)
+    _add_file(self, name);
+  if (events & IWE_CHANGED)
+    _on_file_changed(self, name);
+}
+
+static void
+_scan_dir(WildcardSourceDriver *self)
+{
+  static gint scan_generation;
+  GError *error = NULL;
+  const gchar *name;
+  GHashTableIter iter;
+  gpointer key, value;
+  GDir *dir;
+
+  dir = g_dir_open(self->base_dir, 0, &error);
+  if (!dir)
+    {
+      msg_error("Error opening the base directory of a wildcard-file() source",
+                evt_tag_str("base_dir", self->base_dir),
+                evt_tag_str("error", error->message),
+                NULL);
+      g_clear_error(&error);
+      return;
+    }
+
+  scan_generation++;
+  while ((name = g_dir_read_name(dir)))
+    {
+      WildcardFileReader *fr = _add_file(self, name);
+
+      if (!fr)
+        continue;
+
+      fr->scan_generation = scan_generation;
+      if (fr->state == WFR_CLOSED && !fr->deleted && _fr_get_file_size(fr) != fr->closed_size)
+        _fr_request_open(fr);
+    }
+  g_dir_close(dir);
+
+  /* files not seen by this scan were deleted */
+  g_hash_table_iter_init(&iter, self->file_readers);
+  while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+      WildcardFileReader *fr = (WildcardFileReader *) value;
+
+      if (fr->scan_generation != scan_generation)
+        _on_file_deleted(self, fr);
+    }
+}
+
+static void
+_rescan(gpointer s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  _scan_dir(self);
+
+  if (!inotify_watch_is_active(&self->dir_watch))
+    {
+      iv_validate_now();
+      self->rescan_timer.expires = iv_now;
+      timespec_add_msec(&self->rescan_timer.expires, self->super.follow_freq);
+      iv_timer_register(&self->rescan_timer);
+    }
+}
+
+typedef struct
+{
+  WildcardSourceDriver *self;
+  /* "affile_sd_curpos(<base_dir>/" */
+  gchar *prefix;
+  gsize prefix_len;
+  GPtrArray *stale_names;
+} StalePersistEntriesState;
+
+static void
+_collect_stale_persist_entry(gchar *name, gint entry_size, gpointer entry, gpointer user_data)
+{
+  StalePersistEntriesState *state = (StalePersistEntriesState *) user_data;
+  gsize name_len = strlen(name);
+  gchar *filename;
+
+  if (name_len <= state->prefix_len + 1 || strncmp(name, state->prefix, state->prefix_len) != 0 ||
+      name[name_len - 1] != ')')
+    return;
+
+  filename = g_strndup(name + state->prefix_len, name_len - state->prefix_len - 1);
+  if (!strchr(filename, G_DIR_SEPARATOR) && g_pattern_match_simple(state->self->filename_pattern, filename) &&
+      !_lookup_file(state->self, filename))
+    {
+      gchar *path = g_build_filename(state->self->base_dir, filename, NULL);
+
+      if (access(path, F_OK) < 0 && errno == ENOENT)
+        g_ptr_array_add(state->stale_names, g_strdup(name));
+      g_free(path);
+    }
+  g_free(filename);
+}
+
+static void
+_remove_stale_persist_entries(WildcardSourceDriver *self, PersistState *persist_state)
+{
+  StalePersistEntriesState state;
+  gint i;
+
+  state.self = self;
+  state.prefix = g_strdup_printf("affile_sd_curpos(%s%s", self->base_dir,
+                                 g_str_has_suffix(self->base_dir, G_DIR_SEPARATOR_S) ? "" : G_DIR_SEPARATOR_S);
+  state.prefix_len = strlen(state.prefix);
+  state.stale_names = g_ptr_array_new();
+
+  persist_state_foreach_entry(persist_state, _collect_stale_persist_entry, &state);
+  for (i = 0; i < state.stale_names->len; i++)
+    {
+      gchar *name = g_ptr_array_index(state.stale_names, i);
+
+      msg_verbose("Removing position of a deleted file from the persist file",
+                  evt_tag_str("persist_name", name),
+                  NULL);
+      persist_state_remove_entry(persist_state, name);
+      g_free(name);
+    }
+  g_ptr_array_free(state.stale_names, TRUE);
+  g_free(state.prefix);
+}
+
+void
+wildcard_sd_set_base_dir(LogDriver *s, const gchar *base_dir)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  g_free(self->base_dir);
+  self->base_dir = g_strdup(base_dir);
+  g_string_assign(self->super.filename, base_dir);
+}
+
+void
+wildcard_sd_set_filename_pattern(LogDriver *s, const gchar *filename_pattern)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  g_free(self->filename_pattern);
+  self->filename_pattern = g_strdup(filename_pattern);
+}
+
+void
+wildcard_sd_set_max_files(LogDriver *s, gint max_files)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  self->max_files = max_files;
+}
+
+static gboolean
+wildcard_sd_init(LogPipe *s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+  GlobalConfig *cfg = log_pipe_get_config(s);
+
+  if (!log_src_driver_init_method(s))
+    return FALSE;
+
+  if (!self->base_dir || !self->filename_pattern)
+    {
+      msg_error("base-dir() and filename-pattern() are mandatory for wildcard-file() sources", NULL);
+      return FALSE;
+    }
+
+  if (self->super.follow_freq <= 0 || self->max_files <= 0)
+    {
+      msg_error("follow-freq() and max-files() must be positive for wildcard-file() sources",
+                evt_tag_str("base_dir", self->base_dir),
+                NULL);
+      return FALSE;
+    }
+
+  log_reader_options_init(&self->super.reader_options, cfg, self->super.super.super.group);
+
+  if (cfg->state)
+    _remove_stale_persist_entries(self, cfg->state);
+
+  /* start watching before the scan so that no new file is missed */
+  if (!inotify_watch_add_dir(&self->dir_watch, self->base_dir, _on_dir_event, self))
+    _rescan(self);
+  else
+    _scan_dir(self);
+  return TRUE;
+}
+
+static gboolean
+_close_file_reader(gpointer key, gpointer value, gpointer user_data)
+{
+  WildcardFileReader *fr = (WildcardFileReader *) value;
+
+  _fr_close(fr);
+  iv_list_del_init(&fr->list);
+  return TRUE;
+}
+
+static gboolean
+wildcard_sd_deinit(LogPipe *s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  inotify_watch_remove(&self->dir_watch);
+  if (iv_timer_registered(&self->rescan_timer))
+    iv_timer_unregister(&self->rescan_timer);
+  if (iv_task_registered(&self->housekeeping_task))
+    iv_task_unregister(&self->housekeeping_task);
+
+  g_hash_table_foreach_remove(self->file_readers, _close_file_reader, NULL);
+  g_assert(self->num_open_files == 0);
+
+  return log_src_driver_deinit_method(s);
+}
+
+static void
+wildcard_sd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  /* FILE_NAME is set by the WildcardFileReader of the file */
+  log_src_driver_queue_method(s, msg, path_options, user_data);
+}
+
+static void
+wildcard_sd_free(LogPipe *s)
+{
+  WildcardSourceDriver *self = (WildcardSourceDriver *) s;
+
+  g_hash_table_destroy(self->file_readers);
+  g_free(self->base_dir);
+  g_free(self->filename_pattern);
+  affile_sd_free(s);
+}
+
+LogDriver *
+wildcard_sd_new(GlobalConfig *cfg)
+{
+  WildcardSourceDriver *self = g_new0(WildcardSourceDriver, 1);
+
+  affile_sd_init_instance(&self->super, "", cfg);
+  self->super.super.super.super.init = wildcard_sd_init;
+  self->super.super.super.super.deinit = wildcard_sd_deinit;
+  self->super.super.super.super.queue = wildcard_sd_queue;
+  self->super.super.super.super.notify = NULL;
+  self->super.super.super.super.free_fn = wildcard_sd_free;
+
+  self->super.file_open_options.is_pipe = FALSE;
+  self->super.file_open_options.open_flags = DEFAULT_WILDCARD_SD_OPEN_FLAGS;
+  self->super.follow_freq = 1000;
+  self->max_files = 100;
+
+  self->file_readers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) log_pipe_unref);
+  INIT_IV_LIST_HEAD(&self->idle_readers);
+  INIT_IV_LIST_HEAD(&self->pending_readers);
+  INIT_IV_LIST_HEAD(&self->deleted_readers);
+
+  inotify_watch_init(&self->dir_watch);
+
+  IV_TIMER_INIT(&self->rescan_timer);
+  self->rescan_timer.cookie = self;
+  self->rescan_timer.handler = _rescan;
+
+  IV_TASK_INIT(&self->housekeeping_task);
+  self->housekeeping_task.cookie = self;
+  self->housekeeping_task.handler = _housekeeping;
+
+  return &self->super.super.super;
+}
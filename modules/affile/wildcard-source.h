@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef WILDCARD_SOURCE_H_INCLUDED
+#define WILDCARD_SOURCE_H_INCLUDED
+
+#include "affile-source.h"
+#include "inotify-watch.h"
+
+#include <iv.h>
+#include <iv_list.h>
+
+typedef struct _WildcardSourceDriver
+{
+  AFFileSourceDriver super;
+  gchar *base_dir;
+  gchar *filename_pattern;
+  gint max_files;
+
+  /* full path -> WildcardFileReader */
+  GHashTable *file_readers;
+  gint num_open_files;
+  /* open readers that reached EOF, in the order they did so */
+  struct iv_list_head idle_readers;
+  /* readers waiting for an fd slot to become free */
+  struct iv_list_head pending_readers;
+  /* readers of deleted files, dropped once they are read to the end */
+  struct iv_list_head deleted_readers;
+
+  InotifyWatch dir_watch;
+  struct iv_timer rescan_timer;
+  struct iv_task housekeeping_task;
+} WildcardSourceDriver;
+
+LogDriver *wildcard_sd_new(GlobalConfig *cfg);
+void wildcard_sd_set_base_dir(LogDriver *s, const gchar *base_dir);
+void wildcard_sd_set_filename_pattern(LogDriver *s, const gchar *filename_pattern);
+void wildcard_sd_set_max_files(LogDriver *s, gint max_files);
+
+#endif
@@ -27,6 +27,7 @@
 #include "messages.h"
 #include "misc.h"
 #include "gprocess.h"
+#include "stats/stats-registry.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -148,15 +149,15 @@ _determine_port(AFInetDestDriver *self)
 }
 
 static gboolean
-afinet_dd_setup_addresses(AFSocketDestDriver *s)
+afinet_dd_setup_bind_address(AFSocketDestDriver *s)
 {
   AFInetDestDriver *self = (AFInetDestDriver *) s;
 
-  if (!afsocket_dd_setup_addresses_method(s))
+  if (!afsocket_dd_setup_bind_address_method(s))
     return FALSE;
 
   g_sockaddr_unref(self->super.bind_addr);
-  g_sockaddr_unref(self->super.dest_addr);
+  self->super.bind_addr = NULL;
 
   if (!resolve_hostname_to_sockaddr(&self->super.bind_addr, self->super.transport_mapper->address_family, self->bind_ip))
     return FALSE;
@@ -164,6 +165,20 @@ afinet_dd_setup_addresses(AFSocketDestDriver *s)
   if (self->bind_port)
     g_sockaddr_set_port(self->super.bind_addr, afinet_lookup_service(self->super.transport_mapper, self->bind_port));
 
+  return TRUE;
+}
+
+static gboolean
+afinet_dd_setup_addresses(AFSocketDestDriver *s)
+{
+  AFInetDestDriver *self = (AFInetDestDriver *) s;
+
+  if (!afsocket_dd_setup_addresses_method(s))
+    return FALSE;
+
+  g_sockaddr_unref(self->super.dest_addr);
+  self->super.dest_addr = NULL;
+
   if (!resolve_hostname_to_sockaddr(&self->super.dest_addr, self->super.transport_mapper->address_family, self->hostname))
     return FALSE;
 
@@ -184,6 +199,18 @@ afinet_dd_setup_addresses(AFSocketDestDriver *s)
   return TRUE;
 }
 
+static gboolean
+afinet_dd_setup_server_address(AFSocketDestDriver *s, const gchar *server, GSockAddr **dest_addr)
+{
+  AFInetDestDriver *self = (AFInetDestDriver *) s;
+
+  if (!resolve_hostname_to_sockaddr(dest_addr, self->super.transport_mapper->address_family, server))
+    return FALSE;
+
+  g_sockaddr_set_port(*dest_addr, _determine_port(self));
+  return TRUE;
+}
+
 static const gchar *
 afinet_dd_get_dest_name(AFSocketDestDriver *s)
 {
@@ -197,10 +224,20 @@ afinet_dd_get_dest_name(AFSocketDestDriver *s)
   return buf;
 }
 
+static const gchar *
+afinet_dd_tls_stats_instance(AFInetDestDriver *self)
+{
+  static gchar buf[256];
+
+  g_snprintf(buf, sizeof(buf), "%s,%s", self->super.transport_mapper->transport, afinet_dd_get_dest_name(&self->super));
+  return buf;
+}
+
 static gboolean
 afinet_dd_init(LogPipe *s)
 {
   AFInetDestDriver *self G_GNUC_UNUSED = (AFInetDestDriver *) s;
+  TransportMapperInet *transport_mapper_inet = (TransportMapperInet *) self->super.transport_mapper;
 
 #if SYSLOG_NG_ENABLE_SPOOF_SOURCE
   if (self->spoof_source)
@@ -210,6 +247,11 @@ afinet_dd_init(LogPipe *s)
   if (!afsocket_dd_init(s))
     return FALSE;
 
+  if (transport_mapper_inet->tls_context)
+    tls_context_register_stats(transport_mapper_inet->tls_context,
+                               self->super.transport_mapper->stats_source | SCS_DESTINATION,
+                               self->super.super.super.id, afinet_dd_tls_stats_instance(self));
+
 #if SYSLOG_NG_ENABLE_SPOOF_SOURCE
   if (self->super.transport_mapper->sock_type == SOCK_DGRAM)
     {
@@ -235,6 +277,19 @@ afinet_dd_init(LogPipe *s)
   return TRUE;
 }
 
+static gboolean
+afinet_dd_deinit(LogPipe *s)
+{
+  AFInetDestDriver *self = (AFInetDestDriver *) s;
+  TransportMapperInet *transport_mapper_inet = (TransportMapperInet *) self->super.transport_mapper;
+
+  if (transport_mapper_inet->tls_context)
+    tls_context_unregister_stats(transport_mapper_inet->tls_context,
+                                 self->super.transport_mapper->stats_source | SCS_DESTINATION,
+                                 self->super.super.super.id, afinet_dd_tls_stats_instance(self));
+  return afsocket_dd_deinit(s);
+}
+
 #if SYSLOG_NG_ENABLE_SPOOF_SOURCE
 static gboolean
 afinet_dd_construct_ipv4_packet(AFInetDestDriver *self, LogMessage *msg, GString *msg_line)
@@ -358,7 +413,9 @@ afinet_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options,
   /* NOTE: this code should probably become a LogTransport instance so that
    * spoofed packets are also going through the LogWriter queue */
 
-  if (self->spoof_source && self->lnet_ctx && msg->saddr && (msg->saddr->sa.sa_family == AF_INET || msg->saddr->sa.sa_family == AF_INET6) && log_writer_opened(self->super.writer))
+  LogWriter *writer = afsocket_dd_get_primary_writer(&self->super);
+
+  if (self->spoof_source && self->lnet_ctx && msg->saddr && (msg->saddr->sa.sa_family == AF_INET || msg->saddr->sa.sa_family == AF_INET6) && writer && log_writer_opened(writer))
     {
       gboolean success = FALSE;
 
@@ -369,7 +426,7 @@ afinet_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options,
       if (!self->lnet_buffer)
         self->lnet_buffer = g_string_sized_new(self->spoof_source_maxmsglen);
 
-      log_writer_format_log(self->super.writer, msg, self->lnet_buffer);
+      log_writer_format_log(writer, msg, self->lnet_buffer);
       
       if (self->lnet_buffer->len > self->spoof_source_maxmsglen)
         g_string_truncate(self->lnet_buffer, self->spoof_source_maxmsglen);
@@ -408,7 +465,7 @@ afinet_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options,
       g_static_mutex_unlock(&self->lnet_lock);
     }
 #endif
-  log_dest_driver_queue_method(s, msg, path_options, user_data);
+  afsocket_dd_queue(s, msg, path_options, user_data);
 }
 
 void
@@ -436,10 +493,13 @@ afinet_dd_new_instance(TransportMapper *transport_mapper, gchar *hostname, Globa
 
   afsocket_dd_init_instance(&self->super, socket_options_inet_new(), transport_mapper, cfg);
   self->super.super.super.super.init = afinet_dd_init;
+  self->super.super.super.super.deinit = afinet_dd_deinit;
   self->super.super.super.super.queue = afinet_dd_queue;
   self->super.super.super.super.free_fn = afinet_dd_free;
   self->super.construct_writer = afinet_dd_construct_writer;
+  self->super.setup_bind_address = afinet_dd_setup_bind_address;
   self->super.setup_addresses = afinet_dd_setup_addresses;
+  self->super.setup_server_address = afinet_dd_setup_server_address;
   self->super.get_dest_name = afinet_dd_get_dest_name;
 
   self->hostname = g_strdup(hostname);
@@ -26,6 +26,7 @@
 #include "misc.h"
 #include "transport-mapper-inet.h"
 #include "socket-options-inet.h"
+#include "stats/stats-registry.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -94,17 +95,47 @@ afinet_sd_setup_addresses(AFSocketSourceDriver *s)
   return TRUE;
 }
 
+static const gchar *
+afinet_sd_tls_stats_instance(AFInetSourceDriver *self)
+{
+  static gchar buf[256];
+  gchar bind_addr[MAX_SOCKADDR_STRING];
+
+  g_sockaddr_format(self->super.bind_addr, bind_addr, sizeof(bind_addr), GSA_FULL);
+  g_snprintf(buf, sizeof(buf), "%s,%s", self->super.transport_mapper->transport, bind_addr);
+  return buf;
+}
+
 gboolean
 afinet_sd_init(LogPipe *s)
 {
   AFInetSourceDriver *self = (AFInetSourceDriver *) s;
 
+  TransportMapperInet *transport_mapper_inet = (TransportMapperInet *) self->super.transport_mapper;
+
   if (!afsocket_sd_init_method(&self->super.super.super.super))
     return FALSE;
 
+  if (transport_mapper_inet->tls_context)
+    tls_context_register_stats(transport_mapper_inet->tls_context,
+                               self->super.transport_mapper->stats_source | SCS_SOURCE,
+                               self->super.super.super.id, afinet_sd_tls_stats_instance(self));
   return TRUE;
 }
 
+static gboolean
+afinet_sd_deinit(LogPipe *s)
+{
+  AFInetSourceDriver *self = (AFInetSourceDriver *) s;
+  TransportMapperInet *transport_mapper_inet = (TransportMapperInet *) self->super.transport_mapper;
+
+  if (transport_mapper_inet->tls_context)
+    tls_context_unregister_stats(transport_mapper_inet->tls_context,
+                                 self->super.transport_mapper->stats_source | SCS_SOURCE,
+                                 self->super.super.super.id, afinet_sd_tls_stats_instance(self));
+  return afsocket_sd_deinit_method(s);
+}
+
 void
 afinet_sd_free(LogPipe *s)
 {
@@ -125,6 +156,7 @@ afinet_sd_new_instance(TransportMapper *transport_mapper, GlobalConfig *cfg)
                             transport_mapper,
                             cfg);
   self->super.super.super.super.init = afinet_sd_init;
+  self->super.super.super.super.deinit = afinet_sd_deinit;
   self->super.super.super.super.free_fn = afinet_sd_free;
   self->super.setup_addresses = afinet_sd_setup_addresses;
   return self;
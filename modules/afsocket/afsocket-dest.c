@@ -28,11 +28,48 @@
 #include "gsocket.h"
 #include "stats/stats-registry.h"
 #include "mainloop.h"
+#include "scratch-buffers.h"
 
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
+/*
+ * Connections
+ * ===========
+ *
+ * An AFSocketDestDriver maintains one or more AFSocketDestConnection
+ * instances, each with its own socket, LogWriter and queue.  By default
+ * there is exactly one connection to the server set up by
+ * setup_addresses().  With connections(N) every server gets N connections
+ * and with servers() (only supported by drivers that implement
+ * setup_server_address) additional servers can be specified.
+ *
+ * Messages are distributed among the connections in a round-robin
+ * fashion, or based on the hash of load_balance_key, which keeps messages
+ * with the same key on the same connection, retaining their order.  If
+ * the selected connection is down, the next connection that is up is
+ * used.
+ *
+ * The first connection uses the persist and stats names used when only a
+ * single connection was supported, so that its queue survives upgrades.
+ */
+
+struct _AFSocketDestConnection
+{
+  LogPipe super;
+  AFSocketDestDriver *owner;
+  gint index;
+  /* NULL if connecting to the address set up by setup_addresses() */
+  gchar *server;
+  GSockAddr *dest_addr;
+  gint fd;
+  LogWriter *writer;
+  gboolean connection_initialized;
+  struct iv_fd connect_fd;
+  struct iv_timer reconnect_timer;
+};
+
 typedef struct _ReloadStoreItem
 {
   LogProtoClientFactory *proto_factory;
@@ -40,11 +77,11 @@ typedef struct _ReloadStoreItem
 } ReloadStoreItem;
 
 static ReloadStoreItem*
-_reload_store_item_new(AFSocketDestDriver *afsocket_dd)
+_reload_store_item_new(AFSocketDestConnection *connection)
 {
   ReloadStoreItem *item = g_new(ReloadStoreItem, 1);
-  item->proto_factory = afsocket_dd->proto_factory;
-  item->writer = afsocket_dd->writer;
+  item->proto_factory = connection->owner->proto_factory;
+  item->writer = connection->writer;
   return item;
 }
 
@@ -83,49 +120,91 @@ afsocket_dd_set_keep_alive(LogDriver *s, gboolean enable)
   self->connections_kept_alive_accross_reloads = enable;
 }
 
+void
+afsocket_dd_set_connections(LogDriver *s, gint num_connections)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+
+  self->num_connections = num_connections;
+}
+
+void
+afsocket_dd_set_servers(LogDriver *s, GList *servers)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+
+  string_list_free(self->servers);
+  self->servers = servers;
+}
+
+void
+afsocket_dd_set_load_balance_key(LogDriver *s, LogTemplate *load_balance_key)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+
+  log_template_unref(self->load_balance_key);
+  self->load_balance_key = load_balance_key;
+}
+
+static const gchar *
+afsocket_dc_get_dest_name(AFSocketDestConnection *self)
+{
+  if (self->server)
+    return self->server;
+  return afsocket_dd_get_dest_name(self->owner);
+}
+
 static gchar *
-afsocket_dd_format_persist_name(AFSocketDestDriver *self, gboolean qfile)
+afsocket_dc_format_persist_name(AFSocketDestConnection *self, gboolean qfile)
 {
   static gchar persist_name[256];
+  const gchar *sock_type = (self->owner->transport_mapper->sock_type == SOCK_STREAM) ? "stream" : "dgram";
 
-  g_snprintf(persist_name, sizeof(persist_name),
-             qfile ? "afsocket_dd_qfile(%s,%s)" : "afsocket_dd_connection(%s,%s)",
-             (self->transport_mapper->sock_type == SOCK_STREAM) ? "stream" : "dgram",
-             afsocket_dd_get_dest_name(self));
+  if (self->index == 0)
+    g_snprintf(persist_name, sizeof(persist_name),
+               qfile ? "afsocket_dd_qfile(%s,%s)" : "afsocket_dd_connection(%s,%s)",
+               sock_type, afsocket_dc_get_dest_name(self));
+  else
+    g_snprintf(persist_name, sizeof(persist_name),
+               qfile ? "afsocket_dd_qfile(%s,%s,%d)" : "afsocket_dd_connection(%s,%s,%d)",
+               sock_type, afsocket_dc_get_dest_name(self), self->index);
   return persist_name;
 }
 
 static gchar *
-afsocket_dd_stats_instance(AFSocketDestDriver *self)
+afsocket_dc_stats_instance(AFSocketDestConnection *self)
 {
   static gchar buf[256];
 
-  g_snprintf(buf, sizeof(buf), "%s,%s", self->transport_mapper->transport, afsocket_dd_get_dest_name(self));
+  if (self->index == 0)
+    g_snprintf(buf, sizeof(buf), "%s,%s", self->owner->transport_mapper->transport, afsocket_dc_get_dest_name(self));
+  else
+    g_snprintf(buf, sizeof(buf), "%s,%s,%d", self->owner->transport_mapper->transport, afsocket_dc_get_dest_name(self), self->index);
   return buf;
 }
 
-static gboolean afsocket_dd_connected(AFSocketDestDriver *self);
-static void afsocket_dd_reconnect(AFSocketDestDriver *self);
-static void afsocket_dd_try_connect(AFSocketDestDriver *self);
-static gboolean afsocket_dd_setup_connection(AFSocketDestDriver *self);
+static gboolean afsocket_dc_connected(AFSocketDestConnection *self);
+static void afsocket_dc_reconnect(AFSocketDestConnection *self);
+static void afsocket_dc_try_connect(AFSocketDestConnection *self);
+static gboolean afsocket_dc_setup_connection(AFSocketDestConnection *self);
 
 static void
-afsocket_dd_init_watches(AFSocketDestDriver *self)
+afsocket_dc_init_watches(AFSocketDestConnection *self)
 {
   IV_FD_INIT(&self->connect_fd);
   self->connect_fd.cookie = self;
-  self->connect_fd.handler_out = (void (*)(void *)) afsocket_dd_connected;
+  self->connect_fd.handler_out = (void (*)(void *)) afsocket_dc_connected;
 
   IV_TIMER_INIT(&self->reconnect_timer);
   self->reconnect_timer.cookie = self;
   /* Using reinit as a handler before establishing the first successful connection.
-   * We'll change this to afsocket_dd_reconnect when the initialization of the
+   * We'll change this to afsocket_dc_reconnect when the initialization of the
    * connection succeeds.*/
-  self->reconnect_timer.handler = (void (*)(void *)) afsocket_dd_try_connect;
+  self->reconnect_timer.handler = (void (*)(void *)) afsocket_dc_try_connect;
 }
 
 static void
-afsocket_dd_start_watches(AFSocketDestDriver *self)
+afsocket_dc_start_watches(AFSocketDestConnection *self)
 {
   main_loop_assert_main_thread();
 
@@ -134,7 +213,7 @@ afsocket_dd_start_watches(AFSocketDestDriver *self)
 }
 
 static void
-afsocket_dd_stop_watches(AFSocketDestDriver *self)
+afsocket_dc_stop_watches(AFSocketDestConnection *self)
 {
   main_loop_assert_main_thread();
 
@@ -153,7 +232,7 @@ afsocket_dd_stop_watches(AFSocketDestDriver *self)
 }
 
 static void
-afsocket_dd_start_reconnect_timer(AFSocketDestDriver *self)
+afsocket_dc_start_reconnect_timer(AFSocketDestConnection *self)
 {
   main_loop_assert_main_thread();
 
@@ -162,7 +241,7 @@ afsocket_dd_start_reconnect_timer(AFSocketDestDriver *self)
   iv_validate_now();
 
   self->reconnect_timer.expires = iv_now;
-  timespec_add_msec(&self->reconnect_timer.expires, self->time_reopen * 1000);
+  timespec_add_msec(&self->reconnect_timer.expires, self->owner->time_reopen * 1000);
   iv_timer_register(&self->reconnect_timer);
 }
 
@@ -173,8 +252,9 @@ afsocket_dd_construct_transport(AFSocketDestDriver *self, gint fd)
 }
 
 static gboolean
-afsocket_dd_connected(AFSocketDestDriver *self)
+afsocket_dc_connected(AFSocketDestConnection *self)
 {
+  AFSocketDestDriver *owner = self->owner;
   gchar buf1[256], buf2[256];
   int error = 0;
   socklen_t errorlen = sizeof(error);
@@ -186,7 +266,7 @@ afsocket_dd_connected(AFSocketDestDriver *self)
   if (iv_fd_registered(&self->connect_fd))
     iv_fd_unregister(&self->connect_fd);
 
-  if (self->transport_mapper->sock_type == SOCK_STREAM)
+  if (owner->transport_mapper->sock_type == SOCK_STREAM)
     {
       if (getsockopt(self->fd, SOL_SOCKET, SO_ERROR, &error, &errorlen) == -1)
         {
@@ -194,7 +274,7 @@ afsocket_dd_connected(AFSocketDestDriver *self)
                     evt_tag_int("fd", self->fd),
                     evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
                     evt_tag_errno(EVT_TAG_OSERROR, errno),
-                    evt_tag_int("time_reopen", self->time_reopen),
+                    evt_tag_int("time_reopen", owner->time_reopen),
                     NULL);
           goto error_reconnect;
         }
@@ -204,7 +284,7 @@ afsocket_dd_connected(AFSocketDestDriver *self)
                     evt_tag_int("fd", self->fd),
                     evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
                     evt_tag_errno(EVT_TAG_OSERROR, error),
-                    evt_tag_int("time_reopen", self->time_reopen),
+                    evt_tag_int("time_reopen", owner->time_reopen),
                     NULL);
           goto error_reconnect;
         }
@@ -212,36 +292,37 @@ afsocket_dd_connected(AFSocketDestDriver *self)
   msg_notice("Syslog connection established",
               evt_tag_int("fd", self->fd),
               evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
-              evt_tag_str("local", g_sockaddr_format(self->bind_addr, buf1, sizeof(buf1), GSA_FULL)),
+              evt_tag_str("local", g_sockaddr_format(owner->bind_addr, buf1, sizeof(buf1), GSA_FULL)),
               NULL);
 
-  transport = afsocket_dd_construct_transport(self, self->fd);
+  transport = afsocket_dd_construct_transport(owner, self->fd);
   if (!transport)
     goto error_reconnect;
 
-  proto = log_proto_client_factory_construct(self->proto_factory, transport, &self->writer_options.proto_options.super);
+  proto = log_proto_client_factory_construct(owner->proto_factory, transport, &owner->writer_options.proto_options.super);
 
   log_writer_reopen(self->writer, proto);
   return TRUE;
  error_reconnect:
   close(self->fd);
   self->fd = -1;
-  afsocket_dd_start_reconnect_timer(self);
+  afsocket_dc_start_reconnect_timer(self);
   return FALSE;
 }
 
 static gboolean
-afsocket_dd_start_connect(AFSocketDestDriver *self)
+afsocket_dc_start_connect(AFSocketDestConnection *self)
 {
+  AFSocketDestDriver *owner = self->owner;
   int sock, rc;
   gchar buf1[MAX_SOCKADDR_STRING], buf2[MAX_SOCKADDR_STRING];
 
   main_loop_assert_main_thread();
 
-  g_assert(self->transport_mapper->transport);
-  g_assert(self->bind_addr);
+  g_assert(owner->transport_mapper->transport);
+  g_assert(owner->bind_addr);
 
-  if (!transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr, AFSOCKET_DIR_SEND, &sock))
+  if (!transport_mapper_open_socket(owner->transport_mapper, owner->socket_options, owner->bind_addr, AFSOCKET_DIR_SEND, &sock))
     {
       return FALSE;
     }
@@ -252,14 +333,14 @@ afsocket_dd_start_connect(AFSocketDestDriver *self)
   if (rc == G_IO_STATUS_NORMAL)
     {
       self->fd = sock;
-      afsocket_dd_connected(self);
+      afsocket_dc_connected(self);
     }
   else if (rc == G_IO_STATUS_ERROR && errno == EINPROGRESS)
     {
       /* we must wait until connect succeeds */
 
       self->fd = sock;
-      afsocket_dd_start_watches(self);
+      afsocket_dc_start_watches(self);
     }
   else
     {
@@ -267,7 +348,7 @@ afsocket_dd_start_connect(AFSocketDestDriver *self)
       msg_error("Connection failed",
                 evt_tag_int("fd", sock),
                 evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
-                evt_tag_str("local", g_sockaddr_format(self->bind_addr, buf1, sizeof(buf1), GSA_FULL)),
+                evt_tag_str("local", g_sockaddr_format(owner->bind_addr, buf1, sizeof(buf1), GSA_FULL)),
                 evt_tag_errno(EVT_TAG_OSERROR, errno),
                 NULL);
       close(sock);
@@ -277,32 +358,56 @@ afsocket_dd_start_connect(AFSocketDestDriver *self)
   return TRUE;
 }
 
+static gboolean
+afsocket_dc_setup_address(AFSocketDestConnection *self)
+{
+  AFSocketDestDriver *owner = self->owner;
+
+  g_sockaddr_unref(self->dest_addr);
+  self->dest_addr = NULL;
+
+  /* the address of the primary server is only needed by its connections,
+   * connections to servers() should not fail if it can't be resolved */
+  if (!self->server)
+    {
+      if (!afsocket_dd_setup_addresses(owner))
+        return FALSE;
+
+      self->dest_addr = g_sockaddr_ref(owner->dest_addr);
+      return TRUE;
+    }
+
+  if (!afsocket_dd_setup_bind_address(owner))
+    return FALSE;
+  return owner->setup_server_address(owner, self->server, &self->dest_addr);
+}
+
 static void
-afsocket_dd_reconnect(AFSocketDestDriver *self)
+afsocket_dc_reconnect(AFSocketDestConnection *self)
 {
-  if (!afsocket_dd_setup_addresses(self) ||
-      !afsocket_dd_start_connect(self))
+  if (!afsocket_dc_setup_address(self) ||
+      !afsocket_dc_start_connect(self))
     {
       msg_error("Initiating connection failed, reconnecting",
-                evt_tag_int("time_reopen", self->time_reopen),
+                evt_tag_int("time_reopen", self->owner->time_reopen),
                 NULL);
-      afsocket_dd_start_reconnect_timer(self);
+      afsocket_dc_start_reconnect_timer(self);
     }
 }
 
 static void
-afsocket_dd_try_connect(AFSocketDestDriver *self)
+afsocket_dc_try_connect(AFSocketDestConnection *self)
 {
-  if (!afsocket_dd_setup_addresses(self) ||
-      !afsocket_dd_setup_connection(self))
+  if (!afsocket_dc_setup_address(self) ||
+      !afsocket_dc_setup_connection(self))
     {
       msg_error("Initiating connection failed, reconnecting",
-                evt_tag_int("time_reopen", self->time_reopen),
+                evt_tag_int("time_reopen", self->owner->time_reopen),
                 NULL);
-      afsocket_dd_start_reconnect_timer(self);
+      afsocket_dc_start_reconnect_timer(self);
       return;
     }
-  self->reconnect_timer.handler = (void (*)(void *)) afsocket_dd_reconnect;
+  self->reconnect_timer.handler = (void (*)(void *)) afsocket_dc_reconnect;
 }
 
 static gboolean
@@ -347,23 +452,29 @@ afsocket_dd_setup_transport(AFSocketDestDriver *self)
 }
 
 gboolean
-afsocket_dd_setup_addresses_method(AFSocketDestDriver *self)
+afsocket_dd_setup_bind_address_method(AFSocketDestDriver *self)
 {
   return TRUE;
 }
 
+gboolean
+afsocket_dd_setup_addresses_method(AFSocketDestDriver *self)
+{
+  return afsocket_dd_setup_bind_address(self);
+}
+
 static void
-afsocket_dd_restore_writer(AFSocketDestDriver *self)
+afsocket_dc_restore_writer(AFSocketDestConnection *self)
 {
   GlobalConfig *cfg;
   ReloadStoreItem *item;
 
   g_assert(self->writer == NULL);
 
-  cfg = log_pipe_get_config(&self->super.super.super);
-  item = cfg_persist_config_fetch(cfg, afsocket_dd_format_persist_name(self, FALSE));
+  cfg = log_pipe_get_config(&self->super);
+  item = cfg_persist_config_fetch(cfg, afsocket_dc_format_persist_name(self, FALSE));
 
-  if (item && !_is_protocol_type_changed_during_reload(self, item))
+  if (item && !_is_protocol_type_changed_during_reload(self->owner, item))
     self->writer = _reload_store_item_release_writer(item);
 
   _reload_store_item_free(item);
@@ -382,107 +493,103 @@ afsocket_dd_construct_writer_method(AFSocketDestDriver *self)
 }
 
 static gboolean
-afsocket_dd_setup_writer(AFSocketDestDriver *self)
+afsocket_dc_setup_writer(AFSocketDestConnection *self)
 {
-  afsocket_dd_restore_writer(self);
+  AFSocketDestDriver *owner = self->owner;
+
+  afsocket_dc_restore_writer(self);
 
   if (!self->writer)
     {
       /* NOTE: we open our writer with no fd, so we can send messages down there
        * even while the connection is not established */
 
-      self->writer = afsocket_dd_construct_writer(self);
+      self->writer = afsocket_dd_construct_writer(owner);
     }
-  log_writer_set_options(self->writer, &self->super.super.super,
-                         &self->writer_options,
+  log_writer_set_options(self->writer, &self->super,
+                         &owner->writer_options,
                          STATS_LEVEL0,
-                         self->transport_mapper->stats_source,
-                         self->super.super.id,
-                         afsocket_dd_stats_instance(self));
-  log_writer_set_queue(self->writer, log_dest_driver_acquire_queue(&self->super, afsocket_dd_format_persist_name(self, TRUE)));
+                         owner->transport_mapper->stats_source,
+                         owner->super.super.id,
+                         afsocket_dc_stats_instance(self));
+  log_writer_set_queue(self->writer, log_dest_driver_acquire_queue(&owner->super, afsocket_dc_format_persist_name(self, TRUE)));
 
   if (!log_pipe_init((LogPipe *) self->writer))
     {
       log_pipe_unref((LogPipe *) self->writer);
+      self->writer = NULL;
       return FALSE;
     }
 
-  log_pipe_append(&self->super.super.super, (LogPipe *) self->writer);
+  log_pipe_append(&self->super, (LogPipe *) self->writer);
   return TRUE;
 }
 
 static gboolean
-afsocket_dd_setup_connection(AFSocketDestDriver *self)
+afsocket_dc_setup_connection(AFSocketDestConnection *self)
 {
-  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  GlobalConfig *cfg = log_pipe_get_config(&self->super);
 
-  self->time_reopen = cfg->time_reopen;
+  self->owner->time_reopen = cfg->time_reopen;
 
   if (!log_writer_opened(self->writer))
-    afsocket_dd_reconnect(self);
+    afsocket_dc_reconnect(self);
 
   self->connection_initialized = TRUE;
   return TRUE;
 }
 
-gboolean
-afsocket_dd_init(LogPipe *s)
+static gboolean
+afsocket_dc_init(LogPipe *s)
 {
-  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+  AFSocketDestConnection *self = (AFSocketDestConnection *) s;
 
-  if (!log_dest_driver_init_method(s) ||
-      !afsocket_dd_setup_transport(self))
-    {
-      return FALSE;
-    }
-
-  if (!afsocket_dd_setup_writer(self))
+  if (!afsocket_dc_setup_writer(self))
     return FALSE;
 
-  afsocket_dd_try_connect(self);
+  afsocket_dc_try_connect(self);
   return TRUE;
 }
 
 static void
-afsocket_dd_stop_writer(AFSocketDestDriver *self)
+afsocket_dc_stop_writer(AFSocketDestConnection *self)
 {
   if (self->writer)
     log_pipe_deinit((LogPipe *) self->writer);
 }
 
 static void
-afsocket_dd_save_connection(AFSocketDestDriver *self)
+afsocket_dc_save_connection(AFSocketDestConnection *self)
 {
-  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  GlobalConfig *cfg = log_pipe_get_config(&self->super);
 
-  if (self->connections_kept_alive_accross_reloads)
+  if (self->owner->connections_kept_alive_accross_reloads)
     {
       ReloadStoreItem *item = _reload_store_item_new(self);
-      cfg_persist_config_add(cfg, afsocket_dd_format_persist_name(self, FALSE), item, (GDestroyNotify) _reload_store_item_free, FALSE);
+      cfg_persist_config_add(cfg, afsocket_dc_format_persist_name(self, FALSE), item, (GDestroyNotify) _reload_store_item_free, FALSE);
       self->writer = NULL;
     }
 }
 
-gboolean
-afsocket_dd_deinit(LogPipe *s)
+static gboolean
+afsocket_dc_deinit(LogPipe *s)
 {
-  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+  AFSocketDestConnection *self = (AFSocketDestConnection *) s;
 
-  afsocket_dd_stop_watches(self);
-  afsocket_dd_stop_writer(self);
+  afsocket_dc_stop_watches(self);
+  afsocket_dc_stop_writer(self);
 
   if (self->connection_initialized)
     {
-      afsocket_dd_save_connection(self);
+      afsocket_dc_save_connection(self);
     }
-
-  return log_dest_driver_deinit_method(s);
+  return TRUE;
 }
 
 static void
-afsocket_dd_notify(LogPipe *s, gint notify_code, gpointer user_data)
+afsocket_dc_notify(LogPipe *s, gint notify_code, gpointer user_data)
 {
-  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+  AFSocketDestConnection *self = (AFSocketDestConnection *) s;
   gchar buf[MAX_SOCKADDR_STRING];
 
   switch (notify_code)
@@ -494,22 +601,198 @@ afsocket_dd_notify(LogPipe *s, gint notify_code, gpointer user_data)
       msg_notice("Syslog connection broken",
                  evt_tag_int("fd", self->fd),
                  evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf, sizeof(buf), GSA_FULL)),
-                 evt_tag_int("time_reopen", self->time_reopen),
+                 evt_tag_int("time_reopen", self->owner->time_reopen),
                  NULL);
-      afsocket_dd_start_reconnect_timer(self);
+      afsocket_dc_start_reconnect_timer(self);
       break;
     }
 }
 
+static void
+afsocket_dc_free(LogPipe *s)
+{
+  AFSocketDestConnection *self = (AFSocketDestConnection *) s;
+
+  log_pipe_unref((LogPipe *) self->writer);
+  g_sockaddr_unref(self->dest_addr);
+  g_free(self->server);
+  log_pipe_free_method(s);
+}
+
+/*
+ * NOTE: the connection does not hold a reference to its owner, the
+ * driver keeps its connections only between init and deinit.
+ */
+static AFSocketDestConnection *
+afsocket_dc_new(AFSocketDestDriver *owner, gint index, const gchar *server)
+{
+  AFSocketDestConnection *self = g_new0(AFSocketDestConnection, 1);
+
+  log_pipe_init_instance(&self->super, log_pipe_get_config(&owner->super.super.super));
+  self->super.init = afsocket_dc_init;
+  self->super.deinit = afsocket_dc_deinit;
+  self->super.notify = afsocket_dc_notify;
+  self->super.free_fn = afsocket_dc_free;
+  self->super.expr_node = owner->super.super.super.expr_node;
+
+  self->owner = owner;
+  self->index = index;
+  self->server = g_strdup(server);
+  self->fd = -1;
+  afsocket_dc_init_watches(self);
+  return self;
+}
+
+static void
+afsocket_dd_add_connections(AFSocketDestDriver *self, const gchar *server)
+{
+  gint i;
+
+  for (i = 0; i < self->num_connections; i++)
+    g_ptr_array_add(self->connections, afsocket_dc_new(self, self->connections->len, server));
+}
+
+static void
+afsocket_dd_free_connections(AFSocketDestDriver *self)
+{
+  guint i;
+
+  for (i = 0; i < self->connections->len; i++)
+    log_pipe_unref((LogPipe *) g_ptr_array_index(self->connections, i));
+  g_ptr_array_set_size(self->connections, 0);
+}
+
+static gboolean
+afsocket_dd_setup_connections(AFSocketDestDriver *self)
+{
+  GList *l;
+  guint i;
+
+  if (self->servers && !self->setup_server_address)
+    {
+      msg_error("servers() is not supported by this destination",
+                evt_tag_str("id", self->super.super.id),
+                NULL);
+      return FALSE;
+    }
+
+  afsocket_dd_add_connections(self, NULL);
+  for (l = self->servers; l; l = l->next)
+    afsocket_dd_add_connections(self, (const gchar *) l->data);
+
+  for (i = 0; i < self->connections->len; i++)
+    {
+      if (!log_pipe_init((LogPipe *) g_ptr_array_index(self->connections, i)))
+        {
+          while (i > 0)
+            log_pipe_deinit((LogPipe *) g_ptr_array_index(self->connections, --i));
+          afsocket_dd_free_connections(self);
+          return FALSE;
+        }
+    }
+  return TRUE;
+}
+
+gboolean
+afsocket_dd_init(LogPipe *s)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+
+  if (!log_dest_driver_init_method(s) ||
+      !afsocket_dd_setup_transport(self))
+    {
+      return FALSE;
+    }
+
+  return afsocket_dd_setup_connections(self);
+}
+
+gboolean
+afsocket_dd_deinit(LogPipe *s)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+  guint i;
+
+  for (i = 0; i < self->connections->len; i++)
+    log_pipe_deinit((LogPipe *) g_ptr_array_index(self->connections, i));
+  afsocket_dd_free_connections(self);
+
+  return log_dest_driver_deinit_method(s);
+}
+
+static AFSocketDestConnection *
+afsocket_dd_select_connection(AFSocketDestDriver *self, LogMessage *msg)
+{
+  AFSocketDestConnection *connection;
+  guint num_connections = self->connections->len;
+  guint start, i;
+
+  if (num_connections == 1)
+    return g_ptr_array_index(self->connections, 0);
+
+  if (self->load_balance_key)
+    {
+      SBGString *key = sb_gstring_acquire();
+
+      log_template_format(self->load_balance_key, msg, &self->writer_options.template_options, LTZ_SEND, 0, NULL,
+                          sb_gstring_string(key));
+      start = g_str_hash(sb_gstring_string(key)->str) % num_connections;
+      sb_gstring_release(key);
+    }
+  else
+    {
+      start = ((guint) g_atomic_int_exchange_and_add(&self->round_robin_next, 1)) % num_connections;
+    }
+
+  /* fail over to the next connection that is up */
+  for (i = 0; i < num_connections; i++)
+    {
+      connection = g_ptr_array_index(self->connections, (start + i) % num_connections);
+      if (log_writer_opened(connection->writer))
+        return connection;
+    }
+
+  /* none of them is up, queue where the message belongs */
+  return g_ptr_array_index(self->connections, start);
+}
+
+/*
+ * Accounts the message like log_dest_driver_queue_method() does, but
+ * forwards it to one of the connections instead of the next pipe.
+ */
+void
+afsocket_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+  AFSocketDestConnection *connection;
+
+  stats_counter_inc(self->super.super.processed_group_messages);
+  stats_counter_inc(self->super.queued_global_messages);
+
+  connection = afsocket_dd_select_connection(self, msg);
+  log_pipe_queue(&connection->super, msg, path_options);
+}
+
+LogWriter *
+afsocket_dd_get_primary_writer(AFSocketDestDriver *self)
+{
+  if (self->connections->len == 0)
+    return NULL;
+  return ((AFSocketDestConnection *) g_ptr_array_index(self->connections, 0))->writer;
+}
+
 void
 afsocket_dd_free(LogPipe *s)
 {
   AFSocketDestDriver *self = (AFSocketDestDriver *) s;
 
+  g_assert(self->connections->len == 0);
+  g_ptr_array_free(self->connections, TRUE);
   log_writer_options_destroy(&self->writer_options);
   g_sockaddr_unref(self->bind_addr);
   g_sockaddr_unref(self->dest_addr);
-  log_pipe_unref((LogPipe *) self->writer);
+  string_list_free(self->servers);
+  log_template_unref(self->load_balance_key);
   transport_mapper_free(self->transport_mapper);
   socket_options_free(self->socket_options);
   log_dest_driver_free(s);
@@ -526,19 +809,18 @@ afsocket_dd_init_instance(AFSocketDestDriver *self,
   log_writer_options_defaults(&self->writer_options);
   self->super.super.super.init = afsocket_dd_init;
   self->super.super.super.deinit = afsocket_dd_deinit;
-  /* NULL behaves as if log_msg_forward_msg was specified */
-  self->super.super.super.queue = NULL;
+  self->super.super.super.queue = afsocket_dd_queue;
   self->super.super.super.free_fn = afsocket_dd_free;
-  self->super.super.super.notify = afsocket_dd_notify;
-  self->setup_addresses = afsocket_dd_setup_addresses;
+  self->setup_bind_address = afsocket_dd_setup_bind_address_method;
+  self->setup_addresses = afsocket_dd_setup_addresses_method;
   self->construct_writer = afsocket_dd_construct_writer_method;
   self->transport_mapper = transport_mapper;
   self->socket_options = socket_options;
   self->connections_kept_alive_accross_reloads = TRUE;
   self->time_reopen = cfg->time_reopen;
-  self->connection_initialized = FALSE;
+  self->num_connections = 1;
+  self->connections = g_ptr_array_new();
 
 
   self->writer_options.mark_mode = MM_GLOBAL;
-  afsocket_dd_init_watches(self);
 }
@@ -29,10 +29,12 @@
 #include "transport-mapper.h"
 #include "driver.h"
 #include "logwriter.h"
+#include "template/templates.h"
 
 #include <iv.h>
 
 typedef struct _AFSocketDestDriver AFSocketDestDriver;
+typedef struct _AFSocketDestConnection AFSocketDestConnection;
 
 struct _AFSocketDestDriver
 {
@@ -40,22 +42,29 @@ struct _AFSocketDestDriver
 
   gboolean
     connections_kept_alive_accross_reloads:1;
-  gint fd;
-  LogWriter *writer;
   LogWriterOptions writer_options;
   LogProtoClientFactory *proto_factory;
 
   GSockAddr *bind_addr;
   GSockAddr *dest_addr;
   gint time_reopen;
-  gboolean connection_initialized;
-  struct iv_fd connect_fd;
-  struct iv_timer reconnect_timer;
   SocketOptions *socket_options;
   TransportMapper *transport_mapper;
 
+  /* connections to each server, load balanced by afsocket_dd_queue() */
+  gint num_connections;
+  GList *servers;
+  LogTemplate *load_balance_key;
+  GPtrArray *connections;
+  gint round_robin_next;
+
   LogWriter *(*construct_writer)(AFSocketDestDriver *self);
+  /* sets up bind_addr */
+  gboolean (*setup_bind_address)(AFSocketDestDriver *s);
+  /* sets up bind_addr and the address of the primary server in dest_addr */
   gboolean (*setup_addresses)(AFSocketDestDriver *s);
+  /* resolves a server specified in servers(), optional */
+  gboolean (*setup_server_address)(AFSocketDestDriver *s, const gchar *server, GSockAddr **dest_addr);
   const gchar *(*get_dest_name)(AFSocketDestDriver *s);
 };
 
@@ -65,6 +74,12 @@ afsocket_dd_construct_writer(AFSocketDestDriver *self)
   return self->construct_writer(self);
 }
 
+static inline gboolean
+afsocket_dd_setup_bind_address(AFSocketDestDriver *s)
+{
+  return s->setup_bind_address(s);
+}
+
 static inline gboolean
 afsocket_dd_setup_addresses(AFSocketDestDriver *s)
 {
@@ -78,12 +93,19 @@ afsocket_dd_get_dest_name(AFSocketDestDriver *s)
 }
 
 LogWriter *afsocket_dd_construct_writer_method(AFSocketDestDriver *self);
+gboolean afsocket_dd_setup_bind_address_method(AFSocketDestDriver *self);
 gboolean afsocket_dd_setup_addresses_method(AFSocketDestDriver *self);
 void afsocket_dd_set_keep_alive(LogDriver *self, gint enable);
+void afsocket_dd_set_connections(LogDriver *s, gint num_connections);
+void afsocket_dd_set_servers(LogDriver *s, GList *servers);
+void afsocket_dd_set_load_balance_key(LogDriver *s, LogTemplate *load_balance_key);
+LogWriter *afsocket_dd_get_primary_writer(AFSocketDestDriver *self);
 void afsocket_dd_init_instance(AFSocketDestDriver *self, SocketOptions *socket_options, TransportMapper *transport_mapper, GlobalConfig *cfg);
 LogTransport *afsocket_dd_construct_transport_method(AFSocketDestDriver *self, gint fd);
 
 gboolean afsocket_dd_init(LogPipe *s);
+gboolean afsocket_dd_deinit(LogPipe *s);
+void afsocket_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data);
 void afsocket_dd_free(LogPipe *s);
 
 #endif
@@ -52,6 +52,10 @@ static CfgLexerKeyword afsocket_keywords[] = {
   { "trusted_dn",         KW_TRUSTED_DN },
   { "cipher_suite",       KW_CIPHER_SUITE },
   { "ssl_options",        KW_SSL_OPTIONS },
+  { "session_cache_size", KW_SESSION_CACHE_SIZE },
+  { "session_timeout",    KW_SESSION_TIMEOUT },
+  { "session_tickets",    KW_SESSION_TICKETS },
+  { "ticket_key_rotation", KW_TICKET_KEY_ROTATION },
 
   { "localip",            KW_LOCALIP },
   { "ip",                 KW_IP },
@@ -74,6 +78,9 @@ static CfgLexerKeyword afsocket_keywords[] = {
   { "ip_protocol",        KW_IP_PROTOCOL },
   { "max_connections",    KW_MAX_CONNECTIONS },
   { "keep_alive",         KW_KEEP_ALIVE },
+  { "connections",        KW_CONNECTIONS },
+  { "servers",            KW_SERVERS },
+  { "load_balance_key",   KW_LOAD_BALANCE_KEY },
   { "systemd_syslog",            KW_SYSTEMD_SYSLOG  },
   { NULL }
 };
@@ -45,16 +45,27 @@ afunix_dd_get_dest_name(AFSocketDestDriver *s)
 }
 
 static gboolean
-afunix_dd_setup_addresses(AFSocketDestDriver *s)
+afunix_dd_setup_bind_address(AFSocketDestDriver *s)
 {
   AFUnixDestDriver *self = (AFUnixDestDriver *) s;
 
-  if (!afsocket_dd_setup_addresses_method(s))
+  if (!afsocket_dd_setup_bind_address_method(s))
     return FALSE;
 
   if (!self->super.bind_addr)
     self->super.bind_addr = g_sockaddr_unix_new(NULL);
 
+  return TRUE;
+}
+
+static gboolean
+afunix_dd_setup_addresses(AFSocketDestDriver *s)
+{
+  AFUnixDestDriver *self = (AFUnixDestDriver *) s;
+
+  if (!afsocket_dd_setup_addresses_method(s))
+    return FALSE;
+
   if (!self->super.dest_addr)
     self->super.dest_addr = g_sockaddr_unix_new(self->filename);
 
@@ -77,6 +88,7 @@ afunix_dd_new_instance(TransportMapper *transport_mapper, gchar *filename, Globa
 
   afsocket_dd_init_instance(&self->super, socket_options_new(), transport_mapper, cfg);
   self->super.super.super.super.free_fn = afunix_dd_free;
+  self->super.setup_bind_address = afunix_dd_setup_bind_address;
   self->super.setup_addresses = afunix_dd_setup_addresses;
   self->super.writer_options.mark_mode = MM_NONE;
   self->super.get_dest_name = afunix_dd_get_dest_name;
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "afinet-dest.h"
+#include "apphook.h"
+#include "mainloop.h"
+#include "logmsg.h"
+#include "timeutils.h"
+#include "testutils.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define FAILOVER_TESTCASE(testfunc, ...) { testcase_begin("%s(%s)", #testfunc, #__VA_ARGS__); testfunc(__VA_ARGS__); testcase_end(); }
+
+/* RFC 6761 guarantees that this name doesn't resolve */
+#define UNRESOLVABLE_HOSTNAME "primary.invalid"
+
+/* enough for the connections to be established and flushed */
+#define LOOP_TIMEOUT_MSEC 200
+
+static void
+_quit_main_loop(gpointer user_data)
+{
+  iv_quit();
+}
+
+static void
+_run_main_loop(void)
+{
+  struct iv_timer quit_timer;
+
+  IV_TIMER_INIT(&quit_timer);
+  quit_timer.handler = _quit_main_loop;
+  iv_validate_now();
+  quit_timer.expires = iv_now;
+  timespec_add_msec(&quit_timer.expires, LOOP_TIMEOUT_MSEC);
+  iv_timer_register(&quit_timer);
+
+  iv_main();
+
+  if (iv_timer_registered(&quit_timer))
+    iv_timer_unregister(&quit_timer);
+}
+
+/* returns the listening socket, @port is set to the port it was bound to */
+static gint
+_listen_on_loopback(gchar *port, gsize port_len)
+{
+  struct sockaddr_in sin;
+  socklen_t sin_len = sizeof(sin);
+  gint fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  assert_true(fd >= 0, "Error creating the listening socket");
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert_gint(bind(fd, (struct sockaddr *) &sin, sizeof(sin)), 0, "Error binding the listening socket");
+  assert_gint(listen(fd, 16), 0, "Error listening on the socket");
+  assert_gint(getsockname(fd, (struct sockaddr *) &sin, &sin_len), 0, "Error querying the listening port");
+
+  g_snprintf(port, port_len, "%d", ntohs(sin.sin_port));
+  return fd;
+}
+
+static void
+_queue_message(LogPipe *driver, const gchar *message)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_HOST, "host", -1);
+  log_msg_set_value(msg, LM_V_MESSAGE, message, -1);
+  log_pipe_queue(driver, msg, &path_options);
+}
+
+/* reads everything the destination sent on @fd */
+static GString *
+_receive_all(gint fd)
+{
+  GString *received = g_string_new("");
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  gchar buf[1024];
+  gssize len;
+
+  while (poll(&pfd, 1, LOOP_TIMEOUT_MSEC) > 0 && (len = read(fd, buf, sizeof(buf))) > 0)
+    g_string_append_len(received, buf, len);
+  return received;
+}
+
+static void
+test_servers_are_used_if_the_primary_server_cannot_be_resolved(void)
+{
+  LogDriver *driver;
+  gchar port[16];
+  gint listen_fd, fd;
+  GString *received;
+
+  listen_fd = _listen_on_loopback(port, sizeof(port));
+
+  driver = (LogDriver *) afinet_dd_new_tcp(UNRESOLVABLE_HOSTNAME, configuration);
+  driver->group = g_strdup("d_test");
+  driver->id = g_strdup("d_test#0");
+  afinet_dd_set_destport(driver, port);
+  afsocket_dd_set_servers(driver, g_list_append(NULL, g_strdup("127.0.0.1")));
+  assert_true(log_pipe_init(&driver->super), "Error initializing the destination");
+
+  /* the connection to the primary server is down, messages are sent to
+   * the other server */
+  _run_main_loop();
+  _queue_message(&driver->super, "failover message 1");
+  _queue_message(&driver->super, "failover message 2");
+  _run_main_loop();
+
+  fd = accept(listen_fd, NULL, NULL);
+  assert_true(fd >= 0, "The destination did not connect to the server in servers()");
+
+  received = _receive_all(fd);
+  assert_not_null(strstr(received->str, "failover message 1"), "Message was not sent to the server in servers(): %s", received->str);
+  assert_not_null(strstr(received->str, "failover message 2"), "Message was not sent to the server in servers(): %s", received->str);
+  g_string_free(received, TRUE);
+
+  assert_true(log_pipe_deinit(&driver->super), "Error deinitializing the destination");
+  log_pipe_unref(&driver->super);
+  close(fd);
+  close(listen_fd);
+}
+
+int
+main(int argc, char **argv)
+{
+  app_startup();
+  main_thread_handle = get_thread_id();
+
+  configuration = cfg_new(VERSION_VALUE);
+  configuration->threaded = FALSE;
+
+  FAILOVER_TESTCASE(test_servers_are_used_if_the_primary_server_cannot_be_resolved);
+
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
@@ -84,6 +84,27 @@ transport_mapper_inet_apply_transport_method(TransportMapper *s, GlobalConfig *c
   return transport_mapper_inet_validate_tls_options(self);
 }
 
+/* the address of the server a client is connected to, used as the key of
+ * its cached TLS session, as pooled connections go to different servers */
+static const gchar *
+_format_tls_peer(TransportMapperInet *self, gint fd, gchar *buf, gsize buf_len)
+{
+  struct sockaddr_storage ss;
+  socklen_t ss_len = sizeof(ss);
+  GSockAddr *peer_addr;
+
+  if (self->tls_context->mode != TM_CLIENT ||
+      getpeername(fd, (struct sockaddr *) &ss, &ss_len) < 0)
+    return NULL;
+
+  peer_addr = g_sockaddr_new((struct sockaddr *) &ss, ss_len);
+  if (!peer_addr)
+    return NULL;
+  g_sockaddr_format(peer_addr, buf, buf_len, GSA_FULL);
+  g_sockaddr_unref(peer_addr);
+  return buf;
+}
+
 static LogTransport *
 transport_mapper_inet_construct_log_transport(TransportMapper *s, gint fd)
 {
@@ -92,8 +113,9 @@ transport_mapper_inet_construct_log_transport(TransportMapper *s, gint fd)
   if (self->tls_context)
     {
       TLSSession *tls_session;
+      gchar peer[MAX_SOCKADDR_STRING];
 
-      tls_session = tls_context_setup_session(self->tls_context);
+      tls_session = tls_context_setup_session(self->tls_context, _format_tls_peer(self, fd, peer, sizeof(peer)));
       if (!tls_session)
         return NULL;
 
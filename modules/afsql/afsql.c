@@ -34,6 +34,7 @@
 #include "apphook.h"
 #include "timeutils.h"
 #include "mainloop-worker.h"
+#include "scratch-buffers.h"
 
 #include <string.h>
 
@@ -771,31 +772,35 @@ afsql_dd_ensure_initialized_connection(AFSqlDestDriver *self)
   return TRUE;
 }
 
-static GString *
+/* per-message strings are taken from the scratch buffers of the database
+ * thread, so they don't have to be allocated for every message */
+static SBGString *
 afsql_dd_ensure_accessible_database_table(AFSqlDestDriver *self, LogMessage *msg)
 {
-  GString *table = g_string_sized_new(32);
+  SBGString *table = sb_gstring_acquire();
 
-  log_template_format(self->table, msg, &self->template_options, LTZ_LOCAL, 0, NULL, table);
+  log_template_format(self->table, msg, &self->template_options, LTZ_LOCAL, 0, NULL, sb_gstring_string(table));
 
-  if (!afsql_dd_ensure_table_is_syslogng_conform(self, table))
+  if (!afsql_dd_ensure_table_is_syslogng_conform(self, sb_gstring_string(table)))
     {
       /* If validate table is FALSE then close the connection and wait time_reopen time (next call) */
       msg_error("Error checking table, disconnecting from database, trying again shortly",
                 evt_tag_int("time_reopen", self->time_reopen),
                 NULL);
-      g_string_free(table, TRUE);
+      sb_gstring_release(table);
       return NULL;
     }
 
   return table;
 }
 
-static GString *
+static SBGString *
 afsql_dd_build_insert_command(AFSqlDestDriver *self, LogMessage *msg, GString *table)
 {
-  GString *insert_command = g_string_sized_new(256);
-  GString *value = g_string_sized_new(512);
+  SBGString *sb_insert_command = sb_gstring_acquire();
+  SBGString *sb_value = sb_gstring_acquire();
+  GString *insert_command = sb_gstring_string(sb_insert_command);
+  GString *value = sb_gstring_string(sb_value);
   gint i, j;
 
   g_string_printf(insert_command, "INSERT INTO %s (", table->str);
@@ -852,9 +857,9 @@ afsql_dd_build_insert_command(AFSqlDestDriver *self, LogMessage *msg, GString *t
 
   g_string_append(insert_command, ")");
 
-  g_string_free(value, TRUE);
+  sb_gstring_release(sb_value);
 
-  return insert_command;
+  return sb_insert_command;
 }
 
 static inline gboolean
@@ -933,8 +938,8 @@ afsql_dd_handle_insert_row_error_depending_on_connection_availability(AFSqlDestD
 static gboolean
 afsql_dd_insert_db(AFSqlDestDriver *self)
 {
-  GString *table = NULL;
-  GString *insert_command = NULL;
+  SBGString *table = NULL;
+  SBGString *insert_command = NULL;
   LogMessage *msg;
   gboolean success = TRUE;
   LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
@@ -963,8 +968,8 @@ afsql_dd_insert_db(AFSqlDestDriver *self)
       goto out;
     }
 
-  insert_command = afsql_dd_build_insert_command(self, msg, table);
-  success = afsql_dd_run_query(self, insert_command->str, FALSE, NULL);
+  insert_command = afsql_dd_build_insert_command(self, msg, sb_gstring_string(table));
+  success = afsql_dd_run_query(self, sb_gstring_string(insert_command)->str, FALSE, NULL);
 
   if (success && self->flush_lines_queued != -1)
     {
@@ -975,7 +980,6 @@ afsql_dd_insert_db(AFSqlDestDriver *self)
           /* Assuming that in case of error, the queue is rewound by afsql_dd_commit_transaction() */
           afsql_dd_rollback_transaction(self);
 
-          g_string_free(insert_command, TRUE);
           msg_set_context(NULL);
 
           success = FALSE;
@@ -985,10 +989,10 @@ afsql_dd_insert_db(AFSqlDestDriver *self)
  out:
 
   if (table != NULL)
-    g_string_free(table, TRUE);
+    sb_gstring_release(table);
 
   if (insert_command != NULL)
-    g_string_free(insert_command, TRUE);
+    sb_gstring_release(insert_command);
 
   msg_set_context(NULL);
 
@@ -0,0 +1,642 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "date-format.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+ * Compiled date formats
+ *
+ * strptime_with_tz() interprets its format string for every message.  For
+ * the conversions that commonly occur in log timestamps, the format is
+ * instead compiled once into an array of typed operations, each of them
+ * parsing exactly the same input as the corresponding strptime() conversion
+ * would.  Formats using any other conversion are not compiled, the caller
+ * uses strptime_with_tz() for those.
+ *
+ * In addition, the most frequent layouts (ISO8601/RFC3339, the Apache
+ * access log and BSD syslog timestamps) have hand written parsers that
+ * expect fixed width fields.  These only handle the usual shape of those
+ * timestamps and give up on anything else (e.g.  single digit fields or
+ * named time zones), in which case the generic operations are used.
+ */
+
+typedef enum
+{
+  DFO_LITERAL,
+  DFO_SPACE,
+  DFO_YEAR,
+  DFO_MONTH,
+  DFO_MDAY,
+  DFO_HOUR,
+  DFO_MIN,
+  DFO_SEC,
+  DFO_MONTH_NAME,
+  DFO_WDAY_NAME,
+  DFO_ZONE,
+} DateFormatOpType;
+
+typedef struct _DateFormatOp
+{
+  guint8 type;
+  gchar literal;
+} DateFormatOp;
+
+typedef const guchar *(*DateFormatFastParser)(const guchar *bp, struct tm *tm, long *tm_gmtoff);
+
+struct _DateFormat
+{
+  DateFormatFastParser fast_parse;
+  gint num_ops;
+  DateFormatOp *ops;
+};
+
+#define TM_YEAR_BASE 1900
+
+static const gchar * const month_names[12] =
+{
+  "January", "February", "March", "April", "May", "June", "July",
+  "August", "September", "October", "November", "December"
+};
+
+static const gchar * const wday_names[7] =
+{
+  "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"
+};
+
+/* RFC-822/RFC-2822 North American zones */
+static const gchar * const nast[4] = { "EST", "CST", "MST", "PST" };
+static const gchar * const nadt[4] = { "EDT", "CDT", "MDT", "PDT" };
+
+/* same as conv_num() in strptime-tz.c: the upper limit determines the
+ * number of digits consumed */
+static inline const guchar *
+_read_number(const guchar *bp, gint *dest, guint llim, guint ulim)
+{
+  guint result, rulim = ulim;
+
+  if (*bp < '0' || *bp > '9')
+    return NULL;
+
+  result = 0;
+  do
+    {
+      result = result * 10 + (*bp++ - '0');
+      rulim /= 10;
+    }
+  while (result * 10 <= ulim && rulim && *bp >= '0' && *bp <= '9');
+
+  if (result < llim || result > ulim)
+    return NULL;
+
+  *dest = result;
+  return bp;
+}
+
+/* reads exactly two digits, used by the fixed width parsers */
+static inline gboolean
+_read_2digits(const guchar *bp, gint *dest, gint ulim)
+{
+  gint result;
+
+  if (!isdigit(bp[0]) || !isdigit(bp[1]))
+    return FALSE;
+  result = (bp[0] - '0') * 10 + (bp[1] - '0');
+  if (result > ulim)
+    return FALSE;
+  *dest = result;
+  return TRUE;
+}
+
+/* matches full names and their three letter abbreviations, the same way
+ * find_string() does in strptime-tz.c: as abbreviations are unique
+ * prefixes of the full names, checking them first gives the same result */
+static inline const guchar *
+_read_name(const guchar *bp, gint *dest, const gchar * const *names, gint count)
+{
+  gint i;
+
+  for (i = 0; i < count; i++)
+    {
+      if (strncasecmp(names[i], (const gchar *) bp, 3) == 0)
+        {
+          gsize len = strlen(names[i]);
+
+          *dest = i;
+          if (strncasecmp(names[i], (const gchar *) bp, len) == 0)
+            return bp + len;
+          return bp + 3;
+        }
+    }
+  return NULL;
+}
+
+/* [+-]hh, [+-]hhmm or [+-]hh:mm, bp points after the sign */
+static const guchar *
+_read_numeric_zone(const guchar *bp, gboolean neg, struct tm *tm, long *tm_gmtoff)
+{
+  gint offs = 0, i;
+
+  for (i = 0; i < 4; )
+    {
+      if (isdigit(*bp))
+        {
+          offs = offs * 10 + (*bp++ - '0');
+          i++;
+          continue;
+        }
+      if (i == 2 && *bp == ':')
+        {
+          bp++;
+          continue;
+        }
+      break;
+    }
+  switch (i)
+    {
+    case 2:
+      offs *= 100;
+      break;
+    case 4:
+      i = offs % 100;
+      if (i >= 60)
+        return NULL;
+      /* convert minutes into decimal, exactly like strptime_with_tz() */
+      offs = (offs / 100) * 100 + (i * 50) / 30;
+      break;
+    default:
+      return NULL;
+    }
+  if (neg)
+    offs = -offs;
+  tm->tm_isdst = 0;
+  *tm_gmtoff = (offs * 3600) / 100;
+  return bp;
+}
+
+/* the %z conversion of strptime_with_tz() */
+static const guchar *
+_read_zone(const guchar *bp, struct tm *tm, long *tm_gmtoff)
+{
+  gint i;
+
+  while (isspace(*bp))
+    bp++;
+
+  switch (*bp++)
+    {
+    case 'G':
+      if (*bp++ != 'M')
+        return NULL;
+      /* FALLTHROUGH */
+    case 'U':
+      if (*bp++ != 'T')
+        return NULL;
+      /* FALLTHROUGH */
+    case 'Z':
+      tm->tm_isdst = 0;
+      *tm_gmtoff = 0;
+      return bp;
+    case '+':
+      return _read_numeric_zone(bp, FALSE, tm, tm_gmtoff);
+    case '-':
+      return _read_numeric_zone(bp, TRUE, tm, tm_gmtoff);
+    default:
+      --bp;
+      break;
+    }
+
+  for (i = 0; i < 4; i++)
+    {
+      if (strncasecmp(nast[i], (const gchar *) bp, 3) == 0)
+        {
+          *tm_gmtoff = (-5 - i) * 3600;
+          return bp + 3;
+        }
+    }
+  for (i = 0; i < 4; i++)
+    {
+      if (strncasecmp(nadt[i], (const gchar *) bp, 3) == 0)
+        {
+          tm->tm_isdst = 1;
+          *tm_gmtoff = (-4 - i) * 3600;
+          return bp + 3;
+        }
+    }
+
+  /* military zones, no 'J' */
+  if (*bp >= 'A' && *bp <= 'I')
+    *tm_gmtoff = (('A' - 1) - (gint) *bp) * 3600;
+  else if (*bp >= 'L' && *bp <= 'M')
+    *tm_gmtoff = ('A' - (gint) *bp) * 3600;
+  else if (*bp >= 'N' && *bp <= 'Y')
+    *tm_gmtoff = ((gint) *bp - 'M') * 3600;
+  else
+    return NULL;
+  return bp + 1;
+}
+
+/* only the common numeric forms, anything else goes to _read_zone() */
+static inline const guchar *
+_read_zone_fast(const guchar *bp, struct tm *tm, long *tm_gmtoff)
+{
+  switch (*bp)
+    {
+    case 'Z':
+      tm->tm_isdst = 0;
+      *tm_gmtoff = 0;
+      return bp + 1;
+    case '+':
+      return _read_numeric_zone(bp + 1, FALSE, tm, tm_gmtoff);
+    case '-':
+      return _read_numeric_zone(bp + 1, TRUE, tm, tm_gmtoff);
+    default:
+      return NULL;
+    }
+}
+
+/* "HH:MM:SS" */
+static inline const guchar *
+_read_fixed_time(const guchar *bp, struct tm *tm)
+{
+  if (!_read_2digits(bp, &tm->tm_hour, 23) || bp[2] != ':' ||
+      !_read_2digits(bp + 3, &tm->tm_min, 59) || bp[5] != ':' ||
+      !_read_2digits(bp + 6, &tm->tm_sec, 61) || isdigit(bp[8]))
+    return NULL;
+  return bp + 8;
+}
+
+/* "%Y-%m-%dT%H:%M:%S%z", e.g. 2015-01-26T16:14:49+03:00 */
+static const guchar *
+_parse_iso8601(const guchar *bp, struct tm *tm, long *tm_gmtoff)
+{
+  struct tm parsed = *tm;
+  long gmtoff = *tm_gmtoff;
+  gint mon;
+
+  if (!isdigit(bp[0]) || !isdigit(bp[1]) || !isdigit(bp[2]) || !isdigit(bp[3]) || bp[4] != '-')
+    return NULL;
+  parsed.tm_year = (bp[0] - '0') * 1000 + (bp[1] - '0') * 100 + (bp[2] - '0') * 10 + (bp[3] - '0') - TM_YEAR_BASE;
+
+  if (!_read_2digits(bp + 5, &mon, 12) || mon < 1 || bp[7] != '-' ||
+      !_read_2digits(bp + 8, &parsed.tm_mday, 31) || parsed.tm_mday < 1 || bp[10] != 'T')
+    return NULL;
+  parsed.tm_mon = mon - 1;
+
+  bp = _read_fixed_time(bp + 11, &parsed);
+  if (!bp)
+    return NULL;
+
+  bp = _read_zone_fast(bp, &parsed, &gmtoff);
+  if (!bp)
+    return NULL;
+
+  *tm = parsed;
+  *tm_gmtoff = gmtoff;
+  return bp;
+}
+
+/* "%d/%b/%Y:%H:%M:%S %z", e.g. 21/Jan/2015:14:40:07 +0500 */
+static const guchar *
+_parse_apache(const guchar *bp, struct tm *tm, long *tm_gmtoff)
+{
+  struct tm parsed = *tm;
+  long gmtoff = *tm_gmtoff;
+
+  if (!_read_2digits(bp, &parsed.tm_mday, 31) || parsed.tm_mday < 1 || bp[2] != '/')
+    return NULL;
+
+  bp = _read_name(bp + 3, &parsed.tm_mon, month_names, 12);
+  if (!bp || bp[0] != '/')
+    return NULL;
+
+  if (!isdigit(bp[1]) || !isdigit(bp[2]) || !isdigit(bp[3]) || !isdigit(bp[4]) || bp[5] != ':')
+    return NULL;
+  parsed.tm_year = (bp[1] - '0') * 1000 + (bp[2] - '0') * 100 + (bp[3] - '0') * 10 + (bp[4] - '0') - TM_YEAR_BASE;
+
+  bp = _read_fixed_time(bp + 6, &parsed);
+  if (!bp)
+    return NULL;
+
+  while (isspace(*bp))
+    bp++;
+
+  bp = _read_zone_fast(bp, &parsed, &gmtoff);
+  if (!bp)
+    return NULL;
+
+  *tm = parsed;
+  *tm_gmtoff = gmtoff;
+  return bp;
+}
+
+/* "%b %d %H:%M:%S", e.g. Jan  6 16:14:49 */
+static const guchar *
+_parse_bsd(const guchar *bp, struct tm *tm, long *tm_gmtoff)
+{
+  struct tm parsed = *tm;
+
+  bp = _read_name(bp, &parsed.tm_mon, month_names, 12);
+  if (!bp || !isspace(*bp))
+    return NULL;
+
+  while (isspace(*bp))
+    bp++;
+
+  bp = _read_number(bp, &parsed.tm_mday, 1, 31);
+  if (!bp || !isspace(*bp))
+    return NULL;
+
+  while (isspace(*bp))
+    bp++;
+
+  bp = _read_fixed_time(bp, &parsed);
+  if (!bp)
+    return NULL;
+
+  *tm = parsed;
+  return bp;
+}
+
+static const guchar *
+_parse_ops(DateFormat *self, const guchar *bp, struct tm *tm, long *tm_gmtoff)
+{
+  gint i, value;
+
+  for (i = 0; i < self->num_ops && bp; i++)
+    {
+      DateFormatOp *op = &self->ops[i];
+
+      switch (op->type)
+        {
+        case DFO_LITERAL:
+          if (*bp++ != (guchar) op->literal)
+            return NULL;
+          break;
+        case DFO_SPACE:
+          while (isspace(*bp))
+            bp++;
+          break;
+        case DFO_YEAR:
+          value = TM_YEAR_BASE;
+          bp = _read_number(bp, &value, 0, 9999);
+          tm->tm_year = value - TM_YEAR_BASE;
+          break;
+        case DFO_MONTH:
+          value = 1;
+          bp = _read_number(bp, &value, 1, 12);
+          tm->tm_mon = value - 1;
+          break;
+        case DFO_MDAY:
+          bp = _read_number(bp, &tm->tm_mday, 1, 31);
+          break;
+        case DFO_HOUR:
+          bp = _read_number(bp, &tm->tm_hour, 0, 23);
+          break;
+        case DFO_MIN:
+          bp = _read_number(bp, &tm->tm_min, 0, 59);
+          break;
+        case DFO_SEC:
+          bp = _read_number(bp, &tm->tm_sec, 0, 61);
+          break;
+        case DFO_MONTH_NAME:
+          bp = _read_name(bp, &tm->tm_mon, month_names, 12);
+          break;
+        case DFO_WDAY_NAME:
+          bp = _read_name(bp, &tm->tm_wday, wday_names, 7);
+          break;
+        case DFO_ZONE:
+          bp = _read_zone(bp, tm, tm_gmtoff);
+          break;
+        default:
+          g_assert_not_reached();
+        }
+    }
+  return bp;
+}
+
+/*
+ * Returns the position after the parsed timestamp, or NULL if the input
+ * does not match the format.  Fills the same struct tm fields as
+ * strptime_with_tz() does, except tm_wday and tm_yday which are not
+ * derived from the date.
+ */
+const gchar *
+date_format_parse(DateFormat *self, const gchar *input, struct tm *tm, long *tm_gmtoff)
+{
+  const guchar *bp;
+
+  if (self->fast_parse)
+    {
+      bp = self->fast_parse((const guchar *) input, tm, tm_gmtoff);
+      if (bp)
+        return (const gchar *) bp;
+    }
+  return (const gchar *) _parse_ops(self, (const guchar *) input, tm, tm_gmtoff);
+}
+
+static void
+_add_op(GArray *ops, DateFormatOpType type, gchar literal)
+{
+  DateFormatOp op = { type, literal };
+
+  /* consecutive whitespace in the format matches the same input */
+  if (type == DFO_SPACE && ops->len > 0 && g_array_index(ops, DateFormatOp, ops->len - 1).type == DFO_SPACE)
+    return;
+  g_array_append_val(ops, op);
+}
+
+static void
+_add_ops(GArray *ops, const gchar *spec)
+{
+  for (; *spec; spec++)
+    {
+      switch (*spec)
+        {
+        case 'Y':
+          _add_op(ops, DFO_YEAR, 0);
+          break;
+        case 'm':
+          _add_op(ops, DFO_MONTH, 0);
+          break;
+        case 'd':
+          _add_op(ops, DFO_MDAY, 0);
+          break;
+        case 'H':
+          _add_op(ops, DFO_HOUR, 0);
+          break;
+        case 'M':
+          _add_op(ops, DFO_MIN, 0);
+          break;
+        case 'S':
+          _add_op(ops, DFO_SEC, 0);
+          break;
+        default:
+          _add_op(ops, DFO_LITERAL, *spec);
+          break;
+        }
+    }
+}
+
+static gboolean
+_compile_conversion(GArray *ops, gchar conversion)
+{
+  switch (conversion)
+    {
+    case '%':
+      _add_op(ops, DFO_LITERAL, '%');
+      break;
+    case 'Y':
+      _add_op(ops, DFO_YEAR, 0);
+      break;
+    case 'm':
+      _add_op(ops, DFO_MONTH, 0);
+      break;
+    case 'd':
+    case 'e':
+      _add_op(ops, DFO_MDAY, 0);
+      break;
+    case 'H':
+    case 'k':
+      _add_op(ops, DFO_HOUR, 0);
+      break;
+    case 'M':
+      _add_op(ops, DFO_MIN, 0);
+      break;
+    case 'S':
+      _add_op(ops, DFO_SEC, 0);
+      break;
+    case 'b':
+    case 'B':
+    case 'h':
+      _add_op(ops, DFO_MONTH_NAME, 0);
+      break;
+    case 'a':
+    case 'A':
+      _add_op(ops, DFO_WDAY_NAME, 0);
+      break;
+    case 'z':
+      _add_op(ops, DFO_ZONE, 0);
+      break;
+    case 'n':
+    case 't':
+      _add_op(ops, DFO_SPACE, 0);
+      break;
+    case 'F':
+      _add_ops(ops, "Y-m-d");
+      break;
+    case 'T':
+      _add_ops(ops, "H:M:S");
+      break;
+    case 'R':
+      _add_ops(ops, "H:M");
+      break;
+    default:
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+_ops_equal(GArray *ops, const DateFormatOp *layout, gint layout_len)
+{
+  gint i;
+
+  if (ops->len != layout_len)
+    return FALSE;
+  for (i = 0; i < layout_len; i++)
+    {
+      DateFormatOp *op = &g_array_index(ops, DateFormatOp, i);
+
+      if (op->type != layout[i].type || op->literal != layout[i].literal)
+        return FALSE;
+    }
+  return TRUE;
+}
+
+static const DateFormatOp iso8601_layout[] =
+{
+  { DFO_YEAR }, { DFO_LITERAL, '-' }, { DFO_MONTH }, { DFO_LITERAL, '-' }, { DFO_MDAY }, { DFO_LITERAL, 'T' },
+  { DFO_HOUR }, { DFO_LITERAL, ':' }, { DFO_MIN }, { DFO_LITERAL, ':' }, { DFO_SEC }, { DFO_ZONE }
+};
+
+static const DateFormatOp apache_layout[] =
+{
+  { DFO_MDAY }, { DFO_LITERAL, '/' }, { DFO_MONTH_NAME }, { DFO_LITERAL, '/' }, { DFO_YEAR }, { DFO_LITERAL, ':' },
+  { DFO_HOUR }, { DFO_LITERAL, ':' }, { DFO_MIN }, { DFO_LITERAL, ':' }, { DFO_SEC }, { DFO_SPACE }, { DFO_ZONE }
+};
+
+static const DateFormatOp bsd_layout[] =
+{
+  { DFO_MONTH_NAME }, { DFO_SPACE }, { DFO_MDAY }, { DFO_SPACE },
+  { DFO_HOUR }, { DFO_LITERAL, ':' }, { DFO_MIN }, { DFO_LITERAL, ':' }, { DFO_SEC }
+};
+
+static DateFormatFastParser
+_find_fast_parser(GArray *ops)
+{
+  if (_ops_equal(ops, iso8601_layout, G_N_ELEMENTS(iso8601_layout)))
+    return _parse_iso8601;
+  if (_ops_equal(ops, apache_layout, G_N_ELEMENTS(apache_layout)))
+    return _parse_apache;
+  if (_ops_equal(ops, bsd_layout, G_N_ELEMENTS(bsd_layout)))
+    return _parse_bsd;
+  return NULL;
+}
+
+/* returns NULL if the format uses conversions not supported here */
+DateFormat *
+date_format_compile(const gchar *format)
+{
+  GArray *ops = g_array_new(FALSE, FALSE, sizeof(DateFormatOp));
+  DateFormat *self;
+  const gchar *p;
+
+  for (p = format; *p; p++)
+    {
+      if (isspace(*p))
+        _add_op(ops, DFO_SPACE, 0);
+      else if (*p != '%')
+        _add_op(ops, DFO_LITERAL, *p);
+      else if (!*(++p) || !_compile_conversion(ops, *p))
+        {
+          g_array_free(ops, TRUE);
+          return NULL;
+        }
+    }
+
+  self = g_new0(DateFormat, 1);
+  self->fast_parse = _find_fast_parser(ops);
+  self->num_ops = ops->len;
+  self->ops = (DateFormatOp *) g_array_free(ops, FALSE);
+  return self;
+}
+
+void
+date_format_free(DateFormat *self)
+{
+  g_free(self->ops);
+  g_free(self);
+}
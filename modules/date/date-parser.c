@@ -23,12 +23,14 @@
 
 #include "date-parser.h"
 #include "strptime-tz.h"
+#include "date-format.h"
 #include "misc.h"
 
 typedef struct _DateParser
 {
   LogParser super;
   gchar *date_format;
+  DateFormat *compiled_format;
   gchar *date_tz;
   TimeZoneInfo *date_tz_info;
 } DateParser;
@@ -59,6 +61,10 @@ date_parser_init(LogPipe *s)
   if (self->date_tz_info)
     time_zone_info_free(self->date_tz_info);
   self->date_tz_info = self->date_tz ? time_zone_info_new(self->date_tz) : NULL;
+
+  if (self->compiled_format)
+    date_format_free(self->compiled_format);
+  self->compiled_format = date_format_compile(self->date_format);
   return log_parser_init_method(s);
 }
 
@@ -75,7 +81,10 @@ _parse_timestamp_and_deduce_missing_parts(DateParser *self, struct tm *tm, glong
   current_year = tm->tm_year;
   tm->tm_year = 0;
   tm_gmtoff = -1;
-  remainder = strptime_with_tz(input, self->date_format, tm, &tm_gmtoff, &tm_zone);
+  if (self->compiled_format)
+    remainder = date_format_parse(self->compiled_format, input, tm, &tm_gmtoff);
+  else
+    remainder = strptime_with_tz(input, self->date_format, tm, &tm_gmtoff, &tm_zone);
   if (!remainder || remainder[0])
     return FALSE;
 
@@ -206,6 +215,8 @@ date_parser_free(LogPipe *s)
   g_free(self->date_tz);
   if (self->date_tz_info)
     time_zone_info_free(self->date_tz_info);
+  if (self->compiled_format)
+    date_format_free(self->compiled_format);
 
   log_parser_free_method(s);
 }
@@ -84,9 +84,23 @@ int main()
 
   /* Apache-like */
   testcase("21/Jan/2015:14:40:07 +0500", NULL, "%d/%b/%Y:%T %z", "2015-01-21T14:40:07+05:00");
+  testcase("21/January/2015:14:40:07 +0500", NULL, "%d/%b/%Y:%T %z", "2015-01-21T14:40:07+05:00");
+  testcase("21/Jan/2015:14:40:07 EST", NULL, "%d/%b/%Y:%T %z", "2015-01-21T14:40:07-05:00");
+
+  /* BSD syslog */
+  testcase("Aug 26 16:14:49", NULL, "%b %d %H:%M:%S", "2015-08-26T16:14:49+01:00");
+  testcase("Aug  6 16:14:49", NULL, "%b %e %H:%M:%S", "2015-08-06T16:14:49+01:00");
+  testcase("Aug 6 6:14:49", NULL, "%b %d %H:%M:%S", "2015-08-06T06:14:49+01:00");
+
+  /* Single digit fields are accepted by the generic parser too */
+  testcase("2015-1-6T6:14:49+0300", NULL, NULL, "2015-01-06T06:14:49+03:00");
 
   /* Try with additional text at the end, should fail */
   testcase("2015-01-26T16:14:49+0300 Disappointing log file", NULL, NULL, NULL);
+  testcase("2015-01-26T16:14:49.123+0300", NULL, NULL, NULL);
+  testcase("2015-13-26T16:14:49+0300", NULL, NULL, NULL);
+  testcase("2015-01-26T16:14:49+03", NULL, NULL, "2015-01-26T16:14:49+03:00");
+  testcase("2015-01-26T16:14:49+030", NULL, NULL, NULL);
 
   /* Dates without timezones. America/Phoenix has no DST */
   testcase("Tue, 27 Jan 2015 11:48:46", NULL, "%a, %d %b %Y %T", "2015-01-27T11:48:46+01:00");
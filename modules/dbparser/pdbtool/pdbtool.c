@@ -385,7 +385,7 @@ pdbtool_pdb_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
           if (debug_pattern && !debug_pattern_parse)
             printf("\nValues:\n");
 
-          nv_table_foreach(msg->payload, logmsg_registry, pdbtool_match_values, ret);
+          log_msg_values_foreach(msg, pdbtool_match_values, ret);
           g_string_truncate(output, 0);
           log_msg_print_tags(msg, output);
           printf("TAGS=%s\n", output->str);
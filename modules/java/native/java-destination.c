@@ -163,17 +163,36 @@ void
 java_dd_close(LogThrDestDriver *s)
 {
   JavaDestDriver *self = (JavaDestDriver *)s;
+  java_destination_proxy_clear_batch(self->proxy);
   if (java_destination_proxy_is_opened(self->proxy))
     {
       java_destination_proxy_close(self->proxy);
     }
 }
 
+static gboolean
+java_dd_is_batching(JavaDestDriver *self)
+{
+  return self->super.batch_lines > 0 && java_destination_proxy_supports_batch(self->proxy);
+}
+
+/*
+ * In batch mode messages are only collected into the proxy's ByteBuffer
+ * here, the connection is checked and the JNI boundary is crossed once per
+ * batch in java_worker_flush().
+ */
 static worker_insert_result_t
 java_worker_insert(LogThrDestDriver *s, LogMessage *msg)
 {
   JavaDestDriver *self = (JavaDestDriver *)s;
 
+  if (java_dd_is_batching(self))
+    {
+      if (!java_destination_proxy_add_to_batch(self->proxy, msg))
+        return WORKER_INSERT_RESULT_ERROR;
+      return WORKER_INSERT_RESULT_QUEUED;
+    }
+
   if (!java_dd_open(s))
     {
       return WORKER_INSERT_RESULT_NOT_CONNECTED;
@@ -183,6 +202,21 @@ java_worker_insert(LogThrDestDriver *s, LogMessage *msg)
   return sent ? WORKER_INSERT_RESULT_SUCCESS : WORKER_INSERT_RESULT_ERROR;
 }
 
+static worker_insert_result_t
+java_worker_flush(LogThrDestDriver *s)
+{
+  JavaDestDriver *self = (JavaDestDriver *)s;
+
+  if (!java_dd_open(s))
+    {
+      java_destination_proxy_clear_batch(self->proxy);
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
+
+  gboolean sent = java_destination_proxy_send_batch(self->proxy);
+  return sent ? WORKER_INSERT_RESULT_SUCCESS : WORKER_INSERT_RESULT_ERROR;
+}
+
 static void
 java_worker_message_queue_empty(LogThrDestDriver *d)
 {
@@ -251,6 +285,7 @@ java_dd_new(GlobalConfig *cfg)
 
   self->super.worker.thread_deinit = java_worker_thread_deinit;
   self->super.worker.insert = java_worker_insert;
+  self->super.worker.flush = java_worker_flush;
   self->super.worker.connect = java_dd_open;
   self->super.worker.disconnect = java_dd_close;
   self->super.worker.worker_message_queue_empty = java_worker_message_queue_empty;
@@ -32,6 +32,7 @@ static CfgLexerKeyword java_keywords[] = {
   { "class_name",  KW_CLASS_NAME},
   { "option",      KW_OPTION},
   { "retries",     KW_RETRIES},
+  { "batch_lines", KW_BATCH_LINES},
   { NULL }
 };
 
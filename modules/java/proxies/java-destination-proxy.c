@@ -37,6 +37,7 @@ typedef struct _JavaDestinationImpl
   jmethodID mi_deinit;
   jmethodID mi_send;
   jmethodID mi_send_msg;
+  jmethodID mi_send_batch;
   jmethodID mi_open;
   jmethodID mi_close;
   jmethodID mi_is_opened;
@@ -53,8 +54,23 @@ struct _JavaDestinationProxy
   GString *formatted_message; 
   JavaLogMessageProxy *msg_builder;
   gchar *name_by_uniq_options;
+
+  /* messages are collected into a direct ByteBuffer and passed to
+   * sendBatchProxy() in a single call: formatted messages as a native
+   * gint32 length followed by the UTF-8 bytes, LogMessage instances as
+   * referenced native handles */
+  struct
+  {
+    gchar *buffer;
+    gsize capacity;
+    gsize len;
+    gint count;
+    jobject byte_buffer;
+  } batch;
 };
 
+#define JAVA_BATCH_INITIAL_SIZE 65536
+
 static gboolean
 __load_destination_object(JavaDestinationProxy *self, const gchar *class_name, const gchar *class_path, gpointer handle)
 {
@@ -102,6 +118,10 @@ __load_destination_object(JavaDestinationProxy *self, const gchar *class_name, c
                 NULL);
     }
 
+  self->dest_impl.mi_send_batch = CALL_JAVA_FUNCTION(java_env, GetMethodID, self->loaded_class, "sendBatchProxy", "(Ljava/nio/ByteBuffer;I)Z");
+  if (!self->dest_impl.mi_send_batch)
+    (*java_env)->ExceptionClear(java_env);
+
   self->dest_impl.mi_on_message_queue_empty = CALL_JAVA_FUNCTION(java_env, GetMethodID, self->loaded_class, "onMessageQueueEmptyProxy", "()V");
   if (!self->dest_impl.mi_on_message_queue_empty)
     {
@@ -162,11 +182,25 @@ __load_destination_object(JavaDestinationProxy *self, const gchar *class_name, c
 }
 
 
+static void
+__batch_free_byte_buffer(JavaDestinationProxy *self, JNIEnv *env)
+{
+  if (self->batch.byte_buffer)
+    {
+      CALL_JAVA_FUNCTION(env, DeleteGlobalRef, self->batch.byte_buffer);
+      self->batch.byte_buffer = NULL;
+    }
+}
+
 void
 java_destination_proxy_free(JavaDestinationProxy *self)
 {
   JNIEnv *env = NULL;
   env = java_machine_get_env(self->java_machine, &env);
+
+  java_destination_proxy_clear_batch(self);
+  __batch_free_byte_buffer(self, env);
+  g_free(self->batch.buffer);
   if (self->dest_impl.dest_object)
     {
       CALL_JAVA_FUNCTION(env, DeleteLocalRef, self->dest_impl.dest_object);
@@ -240,6 +274,134 @@ __queue_formatted_message(JavaDestinationProxy *self, JNIEnv *env, LogMessage *m
   return !!(res);
 }
 
+/* the ByteBuffer is recreated when the backing store is reallocated, Java
+ * code must not keep a reference to it past sendBatchProxy().  On failure
+ * there's no ByteBuffer until the next successful call, and the batch
+ * can't be sent. */
+static gboolean
+__batch_reserve(JavaDestinationProxy *self, JNIEnv *env, gsize len)
+{
+  gsize new_capacity;
+  jobject byte_buffer;
+
+  if (self->batch.byte_buffer && self->batch.len + len <= self->batch.capacity)
+    return TRUE;
+
+  new_capacity = MAX(self->batch.capacity, JAVA_BATCH_INITIAL_SIZE);
+  while (new_capacity < self->batch.len + len)
+    new_capacity *= 2;
+
+  __batch_free_byte_buffer(self, env);
+  self->batch.buffer = g_realloc(self->batch.buffer, new_capacity);
+  self->batch.capacity = new_capacity;
+
+  byte_buffer = CALL_JAVA_FUNCTION(env, NewDirectByteBuffer, self->batch.buffer, new_capacity);
+  if (byte_buffer)
+    {
+      self->batch.byte_buffer = CALL_JAVA_FUNCTION(env, NewGlobalRef, byte_buffer);
+      CALL_JAVA_FUNCTION(env, DeleteLocalRef, byte_buffer);
+    }
+
+  if (!self->batch.byte_buffer)
+    {
+      /* don't leave the OutOfMemoryError pending for the next JNI call */
+      (*env)->ExceptionClear(env);
+      msg_error("Can't allocate direct ByteBuffer for batch",
+                evt_tag_int("size", new_capacity),
+                NULL);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static void
+__batch_append(JavaDestinationProxy *self, gconstpointer data, gsize len)
+{
+  memcpy(self->batch.buffer + self->batch.len, data, len);
+  self->batch.len += len;
+}
+
+gboolean
+java_destination_proxy_supports_batch(JavaDestinationProxy *self)
+{
+  return self->dest_impl.mi_send_batch != 0;
+}
+
+gboolean
+java_destination_proxy_add_to_batch(JavaDestinationProxy *self, LogMessage *msg)
+{
+  JNIEnv *env = java_machine_get_env(self->java_machine, &env);
+
+  if (self->dest_impl.mi_send_msg != 0)
+    {
+      jlong handle = (jlong) msg;
+
+      if (!__batch_reserve(self, env, sizeof(handle)))
+        return FALSE;
+
+      log_msg_ref(msg);
+      __batch_append(self, &handle, sizeof(handle));
+    }
+  else
+    {
+      gint32 len;
+
+      log_template_format(self->template, msg, NULL, LTZ_LOCAL, 0, NULL, self->formatted_message);
+      len = self->formatted_message->len;
+      if (!__batch_reserve(self, env, sizeof(len) + len))
+        return FALSE;
+
+      __batch_append(self, &len, sizeof(len));
+      __batch_append(self, self->formatted_message->str, len);
+    }
+  self->batch.count++;
+  return TRUE;
+}
+
+/* the batch is consumed regardless of the result, LogMessage handles are
+ * released by the Java side */
+gboolean
+java_destination_proxy_send_batch(JavaDestinationProxy *self)
+{
+  JNIEnv *env = java_machine_get_env(self->java_machine, &env);
+  jboolean res;
+
+  if (self->batch.count == 0)
+    return TRUE;
+
+  if (!self->batch.byte_buffer)
+    {
+      /* a message could not be added, the batch is incomplete */
+      java_destination_proxy_clear_batch(self);
+      return FALSE;
+    }
+
+  res = CALL_JAVA_FUNCTION(env, CallBooleanMethod, self->dest_impl.dest_object, self->dest_impl.mi_send_batch,
+                           self->batch.byte_buffer, (jint) self->batch.count);
+  self->batch.len = 0;
+  self->batch.count = 0;
+  return !!(res);
+}
+
+void
+java_destination_proxy_clear_batch(JavaDestinationProxy *self)
+{
+  if (self->dest_impl.mi_send_msg != 0)
+    {
+      gsize ofs;
+
+      for (ofs = 0; ofs < self->batch.len; ofs += sizeof(jlong))
+        {
+          jlong handle;
+
+          memcpy(&handle, self->batch.buffer + ofs, sizeof(handle));
+          log_msg_unref((LogMessage *) handle);
+        }
+    }
+  self->batch.len = 0;
+  self->batch.count = 0;
+}
+
 gboolean
 java_destination_proxy_send(JavaDestinationProxy *self, LogMessage *msg)
 {
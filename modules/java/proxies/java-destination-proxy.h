@@ -39,6 +39,10 @@ void java_destination_proxy_deinit(JavaDestinationProxy *self);
 void java_destination_proxy_on_message_queue_empty(JavaDestinationProxy *self);
 gchar *java_destination_proxy_get_name_by_uniq_options(JavaDestinationProxy *self);
 gboolean java_destination_proxy_send(JavaDestinationProxy *self, LogMessage *msg);
+gboolean java_destination_proxy_supports_batch(JavaDestinationProxy *self);
+gboolean java_destination_proxy_add_to_batch(JavaDestinationProxy *self, LogMessage *msg);
+gboolean java_destination_proxy_send_batch(JavaDestinationProxy *self);
+void java_destination_proxy_clear_batch(JavaDestinationProxy *self);
 gboolean java_destination_proxy_open(JavaDestinationProxy *self);
 void java_destination_proxy_close(JavaDestinationProxy *self);
 gboolean java_destination_proxy_is_opened(JavaDestinationProxy *self);
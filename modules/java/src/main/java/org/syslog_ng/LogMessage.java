@@ -12,8 +12,10 @@ public class LogMessage {
   }
 
   public void release() {
-    unref(handle);
-    handle = 0;
+    if (handle != 0) {
+      unref(handle);
+      handle = 0;
+    }
   }
 
   protected long getHandle() {
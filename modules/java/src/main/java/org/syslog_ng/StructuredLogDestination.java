@@ -23,12 +23,51 @@
 
 package org.syslog_ng;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.ArrayList;
+import java.util.List;
+
 public abstract class StructuredLogDestination extends LogDestination {
 	public StructuredLogDestination(long handle) {
 		super(handle);
 	}
 
 	protected abstract boolean send(LogMessage msg);
+
+	/*
+	 * Called instead of send() if batch-lines() is set. The return value
+	 * applies to the whole batch. Messages are released once this method
+	 * returns.
+	 */
+	protected boolean sendBatch(List<LogMessage> msgs) {
+		for (LogMessage msg : msgs) {
+			if (!send(msg))
+				return false;
+		}
+		return true;
+	}
+
+	/* batch contains count native LogMessage handles */
+	public boolean sendBatchProxy(ByteBuffer batch, int count) {
+		ByteBuffer records = batch.duplicate().order(ByteOrder.nativeOrder());
+		List<LogMessage> msgs = new ArrayList<LogMessage>(count);
+
+		for (int i = 0; i < count; i++)
+			msgs.add(new LogMessage(records.getLong()));
+
+		try {
+			return sendBatch(msgs);
+		}
+		catch (Exception e) {
+			sendExceptionMessage(e);
+			return false;
+		}
+		finally {
+			for (LogMessage msg : msgs)
+				msg.release();
+		}
+	}
 	public boolean sendProxy(LogMessage msg) {
 		try {
 			return send(msg);
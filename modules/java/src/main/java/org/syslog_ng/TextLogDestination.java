@@ -23,12 +23,52 @@
 
 package org.syslog_ng;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+import java.util.ArrayList;
+import java.util.List;
+
 public abstract class TextLogDestination extends LogDestination {
+	private static final Charset UTF8 = Charset.forName("UTF-8");
+
 	public TextLogDestination(long handle) {
 		super(handle);
 	}
 
 	protected abstract boolean send(String formattedMessage);
+
+	/*
+	 * Called instead of send() if batch-lines() is set. The return value
+	 * applies to the whole batch.
+	 */
+	protected boolean sendBatch(List<String> formattedMessages) {
+		for (String formattedMessage : formattedMessages) {
+			if (!send(formattedMessage))
+				return false;
+		}
+		return true;
+	}
+
+	/* batch contains count records, each an int length followed by UTF-8 bytes */
+	public boolean sendBatchProxy(ByteBuffer batch, int count) {
+		try {
+			ByteBuffer records = batch.duplicate().order(ByteOrder.nativeOrder());
+			List<String> formattedMessages = new ArrayList<String>(count);
+
+			for (int i = 0; i < count; i++) {
+				byte[] record = new byte[records.getInt()];
+
+				records.get(record);
+				formattedMessages.add(new String(record, UTF8));
+			}
+			return sendBatch(formattedMessages);
+		}
+		catch (Exception e) {
+			sendExceptionMessage(e);
+			return false;
+		}
+	}
 	public boolean sendProxy(String formattedMessage) {
 		try {
 			return send(formattedMessage);
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+/* the batch handling of the proxy is tested against a fake JNIEnv, without
+ * starting a JVM */
+#include "proxies/java-destination-proxy.c"
+
+#include "testutils.h"
+#include "apphook.h"
+#include "cfg.h"
+
+static struct JNINativeInterface_ fake_jni;
+static JNIEnv fake_env = &fake_jni;
+
+static gboolean fail_byte_buffer_allocation;
+static gint byte_buffers_allocated;
+static gint exceptions_cleared;
+static gint send_batch_calls;
+static gint send_batch_count;
+static jobject send_batch_buffer;
+
+static gint fake_method;
+static gint fake_object;
+
+/* JavaVMSingleton and JavaLogMessageProxy are not used by the batch code */
+
+JavaVMSingleton *
+java_machine_ref(void)
+{
+  return NULL;
+}
+
+void
+java_machine_unref(JavaVMSingleton *self)
+{
+}
+
+gboolean
+java_machine_start(JavaVMSingleton *self)
+{
+  return TRUE;
+}
+
+JNIEnv *
+java_machine_get_env(JavaVMSingleton *self, JNIEnv **penv)
+{
+  *penv = &fake_env;
+  return *penv;
+}
+
+jclass
+java_machine_load_class(JavaVMSingleton *self, const gchar *class_name, const gchar *class_path)
+{
+  return NULL;
+}
+
+JavaLogMessageProxy *
+java_log_message_proxy_new(void)
+{
+  return NULL;
+}
+
+void
+java_log_message_proxy_free(JavaLogMessageProxy *self)
+{
+}
+
+jobject
+java_log_message_proxy_create_java_object(JavaLogMessageProxy *self, LogMessage *msg)
+{
+  return NULL;
+}
+
+static jobject JNICALL
+_fake_new_direct_byte_buffer(JNIEnv *env, void *address, jlong capacity)
+{
+  if (fail_byte_buffer_allocation)
+    return NULL;
+
+  byte_buffers_allocated++;
+  return (jobject) address;
+}
+
+static jobject JNICALL
+_fake_new_global_ref(JNIEnv *env, jobject obj)
+{
+  return obj;
+}
+
+static void JNICALL
+_fake_delete_ref(JNIEnv *env, jobject obj)
+{
+}
+
+static void JNICALL
+_fake_exception_clear(JNIEnv *env)
+{
+  exceptions_cleared++;
+}
+
+static jboolean JNICALL
+_fake_call_boolean_method(JNIEnv *env, jobject obj, jmethodID method, ...)
+{
+  va_list args;
+
+  va_start(args, method);
+  send_batch_buffer = va_arg(args, jobject);
+  send_batch_count = va_arg(args, jint);
+  va_end(args);
+
+  send_batch_calls++;
+  return JNI_TRUE;
+}
+
+static JavaDestinationProxy *
+_create_proxy(void)
+{
+  JavaDestinationProxy *self = g_new0(JavaDestinationProxy, 1);
+
+  self->template = log_template_new(configuration, NULL);
+  log_template_compile(self->template, "$MSG", NULL);
+  self->formatted_message = g_string_sized_new(1024);
+  self->dest_impl.dest_object = (jobject) &fake_object;
+  self->dest_impl.mi_send = (jmethodID) &fake_method;
+  self->dest_impl.mi_send_batch = (jmethodID) &fake_method;
+
+  fail_byte_buffer_allocation = FALSE;
+  byte_buffers_allocated = 0;
+  exceptions_cleared = 0;
+  send_batch_calls = 0;
+  send_batch_count = 0;
+  send_batch_buffer = NULL;
+  return self;
+}
+
+static LogMessage *
+_create_message(gsize length)
+{
+  LogMessage *msg = log_msg_new_empty();
+  gchar *value = g_malloc(length);
+
+  memset(value, 'x', length);
+  log_msg_set_value(msg, LM_V_MESSAGE, value, length);
+  g_free(value);
+  return msg;
+}
+
+static gboolean
+_add_message(JavaDestinationProxy *proxy, gsize length)
+{
+  LogMessage *msg = _create_message(length);
+  gboolean result;
+
+  result = java_destination_proxy_add_to_batch(proxy, msg);
+  log_msg_unref(msg);
+  return result;
+}
+
+static void
+test_batch_is_sent_in_a_single_call(void)
+{
+  JavaDestinationProxy *proxy = _create_proxy();
+
+  assert_true(_add_message(proxy, 10), "Adding a message to the batch failed");
+  assert_true(_add_message(proxy, 10), "Adding a message to the batch failed");
+  assert_true(java_destination_proxy_send_batch(proxy), "Sending the batch failed");
+
+  assert_gint(send_batch_calls, 1, "The batch should be sent in a single call");
+  assert_gint(send_batch_count, 2, "Wrong number of messages passed to sendBatchProxy()");
+  assert_not_null(send_batch_buffer, "No ByteBuffer passed to sendBatchProxy()");
+
+  java_destination_proxy_free(proxy);
+}
+
+static void
+test_failed_reservation_skips_the_java_call(void)
+{
+  JavaDestinationProxy *proxy = _create_proxy();
+
+  assert_true(_add_message(proxy, 10), "Adding a message to the batch failed");
+
+  /* a message larger than the current buffer needs a new ByteBuffer */
+  fail_byte_buffer_allocation = TRUE;
+  assert_false(_add_message(proxy, JAVA_BATCH_INITIAL_SIZE * 2),
+               "Adding a message succeeded without a ByteBuffer");
+  assert_gint(exceptions_cleared, 1, "The Java exception of the failed allocation was left pending");
+
+  assert_false(java_destination_proxy_send_batch(proxy), "Sending a batch without a ByteBuffer succeeded");
+  assert_gint(send_batch_calls, 0, "sendBatchProxy() was called without a ByteBuffer");
+  assert_gint(proxy->batch.count, 0, "The failed batch was not cleared");
+
+  /* small messages fit into the existing buffer, but a new ByteBuffer is
+   * still needed before they can be sent */
+  fail_byte_buffer_allocation = FALSE;
+  assert_true(_add_message(proxy, 10), "Adding a message after a failed reservation failed");
+  assert_true(java_destination_proxy_send_batch(proxy), "Sending the batch failed");
+  assert_gint(send_batch_calls, 1, "The batch was not sent after recovering");
+  assert_gint(send_batch_count, 1, "Wrong number of messages passed to sendBatchProxy()");
+  assert_not_null(send_batch_buffer, "No ByteBuffer passed to sendBatchProxy()");
+
+  java_destination_proxy_free(proxy);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+  configuration = cfg_new(VERSION_VALUE);
+
+  fake_jni.NewDirectByteBuffer = _fake_new_direct_byte_buffer;
+  fake_jni.NewGlobalRef = _fake_new_global_ref;
+  fake_jni.DeleteGlobalRef = _fake_delete_ref;
+  fake_jni.DeleteLocalRef = _fake_delete_ref;
+  fake_jni.ExceptionClear = _fake_exception_clear;
+  fake_jni.CallBooleanMethod = _fake_call_boolean_method;
+
+  test_batch_is_sent_in_a_single_call();
+  test_failed_reservation_skips_the_java_call();
+
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
@@ -21,14 +21,25 @@
  */
 
 #include "json-parser.h"
+#include "json-tokenizer.h"
 #include "dot-notation.h"
 #include "scratch-buffers.h"
 
 #include <string.h>
 #include <ctype.h>
 
-#include <json.h>
-#include <json_object_private.h>
+/*
+ * The JSON input is processed in a streaming fashion: the tokenizer walks
+ * the input and leaf values are written right into the LogMessage, without
+ * building a json-c object tree first.  When the input is the MESSAGE
+ * value itself, strings without escape sequences are stored as indirect
+ * values pointing into MESSAGE, so they are not copied at all.
+ *
+ * With extract-prefix() set, the document is first scanned to find the
+ * selected subtree (the last one if an object has duplicate members, just
+ * as json-c did), without processing anything else, and only that subtree
+ * is walked once more to extract values.
+ */
 
 typedef struct _JSONParser
 {
@@ -37,8 +48,20 @@ typedef struct _JSONParser
   gchar *marker;
   gint marker_len;
   gchar *extract_prefix;
+  JSONDotNotation *extract_path;
 } JSONParser;
 
+typedef struct _JSONParserState
+{
+  JSONTokenizer tokenizer;
+  LogMessage *msg;
+  GString *key;
+  GString *value;
+  /* the value @input is stored in, LM_V_NONE if it is not part of the message */
+  NVHandle ref_handle;
+  const gchar *ref_base;
+} JSONParserState;
+
 void
 json_parser_set_prefix(LogParser *p, const gchar *prefix)
 {
@@ -62,188 +85,376 @@ void
 json_parser_set_extract_prefix(LogParser *s, const gchar *extract_prefix)
 {
   JSONParser *self = (JSONParser *) s;
-  
+
   g_free(self->extract_prefix);
   self->extract_prefix = g_strdup(extract_prefix);
+
+  if (self->extract_path)
+    json_dot_notation_free(self->extract_path);
+  self->extract_path = NULL;
+  if (extract_prefix)
+    {
+      self->extract_path = json_dot_notation_new();
+      if (!json_dot_notation_compile(self->extract_path, extract_prefix))
+        {
+          json_dot_notation_free(self->extract_path);
+          self->extract_path = NULL;
+        }
+    }
 }
 
 static void
-json_parser_process_object(struct json_object *jso,
-                                const gchar *prefix,
-                                LogMessage *msg);
+json_parser_store_value(JSONParserState *state, NVHandle handle, const gchar *value, gsize value_len)
+{
+  /* once the referenced value is overwritten, offsets into it are no
+   * longer valid */
+  if (handle == state->ref_handle)
+    state->ref_handle = LM_V_NONE;
+  log_msg_set_value(state->msg, handle, value, value_len);
+}
 
+/* stores a value that is a substring of the input */
 static void
-json_parser_process_single(struct json_object *jso,
-                                const gchar *prefix,
-                                const gchar *obj_key,
-                                LogMessage *msg)
+json_parser_store_input_ref(JSONParserState *state, const gchar *value, gsize value_len)
 {
-  SBGString *key, *value;
-  gboolean parsed = FALSE;
+  NVHandle handle = log_msg_get_value_handle(state->key->str);
+  gsize ofs = value - state->ref_base;
 
-  if (!jso)
-    return;
+  if (state->ref_handle == LM_V_NONE ||
+      ofs + value_len > G_MAXUINT16 ||
+      !log_msg_is_handle_settable_with_an_indirect_value(handle))
+    {
+      json_parser_store_value(state, handle, value, value_len);
+      return;
+    }
+  log_msg_set_value_indirect(state->msg, handle, state->ref_handle, 0, ofs, value_len);
+}
 
-  key = sb_gstring_acquire();
-  value = sb_gstring_acquire();
+/* integers json_object_get_int() would have formatted the same way */
+static gboolean
+_is_canonical_int(const JSONToken *token)
+{
+  const gchar *digits = token->start;
+  gsize len = token->len;
 
-  switch (json_object_get_type(jso))
+  if (*digits == '-')
     {
-    case json_type_boolean:
-      parsed = TRUE;
-      if (json_object_get_boolean(jso))
-        g_string_assign(sb_gstring_string(value), "true");
-      else
-        g_string_assign(sb_gstring_string(value), "false");
-      break;
-    case json_type_double:
-      parsed = TRUE;
-      g_string_printf(sb_gstring_string(value), "%f",
-                       json_object_get_double(jso));
-      break;
-    case json_type_int:
-      parsed = TRUE;
-      g_string_printf(sb_gstring_string(value), "%i",
-                       json_object_get_int(jso));
-      break;
-    case json_type_string:
-      parsed = TRUE;
-      g_string_assign(sb_gstring_string(value),
-                       json_object_get_string(jso));
-      break;
-    case json_type_object:
-      if (prefix)
-        g_string_assign(sb_gstring_string(key), prefix);
-      g_string_append(sb_gstring_string(key), obj_key);
-      g_string_append_c(sb_gstring_string(key), '.');
-      json_parser_process_object(jso, sb_gstring_string(key)->str, msg);
-      break;
-    case json_type_array:
-      {
-        gint i, plen;
-
-        g_string_assign(sb_gstring_string(key), obj_key);
-
-        plen = sb_gstring_string(key)->len;
-
-        for (i = 0; i < json_object_array_length(jso); i++)
-          {
-            g_string_truncate(sb_gstring_string(key), plen);
-            g_string_append_printf(sb_gstring_string(key), "[%d]", i);
-            json_parser_process_single(json_object_array_get_idx(jso, i),
-                                            prefix,
-                                            sb_gstring_string(key)->str, msg);
-          }
-        break;
-      }
-    case json_type_null:
-      break;
-    default:
-      msg_error("JSON parser encountered an unknown type, skipping",
-                 evt_tag_str("key", obj_key), NULL);
-      break;
+      digits++;
+      len--;
     }
+  if (len > 9)
+    return FALSE;
+  return digits[0] != '0' || (len == 1 && digits == token->start);
+}
 
-  if (parsed)
+static void
+json_parser_store_number(JSONParserState *state, const JSONToken *token)
+{
+  gint64 int_value;
+  gdouble double_value;
+
+  if (!token->escaped && _is_canonical_int(token))
     {
-      if (prefix)
-        {
-          g_string_assign(sb_gstring_string(key), prefix);
-          g_string_append(sb_gstring_string(key), obj_key);
-          log_msg_set_value_by_name(msg,
-                             sb_gstring_string(key)->str,
-                             sb_gstring_string(value)->str,
-                             sb_gstring_string(value)->len);
-        }
-      else
-        log_msg_set_value_by_name(msg,
-                           obj_key,
-                           sb_gstring_string(value)->str,
-                           sb_gstring_string(value)->len);
+      json_parser_store_input_ref(state, token->start, token->len);
+      return;
     }
 
-  sb_gstring_release(key);
-  sb_gstring_release(value);
+  g_string_truncate(state->value, 0);
+  g_string_append_len(state->value, token->start, token->len);
+  if (token->escaped)
+    {
+      double_value = g_ascii_strtod(state->value->str, NULL);
+      g_string_printf(state->value, "%f", double_value);
+    }
+  else
+    {
+      /* json_object_get_int() clamps out of range values */
+      int_value = g_ascii_strtoll(state->value->str, NULL, 10);
+      int_value = CLAMP(int_value, G_MININT32, G_MAXINT32);
+      g_string_printf(state->value, "%i", (gint) int_value);
+    }
+  json_parser_store_value(state, log_msg_get_value_handle(state->key->str), state->value->str, state->value->len);
 }
 
 static void
-json_parser_process_object(struct json_object *jso,
-                                const gchar *prefix,
-                                LogMessage *msg)
+json_parser_store_string(JSONParserState *state, const JSONToken *token)
 {
-  struct json_object_iter itr;
+  const gchar *value;
+  gsize value_len;
 
-  json_object_object_foreachC(jso, itr)
+  if (!token->escaped)
     {
-      json_parser_process_single(itr.val, prefix, itr.key, msg);
+      value = json_token_get_string(token, &value_len);
+      json_parser_store_input_ref(state, value, value_len);
+      return;
     }
+
+  g_string_truncate(state->value, 0);
+  json_token_append_string(token, state->value);
+  json_parser_store_value(state, log_msg_get_value_handle(state->key->str), state->value->str, state->value->len);
 }
 
+static gboolean json_parser_process_object(JSONParserState *state, gint depth);
+static gboolean json_parser_process_array(JSONParserState *state, gint depth);
+
 static gboolean
-json_parser_extract(JSONParser *self, struct json_object *jso, LogMessage *msg)
+json_parser_process_value(JSONParserState *state, const JSONToken *token, gint depth)
 {
-  if (self->extract_prefix)
-    jso = json_extract(jso, self->extract_prefix);
-
-  if (!jso || !json_object_is_type(jso, json_type_object))
+  switch (token->type)
     {
+    case JT_STRING:
+      json_parser_store_string(state, token);
+      return TRUE;
+    case JT_NUMBER:
+      json_parser_store_number(state, token);
+      return TRUE;
+    case JT_TRUE:
+      json_parser_store_value(state, log_msg_get_value_handle(state->key->str), "true", 4);
+      return TRUE;
+    case JT_FALSE:
+      json_parser_store_value(state, log_msg_get_value_handle(state->key->str), "false", 5);
+      return TRUE;
+    case JT_NULL:
+      return TRUE;
+    case JT_BEGIN_OBJECT:
+      if (!json_tokenizer_enter(&state->tokenizer, depth))
+        return FALSE;
+      g_string_append_c(state->key, '.');
+      return json_parser_process_object(state, depth);
+    case JT_BEGIN_ARRAY:
+      if (!json_tokenizer_enter(&state->tokenizer, depth))
+        return FALSE;
+      return json_parser_process_array(state, depth);
+    default:
+      g_assert_not_reached();
       return FALSE;
     }
-  
-  json_parser_process_object(jso, self->prefix, msg);
-  return TRUE;
 }
 
-#ifndef JSON_C_VERSION
-const char *
-json_tokener_error_desc(enum json_tokener_error err)
+static gboolean
+json_parser_process_object(JSONParserState *state, gint depth)
 {
-  return json_tokener_errors[err];
+  JSONToken name, value;
+  gsize key_len = state->key->len;
+  gint i;
+
+  for (i = 0; json_tokenizer_next_member(&state->tokenizer, i, &name, &value); i++)
+    {
+      if (value.type == JT_END_OBJECT)
+        return TRUE;
+
+      g_string_truncate(state->key, key_len);
+      json_token_append_string(&name, state->key);
+      if (!json_parser_process_value(state, &value, depth + 1))
+        return FALSE;
+    }
+  return FALSE;
 }
-#endif
 
 static gboolean
-json_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_options, const gchar *input, gsize input_len)
+json_parser_process_array(JSONParserState *state, gint depth)
 {
-  JSONParser *self = (JSONParser *) s;
-  struct json_object *jso;
-  struct json_tokener *tok;
+  JSONToken value;
+  gsize key_len = state->key->len;
+  gint i;
 
-  if (self->marker)
+  for (i = 0; json_tokenizer_next_element(&state->tokenizer, i, &value); i++)
     {
-      if (strncmp(input, self->marker, self->marker_len) != 0)
+      if (value.type == JT_END_ARRAY)
+        return TRUE;
+
+      g_string_truncate(state->key, key_len);
+      g_string_append_printf(state->key, "[%d]", i);
+      if (!json_parser_process_value(state, &value, depth + 1))
         return FALSE;
-      input += self->marker_len;
+    }
+  return FALSE;
+}
+
+static gboolean
+_member_name_equals(const JSONToken *name, const gchar *expected, GString *buffer)
+{
+  const gchar *str;
+  gsize len;
+
+  if (!name->escaped)
+    {
+      str = json_token_get_string(name, &len);
+      return len == strlen(expected) && memcmp(str, expected, len) == 0;
+    }
+  g_string_truncate(buffer, 0);
+  json_token_append_string(name, buffer);
+  return strcmp(buffer->str, expected) == 0;
+}
+
+/*
+ * Looks up the value @path refers to, starting at the value beginning with
+ * @token.  The whole value is checked for syntax errors, the selected
+ * value is returned in @selected, the start of which is left NULL if there
+ * is no such value.
+ */
+static gboolean
+json_parser_select(JSONParserState *state, const JSONToken *token, const JSONDotNotationElem *path,
+                   gint depth, JSONToken *selected)
+{
+  JSONTokenizer *tokenizer = &state->tokenizer;
+  JSONToken name, value;
+  gint i;
 
-      while (isspace(*input))
-        input++;
+  if (!path || !path->used)
+    {
+      if (!json_tokenizer_skip_value(tokenizer, token, depth))
+        return FALSE;
+      *selected = *token;
+      selected->len = tokenizer->pos - token->start;
+      return TRUE;
     }
 
-  tok = json_tokener_new();
-  jso = json_tokener_parse_ex(tok, input, input_len);
-  if (tok->err != json_tokener_success || !jso)
+  if (path->type == JS_MEMBER_REF && token->type == JT_BEGIN_OBJECT)
     {
-      msg_error("Unparsable JSON stream encountered",
-                evt_tag_str ("input", input),
-                tok->err != json_tokener_success ? evt_tag_str ("error", json_tokener_error_desc(tok->err)) : NULL,
-                NULL);
-      json_tokener_free (tok);
+      if (!json_tokenizer_enter(tokenizer, depth))
+        return FALSE;
+      for (i = 0; json_tokenizer_next_member(tokenizer, i, &name, &value); i++)
+        {
+          if (value.type == JT_END_OBJECT)
+            return TRUE;
+
+          if (_member_name_equals(&name, path->member_ref.name, state->value))
+            {
+              selected->start = NULL;
+              if (!json_parser_select(state, &value, path + 1, depth + 1, selected))
+                return FALSE;
+            }
+          else if (!json_tokenizer_skip_value(tokenizer, &value, depth + 1))
+            return FALSE;
+        }
       return FALSE;
     }
-  json_tokener_free(tok);
-
-  log_msg_make_writable(pmsg, path_options);
-  if (!json_parser_extract(self, jso, *pmsg))
+  else if (path->type == JS_ARRAY_REF && token->type == JT_BEGIN_ARRAY)
     {
-      msg_error("Error extracting JSON members into LogMessage as the top-level JSON object is not an object",
-                evt_tag_str ("input", input),
-                NULL);
-      json_object_put(jso);
+      if (!json_tokenizer_enter(tokenizer, depth))
+        return FALSE;
+      for (i = 0; json_tokenizer_next_element(tokenizer, i, &value); i++)
+        {
+          if (value.type == JT_END_ARRAY)
+            return TRUE;
+
+          if (i == path->array_ref.index)
+            {
+              if (!json_parser_select(state, &value, path + 1, depth + 1, selected))
+                return FALSE;
+            }
+          else if (!json_tokenizer_skip_value(tokenizer, &value, depth + 1))
+            return FALSE;
+        }
       return FALSE;
     }
-  json_object_put(jso);
 
+  return json_tokenizer_skip_value(tokenizer, token, depth);
+}
+
+static gboolean
+json_parser_extract(JSONParser *self, JSONParserState *state, LogMessage **pmsg, const LogPathOptions *path_options,
+                    const gchar *input)
+{
+  JSONToken token, selected;
+
+  if (!json_tokenizer_next(&state->tokenizer, &token))
+    goto parse_error;
+
+  if (self->extract_path)
+    {
+      selected.start = NULL;
+      if (!json_parser_select(state, &token, json_dot_notation_get_elems(self->extract_path), 0, &selected))
+        goto parse_error;
+      if (!selected.start)
+        goto not_an_object;
+
+      json_tokenizer_init(&state->tokenizer, selected.start, selected.len);
+      if (!json_tokenizer_next(&state->tokenizer, &token))
+        goto parse_error;
+    }
+  else if (self->extract_prefix)
+    {
+      goto not_an_object;
+    }
+
+  if (token.type != JT_BEGIN_OBJECT)
+    {
+      /* still report invalid input as such */
+      if (!json_tokenizer_skip_value(&state->tokenizer, &token, 0))
+        goto parse_error;
+      goto not_an_object;
+    }
+
+  log_msg_make_writable(pmsg, path_options);
+  state->msg = *pmsg;
+  if (!json_parser_process_object(state, 0))
+    goto parse_error;
   return TRUE;
+
+ parse_error:
+  msg_error("Unparsable JSON stream encountered",
+            evt_tag_str("input", input),
+            evt_tag_str("error", state->tokenizer.error),
+            NULL);
+  return FALSE;
+
+ not_an_object:
+  msg_error("Error extracting JSON members into LogMessage as the top-level JSON object is not an object",
+            evt_tag_str("input", input),
+            NULL);
+  return FALSE;
+}
+
+static gboolean
+json_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_options, const gchar *input, gsize input_len)
+{
+  JSONParser *self = (JSONParser *) s;
+  JSONParserState state;
+  SBGString *key, *value;
+  const gchar *message;
+  gssize message_len;
+  gboolean success;
+
+  message = log_msg_get_value(*pmsg, LM_V_MESSAGE, &message_len);
+  if (input >= message && input + input_len <= message + message_len)
+    {
+      state.ref_handle = LM_V_MESSAGE;
+      state.ref_base = message;
+    }
+  else
+    {
+      state.ref_handle = LM_V_NONE;
+      state.ref_base = NULL;
+    }
+
+  if (self->marker)
+    {
+      if (input_len < self->marker_len || strncmp(input, self->marker, self->marker_len) != 0)
+        return FALSE;
+      input += self->marker_len;
+      input_len -= self->marker_len;
+
+      while (input_len > 0 && isspace(*input))
+        {
+          input++;
+          input_len--;
+        }
+    }
+
+  key = sb_gstring_acquire();
+  value = sb_gstring_acquire();
+  state.key = sb_gstring_string(key);
+  state.value = sb_gstring_string(value);
+  g_string_assign(state.key, self->prefix ? self->prefix : "");
+  json_tokenizer_init(&state.tokenizer, input, input_len);
+
+  success = json_parser_extract(self, &state, pmsg, path_options, input);
+
+  sb_gstring_release(key);
+  sb_gstring_release(value);
+  return success;
 }
 
 static LogPipe *
@@ -268,6 +479,8 @@ json_parser_free(LogPipe *s)
   g_free(self->prefix);
   g_free(self->marker);
   g_free(self->extract_prefix);
+  if (self->extract_path)
+    json_dot_notation_free(self->extract_path);
   log_parser_free_method(s);
 }
 
@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "json-tokenizer.h"
+#include "misc.h"
+
+#include <string.h>
+
+/*
+ * Streaming JSON tokenizer
+ *
+ * Splits a JSON document into tokens without building any kind of tree,
+ * tokens point right into the input buffer.  The accepted syntax follows
+ * json-c's non-strict mode, which json-parser() used earlier: strings may
+ * be quoted by apostrophes, C and C++ style comments count as whitespace
+ * and the literals true, false and null are case insensitive.
+ */
+
+void
+json_tokenizer_init(JSONTokenizer *self, const gchar *input, gsize input_len)
+{
+  self->pos = input;
+  self->end = input + input_len;
+  self->error = NULL;
+}
+
+static inline gboolean
+_set_error(JSONTokenizer *self, const gchar *error)
+{
+  self->error = error;
+  return FALSE;
+}
+
+static gboolean
+_skip_whitespace(JSONTokenizer *self)
+{
+  const gchar *p = self->pos;
+
+  while (p < self->end)
+    {
+      if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        {
+          p++;
+        }
+      else if (*p == '/' && p + 1 < self->end && p[1] == '*')
+        {
+          for (p += 2; p + 1 < self->end && !(p[0] == '*' && p[1] == '/'); p++)
+            ;
+          if (p + 1 >= self->end)
+            return _set_error(self, "unterminated comment");
+          p += 2;
+        }
+      else if (*p == '/' && p + 1 < self->end && p[1] == '/')
+        {
+          while (p < self->end && *p != '\n')
+            p++;
+        }
+      else
+        {
+          break;
+        }
+    }
+  self->pos = p;
+  return TRUE;
+}
+
+static inline gboolean
+_is_digit(gchar c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static gboolean
+_scan_string(JSONTokenizer *self, JSONToken *token)
+{
+  const gchar quote = *self->pos;
+  const gchar *p = self->pos + 1;
+  gint i;
+
+  token->type = JT_STRING;
+  token->escaped = FALSE;
+  while ((p = find_first_of3(p, self->end - p, quote, '\\', quote)))
+    {
+      if (*p == quote)
+        {
+          token->len = p + 1 - token->start;
+          self->pos = p + 1;
+          return TRUE;
+        }
+
+      token->escaped = TRUE;
+      if (p + 1 >= self->end)
+        break;
+      switch (p[1])
+        {
+        case '"':
+        case '\'':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+          p += 2;
+          break;
+        case 'u':
+          if (self->end - p < 6)
+            return _set_error(self, "invalid unicode escape");
+          for (i = 2; i < 6; i++)
+            {
+              if (!g_ascii_isxdigit(p[i]))
+                return _set_error(self, "invalid unicode escape");
+            }
+          p += 6;
+          break;
+        default:
+          return _set_error(self, "invalid escape sequence");
+        }
+    }
+  return _set_error(self, "unterminated string");
+}
+
+static gboolean
+_scan_number(JSONTokenizer *self, JSONToken *token)
+{
+  const gchar *p = self->pos;
+
+  token->type = JT_NUMBER;
+  token->escaped = FALSE;
+  if (*p == '-')
+    p++;
+  if (p >= self->end || !_is_digit(*p))
+    return _set_error(self, "invalid number");
+  while (p < self->end && _is_digit(*p))
+    p++;
+  if (p < self->end && *p == '.')
+    {
+      token->escaped = TRUE;
+      p++;
+      while (p < self->end && _is_digit(*p))
+        p++;
+    }
+  if (p < self->end && (*p == 'e' || *p == 'E'))
+    {
+      token->escaped = TRUE;
+      p++;
+      if (p < self->end && (*p == '+' || *p == '-'))
+        p++;
+      if (p >= self->end || !_is_digit(*p))
+        return _set_error(self, "invalid number");
+      while (p < self->end && _is_digit(*p))
+        p++;
+    }
+  token->len = p - token->start;
+  self->pos = p;
+  return TRUE;
+}
+
+static gboolean
+_scan_literal(JSONTokenizer *self, JSONToken *token, const gchar *literal, JSONTokenType type)
+{
+  gsize len = strlen(literal);
+
+  if (self->end - self->pos < len || g_ascii_strncasecmp(self->pos, literal, len) != 0)
+    return _set_error(self, "unexpected character");
+  token->type = type;
+  token->len = len;
+  token->escaped = FALSE;
+  self->pos += len;
+  return TRUE;
+}
+
+gboolean
+json_tokenizer_next(JSONTokenizer *self, JSONToken *token)
+{
+  if (!_skip_whitespace(self))
+    return FALSE;
+  if (self->pos >= self->end)
+    return _set_error(self, "unexpected end of input");
+
+  token->start = self->pos;
+  switch (*self->pos)
+    {
+    case '{':
+      token->type = JT_BEGIN_OBJECT;
+      break;
+    case '}':
+      token->type = JT_END_OBJECT;
+      break;
+    case '[':
+      token->type = JT_BEGIN_ARRAY;
+      break;
+    case ']':
+      token->type = JT_END_ARRAY;
+      break;
+    case ':':
+      token->type = JT_COLON;
+      break;
+    case ',':
+      token->type = JT_COMMA;
+      break;
+    case '"':
+    case '\'':
+      return _scan_string(self, token);
+    case '-':
+      return _scan_number(self, token);
+    case 't':
+    case 'T':
+      return _scan_literal(self, token, "true", JT_TRUE);
+    case 'f':
+    case 'F':
+      return _scan_literal(self, token, "false", JT_FALSE);
+    case 'n':
+    case 'N':
+      return _scan_literal(self, token, "null", JT_NULL);
+    default:
+      if (_is_digit(*self->pos))
+        return _scan_number(self, token);
+      return _set_error(self, "unexpected character");
+    }
+  token->len = 1;
+  token->escaped = FALSE;
+  self->pos++;
+  return TRUE;
+}
+
+static gboolean
+_expect(JSONTokenizer *self, JSONTokenType type)
+{
+  JSONToken token;
+
+  if (!json_tokenizer_next(self, &token))
+    return FALSE;
+  if (token.type != type)
+    return _set_error(self, "unexpected token");
+  return TRUE;
+}
+
+static inline gboolean
+_is_value_start(JSONTokenType type)
+{
+  return type != JT_END_OBJECT && type != JT_END_ARRAY && type != JT_COLON && type != JT_COMMA;
+}
+
+/*
+ * Reads the @index-th member of the object whose opening brace has already
+ * been consumed.  At the end of the object @value is set to JT_END_OBJECT.
+ */
+gboolean
+json_tokenizer_next_member(JSONTokenizer *self, gint index, JSONToken *name, JSONToken *value)
+{
+  if (!json_tokenizer_next(self, name))
+    return FALSE;
+
+  if (index > 0)
+    {
+      if (name->type == JT_END_OBJECT)
+        {
+          value->type = JT_END_OBJECT;
+          return TRUE;
+        }
+      if (name->type != JT_COMMA)
+        return _set_error(self, "',' or '}' expected");
+      if (!json_tokenizer_next(self, name))
+        return FALSE;
+    }
+  else if (name->type == JT_END_OBJECT)
+    {
+      value->type = JT_END_OBJECT;
+      return TRUE;
+    }
+
+  if (name->type != JT_STRING)
+    return _set_error(self, "object member name expected");
+  if (!_expect(self, JT_COLON) ||
+      !json_tokenizer_next(self, value))
+    return FALSE;
+  if (!_is_value_start(value->type))
+    return _set_error(self, "value expected");
+  return TRUE;
+}
+
+/*
+ * Reads the @index-th element of the array whose opening bracket has
+ * already been consumed.  At the end of the array @value is set to
+ * JT_END_ARRAY.
+ */
+gboolean
+json_tokenizer_next_element(JSONTokenizer *self, gint index, JSONToken *value)
+{
+  if (!json_tokenizer_next(self, value))
+    return FALSE;
+
+  if (value->type == JT_END_ARRAY)
+    return TRUE;
+  if (index > 0)
+    {
+      if (value->type != JT_COMMA)
+        return _set_error(self, "',' or ']' expected");
+      if (!json_tokenizer_next(self, value))
+        return FALSE;
+    }
+  if (!_is_value_start(value->type))
+    return _set_error(self, "value expected");
+  return TRUE;
+}
+
+static gboolean
+_skip_object(JSONTokenizer *self, gint depth)
+{
+  JSONToken name, value;
+  gint i;
+
+  for (i = 0; json_tokenizer_next_member(self, i, &name, &value); i++)
+    {
+      if (value.type == JT_END_OBJECT)
+        return TRUE;
+      if (!json_tokenizer_skip_value(self, &value, depth + 1))
+        return FALSE;
+    }
+  return FALSE;
+}
+
+static gboolean
+_skip_array(JSONTokenizer *self, gint depth)
+{
+  JSONToken value;
+  gint i;
+
+  for (i = 0; json_tokenizer_next_element(self, i, &value); i++)
+    {
+      if (value.type == JT_END_ARRAY)
+        return TRUE;
+      if (!json_tokenizer_skip_value(self, &value, depth + 1))
+        return FALSE;
+    }
+  return FALSE;
+}
+
+/*
+ * Skips the value starting with @first while checking its syntax, @depth is
+ * the nesting level of the value itself.
+ */
+gboolean
+json_tokenizer_skip_value(JSONTokenizer *self, const JSONToken *first, gint depth)
+{
+  switch (first->type)
+    {
+    case JT_STRING:
+    case JT_NUMBER:
+    case JT_TRUE:
+    case JT_FALSE:
+    case JT_NULL:
+      return TRUE;
+    case JT_BEGIN_OBJECT:
+      return json_tokenizer_enter(self, depth) && _skip_object(self, depth);
+    case JT_BEGIN_ARRAY:
+      return json_tokenizer_enter(self, depth) && _skip_array(self, depth);
+    default:
+      return _set_error(self, "value expected");
+    }
+}
+
+gboolean
+json_tokenizer_enter(JSONTokenizer *self, gint depth)
+{
+  if (depth >= JSON_TOKENIZER_MAX_DEPTH)
+    return _set_error(self, "nesting too deep");
+  return TRUE;
+}
+
+static gunichar
+_decode_hex4(const gchar *p)
+{
+  gunichar c = 0;
+  gint i;
+
+  for (i = 0; i < 4; i++)
+    c = (c << 4) + g_ascii_xdigit_value(p[i]);
+  return c;
+}
+
+/*
+ * Appends the unescaped contents of a string token to @result.  The token
+ * must have been returned by json_tokenizer_next(), so its escape
+ * sequences are known to be valid.  Just like json-c strings, the value
+ * is cut at an escaped NUL character.
+ */
+void
+json_token_append_string(const JSONToken *token, GString *result)
+{
+  const gchar *p, *end, *bs;
+  gsize len;
+  gunichar c, low;
+  gchar utf8[6];
+
+  p = json_token_get_string(token, &len);
+  end = p + len;
+  if (!token->escaped)
+    {
+      g_string_append_len(result, p, len);
+      return;
+    }
+
+  while ((bs = memchr(p, '\\', end - p)))
+    {
+      g_string_append_len(result, p, bs - p);
+      p = bs + 2;
+      switch (bs[1])
+        {
+        case 'b':
+          g_string_append_c(result, '\b');
+          break;
+        case 'f':
+          g_string_append_c(result, '\f');
+          break;
+        case 'n':
+          g_string_append_c(result, '\n');
+          break;
+        case 'r':
+          g_string_append_c(result, '\r');
+          break;
+        case 't':
+          g_string_append_c(result, '\t');
+          break;
+        case 'u':
+          c = _decode_hex4(p);
+          p += 4;
+          if (c == 0)
+            return;
+          if (c >= 0xD800 && c < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+            {
+              low = _decode_hex4(p + 2);
+              if (low >= 0xDC00 && low < 0xE000)
+                {
+                  c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                  p += 6;
+                }
+            }
+          g_string_append_len(result, utf8, g_unichar_to_utf8(c, utf8));
+          break;
+        default:
+          g_string_append_c(result, bs[1]);
+          break;
+        }
+    }
+  g_string_append_len(result, p, end - p);
+}
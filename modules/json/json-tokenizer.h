@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015 BalaBit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef JSON_TOKENIZER_H_INCLUDED
+#define JSON_TOKENIZER_H_INCLUDED 1
+
+#include "syslog-ng.h"
+
+/* same as json-c's default, deeper documents are rejected */
+#define JSON_TOKENIZER_MAX_DEPTH 32
+
+typedef enum
+{
+  JT_BEGIN_OBJECT,
+  JT_END_OBJECT,
+  JT_BEGIN_ARRAY,
+  JT_END_ARRAY,
+  JT_COLON,
+  JT_COMMA,
+  JT_STRING,
+  JT_NUMBER,
+  JT_TRUE,
+  JT_FALSE,
+  JT_NULL,
+} JSONTokenType;
+
+typedef struct _JSONToken
+{
+  JSONTokenType type;
+  /* the token as it appears in the input, strings include their quotes */
+  const gchar *start;
+  gsize len;
+  /* strings: contains backslash escapes, numbers: has a fraction or an exponent */
+  gboolean escaped;
+} JSONToken;
+
+typedef struct _JSONTokenizer
+{
+  const gchar *pos;
+  const gchar *end;
+  const gchar *error;
+} JSONTokenizer;
+
+void json_tokenizer_init(JSONTokenizer *self, const gchar *input, gsize input_len);
+gboolean json_tokenizer_next(JSONTokenizer *self, JSONToken *token);
+gboolean json_tokenizer_next_member(JSONTokenizer *self, gint index, JSONToken *name, JSONToken *value);
+gboolean json_tokenizer_next_element(JSONTokenizer *self, gint index, JSONToken *value);
+gboolean json_tokenizer_enter(JSONTokenizer *self, gint depth);
+gboolean json_tokenizer_skip_value(JSONTokenizer *self, const JSONToken *first, gint depth);
+
+void json_token_append_string(const JSONToken *token, GString *result);
+
+static inline const gchar *
+json_token_get_string(const JSONToken *token, gsize *len)
+{
+  *len = token->len - 2;
+  return token->start + 1;
+}
+
+#endif
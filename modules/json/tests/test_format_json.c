@@ -25,6 +25,9 @@
 #include "plugin.h"
 #include "cfg.h"
 
+/* kept small, so that it doesn't slow down the test suite */
+#define PERF_ITERATIONS 10000
+
 void
 test_format_json(void)
 {
@@ -115,6 +118,35 @@ test_format_json_on_error(void)
 
 }
 
+static void
+_benchmark_format_json(const gchar *template)
+{
+  LogMessage *msg = create_sample_message();
+  LogTemplate *templ = compile_template(template, FALSE);
+  GString *result = g_string_sized_new(1024);
+  gint i;
+
+  start_stopwatch();
+  for (i = 0; i < PERF_ITERATIONS; i++)
+    {
+      g_string_truncate(result, 0);
+      log_template_format(templ, msg, NULL, LTZ_LOCAL, 999, NULL, result);
+    }
+  stop_stopwatch_and_display_result("Formatting %d messages, template='%s'", PERF_ITERATIONS, template);
+
+  g_string_free(result, TRUE);
+  log_template_unref(templ);
+  log_msg_unref(msg);
+}
+
+void
+test_format_json_performance(void)
+{
+  _benchmark_format_json("$(format-json --scope rfc3164)");
+  _benchmark_format_json("$(format-json --scope rfc3164 --scope nv-pairs)");
+  _benchmark_format_json("$(format-json MSG=$escaping)");
+}
+
 int
 main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
 {
@@ -129,6 +161,7 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   test_format_json_rekey();
   test_format_json_with_type_hints();
   test_format_json_on_error();
+  test_format_json_performance();
 
   deinit_template_tests();
   app_shutdown();
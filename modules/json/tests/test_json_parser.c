@@ -78,6 +78,26 @@ parse_json_into_log_message(const gchar *json)
   return msg;
 }
 
+static LogMessage *
+parse_json_message_into_log_message(const gchar *json)
+{
+  LogMessage *msg;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogParser *cloned_parser;
+  const gchar *input;
+  gssize input_len;
+  gboolean success;
+
+  cloned_parser = (LogParser *) log_pipe_clone(&json_parser->super);
+  msg = log_msg_new_empty();
+  log_msg_set_value(msg, LM_V_MESSAGE, json, -1);
+  input = log_msg_get_value(msg, LM_V_MESSAGE, &input_len);
+  success = log_parser_process(cloned_parser, &msg, &path_options, input, input_len);
+  log_pipe_unref(&cloned_parser->super);
+  assert_true(success, "expected json-parser success and it returned failure, json=%s", json);
+  return msg;
+}
+
 static void
 assert_json_parser_fails(const gchar *json)
 {
@@ -168,6 +188,75 @@ test_json_parser_extracts_subobjects_if_extract_prefix_is_specified(void)
   assert_log_message_value(msg, log_msg_get_value_handle("foo"), "bar");
 }
 
+static void
+test_json_parser_unescapes_strings(void)
+{
+  LogMessage *msg;
+
+  msg = parse_json_into_log_message("{\"esc\": \"a\\\"b\\\\c\\td\\u00e9\", \"k\\u0065y\": \"value\"}");
+  assert_log_message_value(msg, log_msg_get_value_handle("esc"), "a\"b\\c\td\xc3\xa9");
+  assert_log_message_value(msg, log_msg_get_value_handle("key"), "value");
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_processes_nested_arrays_and_objects(void)
+{
+  LogMessage *msg;
+
+  msg = parse_json_into_log_message("{'array': [[1, 2], [{'foo': 'bar'}]], 'object': {'empty': {}, 'list': []}}");
+  assert_log_message_value(msg, log_msg_get_value_handle("array[0][0]"), "1");
+  assert_log_message_value(msg, log_msg_get_value_handle("array[0][1]"), "2");
+  assert_log_message_value(msg, log_msg_get_value_handle("array[1][0].foo"), "bar");
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_references_values_in_message(void)
+{
+  LogMessage *msg;
+
+  json_parser_set_marker(json_parser, "@cee:");
+  msg = parse_json_message_into_log_message("@cee: {'foo': 'bar', 'int': 123, 'MESSAGE': 'overwritten', 'escaped': 'a\\nb', 'after': 'baz'}");
+  assert_log_message_value(msg, log_msg_get_value_handle("foo"), "bar");
+  assert_log_message_value(msg, log_msg_get_value_handle("int"), "123");
+  assert_log_message_value(msg, LM_V_MESSAGE, "overwritten");
+  assert_log_message_value(msg, log_msg_get_value_handle("escaped"), "a\nb");
+  assert_log_message_value(msg, log_msg_get_value_handle("after"), "baz");
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_fails_for_syntax_errors_anywhere_in_the_input(void)
+{
+  assert_json_parser_fails("{'foo': 'bar'");
+  assert_json_parser_fails("{'foo': 'bar',}");
+  assert_json_parser_fails("{'foo': [1, 2,]}");
+  assert_json_parser_fails("{'foo': 'bar\\x'}");
+  assert_json_parser_fails("{'foo': [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]}");
+}
+
+static void
+test_json_parser_extracts_members_by_dot_notation(void)
+{
+  LogMessage *msg;
+
+  json_parser_set_extract_prefix(json_parser, "foo.bar[1]");
+  msg = parse_json_into_log_message("{'skipped': {'bar': [{'a': 'b'}]}, 'foo': {'bar': [{'c': 'd'}, {'e': 'f'}]}}");
+  assert_log_message_value(msg, log_msg_get_value_handle("e"), "f");
+  assert_log_message_value(msg, log_msg_get_value_handle("a"), NULL);
+  assert_log_message_value(msg, log_msg_get_value_handle("c"), NULL);
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_fails_when_extract_prefix_does_not_select_an_object(void)
+{
+  json_parser_set_extract_prefix(json_parser, "foo.bar[5]");
+  assert_json_parser_fails("{'foo': {'bar': [{'c': 'd'}, {'e': 'f'}]}}");
+  assert_json_parser_fails("{'foo': {'bar': [{'c': 'd'}, {'e': 'f'}]}, 'foo': 'overridden'}");
+}
+
 static void
 test_json_parser(void)
 {
@@ -179,6 +268,12 @@ test_json_parser(void)
   JSON_PARSER_TESTCASE(test_json_parser_validate_type_representation);
   JSON_PARSER_TESTCASE(test_json_parser_fails_for_non_object_top_element);
   JSON_PARSER_TESTCASE(test_json_parser_extracts_subobjects_if_extract_prefix_is_specified);
+  JSON_PARSER_TESTCASE(test_json_parser_unescapes_strings);
+  JSON_PARSER_TESTCASE(test_json_parser_processes_nested_arrays_and_objects);
+  JSON_PARSER_TESTCASE(test_json_parser_references_values_in_message);
+  JSON_PARSER_TESTCASE(test_json_parser_fails_for_syntax_errors_anywhere_in_the_input);
+  JSON_PARSER_TESTCASE(test_json_parser_extracts_members_by_dot_notation);
+  JSON_PARSER_TESTCASE(test_json_parser_fails_when_extract_prefix_does_not_select_an_object);
 }
 
 int
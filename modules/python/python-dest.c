@@ -35,6 +35,12 @@
 #define SCS_PYTHON 0
 #endif
 
+typedef struct
+{
+  LogMessage *msg;
+  gint32 seq_num;
+} PythonDestBatchItem;
+
 typedef struct
 {
   LogThrDestDriver super;
@@ -46,12 +52,16 @@ typedef struct
   GHashTable *options;
   ValuePairs *vp;
 
+  /* messages waiting for send_batch(), only used by the worker thread */
+  GArray *batch;
+
   struct
   {
     PyObject *class;
     PyObject *instance;
     PyObject *is_opened;
     PyObject *send;
+    PyObject *send_batch;
   } py;
 } PythonDestDriver;
 
@@ -277,6 +287,12 @@ _py_invoke_send(PythonDestDriver *self, PyObject *dict)
   return _py_invoke_bool_function(self, self->py.send, dict);
 }
 
+static gboolean
+_py_invoke_send_batch(PythonDestDriver *self, PyObject *list)
+{
+  return _py_invoke_bool_function(self, self->py.send_batch, list);
+}
+
 static gboolean
 _py_invoke_init(PythonDestDriver *self)
 {
@@ -322,14 +338,16 @@ _py_init_bindings(PythonDestDriver *self)
   /* these are fast paths, store references to be faster */
   self->py.is_opened = _py_get_attr_or_null(self->py.instance, "is_opened");
   self->py.send = _py_get_attr_or_null(self->py.instance, "send");
-  if (!self->py.send)
+  self->py.send_batch = _py_get_attr_or_null(self->py.instance, "send_batch");
+  if (!self->py.send && !self->py.send_batch)
     {
-      msg_error("Error initializing Python destination, class does not have a send() method",
+      msg_error("Error initializing Python destination, class does not have a send() or send_batch() method",
                 evt_tag_str("driver", self->super.super.super.id),
                 evt_tag_str("class", self->class),
                 NULL);
+      return FALSE;
     }
-  return self->py.send != NULL;
+  return TRUE;
 }
 
 static void
@@ -339,6 +357,7 @@ _py_free_bindings(PythonDestDriver *self)
   Py_CLEAR(self->py.instance);
   Py_CLEAR(self->py.is_opened);
   Py_CLEAR(self->py.send);
+  Py_CLEAR(self->py.send_batch);
 }
 
 static gboolean
@@ -355,33 +374,173 @@ _py_init_object(PythonDestDriver *self)
   return TRUE;
 }
 
+/* NOTE: the GIL must be held, returns NULL if value-pairs failed to format the message */
+static PyObject *
+_py_create_msg_object(PythonDestDriver *self, LogMessage *msg, gint32 seq_num)
+{
+  PyObject *msg_object;
+
+  if (!self->vp)
+    return py_log_message_new(msg, TRUE);
+
+  if (!py_value_pairs_apply(self->vp, &self->template_options, seq_num, msg, &msg_object))
+    return NULL;
+  return msg_object;
+}
+
+static void
+_clear_batch(PythonDestDriver *self)
+{
+  guint i;
+
+  for (i = 0; i < self->batch->len; i++)
+    log_msg_unref(g_array_index(self->batch, PythonDestBatchItem, i).msg);
+  g_array_set_size(self->batch, 0);
+}
+
+/* logs the pending Python exception, if there is one; value-pairs failures
+ * don't raise any */
+static void
+_py_log_message_object_error(PythonDestDriver *self)
+{
+  gchar buf[256];
+
+  if (PyErr_Occurred())
+    {
+      msg_error("Error converting message to a Python object, dropping message",
+                evt_tag_str("driver", self->super.super.super.id),
+                evt_tag_str("class", self->class),
+                evt_tag_str("exception", _py_format_exception_text(buf, sizeof(buf))),
+                NULL);
+    }
+  else
+    {
+      msg_error("Error formatting message with value-pairs, dropping message",
+                evt_tag_str("driver", self->super.super.super.id),
+                evt_tag_str("class", self->class),
+                NULL);
+    }
+}
+
+/* messages that fail to convert are dropped on their own, returns NULL
+ * with the Python error already reported if the list itself could not be
+ * built, in which case the whole batch is retried */
+static PyObject *
+_py_create_batch_list(PythonDestDriver *self)
+{
+  PyObject *list, *msg_object;
+  gchar buf[256];
+  guint i;
+
+  list = PyList_New(0);
+  if (!list)
+    goto error;
+
+  for (i = 0; i < self->batch->len; i++)
+    {
+      PythonDestBatchItem *item = &g_array_index(self->batch, PythonDestBatchItem, i);
+
+      msg_object = _py_create_msg_object(self, item->msg, item->seq_num);
+      if (!msg_object)
+        {
+          _py_log_message_object_error(self);
+          continue;
+        }
+
+      if (PyList_Append(list, msg_object) < 0)
+        {
+          Py_DECREF(msg_object);
+          goto error;
+        }
+      Py_DECREF(msg_object);
+    }
+  return list;
+
+ error:
+  msg_error("Error building the message list for Python send_batch()",
+            evt_tag_str("driver", self->super.super.super.id),
+            evt_tag_str("class", self->class),
+            evt_tag_int("batch_size", self->batch->len),
+            evt_tag_str("exception", PyErr_Occurred() ? _py_format_exception_text(buf, sizeof(buf)) : "None"),
+            NULL);
+  Py_XDECREF(list);
+  return NULL;
+}
+
+/*
+ * send_batch() mode: messages are collected without touching the Python
+ * interpreter, then passed to send_batch() as a single list, acquiring the
+ * GIL once per batch.
+ */
 static worker_insert_result_t
-python_dd_insert(LogThrDestDriver *d, LogMessage *msg)
+python_dd_flush(LogThrDestDriver *d)
 {
   PythonDestDriver *self = (PythonDestDriver *)d;
   worker_insert_result_t result = WORKER_INSERT_RESULT_ERROR;
-  gboolean success;
-  PyObject *msg_object;
+  PyObject *list;
   PyGILState_STATE gstate;
 
+  if (self->batch->len == 0)
+    return WORKER_INSERT_RESULT_SUCCESS;
+
   gstate = PyGILState_Ensure();
   if (!_py_invoke_is_opened(self))
     {
       result = WORKER_INSERT_RESULT_NOT_CONNECTED;
       goto exit;
     }
-  if (self->vp)
+
+  list = _py_create_batch_list(self);
+  if (!list)
+    goto exit;
+
+  if (PyList_Size(list) == 0 || _py_invoke_send_batch(self, list))
     {
-      success = py_value_pairs_apply(self->vp, &self->template_options, self->super.seq_num, msg, &msg_object);
-      if (!success && (self->template_options.on_error & ON_ERROR_DROP_MESSAGE))
-        {
-          goto exit;
-        }
+      result = WORKER_INSERT_RESULT_SUCCESS;
     }
   else
     {
-      msg_object = py_log_message_new(msg);
+      msg_error("Python send_batch() method returned failure, suspending destination for time_reopen()",
+                evt_tag_str("driver", self->super.super.super.id),
+                evt_tag_str("class", self->class),
+                evt_tag_int("batch_size", self->batch->len),
+                evt_tag_int("time_reopen", self->super.time_reopen),
+                NULL);
+    }
+  Py_DECREF(list);
+
+ exit:
+  PyGILState_Release(gstate);
+  _clear_batch(self);
+  return result;
+}
+
+static worker_insert_result_t
+python_dd_insert(LogThrDestDriver *d, LogMessage *msg)
+{
+  PythonDestDriver *self = (PythonDestDriver *)d;
+  worker_insert_result_t result = WORKER_INSERT_RESULT_ERROR;
+  gboolean success;
+  PyObject *msg_object;
+  PyGILState_STATE gstate;
+
+  if (self->py.send_batch)
+    {
+      PythonDestBatchItem item = { log_msg_ref(msg), self->super.seq_num };
+
+      g_array_append_val(self->batch, item);
+      return WORKER_INSERT_RESULT_QUEUED;
+    }
+
+  gstate = PyGILState_Ensure();
+  if (!_py_invoke_is_opened(self))
+    {
+      result = WORKER_INSERT_RESULT_NOT_CONNECTED;
+      goto exit;
     }
+  msg_object = _py_create_msg_object(self, msg, self->super.seq_num);
+  if (!msg_object)
+    goto exit;
 
   success = _py_invoke_send(self, msg_object);
   if (success)
@@ -447,6 +606,8 @@ python_dd_disconnect(LogThrDestDriver *d)
 {
   PythonDestDriver *self = (PythonDestDriver *) d;
 
+  /* unsent messages are rewound by LogThrDestDriver */
+  _clear_batch(self);
   python_dd_close(self);
 }
 
@@ -519,6 +680,9 @@ python_dd_free(LogPipe *d)
 
   g_free(self->class);
 
+  _clear_batch(self);
+  g_array_free(self->batch, TRUE);
+
   if (self->vp)
     value_pairs_free(self->vp);
 
@@ -544,12 +708,14 @@ python_dd_new(GlobalConfig *cfg)
   self->super.worker.thread_deinit = python_dd_worker_deinit;
   self->super.worker.disconnect = python_dd_disconnect;
   self->super.worker.insert = python_dd_insert;
+  self->super.worker.flush = python_dd_flush;
 
   self->super.format.stats_instance = python_dd_format_stats_instance;
   self->super.format.persist_name = python_dd_format_persist_name;
   self->super.stats_source = SCS_PYTHON;
 
   self->options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->batch = g_array_new(FALSE, FALSE, sizeof(PythonDestBatchItem));
 
   return (LogDriver *)self;
 }
@@ -28,26 +28,247 @@ typedef struct _PyLogMessage
 {
   PyObject_HEAD
   LogMessage *msg;
+  gboolean zero_copy;
 } PyLogMessage;
 
+/* exports a single value of a LogMessage through the buffer protocol */
+typedef struct _PyLogMessageValue
+{
+  PyObject_HEAD
+  /* pins the payload the value points into; the message is not modified
+   * in place while a zero_copy view is alive, so no payload reference is
+   * taken: NVTable refs are not atomic and belong to the owning thread */
+  LogMessage *msg;
+  const gchar *value;
+  gssize value_len;
+} PyLogMessageValue;
+
 static PyTypeObject py_log_message_type;
+static PyTypeObject py_log_message_value_type;
+
+/* name -> NVHandle cache, protected by the GIL */
+static PyObject *py_log_message_handles;
+
+/*
+ * LogMessage objects are lazy: values are only looked up and converted to
+ * Python strings when accessed, either as attributes (msg.MESSAGE) or by
+ * subscripting, which also works for names that are not valid Python
+ * identifiers (msg['.SDATA.meta.sequenceId']).
+ *
+ * Handles of existing names are cached in a dict keyed by the (usually
+ * interned) name object.  Names are never registered from Python: a name
+ * that is not known to the NVRegistry can't have a value in any message.
+ * Attributes of the Python object itself (e.g. methods) take precedence
+ * over name-value pairs.
+ *
+ * get_view(name) returns a read-only memoryview of a value.  For zero_copy
+ * instances, the view points directly into the payload of the message and
+ * holds a reference to the message until the view is released, which keeps
+ * the payload alive as such messages are not modified in place.  Values
+ * that don't live in the payload (e.g. macros) and values of other
+ * instances, whose messages may be changed by the log path, are copied.
+ */
+static const gchar *
+py_log_message_name_as_string(PyObject *name)
+{
+#if PY_MAJOR_VERSION >= 3
+  if (PyUnicode_Check(name))
+    return PyUnicode_AsUTF8(name);
+#endif
+  return PyBytes_AsString(name);
+}
+
+/* returns 0 with a KeyError set if the name is unknown, or with another
+ * Python exception set if the name is invalid */
+static NVHandle
+py_log_message_lookup_handle(PyObject *name)
+{
+  PyObject *cached, *handle_object;
+  const gchar *name_str;
+  NVHandle handle;
+
+  cached = PyDict_GetItem(py_log_message_handles, name);
+  if (cached)
+    return (NVHandle) PyLong_AsLong(cached);
+
+  name_str = py_log_message_name_as_string(name);
+  if (!name_str)
+    return 0;
+
+  handle = nv_registry_get_handle(logmsg_registry, name_str);
+  if (!handle)
+    {
+      PyErr_SetObject(PyExc_KeyError, name);
+      return 0;
+    }
+
+  handle_object = PyLong_FromLong(handle);
+  if (handle_object)
+    {
+      PyDict_SetItem(py_log_message_handles, name, handle_object);
+      Py_DECREF(handle_object);
+    }
+  return handle;
+}
+
+static PyObject *
+py_log_message_get_value(PyLogMessage *self, NVHandle handle)
+{
+  const gchar *value;
+  gssize value_len;
+
+  value = log_msg_get_value(self->msg, handle, &value_len);
+  if (!value)
+    return NULL;
+  return PyBytes_FromStringAndSize(value, value_len);
+}
+
+static PyObject *
+py_log_message_getattro(PyLogMessage *self, PyObject *name)
+{
+  PyObject *value, *exc, *exc_value, *exc_tb;
+  NVHandle handle;
+
+  value = PyObject_GenericGetAttr((PyObject *) self, name);
+  if (value || !PyErr_ExceptionMatches(PyExc_AttributeError))
+    return value;
+
+  /* not an attribute of the object, try the name-value pairs, keeping
+   * the original AttributeError in case there's no such name either */
+  PyErr_Fetch(&exc, &exc_value, &exc_tb);
+  handle = py_log_message_lookup_handle(name);
+  if (!handle)
+    {
+      PyErr_Clear();
+      PyErr_Restore(exc, exc_value, exc_tb);
+      return NULL;
+    }
+  Py_XDECREF(exc);
+  Py_XDECREF(exc_value);
+  Py_XDECREF(exc_tb);
+
+  value = py_log_message_get_value(self, handle);
+  if (!value && !PyErr_Occurred())
+    PyErr_SetObject(PyExc_AttributeError, name);
+  return value;
+}
+
+static PyObject *
+py_log_message_subscript(PyLogMessage *self, PyObject *key)
+{
+  NVHandle handle;
+  PyObject *value;
+
+  handle = py_log_message_lookup_handle(key);
+  if (!handle)
+    return NULL;
+
+  value = py_log_message_get_value(self, handle);
+  if (!value && !PyErr_Occurred())
+    PyErr_SetObject(PyExc_KeyError, key);
+  return value;
+}
+
+static gboolean
+py_log_message_value_is_in_payload(LogMessage *msg, const gchar *value, gssize value_len)
+{
+  const gchar *payload_start = (const gchar *) msg->payload;
+  const gchar *payload_end = payload_start + msg->payload->size;
+
+  return value >= payload_start && value + value_len <= payload_end;
+}
 
 static PyObject *
-py_log_message_getattr(PyLogMessage *self, gchar *name)
+py_log_message_get_view(PyLogMessage *self, PyObject *args)
 {
+  PyObject *name, *exporter, *view;
   NVHandle handle;
   const gchar *value;
+  gssize value_len;
+
+  if (!PyArg_ParseTuple(args, "O", &name))
+    return NULL;
 
-  handle = log_msg_get_value_handle(name);
-  value = log_msg_get_value(self->msg, handle, NULL);
+  handle = py_log_message_lookup_handle(name);
+  if (!handle)
+    return NULL;
+
+  value = log_msg_get_value(self->msg, handle, &value_len);
   if (!value)
     {
-      PyErr_SetString(PyExc_AttributeError, "No such attribute");
+      PyErr_SetObject(PyExc_KeyError, name);
       return NULL;
     }
-  return PyBytes_FromString(value);
+
+  if (self->zero_copy && py_log_message_value_is_in_payload(self->msg, value, value_len))
+    {
+      PyLogMessageValue *v = PyObject_New(PyLogMessageValue, &py_log_message_value_type);
+
+      if (!v)
+        return NULL;
+      v->msg = log_msg_ref(self->msg);
+      v->value = value;
+      v->value_len = value_len;
+      exporter = (PyObject *) v;
+    }
+  else
+    {
+      exporter = PyBytes_FromStringAndSize(value, value_len);
+      if (!exporter)
+        return NULL;
+    }
+
+  view = PyMemoryView_FromObject(exporter);
+  Py_DECREF(exporter);
+  return view;
+}
+
+static PyMappingMethods py_log_message_mapping =
+{
+  .mp_subscript = (binaryfunc) py_log_message_subscript,
+};
+
+static PyMethodDef py_log_message_methods[] =
+{
+  { "get_view", (PyCFunction) py_log_message_get_view, METH_VARARGS, "Return a read-only memoryview of a name-value pair" },
+  { NULL,       NULL, 0, NULL }   /* sentinel*/
+};
+
+static int
+py_log_message_value_getbuffer(PyLogMessageValue *self, Py_buffer *view, int flags)
+{
+  return PyBuffer_FillInfo(view, (PyObject *) self, (void *) self->value, self->value_len, TRUE, flags);
 }
 
+static void
+py_log_message_value_free(PyLogMessageValue *self)
+{
+  log_msg_unref(self->msg);
+  PyObject_Del(self);
+}
+
+static PyBufferProcs py_log_message_value_buffer =
+{
+  .bf_getbuffer = (getbufferproc) py_log_message_value_getbuffer,
+};
+
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+#define PY_LOG_MESSAGE_VALUE_FLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER)
+#else
+#define PY_LOG_MESSAGE_VALUE_FLAGS (Py_TPFLAGS_DEFAULT)
+#endif
+
+static PyTypeObject py_log_message_value_type =
+{
+  PyObject_HEAD_INIT(&PyType_Type)
+  .tp_name = "LogMessageValue",
+  .tp_basicsize = sizeof(PyLogMessageValue),
+  .tp_dealloc = (destructor) py_log_message_value_free,
+  .tp_as_buffer = &py_log_message_value_buffer,
+  .tp_flags = PY_LOG_MESSAGE_VALUE_FLAGS,
+  .tp_doc = "A single value of a syslog-ng log message, exported without copying",
+};
+
 static void
 py_log_message_free(PyLogMessage *self)
 {
@@ -55,8 +276,13 @@ py_log_message_free(PyLogMessage *self)
   PyObject_Del(self);
 }
 
+/*
+ * @zero_copy: views returned by get_view() may point into the payload of
+ * @msg, used for messages that are not modified in place while the Python
+ * object is alive (e.g. they were taken off a LogQueue).
+ */
 PyObject *
-py_log_message_new(LogMessage *msg)
+py_log_message_new(LogMessage *msg, gboolean zero_copy)
 {
   PyLogMessage *self;
 
@@ -65,6 +291,7 @@ py_log_message_new(LogMessage *msg)
     return NULL;
 
   self->msg = log_msg_ref(msg);
+  self->zero_copy = zero_copy;
   return (PyObject *) self;
 }
 
@@ -74,15 +301,20 @@ static PyTypeObject py_log_message_type =
   .tp_name = "LogMessage",
   .tp_basicsize = sizeof(PyLogMessage),
   .tp_dealloc = (destructor) py_log_message_free,
-  .tp_getattr = (getattrfunc) py_log_message_getattr,
+  .tp_getattro = (getattrofunc) py_log_message_getattro,
+  .tp_as_mapping = &py_log_message_mapping,
   .tp_setattr = (setattrfunc) NULL,
   .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
   .tp_doc = "LogMessage class encapsulating a syslog-ng log message",
   .tp_new = PyType_GenericNew,
+  .tp_methods = py_log_message_methods,
 };
 
 void
 python_log_message_init(void)
 {
   PyType_Ready(&py_log_message_type);
+  PyType_Ready(&py_log_message_value_type);
+  if (!py_log_message_handles)
+    py_log_message_handles = PyDict_New();
 }
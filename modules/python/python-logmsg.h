@@ -27,7 +27,7 @@
 
 #include "python-module.h"
 
-PyObject *py_log_message_new(LogMessage *msg);
+PyObject *py_log_message_new(LogMessage *msg, gboolean zero_copy);
 void python_log_message_init(void);
 
 #endif
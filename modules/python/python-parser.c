@@ -34,6 +34,7 @@ static CfgLexerKeyword python_keywords[] = {
   { "class",                    KW_CLASS   },
   { "imports",                  KW_IMPORTS },
   { "options",                  KW_OPTIONS },
+  { "batch_lines",              KW_BATCH_LINES },
   { NULL }
 };
 
@@ -36,10 +36,13 @@ _py_construct_args_tuple(LogMessage *msg, gint argc, GString *argv[])
   gint i;
 
   args = PyTuple_New(1 + argc - 1);
-  PyTuple_SetItem(args, 0, py_log_message_new(msg));
+  /* the message is not necessarily write protected here and argv[] is
+   * reused by the template engine, so neither can be exported without
+   * copying */
+  PyTuple_SetItem(args, 0, py_log_message_new(msg, FALSE));
   for (i = 1; i < argc; i++)
     {
-      PyTuple_SetItem(args, i, PyBytes_FromString(argv[i]->str));
+      PyTuple_SetItem(args, i, PyBytes_FromStringAndSize(argv[i]->str, argv[i]->len));
     }
   return args;
 }
@@ -24,11 +24,32 @@ class LogDestination(object):
         """Send a message to the target service
 
         It should return True to indicate success, False will suspend the
-        destination for a period specified by the time-reopen() option."""
+        destination for a period specified by the time-reopen() option.
+
+        Unless value-pairs() is used, msg is a LogMessage object, its values
+        are looked up on access (msg.MESSAGE or msg['.SDATA.meta.x']), and
+        msg.get_view(name) returns a memoryview of a value without copying
+        it."""
         pass
 
+    # def send_batch(self, msgs):
+    #     """Send a list of messages to the target service
+    #
+    #     Optional, if defined, it is used instead of send(). Messages are
+    #     collected while the destination queue has messages (or until
+    #     batch-lines() is reached) and passed in a single call, which saves
+    #     per-message interpreter overhead. The return value has the same
+    #     meaning as for send(), and applies to the whole batch."""
+
 
 class DummyPythonDest(LogDestination):
     def send(self, msg):
         print('queue', msg)
         return True
+
+
+class DummyPythonBatchDest(LogDestination):
+    def send_batch(self, msgs):
+        for msg in msgs:
+            print('queue', msg)
+        return True
@@ -38,6 +38,7 @@ static const char aix_fwd_string[] = "Message forwarded from ";
 static const char repeat_msg_string[] = "last message repeated";
 static NVHandle is_synced;
 static NVHandle cisco_seqid;
+static NVHandle raw_sdata;
 
 static gboolean
 log_msg_parse_pri(LogMessage *self, const guchar **data, gint *length, guint flags, guint16 default_pri)
@@ -416,6 +417,23 @@ __get_normalized_time(LogStamp const timestamp, gint const normalized_hour, gint
          - timestamp.zone_offset;
 }
 
+/* the same as the mktime() based conversion below, but without calling
+ * mktime() for each message, it fails for out of range values and for
+ * local times on days with a time zone transition */
+static inline gboolean
+__convert_wall_clock_to_utc(LogStamp *timestamp, const struct tm *tm, glong assume_timezone)
+{
+  glong zone_offset = timestamp->zone_offset != -1 ? timestamp->zone_offset : assume_timezone;
+  time_t tv_sec;
+
+  if (!cached_wall_clock_to_utc(tm, &zone_offset, &tv_sec))
+    return FALSE;
+
+  timestamp->tv_sec = tv_sec;
+  timestamp->zone_offset = zone_offset;
+  return TRUE;
+}
+
 /* FIXME: this function should really be exploded to a lot of smaller functions... (Bazsi) */
 static gboolean
 log_msg_parse_date(LogMessage *self, const guchar **data, gint *length, guint parse_flags, glong assume_timezone)
@@ -473,10 +491,13 @@ log_msg_parse_date(LogMessage *self, const guchar **data, gint *length, guint pa
         return FALSE;
     }
 
-  unnormalized_hour = tm.tm_hour;
-  self->timestamps[LM_TS_STAMP].tv_sec = cached_mktime(&tm);
-  __set_zone_offset(&(self->timestamps[LM_TS_STAMP]), assume_timezone);
-  self->timestamps[LM_TS_STAMP].tv_sec = __get_normalized_time(self->timestamps[LM_TS_STAMP], tm.tm_hour, unnormalized_hour);
+  if (!__convert_wall_clock_to_utc(&self->timestamps[LM_TS_STAMP], &tm, assume_timezone))
+    {
+      unnormalized_hour = tm.tm_hour;
+      self->timestamps[LM_TS_STAMP].tv_sec = cached_mktime(&tm);
+      __set_zone_offset(&(self->timestamps[LM_TS_STAMP]), assume_timezone);
+      self->timestamps[LM_TS_STAMP].tv_sec = __get_normalized_time(self->timestamps[LM_TS_STAMP], tm.tm_hour, unnormalized_hour);
+    }
 
   *data = src;
   *length = left;
@@ -516,6 +537,18 @@ log_msg_parse_version(LogMessage *self, const guchar **data, gint *length)
   return TRUE;
 }
 
+/* moves @data to the first of the delimiters, or to the end */
+static inline void
+__skip_until_delims(const guchar **data, gint *length, gchar d1, gchar d2, gchar d3)
+{
+  const guchar *delim = (const guchar *) find_first_of3((const gchar *) *data, *length, d1, d2, d3);
+
+  if (!delim)
+    delim = *data + *length;
+  *length -= delim - *data;
+  *data = delim;
+}
+
 static void
 log_msg_parse_legacy_program_name(LogMessage *self, const guchar **data, gint *length, guint flags)
 {
@@ -526,20 +559,12 @@ log_msg_parse_legacy_program_name(LogMessage *self, const guchar **data, gint *l
   src = *data;
   left = *length;
   prog_start = src;
-  while (left && *src != ' ' && *src != '[' && *src != ':')
-    {
-      src++;
-      left--;
-    }
+  __skip_until_delims(&src, &left, ' ', '[', ':');
   log_msg_set_value(self, LM_V_PROGRAM, (gchar *) prog_start, src - prog_start);
   if (left > 0 && *src == '[')
     {
       const guchar *pid_start = src + 1;
-      while (left && *src != ' ' && *src != ']' && *src != ':')
-        {
-          src++;
-          left--;
-        }
+      __skip_until_delims(&src, &left, ' ', ']', ':');
       if (left)
         {
           log_msg_set_value(self, LM_V_PID, (gchar *) pid_start, src - pid_start);
@@ -611,15 +636,27 @@ log_msg_parse_hostname(LogMessage *self, const guchar **data, gint *length,
   oldsrc = src;
   oldleft = left;
 
-  while (left && *src != ' ' && *src != ':' && *src != '[' && dst < sizeof(hostname_buf) - 1)
+  if (G_LIKELY((flags & LP_CHECK_HOSTNAME) == 0))
+    {
+      gint scan_len = MIN(left, sizeof(hostname_buf) - 1);
+
+      __skip_until_delims(&src, &scan_len, ' ', ':', '[');
+      dst = src - oldsrc;
+      memcpy(hostname_buf, oldsrc, dst);
+      left -= dst;
+    }
+  else
     {
-      if (G_UNLIKELY((flags & LP_CHECK_HOSTNAME) && (invalid_chars[((guint) *src) >> 8] & (1 << (((guint) *src) % 8)))))
+      while (left && *src != ' ' && *src != ':' && *src != '[' && dst < sizeof(hostname_buf) - 1)
         {
-          break;
+          if (G_UNLIKELY(invalid_chars[((guint) *src) >> 8] & (1 << (((guint) *src) % 8))))
+            {
+              break;
+            }
+          hostname_buf[dst++] = *src;
+          src++;
+          left--;
         }
-      hostname_buf[dst++] = *src;
-      src++;
-      left--;
     }
   hostname_buf[dst] = 0;
 
@@ -658,6 +695,68 @@ sd_step_and_store(LogMessage *self, const guchar **data, gint *left)
   (*left)--;
 }
 
+/* finds the end of the structured data without validating it and returns
+ * its length, @num_values is an upper bound of the SDATA values in it */
+static gint
+__scan_sd(const guchar *src, gint left, gint *num_values)
+{
+  gboolean in_value = FALSE, quote = FALSE;
+  gint i;
+
+  *num_values = 0;
+  for (i = 0; i < left; i++)
+    {
+      if (in_value)
+        {
+          if (quote)
+            quote = FALSE;
+          else if (src[i] == '\\')
+            quote = TRUE;
+          else if (src[i] == '"')
+            in_value = FALSE;
+        }
+      else if (src[i] == '"')
+        {
+          in_value = TRUE;
+          (*num_values)++;
+        }
+      else if (src[i] == '[')
+        {
+          (*num_values)++;
+        }
+      else if (src[i] == ']' && (i + 1 == left || src[i + 1] != '['))
+        {
+          return i + 1;
+        }
+    }
+  return left;
+}
+
+/* '\\' only escapes '"', ']' and '\\' itself, it is kept in front of
+ * anything else */
+static gsize
+__unescape_sd_param_value(gchar *dest, gsize dest_size, const guchar *src, gsize len)
+{
+  gboolean quote = FALSE;
+  gsize i, pos = 0;
+
+  for (i = 0; i < len; i++)
+    {
+      if (!quote && src[i] == '\\')
+        {
+          quote = TRUE;
+          continue;
+        }
+      if (quote && src[i] != '"' && src[i] != ']' && src[i] != '\\' && pos < dest_size - 1)
+        dest[pos++] = '\\';
+      if (pos < dest_size - 1)
+        dest[pos++] = src[i];
+      quote = FALSE;
+    }
+  dest[pos] = 0;
+  return pos;
+}
+
 /**
  * log_msg_parse:
  * @self: LogMessage instance to store parsed information into
@@ -700,6 +799,11 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
   gsize sd_param_value_len;
   gchar sd_value_name[66];
 
+  const guchar *sd_start = src, *value_start;
+  gsize value_len;
+  gboolean escaped;
+  NVHandle raw_sd_handle = 0;
+
   guint open_sd = 0;
   gint left = *length, pos;
 
@@ -711,6 +815,19 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
     }
   else if (left && src[0] == '[')
     {
+      gint num_values;
+      gint sd_len = __scan_sd(src, left, &num_values);
+
+      log_msg_reserve_sdata(self, num_values);
+
+      /* values that need no unescaping are stored as references into the
+       * raw SD string, instead of copying each of them */
+      if (sd_len <= G_MAXUINT16)
+        {
+          raw_sd_handle = raw_sdata;
+          log_msg_set_value(self, raw_sd_handle, (const gchar *) src, sd_len);
+        }
+
       sd_step_and_store(self, &src, &left);
       open_sd++;
       do
@@ -799,41 +916,29 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
 
               /* read sd-param-value */
 
+              escaped = FALSE;
               if (left && *src == '"')
                 {
                   gboolean quote = FALSE;
                   /* opening quote */
                   sd_step_and_store(self, &src, &left);
-                  pos = 0;
+                  value_start = src;
 
                   while (left && (*src != '"' || quote))
                     {
                       if (!quote && *src == '\\')
                         {
-                          quote = TRUE;
+                          quote = escaped = TRUE;
                         }
                       else
-                       {
-                         if (quote && *src != '"' && *src != ']' && *src != '\\' && pos < sizeof(sd_param_value) - 1)
-                           {
-                             sd_param_value[pos] = '\\';
-                             pos++;
-                           }
-                         else if (!quote &&  *src == ']')
-                           {
-                             goto error;
-                           }
-                         if (pos < sizeof(sd_param_value) - 1)
-                           {
-                             sd_param_value[pos] = *src;
-                             pos++;
-                           }
-                         quote = FALSE;
-                       }
+                        {
+                          if (!quote && *src == ']')
+                            goto error;
+                          quote = FALSE;
+                        }
                       sd_step_and_store(self, &src, &left);
                     }
-                  sd_param_value[pos] = 0;
-                  sd_param_value_len = pos;
+                  value_len = src - value_start;
 
                   if (left && *src == '"')/* closing quote */
                     sd_step_and_store(self, &src, &left);
@@ -845,7 +950,17 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
                   goto error;
                 }
 
-              log_msg_set_value_by_name(self, sd_value_name, sd_param_value, sd_param_value_len);
+              if (!escaped && raw_sd_handle)
+                {
+                  /* no unescaping needed, refer to the value in the raw SD string */
+                  log_msg_set_value_indirect(self, log_msg_get_value_handle(sd_value_name), raw_sd_handle, 0,
+                                             value_start - sd_start, MIN(value_len, options->sdata_param_value_max));
+                }
+              else
+                {
+                  sd_param_value_len = __unescape_sd_param_value(sd_param_value, sizeof(sd_param_value), value_start, value_len);
+                  log_msg_set_value_by_name(self, sd_value_name, sd_param_value, sd_param_value_len);
+                }
             }
 
           if (left && *src == ']')
@@ -1175,6 +1290,7 @@ syslog_format_init(void)
     {
       is_synced = log_msg_get_value_handle(".SDATA.timeQuality.isSynced");
       cisco_seqid = log_msg_get_value_handle(".SDATA.meta.sequenceId");
+      raw_sdata = log_msg_get_hidden_value_handle(".RAWSDATA");
       handles_initialized = TRUE;
     }
 }
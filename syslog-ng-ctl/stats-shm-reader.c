@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2002-2013 BalaBit IT Ltd, Budapest, Hungary
+ * Copyright (c) 1998-2013 Balázs Scheidler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "stats-shm-reader.h"
+#include "stats/stats-shm.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+/*
+ * Reads the statistics segment published by stats-shm-file() without
+ * contacting syslog-ng: takes a consistent copy of the segment using the
+ * seqlock protocol described in lib/stats/stats-shm.c and formats it as
+ * CSV.
+ */
+
+#define STATS_SHM_READER_MAX_RETRIES 1000
+
+typedef struct _StatsShmMapping
+{
+  gint fd;
+  gpointer base;
+  gsize size;
+} StatsShmMapping;
+
+static gboolean
+_map(StatsShmMapping *self, gsize size)
+{
+  if (self->base)
+    munmap(self->base, self->size);
+
+  self->base = mmap(NULL, size, PROT_READ, MAP_SHARED, self->fd, 0);
+  if (self->base == MAP_FAILED)
+    {
+      self->base = NULL;
+      return FALSE;
+    }
+  self->size = size;
+  return TRUE;
+}
+
+static gboolean
+_validate_layout(StatsShmHeader *header, gsize size)
+{
+  gsize entries_end = (gsize) header->entries_offset + (gsize) header->num_counters * sizeof(StatsShmEntry);
+  gsize values_end = (gsize) header->values_offset + (gsize) header->num_counters * sizeof(guint32);
+  gsize names_end = (gsize) header->names_offset + header->names_size;
+
+  return entries_end <= size && values_end <= size && names_end <= size;
+}
+
+/* copies a consistent snapshot of the segment, returns NULL on failure */
+static gchar *
+_read_snapshot(StatsShmMapping *mapping)
+{
+  gint retries;
+
+  for (retries = 0; retries < STATS_SHM_READER_MAX_RETRIES; retries++)
+    {
+      StatsShmHeader *header = (StatsShmHeader *) mapping->base;
+      guint32 seq;
+      gchar *snapshot;
+
+      seq = (guint32) g_atomic_int_get((gint *) &header->seq);
+      if (seq & 1)
+        {
+          /* writer in progress */
+          g_usleep(1000);
+          continue;
+        }
+
+      if (header->segment_size > mapping->size)
+        {
+          if (!_map(mapping, header->segment_size))
+            return NULL;
+          continue;
+        }
+
+      snapshot = g_malloc(mapping->size);
+      memcpy(snapshot, mapping->base, mapping->size);
+
+      if ((guint32) g_atomic_int_get((gint *) &header->seq) == seq)
+        return snapshot;
+      g_free(snapshot);
+    }
+  return NULL;
+}
+
+static void
+_format_snapshot(StatsShmHeader *header, const gchar *filter, GString *result)
+{
+  StatsShmEntry *entries = (StatsShmEntry *) (((gchar *) header) + header->entries_offset);
+  guint32 *values = (guint32 *) (((gchar *) header) + header->values_offset);
+  const gchar *names = ((gchar *) header) + header->names_offset;
+  guint32 i;
+
+  g_string_append(result, "SourceName;SourceId;SourceInstance;Type;Number\n");
+  for (i = 0; i < header->num_counters; i++)
+    {
+      const gchar *name;
+
+      if (entries[i].name_offset + entries[i].name_len >= header->names_size)
+        continue;
+
+      name = names + entries[i].name_offset;
+      if (filter && !g_pattern_match_simple(filter, name))
+        continue;
+
+      g_string_append_len(result, name, entries[i].name_len);
+      g_string_append_printf(result, ";%u\n", values[i]);
+    }
+}
+
+GString *
+stats_shm_reader_dump(const gchar *filename, const gchar *filter)
+{
+  StatsShmMapping mapping = { -1, NULL, 0 };
+  StatsShmHeader *header;
+  struct stat st;
+  gchar *snapshot = NULL;
+  GString *result = NULL;
+
+  mapping.fd = open(filename, O_RDONLY);
+  if (mapping.fd < 0)
+    {
+      fprintf(stderr, "Error opening statistics file %s: %s\n", filename, g_strerror(errno));
+      return NULL;
+    }
+
+  if (fstat(mapping.fd, &st) < 0 || st.st_size < sizeof(StatsShmHeader) || !_map(&mapping, st.st_size))
+    {
+      fprintf(stderr, "Error mapping statistics file %s\n", filename);
+      goto exit;
+    }
+
+  header = (StatsShmHeader *) mapping.base;
+  if (memcmp(header->magic, STATS_SHM_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != STATS_SHM_VERSION)
+    {
+      fprintf(stderr, "Unsupported statistics file format: %s\n", filename);
+      goto exit;
+    }
+
+  snapshot = _read_snapshot(&mapping);
+  if (!snapshot || !_validate_layout((StatsShmHeader *) snapshot, mapping.size))
+    {
+      fprintf(stderr, "Error reading a consistent snapshot from %s\n", filename);
+      goto exit;
+    }
+
+  result = g_string_sized_new(mapping.size);
+  _format_snapshot((StatsShmHeader *) snapshot, filter, result);
+
+exit:
+  g_free(snapshot);
+  if (mapping.base)
+    munmap(mapping.base, mapping.size);
+  close(mapping.fd);
+  return result;
+}
@@ -25,6 +25,7 @@
 #include "syslog-ng.h"
 #include "gsocket.h"
 #include "control-client.h"
+#include "stats-shm-reader.h"
 #include "cfg.h"
 #include "reloc.h"
 
@@ -96,13 +97,26 @@ slng_verbose(int argc, char *argv[], const gchar *mode)
 }
 
 static gboolean stats_options_reset_is_set = FALSE;
+static gchar *stats_options_filter = NULL;
+static gchar *stats_shm_options_file = NULL;
 
 static GOptionEntry stats_options[] =
 {
   { "reset", 'r', 0, G_OPTION_ARG_NONE, &stats_options_reset_is_set, "reset counters", NULL },
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &stats_options_filter,
+    "only query counters matching the pattern", "<component;id;instance;type glob>" },
   { NULL,    0,   0, G_OPTION_ARG_NONE, NULL,                        NULL,             NULL }
 };
 
+static GOptionEntry stats_shm_options[] =
+{
+  { "file", 'F', 0, G_OPTION_ARG_STRING, &stats_shm_options_file,
+    "the file set in stats-shm-file()", "<file>" },
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &stats_options_filter,
+    "only show counters matching the pattern", "<component;id;instance;type glob>" },
+  { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
 static GOptionEntry verbose_options[] =
 {
   { "set", 's', 0, G_OPTION_ARG_STRING, &verbose_set,
@@ -111,16 +125,59 @@ static GOptionEntry verbose_options[] =
 };
 
 
-static const gchar *
+static gchar *
 _stats_command_builder()
 {
-  return stats_options_reset_is_set ? "RESET_STATS\n" : "STATS\n";
+  if (stats_options_reset_is_set)
+    return g_strdup("RESET_STATS\n");
+  if (stats_options_filter)
+    return g_strdup_printf("QUERY_STATS %s\n", stats_options_filter);
+  return g_strdup("STATS\n");
 }
 
 static gint
 slng_stats(int argc, char *argv[], const gchar *mode)
 {
-  GString *rsp = slng_run_command(_stats_command_builder());
+  gchar *command = _stats_command_builder();
+  GString *rsp = slng_run_command(command);
+
+  g_free(command);
+  if (rsp == NULL)
+    return 1;
+
+  printf("%s\n", rsp->str);
+
+  g_string_free(rsp, TRUE);
+
+  return 0;
+}
+
+static gint
+slng_stats_shm(int argc, char *argv[], const gchar *mode)
+{
+  GString *rsp;
+
+  if (!stats_shm_options_file)
+    {
+      fprintf(stderr, "Please specify the statistics file using --file\n");
+      return 1;
+    }
+
+  rsp = stats_shm_reader_dump(stats_shm_options_file, stats_options_filter);
+  if (rsp == NULL)
+    return 1;
+
+  printf("%s", rsp->str);
+
+  g_string_free(rsp, TRUE);
+
+  return 0;
+}
+
+static gint
+slng_latency(int argc, char *argv[], const gchar *mode)
+{
+  GString *rsp = slng_run_command("LATENCY\n");
 
   if (rsp == NULL)
     return 1;
@@ -202,6 +259,8 @@ static struct
 } modes[] =
 {
   { "stats", stats_options, "Query/reset syslog-ng statistics", slng_stats },
+  { "stats-shm", stats_shm_options, "Read statistics from the stats-shm-file() without contacting syslog-ng", slng_stats_shm },
+  { "latency", no_options, "Dump message latency histograms", slng_latency },
   { "verbose", verbose_options, "Enable/query verbose messages", slng_verbose },
   { "debug", verbose_options, "Enable/query debug messages", slng_verbose },
   { "trace", verbose_options, "Enable/query trace messages", slng_verbose },
@@ -20,3 +20,67 @@ class DestTest(object):
             f.write('{DATE} {HOST} {MSGHDR}{MSG}\n'.format(**msg))
 
         return True
+
+
+class BatchDestTest(DestTest):
+
+    def init(self, options):
+        self.failed_once = False
+        return True
+
+    def send(self, msg):
+        # send_batch() takes precedence, this is never called
+        return False
+
+    def send_batch(self, msgs):
+        # the first batch is refused, it has to be retried as a whole
+        if not self.failed_once:
+            self.failed_once = True
+            return False
+
+        with open('test-python-batch.log', 'a') as f:
+            for msg in msgs:
+                f.write('{DATE} {HOST} {MSGHDR}{MSG}\n'.format(**msg))
+
+        return True
+
+
+class LogMessageDestTest(DestTest):
+    # receives LogMessage objects, as there is no value-pairs() option
+
+    def init(self, options):
+        self.prev_view = None
+        self.prev_value = None
+        return True
+
+    def check_message(self, msg):
+        # methods take precedence over name-value pairs
+        if not callable(msg.get_view):
+            return False
+
+        # unknown names are not attributes
+        if hasattr(msg, 'NO_SUCH_NAME_IN_THIS_TEST'):
+            return False
+
+        if msg.MSG != msg['MSG'] or msg.HOST != b'bzorp':
+            return False
+
+        view = msg.get_view('MSG')
+        if view.tobytes() != msg.MSG:
+            return False
+
+        # a view outlives the message object it was taken from
+        if self.prev_view is not None and self.prev_view.tobytes() != self.prev_value:
+            return False
+        self.prev_view = view
+        self.prev_value = msg.MSG
+        return True
+
+    def send(self, msg):
+        if not self.check_message(msg):
+            return False
+
+        with open('test-python-logmsg.log', 'ab') as f:
+            f.write(msg.ISODATE + b' ' + msg.HOST + b' ' + msg.MSGHDR + msg.get_view('MSG').tobytes() + b'\n')
+
+        return True
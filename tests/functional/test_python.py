@@ -5,17 +5,36 @@ from messagecheck import *
 from control import flush_files, stop_syslogng
 import os
 
+port_number_batch = port_number + 4
+port_number_logmsg = port_number + 5
+
 config = """@version: 3.7
 
+options { time-reopen(1); };
+
 source s_int { internal(); };
 source s_tcp { tcp(port(%(port_number)d)); };
+source s_tcp_batch { tcp(port(%(port_number_batch)d)); };
+source s_tcp_logmsg { tcp(port(%(port_number_logmsg)d)); };
 
 destination d_python {
     python(class(sngtestmod.DestTest)
            value-pairs(key('MSG') pair('HOST', 'bzorp') pair('DATE', '$ISODATE') key('MSGHDR')));
 };
 
+destination d_python_batch {
+    python(class(sngtestmod.BatchDestTest)
+           batch-lines(10)
+           value-pairs(key('MSG') pair('HOST', 'bzorp') pair('DATE', '$ISODATE') key('MSGHDR')));
+};
+
 log { source(s_tcp); destination(d_python); };
+destination d_python_logmsg {
+    python(class(sngtestmod.LogMessageDestTest));
+};
+
+log { source(s_tcp_batch); destination(d_python_batch); };
+log { source(s_tcp_logmsg); destination(d_python_logmsg); };
 
 """ % locals()
 
@@ -53,3 +72,39 @@ def test_python():
     if not stopped or not check_file_expected('test-python', expected, settle_time=2):
         return False
     return True
+
+def test_python_batch():
+
+    messages = (
+        'pythonbatch1',
+        'pythonbatch2'
+    )
+    s = SocketSender(AF_INET, ('localhost', port_number_batch), dgram=0)
+
+    # the first send_batch() call fails, the messages must be delivered
+    # exactly once and in order after the batch is retried
+    expected = []
+    for msg in messages:
+        expected.extend(s.sendMessages(msg, pri=7))
+    stopped = stop_syslogng()
+    if not stopped or not check_file_expected('test-python-batch', expected, settle_time=3):
+        return False
+    return True
+
+def test_python_logmsg():
+
+    messages = (
+        'pythonlogmsg1',
+        'pythonlogmsg2'
+    )
+    s = SocketSender(AF_INET, ('localhost', port_number_logmsg), dgram=0)
+
+    # LogMessageDestTest only writes messages that passed its attribute,
+    # method and memoryview checks
+    expected = []
+    for msg in messages:
+        expected.extend(s.sendMessages(msg, pri=7))
+    stopped = stop_syslogng()
+    if not stopped or not check_file_expected('test-python-logmsg', expected, settle_time=2):
+        return False
+    return True
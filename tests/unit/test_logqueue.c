@@ -1,5 +1,6 @@
 #include "logqueue.h"
 #include "logqueue-fifo.h"
+#include "logqueue-mpsc.h"
 #include "logpipe.h"
 #include "apphook.h"
 #include "plugin.h"
@@ -19,6 +20,8 @@ MsgFormatOptions parse_options;
 
 #define OVERFLOW_SIZE 10000
 
+typedef LogQueue *(*LogQueueConstructor)(gint qoverflow_size, const gchar *persist_name);
+
 void
 test_ack(LogMessage *msg, AckType ack_type)
 {
@@ -77,12 +80,12 @@ rewind_messages(LogQueue *q)
 }
 
 void
-testcase_zero_diskbuf_and_normal_acks()
+testcase_zero_diskbuf_and_normal_acks(LogQueueConstructor queue_new)
 {
   LogQueue *q;
   gint i;
 
-  q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  q = queue_new(OVERFLOW_SIZE, NULL);
   log_queue_set_use_backlog(q, TRUE);
 
   fed_messages = 0;
@@ -102,12 +105,12 @@ testcase_zero_diskbuf_and_normal_acks()
 }
 
 void
-testcase_zero_diskbuf_alternating_send_acks()
+testcase_zero_diskbuf_alternating_send_acks(LogQueueConstructor queue_new)
 {
   LogQueue *q;
   gint i;
 
-  q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  q = queue_new(OVERFLOW_SIZE, NULL);
   log_queue_set_use_backlog(q, TRUE);
 
   fed_messages = 0;
@@ -127,11 +130,68 @@ testcase_zero_diskbuf_alternating_send_acks()
   log_queue_unref(q);
 }
 
-#define FEEDERS 1
+static gint length_notifications;
+
+static void
+count_length_notification(gpointer user_data)
+{
+  length_notifications++;
+}
+
+void
+testcase_notify_on_length(LogQueueConstructor queue_new)
+{
+  LogQueue *q;
+
+  q = queue_new(OVERFLOW_SIZE, NULL);
+
+  fed_messages = 0;
+  length_notifications = 0;
+  if (log_queue_notify_on_length(q, 10, count_length_notification, NULL, NULL))
+    {
+      fprintf(stderr, "notify_on_length reported an empty queue as complete\n");
+      exit(1);
+    }
+
+  feed_some_messages(&q, 9);
+  if (length_notifications != 0)
+    {
+      fprintf(stderr, "length notification fired too early: length=%d, notifications=%d\n",
+              (gint) log_queue_get_length(q), length_notifications);
+      exit(1);
+    }
+
+  feed_some_messages(&q, 1);
+  feed_some_messages(&q, 5);
+  if (length_notifications != 1)
+    {
+      fprintf(stderr, "length notification should fire exactly once when the batch fills: notifications=%d\n",
+              length_notifications);
+      exit(1);
+    }
+
+  if (!log_queue_notify_on_length(q, 10, count_length_notification, NULL, NULL))
+    {
+      fprintf(stderr, "notify_on_length did not report a full batch\n");
+      exit(1);
+    }
+  feed_some_messages(&q, 1);
+  if (length_notifications != 1)
+    {
+      fprintf(stderr, "length notification stayed registered after reporting a full batch\n");
+      exit(1);
+    }
+
+  send_some_messages(q, fed_messages);
+  log_queue_unref(q);
+}
+
+#define MAX_FEEDERS 8
 #define MESSAGES_PER_FEEDER 30000
-#define MESSAGES_SUM (FEEDERS * MESSAGES_PER_FEEDER)
 #define TEST_RUNS 10
 
+gint feeders;
+
 GStaticMutex tlock;
 glong sum_time;
 
@@ -193,7 +253,7 @@ threaded_consume(gpointer st)
   /* just to make sure time is properly cached */
   iv_init();
 
-  while (msg_count < MESSAGES_SUM)
+  while (msg_count < feeders * MESSAGES_PER_FEEDER)
     {
       gint slept = 0;
       msg = NULL;
@@ -251,21 +311,23 @@ output_thread(gpointer args)
 
 
 void
-testcase_with_threads()
+testcase_with_threads(LogQueueConstructor queue_new, gint num_feeders)
 {
   LogQueue *q;
-  GThread *thread_feed[FEEDERS], *thread_consume;
-  GThread *other_threads[FEEDERS];
+  GThread *thread_feed[MAX_FEEDERS], *thread_consume;
+  GThread *other_threads[MAX_FEEDERS];
   gint i, j;
 
-  log_queue_set_max_threads(FEEDERS);
+  feeders = num_feeders;
+  sum_time = 0;
+  log_queue_set_max_threads(feeders);
   for (i = 0; i < TEST_RUNS; i++)
     {
       fprintf(stderr,"starting testrun: %d\n",i);
-      q = log_queue_fifo_new(MESSAGES_SUM, NULL);
+      q = queue_new(feeders * MESSAGES_PER_FEEDER, NULL);
       log_queue_set_use_backlog(q, TRUE);
 
-      for (j = 0; j < FEEDERS; j++)
+      for (j = 0; j < feeders; j++)
         {
           fprintf(stderr,"starting feed thread %d\n",j);
           other_threads[j] = g_thread_create(output_thread, NULL, TRUE, NULL);
@@ -274,7 +336,7 @@ testcase_with_threads()
 
       thread_consume = g_thread_create(threaded_consume, q, TRUE, NULL);
 
-      for (j = 0; j < FEEDERS; j++)
+      for (j = 0; j < feeders; j++)
       {
         fprintf(stderr,"waiting for feed thread %d\n",j);
         g_thread_join(thread_feed[j]);
@@ -284,7 +346,31 @@ testcase_with_threads()
 
       log_queue_unref(q);
     }
-  fprintf(stderr, "Feed speed: %.2lf\n", (double) TEST_RUNS * MESSAGES_SUM * 1000000 / sum_time);
+  fprintf(stderr, "Feed speed: %.2lf\n", (double) TEST_RUNS * feeders * MESSAGES_PER_FEEDER * 1000000 / sum_time);
+}
+
+/* the same as testcase_with_threads() but with several producers hammering
+ * the queue at the same time, prints the per-producer feed speed to
+ * compare queue implementations under contention */
+void
+testcase_contention(const gchar *name, LogQueueConstructor queue_new)
+{
+  fprintf(stderr, "Start testcase_contention for %s, feeders=%d\n", name, MAX_FEEDERS);
+  testcase_with_threads(queue_new, MAX_FEEDERS);
+}
+
+void
+testcase_queue(const gchar *name, LogQueueConstructor queue_new)
+{
+  fprintf(stderr,"Start testcase_with_threads for %s\n", name);
+  testcase_with_threads(queue_new, 1);
+
+  fprintf(stderr,"Start testcase_zero_diskbuf_alternating_send_acks for %s\n", name);
+  testcase_zero_diskbuf_alternating_send_acks(queue_new);
+  fprintf(stderr,"Start testcase_zero_diskbuf_and_normal_acks for %s\n", name);
+  testcase_zero_diskbuf_and_normal_acks(queue_new);
+  fprintf(stderr,"Start testcase_notify_on_length for %s\n", name);
+  testcase_notify_on_length(queue_new);
 }
 
 int
@@ -299,14 +385,10 @@ main()
   msg_format_options_defaults(&parse_options);
   msg_format_options_init(&parse_options, configuration);
 
-  fprintf(stderr,"Start testcase_with_threads\n");
-  testcase_with_threads();
+  testcase_queue("fifo", log_queue_fifo_new);
+  testcase_queue("mpsc", log_queue_mpsc_new);
 
-#if 1
-  fprintf(stderr,"Start testcase_zero_diskbuf_alternating_send_acks\n");
-  testcase_zero_diskbuf_alternating_send_acks();
-  fprintf(stderr,"Start testcase_zero_diskbuf_and_normal_acks\n");
-  testcase_zero_diskbuf_and_normal_acks();
-#endif
+  testcase_contention("fifo", log_queue_fifo_new);
+  testcase_contention("mpsc", log_queue_mpsc_new);
   return 0;
 }
@@ -56,8 +56,9 @@ assert_log_message_sdata_pairs(LogMessage *message, const gchar *expected_sd_pai
   gint i;
   for (i = 0; expected_sd_pairs && expected_sd_pairs[i][0] != NULL;i++)
     {
-      const gchar *actual_value = log_msg_get_value_by_name(message, expected_sd_pairs[i][0], NULL);
-      assert_string(actual_value, expected_sd_pairs[i][1], NULL);
+      gssize actual_value_len;
+      const gchar *actual_value = log_msg_get_value_by_name(message, expected_sd_pairs[i][0], &actual_value_len);
+      assert_nstring(actual_value, actual_value_len, expected_sd_pairs[i][1], -1, NULL);
     }
 }
 
@@ -264,6 +265,32 @@ test_log_messages_can_be_parsed()
            NULL, "2499", NULL, ignore_sdata_pairs
            );
 
+  /* local time on a day with a DST transition and on an ordinary day */
+  testcase("<7>2006-04-02T10:00:00 bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
+           7,             // pri
+           1143968400, 0, 3600,    // timestamp (sec/usec/zone)
+           "bzorp",        // host
+           "openvpn",        // openvpn
+           "PTHREAD support initialized", // msg
+           NULL, "2499", NULL, ignore_sdata_pairs
+           );
+  testcase("<7>2006-04-02T20:00:00 bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
+           7,             // pri
+           1144000800, 0, 7200,    // timestamp (sec/usec/zone)
+           "bzorp",        // host
+           "openvpn",        // openvpn
+           "PTHREAD support initialized", // msg
+           NULL, "2499", NULL, ignore_sdata_pairs
+           );
+  testcase("<7>2006-06-15T12:00:00 bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
+           7,             // pri
+           1150365600, 0, 7200,    // timestamp (sec/usec/zone)
+           "bzorp",        // host
+           "openvpn",        // openvpn
+           "PTHREAD support initialized", // msg
+           NULL, "2499", NULL, ignore_sdata_pairs
+           );
+
   testcase("<7>2006-03-26T01:59:59.156+01:00 bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
            7,             // pri
            1143334799, 156000, 3600,    // timestamp (sec/usec/zone)
@@ -676,6 +703,29 @@ test_log_messages_can_be_parsed()
            expected_sd_pairs_test_5b
            );
 
+  const gchar *expected_sd_pairs_test_5c[][2]=
+    {
+      { ".SDATA.a.x", "plain"},
+      { ".SDATA.a.y", "es\"caped"},
+      { ".SDATA.a.z", "x\\y"},
+      { ".SDATA.b", ""},
+      { ".SDATA.c.w", "last"},
+      {  NULL , NULL}
+    };
+
+  // plain and escaped values mixed
+  testcase("<132>1 2006-10-29T01:59:59.156+01:00 mymachine evntslog - - [a x=\"plain\" y=\"es\\\"caped\" z=\"x\\y\"][b][c w=\"last\"] An application event log entry...",  LP_SYSLOG_PROTOCOL, NULL,
+           132,             // pri
+           1162083599, 156000, 3600,    // timestamp (sec/usec/zone)
+           "mymachine",        // host
+           "evntslog", //app
+           "An application event log entry...", // msg
+           "[a x=\"plain\" y=\"es\\\"caped\" z=\"x\\\\y\"][b][c w=\"last\"]", //sd_str
+           "",//processid
+           "",//msgid
+           expected_sd_pairs_test_5c
+           );
+
   const gchar *expected_sd_pairs_test_6[][2]=
     {
        { ".SDATA.a.i", "ok"},
@@ -869,6 +919,41 @@ testcase("<132>1 2006-10-29T01:59:59.156+01:00 mymachine evntslog - - [a i=\"]ok
 /*############################*/
 }
 
+/* kept small, so that it doesn't slow down the test suite */
+#define PERF_ITERATIONS 10000
+
+static void
+_benchmark_message_parsing(const gchar *raw_message, gint parse_flags)
+{
+  GSockAddr *addr = g_sockaddr_inet_new("10.10.10.10", 1010);
+  gsize raw_message_len = strlen(raw_message);
+  gint i;
+
+  parse_options.flags = parse_flags;
+  parse_options.sdata_param_value_max = 255;
+
+  start_stopwatch();
+  for (i = 0; i < PERF_ITERATIONS; i++)
+    {
+      LogMessage *msg = log_msg_new(raw_message, raw_message_len, addr, &parse_options);
+
+      log_msg_unref(msg);
+    }
+  stop_stopwatch_and_display_result("Parsing %d messages, flags=%x, msg='%s'", PERF_ITERATIONS, parse_flags, raw_message);
+  g_sockaddr_unref(addr);
+}
+
+void
+test_log_message_parsing_performance()
+{
+  _benchmark_message_parsing("<15>Jan 10 01:00:00 bzorp openvpn[2499]: PTHREAD support initialized",
+                             LP_EXPECT_HOSTNAME);
+  _benchmark_message_parsing("<7>2006-11-10T10:43:21.156+02:00 bzorp openvpn[2499]: PTHREAD support initialized",
+                             LP_EXPECT_HOSTNAME);
+  _benchmark_message_parsing("<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 [exampleSDID@0 iut=\"3\" eventSource=\"Application\" eventID=\"1011\"] An application event log entry...",
+                             LP_SYSLOG_PROTOCOL);
+}
+
 int
 main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
 {
@@ -878,6 +963,7 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   init_and_load_syslogformat_module();
 
   test_log_messages_can_be_parsed();
+  test_log_message_parsing_performance();
 
   deinit_syslogformat_module();
   app_shutdown();
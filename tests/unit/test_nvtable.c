@@ -101,6 +101,85 @@ test_nv_registry()
   nv_registry_free(reg);
 }
 
+/*
+ * Concurrent lookups: threads allocate overlapping sets of names while
+ * others look them up without the registry lock, every thread has to see
+ * the same handle for the same name, with a complete descriptor.
+ */
+
+#define CONCURRENT_THREADS 8
+#define CONCURRENT_NAMES   4096
+
+typedef struct _ConcurrentLookupArgs
+{
+  NVRegistry *reg;
+  gint offset;
+  NVHandle handles[CONCURRENT_NAMES];
+} ConcurrentLookupArgs;
+
+static gpointer
+_alloc_and_lookup_names(gpointer user_data)
+{
+  ConcurrentLookupArgs *args = (ConcurrentLookupArgs *) user_data;
+  gchar dyn_name[16];
+  const gchar *name;
+  gssize len;
+  gint i, n;
+
+  for (i = 0; i < CONCURRENT_NAMES; i++)
+    {
+      n = (i + args->offset) % CONCURRENT_NAMES;
+      g_snprintf(dyn_name, sizeof(dyn_name), "CONC%05d", n);
+      args->handles[n] = nv_registry_alloc_handle(args->reg, dyn_name);
+      TEST_ASSERT(args->handles[n] != 0);
+
+      name = nv_registry_get_handle_name(args->reg, args->handles[n], &len);
+      TEST_ASSERT(strcmp(name, dyn_name) == 0);
+      TEST_ASSERT(strlen(name) == len);
+
+      /* a name allocated by another thread may or may not be there yet,
+       * but if it is, it has to be complete */
+      g_snprintf(dyn_name, sizeof(dyn_name), "CONC%05d", (n + CONCURRENT_NAMES / 2) % CONCURRENT_NAMES);
+      if (nv_registry_get_handle(args->reg, dyn_name))
+        {
+          name = nv_registry_get_handle_name(args->reg, nv_registry_get_handle(args->reg, dyn_name), &len);
+          TEST_ASSERT(strcmp(name, dyn_name) == 0);
+        }
+    }
+  return NULL;
+}
+
+static void
+test_nv_registry_concurrent_lookups()
+{
+  const gchar *builtins[] = { "BUILTIN1", NULL };
+  ConcurrentLookupArgs *args = g_new0(ConcurrentLookupArgs, CONCURRENT_THREADS);
+  GThread *threads[CONCURRENT_THREADS];
+  NVRegistry *reg;
+  gint i, n;
+
+  reg = nv_registry_new(builtins);
+  for (i = 0; i < CONCURRENT_THREADS; i++)
+    {
+      args[i].reg = reg;
+      args[i].offset = i * (CONCURRENT_NAMES / CONCURRENT_THREADS);
+      threads[i] = g_thread_create(_alloc_and_lookup_names, &args[i], TRUE, NULL);
+    }
+  for (i = 0; i < CONCURRENT_THREADS; i++)
+    g_thread_join(threads[i]);
+
+  for (n = 0; n < CONCURRENT_NAMES; n++)
+    {
+      /* every thread got the same handle for the same name */
+      TEST_ASSERT(args[0].handles[n] >= 2 && args[0].handles[n] <= CONCURRENT_NAMES + 1);
+      for (i = 1; i < CONCURRENT_THREADS; i++)
+        TEST_ASSERT(args[i].handles[n] == args[0].handles[n]);
+    }
+
+  g_free(args);
+  nv_registry_free(reg);
+}
+
 /*
  * NVTable:
  *
@@ -874,6 +953,81 @@ test_nvtable_realloc(void)
   test_nvtable_realloc_leaves_original_intact_if_there_are_multiple_references();
 }
 
+static void
+test_nvtable_overlay_inherits_values_from_parent(void)
+{
+  NVTable *parent, *overlay;
+  gboolean success, new_entry;
+
+  parent = nv_table_new(STATIC_VALUES, STATIC_VALUES, 256);
+  success = nv_table_add_value(parent, STATIC_HANDLE, STATIC_NAME, 4, "parent", 6, NULL);
+  TEST_ASSERT(success == TRUE);
+  success = nv_table_add_value(parent, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "dynamic", 7, NULL);
+  TEST_ASSERT(success == TRUE);
+
+  overlay = nv_table_new_overlay(parent, 4, 64);
+  TEST_NVTABLE_ASSERT(overlay, STATIC_HANDLE, "parent", 6);
+  TEST_NVTABLE_ASSERT(overlay, DYN_HANDLE, "dynamic", 7);
+  TEST_ASSERT(nv_table_is_value_set(overlay, DYN_HANDLE));
+
+  success = nv_table_add_value(overlay, STATIC_HANDLE, STATIC_NAME, 4, "overlay", 7, &new_entry);
+  TEST_ASSERT(success == TRUE);
+  TEST_ASSERT(new_entry == FALSE);
+  success = nv_table_add_value(overlay, DYN_HANDLE + 1, "VAL18", 5, "new", 3, &new_entry);
+  TEST_ASSERT(success == TRUE);
+  TEST_ASSERT(new_entry == TRUE);
+
+  TEST_NVTABLE_ASSERT(overlay, STATIC_HANDLE, "overlay", 7);
+  TEST_NVTABLE_ASSERT(overlay, DYN_HANDLE + 1, "new", 3);
+  TEST_NVTABLE_ASSERT(parent, STATIC_HANDLE, "parent", 6);
+  TEST_ASSERT(nv_table_is_value_set(parent, DYN_HANDLE + 1) == FALSE);
+
+  /* clearing a value in the overlay has to shadow the parent */
+  success = nv_table_add_value(overlay, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "", 0, NULL);
+  TEST_ASSERT(success == TRUE);
+  TEST_NVTABLE_ASSERT(overlay, DYN_HANDLE, "", 0);
+  TEST_NVTABLE_ASSERT(parent, DYN_HANDLE, "dynamic", 7);
+
+  nv_table_unref(overlay);
+  nv_table_unref(parent);
+}
+
+static void
+test_nvtable_overlay_copies_references_to_parent_values(void)
+{
+  NVTable *parent, *overlay;
+  NVDynValue *dyn_slot;
+  gboolean success;
+
+  parent = nv_table_new(STATIC_VALUES, STATIC_VALUES, 256);
+  success = nv_table_add_value(parent, STATIC_HANDLE, STATIC_NAME, 4, "referenced", 10, NULL);
+  TEST_ASSERT(success == TRUE);
+
+  overlay = nv_table_new_overlay(parent, 4, 64);
+  success = nv_table_add_value_indirect(overlay, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), STATIC_HANDLE, 0, 2, 3, NULL);
+  TEST_ASSERT(success == TRUE);
+  TEST_NVTABLE_ASSERT(overlay, DYN_HANDLE, "fer", 3);
+
+  /* the parent must not be marked as referenced, changing the value in
+   * the overlay leaves the copied value intact */
+  TEST_ASSERT(nv_table_get_entry(parent, STATIC_HANDLE, &dyn_slot)->referenced == FALSE);
+  success = nv_table_add_value(overlay, STATIC_HANDLE, STATIC_NAME, 4, "changed", 7, NULL);
+  TEST_ASSERT(success == TRUE);
+  TEST_NVTABLE_ASSERT(overlay, DYN_HANDLE, "fer", 3);
+  TEST_NVTABLE_ASSERT(overlay, STATIC_HANDLE, "changed", 7);
+  TEST_NVTABLE_ASSERT(parent, STATIC_HANDLE, "referenced", 10);
+
+  nv_table_unref(overlay);
+  nv_table_unref(parent);
+}
+
+static void
+test_nvtable_overlay(void)
+{
+  test_nvtable_overlay_inherits_values_from_parent();
+  test_nvtable_overlay_copies_references_to_parent_values();
+}
+
 static void
 test_nvtable(void)
 {
@@ -883,6 +1037,7 @@ test_nvtable(void)
   test_nvtable_lookup();
   test_nvtable_clone();
   test_nvtable_realloc();
+  test_nvtable_overlay();
 }
 
 int
@@ -890,6 +1045,7 @@ main(int argc, char *argv[])
 {
   app_startup();
   test_nv_registry();
+  test_nv_registry_concurrent_lookups();
   test_nvtable();
   app_shutdown();
   return 0;